@@ -106,6 +106,10 @@ EXTERN(djpeg_dest_ptr) jinit_write_bmp(j_decompress_ptr cinfo, boolean is_os2,
                                        boolean use_inversion_array);
 EXTERN(cjpeg_source_ptr) jinit_read_gif(j_compress_ptr cinfo);
 EXTERN(djpeg_dest_ptr) jinit_write_gif(j_decompress_ptr cinfo, boolean is_lzw);
+EXTERN(djpeg_dest_ptr) jinit_write_gif_mem(j_decompress_ptr cinfo,
+                                           boolean is_lzw,
+                                           unsigned char **outbuffer,
+                                           unsigned long *outsize);
 EXTERN(cjpeg_source_ptr) jinit_read_ppm(j_compress_ptr cinfo);
 EXTERN(djpeg_dest_ptr) jinit_write_ppm(j_decompress_ptr cinfo);
 EXTERN(cjpeg_source_ptr) jinit_read_targa(j_compress_ptr cinfo);
@@ -139,9 +143,11 @@ EXTERN(FILE *) write_stdout(void);
 #ifdef DONT_USE_B_MODE          /* define mode parameters for fopen() */
 #define READ_BINARY     "r"
 #define WRITE_BINARY    "w"
+#define UPDATE_BINARY   "w+"
 #else
 #define READ_BINARY     "rb"
 #define WRITE_BINARY    "wb"
+#define UPDATE_BINARY   "w+b"
 #endif
 
 #ifndef EXIT_FAILURE            /* define exit() codes if not provided */
@@ -143,6 +143,7 @@ static const char *progname;    /* program name for error messages */
 static char *icc_filename;      /* for -icc switch */
 static char *outfilename;       /* for -outfile switch */
 boolean memdst;                 /* for -memdst switch */
+boolean mmapdst;                /* for -mmap switch */
 boolean report;                 /* for -report switch */
 
 
@@ -197,6 +198,7 @@ usage(void)
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
   fprintf(stderr, "  -memdst        Compress to memory instead of file (useful for benchmarking)\n");
 #endif
+  fprintf(stderr, "  -mmap          Memory-map output file instead of writing it with stdio\n");
   fprintf(stderr, "  -report        Report compression progress\n");
   fprintf(stderr, "  -verbose  or  -debug   Emit debug output\n");
   fprintf(stderr, "  -version       Print version information and exit\n");
@@ -242,6 +244,7 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
   icc_filename = NULL;
   outfilename = NULL;
   memdst = FALSE;
+  mmapdst = FALSE;
   report = FALSE;
   cinfo->err->trace_level = 0;
 
@@ -361,6 +364,10 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
       exit(EXIT_FAILURE);
 #endif
 
+    } else if (keymatch(arg, "mmap", 2)) {
+      /* Use memory-mapped destination manager */
+      mmapdst = TRUE;
+
     } else if (keymatch(arg, "memdst", 2)) {
       /* Use in-memory destination manager */
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
@@ -592,7 +599,9 @@ main(int argc, char **argv)
 
   /* Open the output file. */
   if (outfilename != NULL) {
-    if ((output_file = fopen(outfilename, WRITE_BINARY)) == NULL) {
+    if ((output_file = fopen(outfilename,
+                             mmapdst ? UPDATE_BINARY : WRITE_BINARY)) ==
+        NULL) {
       fprintf(stderr, "%s: can't open %s\n", progname, outfilename);
       exit(EXIT_FAILURE);
     }
@@ -652,7 +661,10 @@ main(int argc, char **argv)
     jpeg_mem_dest(&cinfo, &outbuffer, &outsize);
   else
 #endif
-    jpeg_stdio_dest(&cinfo, output_file);
+    if (mmapdst)
+      jpeg_mmap_dest(&cinfo, output_file);
+    else
+      jpeg_stdio_dest(&cinfo, output_file);
 
   /* Start compressor */
   jpeg_start_compress(&cinfo, TRUE);
@@ -19,6 +19,10 @@
 #include <jpeglib.h>
 #include "jconfigint.h"
 
+#ifndef MIN
+#define MIN(a, b)  ((a) < (b) ? (a) : (b))
+#endif
+
 
 /* Fully reversible */
 
@@ -97,6 +97,8 @@ static char *icc_filename;      /* for -icc switch */
 JDIMENSION max_scans;           /* for -maxscans switch */
 static char *outfilename;       /* for -outfile switch */
 boolean memsrc;                 /* for -memsrc switch */
+boolean memdst;                 /* for -memdst switch */
+boolean mmapsrc;                /* for -mmap switch */
 boolean report;                 /* for -report switch */
 boolean skip, crop;
 JDIMENSION skip_start, skip_end;
@@ -177,6 +179,10 @@ usage(void)
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
   fprintf(stderr, "  -memsrc        Load input file into memory before decompressing\n");
 #endif
+#ifdef GIF_SUPPORTED
+  fprintf(stderr, "  -memdst        Decompress to memory before writing output file [GIF only]\n");
+#endif
+  fprintf(stderr, "  -mmap          Memory-map input file instead of reading it with stdio\n");
   fprintf(stderr, "  -report        Report decompression progress\n");
   fprintf(stderr, "  -skip Y0,Y1    Decompress all rows except those between Y0 and Y1 (inclusive)\n");
   fprintf(stderr, "  -crop WxH+X+Y  Decompress only a rectangular subregion of the image\n");
@@ -209,6 +215,8 @@ parse_switches(j_decompress_ptr cinfo, int argc, char **argv,
   max_scans = 0;
   outfilename = NULL;
   memsrc = FALSE;
+  memdst = FALSE;
+  mmapsrc = FALSE;
   report = FALSE;
   skip = FALSE;
   crop = FALSE;
@@ -385,6 +393,10 @@ parse_switches(j_decompress_ptr cinfo, int argc, char **argv,
         usage();
       outfilename = argv[argn]; /* save it away for later use */
 
+    } else if (keymatch(arg, "mmap", 2)) {
+      /* Use memory-mapped source manager */
+      mmapsrc = TRUE;
+
     } else if (keymatch(arg, "memsrc", 2)) {
       /* Use in-memory source manager */
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
@@ -395,6 +407,10 @@ parse_switches(j_decompress_ptr cinfo, int argc, char **argv,
       exit(EXIT_FAILURE);
 #endif
 
+    } else if (keymatch(arg, "memdst", 4)) {
+      /* Use in-memory GIF writer */
+      memdst = TRUE;
+
     } else if (keymatch(arg, "pnm", 1) || keymatch(arg, "ppm", 1)) {
       /* PPM/PGM output format. */
       requested_fmt = FMT_PPM;
@@ -548,6 +564,8 @@ main(int argc, char **argv)
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
   unsigned long insize = 0;
 #endif
+  unsigned char *outbuffer = NULL;
+  unsigned long outsize = 0;
   JDIMENSION num_scanlines;
 
   /* On Mac, fetch a command line. */
@@ -665,7 +683,10 @@ main(int argc, char **argv)
     jpeg_mem_src(&cinfo, inbuffer, insize);
   } else
 #endif
-    jpeg_stdio_src(&cinfo, input_file);
+    if (mmapsrc)
+      jpeg_mmap_src(&cinfo, input_file);
+    else
+      jpeg_stdio_src(&cinfo, input_file);
 
   /* Read file header, set default decompression parameters */
   (void)jpeg_read_header(&cinfo, TRUE);
@@ -687,10 +708,16 @@ main(int argc, char **argv)
 #endif
 #ifdef GIF_SUPPORTED
   case FMT_GIF:
-    dest_mgr = jinit_write_gif(&cinfo, TRUE);
+    if (memdst)
+      dest_mgr = jinit_write_gif_mem(&cinfo, TRUE, &outbuffer, &outsize);
+    else
+      dest_mgr = jinit_write_gif(&cinfo, TRUE);
     break;
   case FMT_GIF0:
-    dest_mgr = jinit_write_gif(&cinfo, FALSE);
+    if (memdst)
+      dest_mgr = jinit_write_gif_mem(&cinfo, FALSE, &outbuffer, &outsize);
+    else
+      dest_mgr = jinit_write_gif(&cinfo, FALSE);
     break;
 #endif
 #ifdef PPM_SUPPORTED
@@ -707,6 +734,9 @@ main(int argc, char **argv)
     ERREXIT(&cinfo, JERR_UNSUPPORTED_FORMAT);
     break;
   }
+  /* Only the GIF writer can write to memory */
+  if (memdst && requested_fmt != FMT_GIF && requested_fmt != FMT_GIF0)
+    ERREXIT(&cinfo, JERR_UNSUPPORTED_FORMAT);
   dest_mgr->output_file = output_file;
 
   /* Start decompressor */
@@ -850,6 +880,16 @@ main(int argc, char **argv)
   (void)jpeg_finish_decompress(&cinfo);
   jpeg_destroy_decompress(&cinfo);
 
+  /* Write the in-memory output image, if any, to the output file */
+  if (memdst) {
+    if (JFWRITE(output_file, outbuffer, outsize) != outsize ||
+        fflush(output_file) != 0) {
+      fprintf(stderr, "%s: can't write output file\n", progname);
+      exit(EXIT_FAILURE);
+    }
+    free(outbuffer);
+  }
+
   /* Close files, if we opened them */
   if (input_file != stdin)
     fclose(input_file);
@@ -854,6 +854,110 @@ public class TJDecompressor implements Closeable {
     return img;
   }
 
+  /**
+   * Decompress a rectangular region of the JPEG source image associated with
+   * this decompressor instance and output a grayscale, RGB, or CMYK image to
+   * the given destination buffer.  Only the parts of the JPEG image that are
+   * needed in order to produce the region are decompressed, so this is much
+   * faster than decompressing the whole image and then extracting the region.
+   * The decompressed pixels are identical to the corresponding pixels that
+   * {@link #decompress(byte[], int, int, int, int, int, int, int)} would
+   * produce when decompressing the whole image without scaling.
+   * <p>
+   * NOTE: The output image is fully recoverable if this method throws a
+   * non-fatal {@link TJException} (unless
+   * {@link TJ#FLAG_STOPONWARNING TJ.FLAG_STOPONWARNING} is specified.)
+   *
+   * @param dstBuf buffer that will receive the decompressed region.  This
+   * buffer should normally be <code>pitch * height</code> bytes in size.
+   *
+   * @param x left boundary (in pixels) of the region to decompress, relative
+   * to the left edge of the JPEG image
+   *
+   * @param y upper boundary (in pixels) of the region to decompress, relative
+   * to the top of the JPEG image
+   *
+   * @param width width (in pixels) of the region to decompress.
+   * <code>x + width</code> must not exceed the width of the JPEG image.
+   *
+   * @param pitch bytes per line of the destination image.  Normally, this
+   * should be set to <code>width * TJ.pixelSize(pixelFormat)</code> if the
+   * destination image is unpadded, but you can use this to, for instance, pad
+   * each line of the destination image to a 4-byte boundary.  Setting this
+   * parameter to 0 is the equivalent of setting it to
+   * <code>width * TJ.pixelSize(pixelFormat)</code>.
+   *
+   * @param height height (in pixels) of the region to decompress.
+   * <code>y + height</code> must not exceed the height of the JPEG image.
+   *
+   * @param pixelFormat pixel format of the decompressed image (one of
+   * {@link TJ#PF_RGB TJ.PF_*})
+   *
+   * @param flags the bitwise OR of one or more of
+   * {@link TJ#FLAG_BOTTOMUP TJ.FLAG_*}
+   */
+  public void decompressRegion(byte[] dstBuf, int x, int y, int width,
+                               int pitch, int height, int pixelFormat,
+                               int flags) throws TJException {
+    if (jpegBuf == null)
+      throw new IllegalStateException(NO_ASSOC_ERROR);
+    if (dstBuf == null || x < 0 || y < 0 || width < 1 || pitch < 0 ||
+        height < 1 || pixelFormat < 0 || pixelFormat >= TJ.NUMPF || flags < 0)
+      throw new IllegalArgumentException("Invalid argument in decompressRegion()");
+    decompressRegion(jpegBuf, jpegBufSize, dstBuf, x, y, width, pitch, height,
+                     pixelFormat, flags);
+  }
+
+  /**
+   * Decompress a rectangular region of the JPEG source image associated with
+   * this decompressor instance and output a grayscale, RGB, or CMYK image to
+   * the given destination buffer.
+   * <p>
+   * NOTE: The output image is fully recoverable if this method throws a
+   * non-fatal {@link TJException} (unless
+   * {@link TJ#FLAG_STOPONWARNING TJ.FLAG_STOPONWARNING} is specified.)
+   *
+   * @param dstBuf buffer that will receive the decompressed region.  This
+   * buffer should normally be <code>stride * height</code> pixels in size.
+   *
+   * @param x see
+   * {@link #decompressRegion(byte[], int, int, int, int, int, int, int)}
+   * for description
+   *
+   * @param y see
+   * {@link #decompressRegion(byte[], int, int, int, int, int, int, int)}
+   * for description
+   *
+   * @param width see
+   * {@link #decompressRegion(byte[], int, int, int, int, int, int, int)}
+   * for description
+   *
+   * @param stride pixels per line of the destination image.  Normally, this
+   * should be set to <code>width</code>.  Setting this parameter to 0 is the
+   * equivalent of setting it to <code>width</code>.
+   *
+   * @param height see
+   * {@link #decompressRegion(byte[], int, int, int, int, int, int, int)}
+   * for description
+   *
+   * @param pixelFormat pixel format of the decompressed image (one of
+   * {@link TJ#PF_RGB TJ.PF_*})
+   *
+   * @param flags the bitwise OR of one or more of
+   * {@link TJ#FLAG_BOTTOMUP TJ.FLAG_*}
+   */
+  public void decompressRegion(int[] dstBuf, int x, int y, int width,
+                               int stride, int height, int pixelFormat,
+                               int flags) throws TJException {
+    if (jpegBuf == null)
+      throw new IllegalStateException(NO_ASSOC_ERROR);
+    if (dstBuf == null || x < 0 || y < 0 || width < 1 || stride < 0 ||
+        height < 1 || pixelFormat < 0 || pixelFormat >= TJ.NUMPF || flags < 0)
+      throw new IllegalArgumentException("Invalid argument in decompressRegion()");
+    decompressRegion(jpegBuf, jpegBufSize, dstBuf, x, y, width, stride,
+                     height, pixelFormat, flags);
+  }
+
   /**
    * Free the native structures associated with this decompressor instance.
    */
@@ -899,6 +1003,14 @@ public class TJDecompressor implements Closeable {
     int y, int desiredWidth, int stride, int desiredHeight, int pixelFormat,
     int flags) throws TJException;
 
+  private native void decompressRegion(byte[] srcBuf, int size,
+    byte[] dstBuf, int x, int y, int width, int pitch, int height,
+    int pixelFormat, int flags) throws TJException;
+
+  private native void decompressRegion(byte[] srcBuf, int size, int[] dstBuf,
+    int x, int y, int width, int stride, int height, int pixelFormat,
+    int flags) throws TJException;
+
   @Deprecated
   private native void decompressToYUV(byte[] srcBuf, int size, byte[] dstBuf,
     int flags) throws TJException;
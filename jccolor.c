@@ -201,9 +201,17 @@ rgb_ycc_start(j_compress_ptr cinfo)
   JLONG *rgb_ycc_tab;
   JLONG i;
 
+  /* The conversion tables are constant, so they are built only once and then
+   * retained for subsequent images.
+   */
+  if (cinfo->master->rgb_ycc_tab != NULL) {
+    cconvert->rgb_ycc_tab = cinfo->master->rgb_ycc_tab;
+    return;
+  }
+
   /* Allocate and fill in the conversion tables. */
-  cconvert->rgb_ycc_tab = rgb_ycc_tab = (JLONG *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
+  cconvert->rgb_ycc_tab = cinfo->master->rgb_ycc_tab = rgb_ycc_tab = (JLONG *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
                                 (TABLE_SIZE * sizeof(JLONG)));
 
   for (i = 0; i <= MAXJSAMPLE; i++) {
@@ -48,6 +48,8 @@ typedef struct {
 
   /* Pointer to the DCT routine actually in use */
   forward_DCT_method_ptr dct;
+  /* Routine that transforms two adjacent blocks in one call, or NULL */
+  forward_DCT_method_ptr dct_pair;
   convsamp_method_ptr convsamp;
   quantize_method_ptr quantize;
 
@@ -57,7 +59,7 @@ typedef struct {
    */
   DCTELEM *divisors[NUM_QUANT_TBLS];
 
-  /* work area for FDCT subroutine */
+  /* work area for FDCT subroutine (two blocks if dct_pair is used) */
   DCTELEM *workspace;
 
 #ifdef DCT_FLOAT_SUPPORTED
@@ -73,6 +75,25 @@ typedef struct {
 typedef my_fdct_controller *my_fdct_ptr;
 
 
+/* The divisors are retained across images, along with copies of the
+ * quantization tables and DCT method from which they were computed, so that
+ * they need not be recomputed unless the tables or DCT method change.  (The
+ * divisor arrays come first so that they are aligned for the SIMD routines.)
+ */
+
+struct jpeg_fdct_cache {
+  DCTELEM divisors[NUM_QUANT_TBLS][DCTSIZE2 * 4];
+#ifdef DCT_FLOAT_SUPPORTED
+  FAST_FLOAT float_divisors[NUM_QUANT_TBLS][DCTSIZE2];
+#endif
+  UINT16 quantval[NUM_QUANT_TBLS][DCTSIZE2];
+  J_DCT_METHOD dct_method[NUM_QUANT_TBLS];
+  boolean valid[NUM_QUANT_TBLS];
+  boolean no_simd_quantize[NUM_QUANT_TBLS]; /* TRUE if a divisor cannot be
+                                               used by jsimd_quantize() */
+};
+
+
 #if BITS_IN_JSAMPLE == 8
 
 /*
@@ -236,11 +257,19 @@ METHODDEF(void)
 start_pass_fdctmgr(j_compress_ptr cinfo)
 {
   my_fdct_ptr fdct = (my_fdct_ptr)cinfo->fdct;
+  struct jpeg_fdct_cache *cache = cinfo->master->fdct_cache;
   int ci, qtblno, i;
   jpeg_component_info *compptr;
   JQUANT_TBL *qtbl;
   DCTELEM *dtbl;
 
+  if (cache == NULL) {
+    cache = cinfo->master->fdct_cache = (struct jpeg_fdct_cache *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(struct jpeg_fdct_cache));
+    MEMZERO(cache, sizeof(struct jpeg_fdct_cache));
+  }
+
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
     qtblno = compptr->quant_tbl_no;
@@ -249,25 +278,29 @@ start_pass_fdctmgr(j_compress_ptr cinfo)
         cinfo->quant_tbl_ptrs[qtblno] == NULL)
       ERREXIT1(cinfo, JERR_NO_QUANT_TABLE, qtblno);
     qtbl = cinfo->quant_tbl_ptrs[qtblno];
+    fdct->divisors[qtblno] = cache->divisors[qtblno];
+#ifdef DCT_FLOAT_SUPPORTED
+    fdct->float_divisors[qtblno] = cache->float_divisors[qtblno];
+#endif
+    /* Reuse the divisors from a previous pass or image if possible */
+    if (cache->valid[qtblno] &&
+        cache->dct_method[qtblno] == cinfo->dct_method &&
+        !MEMCMP(cache->quantval[qtblno], qtbl->quantval,
+                sizeof(qtbl->quantval)))
+      goto check_quantize;
     /* Compute divisors for this quant table */
-    /* We may do this more than once for same table, but it's not a big deal */
+    cache->no_simd_quantize[qtblno] = FALSE;
     switch (cinfo->dct_method) {
 #ifdef DCT_ISLOW_SUPPORTED
     case JDCT_ISLOW:
       /* For LL&M IDCT method, divisors are equal to raw quantization
        * coefficients multiplied by 8 (to counteract scaling).
        */
-      if (fdct->divisors[qtblno] == NULL) {
-        fdct->divisors[qtblno] = (DCTELEM *)
-          (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                      (DCTSIZE2 * 4) * sizeof(DCTELEM));
-      }
       dtbl = fdct->divisors[qtblno];
       for (i = 0; i < DCTSIZE2; i++) {
 #if BITS_IN_JSAMPLE == 8
-        if (!compute_reciprocal(qtbl->quantval[i] << 3, &dtbl[i]) &&
-            fdct->quantize == jsimd_quantize)
-          fdct->quantize = quantize;
+        if (!compute_reciprocal(qtbl->quantval[i] << 3, &dtbl[i]))
+          cache->no_simd_quantize[qtblno] = TRUE;
 #else
         dtbl[i] = ((DCTELEM)qtbl->quantval[i]) << 3;
 #endif
@@ -297,20 +330,14 @@ start_pass_fdctmgr(j_compress_ptr cinfo)
         };
         SHIFT_TEMPS
 
-        if (fdct->divisors[qtblno] == NULL) {
-          fdct->divisors[qtblno] = (DCTELEM *)
-            (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                        (DCTSIZE2 * 4) * sizeof(DCTELEM));
-        }
         dtbl = fdct->divisors[qtblno];
         for (i = 0; i < DCTSIZE2; i++) {
 #if BITS_IN_JSAMPLE == 8
           if (!compute_reciprocal(
                 DESCALE(MULTIPLY16V16((JLONG)qtbl->quantval[i],
                                       (JLONG)aanscales[i]),
-                        CONST_BITS - 3), &dtbl[i]) &&
-              fdct->quantize == jsimd_quantize)
-            fdct->quantize = quantize;
+                        CONST_BITS - 3), &dtbl[i]))
+            cache->no_simd_quantize[qtblno] = TRUE;
 #else
           dtbl[i] = (DCTELEM)
             DESCALE(MULTIPLY16V16((JLONG)qtbl->quantval[i],
@@ -339,11 +366,6 @@ start_pass_fdctmgr(j_compress_ptr cinfo)
           1.0, 0.785694958, 0.541196100, 0.275899379
         };
 
-        if (fdct->float_divisors[qtblno] == NULL) {
-          fdct->float_divisors[qtblno] = (FAST_FLOAT *)
-            (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                        DCTSIZE2 * sizeof(FAST_FLOAT));
-        }
         fdtbl = fdct->float_divisors[qtblno];
         i = 0;
         for (row = 0; row < DCTSIZE; row++) {
@@ -361,6 +383,13 @@ start_pass_fdctmgr(j_compress_ptr cinfo)
       ERREXIT(cinfo, JERR_NOT_COMPILED);
       break;
     }
+    MEMCOPY(cache->quantval[qtblno], qtbl->quantval, sizeof(qtbl->quantval));
+    cache->dct_method[qtblno] = cinfo->dct_method;
+    cache->valid[qtblno] = TRUE;
+
+check_quantize:
+    if (cache->no_simd_quantize[qtblno] && fdct->quantize == jsimd_quantize)
+      fdct->quantize = quantize;
   }
 }
 
@@ -500,13 +529,28 @@ forward_DCT(j_compress_ptr cinfo, jpeg_component_info *compptr,
 
   /* Make sure the compiler doesn't look up these every pass */
   forward_DCT_method_ptr do_dct = fdct->dct;
+  forward_DCT_method_ptr do_dct_pair = fdct->dct_pair;
   convsamp_method_ptr do_convsamp = fdct->convsamp;
   quantize_method_ptr do_quantize = fdct->quantize;
   workspace = fdct->workspace;
 
   sample_data += start_row;     /* fold in the vertical offset once */
 
-  for (bi = 0; bi < num_blocks; bi++, start_col += DCTSIZE) {
+  bi = 0;
+  if (do_dct_pair != NULL) {
+    /* Transform as many pairs of adjacent blocks as possible in one call */
+    for (; bi + 1 < num_blocks; bi += 2, start_col += 2 * DCTSIZE) {
+      (*do_convsamp) (sample_data, start_col, workspace);
+      (*do_convsamp) (sample_data, start_col + DCTSIZE, workspace + DCTSIZE2);
+
+      (*do_dct_pair) (workspace);
+
+      (*do_quantize) (coef_blocks[bi], divisors, workspace);
+      (*do_quantize) (coef_blocks[bi + 1], divisors, workspace + DCTSIZE2);
+    }
+  }
+
+  for (; bi < num_blocks; bi++, start_col += DCTSIZE) {
     /* Load data into workspace, applying unsigned->signed conversion */
     (*do_convsamp) (sample_data, start_col, workspace);
 
@@ -627,6 +671,7 @@ jinit_forward_dct(j_compress_ptr cinfo)
                                 sizeof(my_fdct_controller));
   cinfo->fdct = (struct jpeg_forward_dct *)fdct;
   fdct->pub.start_pass = start_pass_fdctmgr;
+  fdct->dct_pair = NULL;
 
   /* First determine the DCT... */
   switch (cinfo->dct_method) {
@@ -637,6 +682,8 @@ jinit_forward_dct(j_compress_ptr cinfo)
       fdct->dct = jsimd_fdct_islow;
     else
       fdct->dct = jpeg_fdct_islow;
+    if (jsimd_can_fdct_islow_pair())
+      fdct->dct_pair = jsimd_fdct_islow_pair;
     break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -708,7 +755,8 @@ jinit_forward_dct(j_compress_ptr cinfo)
 #endif
     fdct->workspace = (DCTELEM *)
       (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                  sizeof(DCTELEM) * DCTSIZE2);
+                                  sizeof(DCTELEM) * DCTSIZE2 *
+                                  (fdct->dct_pair != NULL ? 2 : 1));
 
   /* Mark divisor tables unallocated */
   for (i = 0; i < NUM_QUANT_TBLS; i++) {
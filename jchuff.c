@@ -131,6 +131,19 @@ typedef struct {
 
 typedef huff_entropy_encoder *huff_entropy_ptr;
 
+/* Derived tables are retained across images, along with copies of the Huffman
+ * tables from which they were built, so that they need not be rebuilt unless
+ * the Huffman tables change.  The first index is 1 for DC tables and 0 for AC
+ * tables.
+ */
+
+struct jpeg_huff_cache {
+  c_derived_tbl derived_tbls[2][NUM_HUFF_TBLS];
+  UINT8 bits[2][NUM_HUFF_TBLS][17];
+  UINT8 huffval[2][NUM_HUFF_TBLS][256];
+  boolean valid[2][NUM_HUFF_TBLS];
+};
+
 /* Working state while writing an MCU.
  * This struct contains all the fields that are needed by subroutines.
  */
@@ -250,7 +263,8 @@ jpeg_make_c_derived_tbl(j_compress_ptr cinfo, boolean isDC, int tblno,
 {
   JHUFF_TBL *htbl;
   c_derived_tbl *dtbl;
-  int p, i, l, lastp, si, maxsymbol;
+  struct jpeg_huff_cache *cache = cinfo->master->huff_cache;
+  int p, i, l, lastp, si, maxsymbol, dc = isDC ? 1 : 0;
   char huffsize[257];
   unsigned int huffcode[257];
   unsigned int code;
@@ -274,6 +288,21 @@ jpeg_make_c_derived_tbl(j_compress_ptr cinfo, boolean isDC, int tblno,
                                   sizeof(c_derived_tbl));
   dtbl = *pdtbl;
 
+  /* Reuse the derived table from a previous scan or image if possible */
+  if (cache == NULL) {
+    cache = cinfo->master->huff_cache = (struct jpeg_huff_cache *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(struct jpeg_huff_cache));
+    MEMZERO(cache, sizeof(struct jpeg_huff_cache));
+  }
+  if (cache->valid[dc][tblno] &&
+      !MEMCMP(cache->bits[dc][tblno], htbl->bits, sizeof(htbl->bits)) &&
+      !MEMCMP(cache->huffval[dc][tblno], htbl->huffval,
+              sizeof(htbl->huffval))) {
+    MEMCOPY(dtbl, &cache->derived_tbls[dc][tblno], sizeof(c_derived_tbl));
+    return;
+  }
+
   /* Figure C.1: make table of Huffman code length for each symbol */
 
   p = 0;
@@ -330,6 +359,11 @@ jpeg_make_c_derived_tbl(j_compress_ptr cinfo, boolean isDC, int tblno,
     dtbl->ehufco[i] = huffcode[p];
     dtbl->ehufsi[i] = huffsize[p];
   }
+
+  MEMCOPY(&cache->derived_tbls[dc][tblno], dtbl, sizeof(c_derived_tbl));
+  MEMCOPY(cache->bits[dc][tblno], htbl->bits, sizeof(htbl->bits));
+  MEMCOPY(cache->huffval[dc][tblno], htbl->huffval, sizeof(htbl->huffval));
+  cache->valid[dc][tblno] = TRUE;
 }
 
 
@@ -53,6 +53,10 @@ jpeg_abort(j_common_ptr cinfo)
     ((j_decompress_ptr)cinfo)->marker_list = NULL;
   } else {
     cinfo->global_state = CSTATE_START;
+    /* jpeg_mmap_dest() leaves the output file mapped until term_destination
+     * is called, which doesn't happen if compression is aborted.
+     */
+    jrelease_mmap_dest((j_compress_ptr)cinfo);
   }
 }
 
@@ -73,8 +77,16 @@ jpeg_destroy(j_common_ptr cinfo)
 {
   /* We need only tell the memory manager to release everything. */
   /* NB: mem pointer is NULL if memory mgr failed to initialize. */
-  if (cinfo->mem != NULL)
+  if (cinfo->mem != NULL) {
+    /* ... but first release any memory-mapped file, since the source or
+     * destination manager that tracks it is about to be freed.
+     */
+    if (cinfo->is_decompressor)
+      jrelease_mmap_src((j_decompress_ptr)cinfo);
+    else
+      jrelease_mmap_dest((j_compress_ptr)cinfo);
     (*cinfo->mem->self_destruct) (cinfo);
+  }
   cinfo->mem = NULL;            /* be safe if jpeg_destroy is called twice */
   cinfo->global_state = 0;      /* mark it destroyed */
 }
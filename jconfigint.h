@@ -25,6 +25,12 @@
 /* Define to 1 if you have the <intrin.h> header file. */
 /* #undef HAVE_INTRIN_H */
 
+/* Define if you have mmap() and the other POSIX memory-mapped file functions. */
+#define HAVE_MMAP
+
+/* Define if you have posix_fallocate(). */
+#define HAVE_POSIX_FALLOCATE
+
 #if defined(_MSC_VER) && defined(HAVE_INTRIN_H)
 #if (SIZEOF_SIZE_T == 8)
 #define HAVE_BITSCANFORWARD64
@@ -159,6 +159,7 @@ jpeg_crop_scanline(j_decompress_ptr cinfo, JDIMENSION *xoffset,
   JDIMENSION input_xoffset;
   boolean reinit_upsampler = FALSE;
   jpeg_component_info *compptr;
+  my_master_ptr master = (my_master_ptr)cinfo->master;
 
   if (cinfo->global_state != DSTATE_SCANNING || cinfo->output_scanline != 0)
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
@@ -246,6 +247,16 @@ jpeg_crop_scanline(j_decompress_ptr cinfo, JDIMENSION *xoffset,
     jinit_upsampler(cinfo);
     cinfo->master->jinit_upsampler_no_alloc = FALSE;
   }
+
+  /* The h1v2 and h2v2 merged upsamplers copy whole output rows to and from
+   * their spare row, so the row width must match the cropped output width.
+   */
+  if (master->using_merged_upsample && cinfo->max_v_samp_factor == 2) {
+    my_merged_upsample_ptr upsample = (my_merged_upsample_ptr)cinfo->upsample;
+
+    upsample->out_row_width =
+      cinfo->output_width * cinfo->out_color_components;
+  }
 }
 
 
@@ -490,6 +501,16 @@ jpeg_skip_scanlines(j_decompress_ptr cinfo, JDIMENSION num_lines)
       if (!master->using_merged_upsample) {
         upsample->next_row_out = cinfo->max_v_samp_factor;
         upsample->rows_to_go = cinfo->output_height - cinfo->output_scanline;
+      } else {
+        my_merged_upsample_ptr merged =
+          (my_merged_upsample_ptr)cinfo->upsample;
+
+        /* If we stopped reading in the middle of a row group, then the spare
+         * row holds a line from the iMCU row that we just skipped.  Discard
+         * it, so that it is not returned in place of the next line.
+         */
+        merged->spare_full = FALSE;
+        merged->rows_to_go = cinfo->output_height - cinfo->output_scanline;
       }
     }
   }
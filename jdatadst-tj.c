@@ -10,7 +10,8 @@
  * file.
  *
  * This file contains compression data destination routines for the case of
- * emitting JPEG data to memory or to a file (or any stdio stream).
+ * emitting JPEG data to memory (either a single buffer or a list of buffers)
+ * or to a callback function.
  * While these routines are sufficient for most applications,
  * some will want to use a different destination manager.
  * IMPORTANT: we assume that fwrite() will correctly transcribe an array of
@@ -29,6 +30,14 @@ extern void free(void *ptr);
 #endif
 void jpeg_mem_dest_tj(j_compress_ptr cinfo, unsigned char **outbuffer,
                       unsigned long *outsize, boolean alloc);
+void jpeg_callback_dest_tj(j_compress_ptr cinfo,
+                           int (*callback) (const unsigned char *,
+                                            unsigned long, void *),
+                           void *callbackData, unsigned char *buffer,
+                           unsigned long bufsize);
+void jpeg_buffers_dest_tj(j_compress_ptr cinfo, unsigned char **buffers,
+                          const unsigned long *sizes, int numbuffers,
+                          unsigned long *outsize);
 
 
 #define OUTPUT_BUF_SIZE  4096   /* choose an efficiently fwrite'able size */
@@ -45,6 +54,20 @@ typedef struct {
   JOCTET *buffer;               /* start of buffer */
   size_t bufsize;
   boolean alloc;
+
+  /* The callback and buffer list destinations share this object, so that a
+   * compressor can switch among the destinations from one image to the next.
+   */
+  int (*callback) (const unsigned char *, unsigned long, void *);
+  void *callbackData;
+  JOCTET *callbackBuffer;       /* fixed-size buffer passed to callback */
+  size_t callbackBufsize;
+  JOCTET *defaultCallbackBuffer;
+
+  unsigned char **buffers;      /* buffer list */
+  const unsigned long *sizes;
+  int numbuffers, curbuffer;
+  size_t listsize;              /* size of the buffers before curbuffer */
 } my_mem_destination_mgr;
 
 typedef my_mem_destination_mgr *my_mem_dest_ptr;
@@ -167,9 +190,11 @@ jpeg_mem_dest_tj(j_compress_ptr cinfo, unsigned char **outbuffer,
     dest = (my_mem_dest_ptr)cinfo->dest;
     dest->newbuffer = NULL;
     dest->buffer = NULL;
+    dest->defaultCallbackBuffer = NULL;
   } else if (cinfo->dest->init_destination != init_mem_destination) {
     /* It is unsafe to reuse the existing destination manager unless it was
-     * created by this function.
+     * created by this function, jpeg_callback_dest_tj(), or
+     * jpeg_buffers_dest_tj().
      */
     ERREXIT(cinfo, JERR_BUFFER_SIZE);
   }
@@ -193,10 +218,206 @@ jpeg_mem_dest_tj(j_compress_ptr cinfo, unsigned char **outbuffer,
       *outsize = OUTPUT_BUF_SIZE;
     } else
       ERREXIT(cinfo, JERR_BUFFER_SIZE);
-  }
+  } else if (alloc)
+    /* The caller's buffer (which may have been allocated by a previous call,
+     * possibly for a different JPEG image) is freed if it has to be grown.
+     * Any other buffer that we allocated previously now belongs to the
+     * caller.
+     */
+    dest->newbuffer = *outbuffer;
 
   dest->pub.next_output_byte = dest->buffer = *outbuffer;
   if (!reused)
     dest->bufsize = *outsize;
   dest->pub.free_in_buffer = dest->bufsize;
 }
+
+
+/*
+ * Empty the output buffer of the callback destination by passing its
+ * contents to the callback function.
+ */
+
+METHODDEF(boolean)
+empty_callback_output_buffer(j_compress_ptr cinfo)
+{
+  my_mem_dest_ptr dest = (my_mem_dest_ptr)cinfo->dest;
+
+  if ((*dest->callback) (dest->callbackBuffer,
+                         (unsigned long)dest->callbackBufsize,
+                         dest->callbackData) == -1)
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+
+  dest->pub.next_output_byte = dest->callbackBuffer;
+  dest->pub.free_in_buffer = dest->callbackBufsize;
+
+  return TRUE;
+}
+
+
+/*
+ * Terminate the callback destination by passing any remaining data to the
+ * callback function.
+ */
+
+METHODDEF(void)
+term_callback_destination(j_compress_ptr cinfo)
+{
+  my_mem_dest_ptr dest = (my_mem_dest_ptr)cinfo->dest;
+  size_t datacount = dest->callbackBufsize - dest->pub.free_in_buffer;
+
+  if (datacount > 0 &&
+      (*dest->callback) (dest->callbackBuffer, (unsigned long)datacount,
+                         dest->callbackData) == -1)
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+
+
+/*
+ * Prepare for output to a callback function.
+ * The compressed data is accumulated in a fixed-size buffer, which is passed
+ * to the callback function whenever it fills up and once more (if it contains
+ * any data) when compression finishes.  Thus, the memory required for the
+ * compressed data does not depend on the size of the JPEG image.  If the
+ * callback function returns -1, then compression is aborted.
+ * The caller may supply the fixed-size buffer.  Otherwise, a buffer of
+ * OUTPUT_BUF_SIZE bytes is allocated and retained for the life of the JPEG
+ * object.
+ */
+
+GLOBAL(void)
+jpeg_callback_dest_tj(j_compress_ptr cinfo,
+                      int (*callback) (const unsigned char *, unsigned long,
+                                       void *),
+                      void *callbackData, unsigned char *buffer,
+                      unsigned long bufsize)
+{
+  my_mem_dest_ptr dest;
+
+  if (callback == NULL || (buffer != NULL && bufsize == 0)) /* sanity check */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  if (cinfo->dest == NULL) {    /* first time for this JPEG object? */
+    cinfo->dest = (struct jpeg_destination_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(my_mem_destination_mgr));
+    dest = (my_mem_dest_ptr)cinfo->dest;
+    dest->newbuffer = NULL;
+    dest->buffer = NULL;
+    dest->defaultCallbackBuffer = NULL;
+  } else if (cinfo->dest->init_destination != init_mem_destination) {
+    /* It is unsafe to reuse the existing destination manager unless it was
+     * created by this function, jpeg_mem_dest_tj(), or
+     * jpeg_buffers_dest_tj().
+     */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  }
+
+  dest = (my_mem_dest_ptr)cinfo->dest;
+  if (buffer == NULL) {
+    if (dest->defaultCallbackBuffer == NULL)
+      dest->defaultCallbackBuffer = (JOCTET *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                    OUTPUT_BUF_SIZE * sizeof(JOCTET));
+    buffer = dest->defaultCallbackBuffer;
+    bufsize = OUTPUT_BUF_SIZE;
+  }
+  dest->pub.init_destination = init_mem_destination;
+  dest->pub.empty_output_buffer = empty_callback_output_buffer;
+  dest->pub.term_destination = term_callback_destination;
+  dest->callback = callback;
+  dest->callbackData = callbackData;
+  dest->callbackBuffer = buffer;
+  dest->callbackBufsize = (size_t)bufsize;
+
+  dest->pub.next_output_byte = dest->callbackBuffer;
+  dest->pub.free_in_buffer = dest->callbackBufsize;
+}
+
+
+/*
+ * Empty the output buffer of the buffer list destination by moving on to the
+ * next non-empty buffer in the list.
+ */
+
+METHODDEF(boolean)
+empty_buffers_output_buffer(j_compress_ptr cinfo)
+{
+  my_mem_dest_ptr dest = (my_mem_dest_ptr)cinfo->dest;
+
+  do {
+    dest->listsize += dest->sizes[dest->curbuffer];
+    if (++dest->curbuffer >= dest->numbuffers)
+      ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  } while (dest->sizes[dest->curbuffer] == 0);
+
+  dest->pub.next_output_byte = dest->buffers[dest->curbuffer];
+  dest->pub.free_in_buffer = dest->sizes[dest->curbuffer];
+
+  return TRUE;
+}
+
+
+/*
+ * Terminate the buffer list destination.
+ */
+
+METHODDEF(void)
+term_buffers_destination(j_compress_ptr cinfo)
+{
+  my_mem_dest_ptr dest = (my_mem_dest_ptr)cinfo->dest;
+
+  *dest->outsize = (unsigned long)(dest->listsize +
+                                   dest->sizes[dest->curbuffer] -
+                                   dest->pub.free_in_buffer);
+}
+
+
+/*
+ * Prepare for output to a list of memory buffers, which are filled in order
+ * (scatter-gather output.)  The buffers are never reallocated, so an error is
+ * raised if the compressed data does not fit in them.  The buffer list must
+ * remain valid until compression finishes.
+ */
+
+GLOBAL(void)
+jpeg_buffers_dest_tj(j_compress_ptr cinfo, unsigned char **buffers,
+                     const unsigned long *sizes, int numbuffers,
+                     unsigned long *outsize)
+{
+  my_mem_dest_ptr dest;
+
+  if (buffers == NULL || sizes == NULL || numbuffers < 1 ||
+      outsize == NULL)          /* sanity check */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  if (cinfo->dest == NULL) {    /* first time for this JPEG object? */
+    cinfo->dest = (struct jpeg_destination_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(my_mem_destination_mgr));
+    dest = (my_mem_dest_ptr)cinfo->dest;
+    dest->newbuffer = NULL;
+    dest->buffer = NULL;
+    dest->defaultCallbackBuffer = NULL;
+  } else if (cinfo->dest->init_destination != init_mem_destination) {
+    /* It is unsafe to reuse the existing destination manager unless it was
+     * created by this function, jpeg_mem_dest_tj(), or
+     * jpeg_callback_dest_tj().
+     */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  }
+
+  dest = (my_mem_dest_ptr)cinfo->dest;
+  dest->pub.init_destination = init_mem_destination;
+  dest->pub.empty_output_buffer = empty_buffers_output_buffer;
+  dest->pub.term_destination = term_buffers_destination;
+  dest->buffers = buffers;
+  dest->sizes = sizes;
+  dest->numbuffers = numbuffers;
+  dest->curbuffer = 0;
+  dest->listsize = 0;
+  dest->outsize = outsize;
+
+  dest->pub.next_output_byte = buffers[0];
+  dest->pub.free_in_buffer = sizes[0];
+}
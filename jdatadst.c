@@ -10,7 +10,9 @@
  * file.
  *
  * This file contains compression data destination routines for the case of
- * emitting JPEG data to memory or to a file (or any stdio stream).
+ * emitting JPEG data to memory or to a file (or any stdio stream), as well as
+ * a destination manager that writes JPEG data directly into a memory-mapped
+ * file.
  * While these routines are sufficient for most applications,
  * some will want to use a different destination manager.
  * IMPORTANT: we assume that fwrite() will correctly transcribe an array of
@@ -22,6 +24,13 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jerror.h"
+#include "jconfigint.h"
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #ifndef HAVE_STDLIB_H           /* <stdlib.h> should declare malloc(),free() */
 extern void *malloc(size_t size);
@@ -43,6 +52,25 @@ typedef my_destination_mgr *my_dest_ptr;
 #define OUTPUT_BUF_SIZE  4096   /* choose an efficiently fwrite'able size */
 
 
+#ifdef HAVE_MMAP
+/* Expanded data destination object for memory-mapped file output */
+
+typedef struct {
+  my_destination_mgr stdio;     /* used if the file cannot be mapped */
+
+  JOCTET *map;                  /* start of mapping, or NULL if none */
+  size_t map_size;              /* size of mapping */
+  long map_offset;              /* file offset of start of mapping */
+  long offset;                  /* file offset of start of JPEG data */
+  size_t bufsize;               /* space for JPEG data in mapping */
+} my_mmap_destination_mgr;
+
+typedef my_mmap_destination_mgr *my_mmap_dest_ptr;
+
+#define MMAP_OUTPUT_BUF_SIZE  65536  /* initial size of mapped JPEG data */
+#endif
+
+
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
 /* Expanded data destination object for memory output */
 
@@ -87,6 +115,107 @@ init_mem_destination(j_compress_ptr cinfo)
 }
 #endif
 
+#ifdef HAVE_MMAP
+/*
+ * Grow the output file so that it can hold bufsize bytes of JPEG data, and
+ * (re)map it.  Returns FALSE if the file cannot be grown or mapped.  The disk
+ * space is allocated before the file is mapped, so running out of space is
+ * reported as a write error rather than as a SIGBUS when the mapping is
+ * written.
+ */
+
+LOCAL(boolean)
+map_output_file(my_mmap_dest_ptr dest, size_t bufsize)
+{
+  int fd = fileno(dest->stdio.outfile);
+  size_t map_size = (size_t)(dest->offset - dest->map_offset) + bufsize;
+  void *map;
+
+  if (map_size < bufsize || (long)(dest->map_offset + map_size) < 0)
+    return FALSE;
+#ifdef HAVE_POSIX_FALLOCATE
+  if (posix_fallocate(fd, (off_t)dest->map_offset, (off_t)map_size) != 0)
+    return FALSE;
+#else
+  if (ftruncate(fd, (off_t)(dest->map_offset + map_size)) < 0)
+    return FALSE;
+#endif
+  /* The new mapping is created before the old one is released, so that the
+   * old one remains valid (and can still be released by
+   * unmap_output_file()) if this fails.
+   */
+  map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+             (off_t)dest->map_offset);
+  if (map == MAP_FAILED)
+    return FALSE;
+  if (dest->map != NULL)
+    munmap(dest->map, dest->map_size);
+  dest->map = (JOCTET *)map;
+  dest->map_size = map_size;
+  dest->bufsize = bufsize;
+  return TRUE;
+}
+
+/*
+ * Release the mapping, trim the unused space from the end of the output file,
+ * and leave the stream positioned after the JPEG data that has been written.
+ * Returns FALSE if the file cannot be truncated or repositioned.
+ */
+
+LOCAL(boolean)
+unmap_output_file(my_mmap_dest_ptr dest)
+{
+  long end = dest->offset +
+             (long)(dest->bufsize - dest->stdio.pub.free_in_buffer);
+
+  munmap(dest->map, dest->map_size);
+  dest->map = NULL;
+  return ftruncate(fileno(dest->stdio.outfile), (off_t)end) == 0 &&
+         fseek(dest->stdio.outfile, end, SEEK_SET) == 0;
+}
+
+METHODDEF(boolean) empty_output_buffer(j_compress_ptr cinfo);
+METHODDEF(boolean) empty_mmap_output_buffer(j_compress_ptr cinfo);
+METHODDEF(void) term_destination(j_compress_ptr cinfo);
+METHODDEF(void) term_mmap_destination(j_compress_ptr cinfo);
+
+METHODDEF(void)
+init_mmap_destination(j_compress_ptr cinfo)
+{
+  my_mmap_dest_ptr dest = (my_mmap_dest_ptr)cinfo->dest;
+  FILE *outfile = dest->stdio.outfile;
+  int fd = fileno(outfile), flags;
+  struct stat st;
+  long page_size;
+
+  /* Only regular files that are open for reading and writing (mode "w+b" or
+   * "r+b") can be mapped.  Anything else is written with fwrite().
+   */
+  if (fd >= 0 && fflush(outfile) == 0 &&
+      (dest->offset = ftell(outfile)) >= 0 && fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode) && (flags = fcntl(fd, F_GETFL)) != -1 &&
+      (flags & O_ACCMODE) == O_RDWR && !(flags & O_APPEND) &&
+      (page_size = sysconf(_SC_PAGESIZE)) > 0) {
+    dest->map_offset = dest->offset & ~(page_size - 1);
+    if (map_output_file(dest, MMAP_OUTPUT_BUF_SIZE)) {
+      dest->stdio.pub.empty_output_buffer = empty_mmap_output_buffer;
+      dest->stdio.pub.term_destination = term_mmap_destination;
+      dest->stdio.pub.next_output_byte =
+        dest->map + (dest->offset - dest->map_offset);
+      dest->stdio.pub.free_in_buffer = dest->bufsize;
+      return;
+    }
+    /* Undo any change to the file size */
+    if (ftruncate(fd, st.st_size) < 0)
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+  }
+
+  init_destination(cinfo);
+  dest->stdio.pub.empty_output_buffer = empty_output_buffer;
+  dest->stdio.pub.term_destination = term_destination;
+}
+#endif
+
 
 /*
  * Empty the output buffer --- called whenever buffer fills up.
@@ -157,6 +286,25 @@ empty_mem_output_buffer(j_compress_ptr cinfo)
 }
 #endif
 
+#ifdef HAVE_MMAP
+METHODDEF(boolean)
+empty_mmap_output_buffer(j_compress_ptr cinfo)
+{
+  my_mmap_dest_ptr dest = (my_mmap_dest_ptr)cinfo->dest;
+  size_t datacount = dest->bufsize;
+
+  /* Double the size of the mapped region */
+  if (!map_output_file(dest, datacount * 2))
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+
+  dest->stdio.pub.next_output_byte =
+    dest->map + (dest->offset - dest->map_offset) + datacount;
+  dest->stdio.pub.free_in_buffer = dest->bufsize - datacount;
+
+  return TRUE;
+}
+#endif
+
 
 /*
  * Terminate destination --- called by jpeg_finish_compress
@@ -195,6 +343,39 @@ term_mem_destination(j_compress_ptr cinfo)
 }
 #endif
 
+#ifdef HAVE_MMAP
+METHODDEF(void)
+term_mmap_destination(j_compress_ptr cinfo)
+{
+  my_mmap_dest_ptr dest = (my_mmap_dest_ptr)cinfo->dest;
+
+  if (!unmap_output_file(dest))
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+#endif
+
+
+/*
+ * Release the memory-mapped output file, if any --- called by jpeg_abort and
+ * jpeg_destroy, since term_destination is not called if compression is
+ * aborted.  The file is truncated at the end of the data written so far, so
+ * the stream must not have been closed yet.  Errors are ignored, since the
+ * application is already abandoning the image.
+ */
+
+GLOBAL(void)
+jrelease_mmap_dest(j_compress_ptr cinfo)
+{
+#ifdef HAVE_MMAP
+  my_mmap_dest_ptr dest = (my_mmap_dest_ptr)cinfo->dest;
+
+  if (dest != NULL &&
+      dest->stdio.pub.init_destination == init_mmap_destination &&
+      dest->map != NULL)
+    (void)unmap_output_file(dest);
+#endif
+}
+
 
 /*
  * Prepare for output to a stdio stream.
@@ -232,6 +413,53 @@ jpeg_stdio_dest(j_compress_ptr cinfo, FILE *outfile)
 }
 
 
+/*
+ * Prepare for output to a memory-mapped file.
+ * The caller must have already opened the stream, and is responsible
+ * for closing it after finishing compression.  The JPEG data is written
+ * directly into a mapping of the file, starting at the current position of
+ * the stream, and the file is grown as necessary.  When compression is
+ * finished or aborted, the file is truncated at the end of the JPEG data, so
+ * any data that previously followed the current position is discarded.  The
+ * stream must have been opened for both reading and writing (for instance,
+ * with mode "w+b"), since a write-only file cannot be mapped.  If the file
+ * cannot be mapped, or if memory-mapped files are not supported on this
+ * platform, then the JPEG data is written as if jpeg_stdio_dest() had been
+ * called.
+ */
+
+GLOBAL(void)
+jpeg_mmap_dest(j_compress_ptr cinfo, FILE *outfile)
+{
+#ifdef HAVE_MMAP
+  my_mmap_dest_ptr dest;
+
+  /* The destination object is made permanent so that multiple JPEG images
+   * can be written to the same file without re-executing jpeg_mmap_dest.
+   */
+  if (cinfo->dest == NULL) {    /* first time for this JPEG object? */
+    cinfo->dest = (struct jpeg_destination_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(my_mmap_destination_mgr));
+    ((my_mmap_dest_ptr)cinfo->dest)->map = NULL;
+  } else if (cinfo->dest->init_destination != init_mmap_destination) {
+    /* It is unsafe to reuse the existing destination manager unless it was
+     * created by this function.
+     */
+    ERREXIT(cinfo, JERR_BAD_SRCDST_MGR);
+  }
+
+  dest = (my_mmap_dest_ptr)cinfo->dest;
+  dest->stdio.pub.init_destination = init_mmap_destination;
+  dest->stdio.pub.empty_output_buffer = empty_output_buffer;
+  dest->stdio.pub.term_destination = term_destination;
+  dest->stdio.outfile = outfile;
+#else
+  jpeg_stdio_dest(cinfo, outfile);
+#endif
+}
+
+
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
 /*
  * Prepare for output to a memory buffer.
@@ -10,7 +10,9 @@
  * file.
  *
  * This file contains decompression data source routines for the case of
- * reading JPEG data from memory or from a file (or any stdio stream).
+ * reading JPEG data from memory or from a file (or any stdio stream), as well
+ * as a source manager that memory-maps the file and feeds the mapping directly
+ * to the decompressor.
  * While these routines are sufficient for most applications,
  * some will want to use a different source manager.
  * IMPORTANT: we assume that fread() will correctly transcribe an array of
@@ -22,6 +24,12 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jerror.h"
+#include "jconfigint.h"
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 /* Expanded data source object for stdio input */
@@ -39,6 +47,23 @@ typedef my_source_mgr *my_src_ptr;
 #define INPUT_BUF_SIZE  4096    /* choose an efficiently fread'able size */
 
 
+#ifdef HAVE_MMAP
+/* Expanded data source object for memory-mapped file input */
+
+typedef struct {
+  my_source_mgr stdio;          /* used if the file cannot be mapped */
+
+  JOCTET *map;                  /* start of mapping, or NULL if none */
+  size_t map_size;              /* size of mapping */
+  long map_offset;              /* file offset of start of mapping */
+  long offset;                  /* file offset of next unread byte */
+  boolean use_stdio;            /* TRUE if reading the file with fread() */
+} my_mmap_source_mgr;
+
+typedef my_mmap_source_mgr *my_mmap_src_ptr;
+#endif
+
+
 /*
  * Initialize source --- called by jpeg_read_header
  * before any data is actually read.
@@ -64,6 +89,66 @@ init_mem_source(j_decompress_ptr cinfo)
 }
 #endif
 
+#ifdef HAVE_MMAP
+METHODDEF(boolean) fill_input_buffer(j_decompress_ptr cinfo);
+METHODDEF(boolean) fill_mmap_input_buffer(j_decompress_ptr cinfo);
+
+METHODDEF(void)
+init_mmap_source(j_decompress_ptr cinfo)
+{
+  my_mmap_src_ptr src = (my_mmap_src_ptr)cinfo->src;
+  int fd = fileno(src->stdio.infile);
+  struct stat st;
+  long page_size;
+  void *map;
+
+  src->stdio.start_of_file = TRUE;
+
+  /* If the previous image was aborted, then keep reading from the existing
+   * mapping, just as the stdio source manager keeps reading from its buffer.
+   */
+  if (src->map != NULL || src->use_stdio)
+    return;
+
+  /* Map the remainder of the file, starting at the page that contains the
+   * next unread byte.  Pipes, empty files, and files that are too large to map
+   * into the address space are read with fread() instead.
+   */
+  if (src->offset < 0)          /* first image? */
+    src->offset = ftell(src->stdio.infile);
+  if (src->offset >= 0 && fd >= 0 && fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode) && st.st_size > src->offset &&
+      (page_size = sysconf(_SC_PAGESIZE)) > 0) {
+    src->map_offset = src->offset & ~(page_size - 1);
+    if ((unsigned long long)(st.st_size - src->map_offset) <=
+        (unsigned long long)((size_t)-1)) {
+      src->map_size = (size_t)(st.st_size - src->map_offset);
+      map = mmap(NULL, src->map_size, PROT_READ, MAP_PRIVATE, fd,
+                 (off_t)src->map_offset);
+      if (map != MAP_FAILED) {
+        src->map = (JOCTET *)map;
+        src->stdio.pub.fill_input_buffer = fill_mmap_input_buffer;
+        src->stdio.pub.next_input_byte =
+          src->map + (src->offset - src->map_offset);
+        src->stdio.pub.bytes_in_buffer =
+          (size_t)(st.st_size - src->offset);
+        return;
+      }
+    }
+  }
+
+  /* Fall back to reading the file with fread(), starting with the first byte
+   * that was not consumed from the mapping of the previous image (if any.)
+   */
+  if (src->offset >= 0 && fseek(src->stdio.infile, src->offset, SEEK_SET))
+    ERREXIT(cinfo, JERR_FILE_READ);
+  src->use_stdio = TRUE;
+  src->stdio.pub.fill_input_buffer = fill_input_buffer;
+  src->stdio.pub.bytes_in_buffer = 0;
+  src->stdio.pub.next_input_byte = NULL;
+}
+#endif
+
 
 /*
  * Fill the input buffer --- called whenever buffer is emptied.
@@ -146,6 +231,28 @@ fill_mem_input_buffer(j_decompress_ptr cinfo)
 }
 #endif
 
+#ifdef HAVE_MMAP
+METHODDEF(boolean)
+fill_mmap_input_buffer(j_decompress_ptr cinfo)
+{
+  static const JOCTET mybuffer[4] = {
+    (JOCTET)0xFF, (JOCTET)JPEG_EOI, 0, 0
+  };
+
+  /* The mapping extends to the end of the file, so any request for more data
+   * is treated as a premature EOF.
+   */
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+
+  /* Insert a fake EOI marker */
+
+  cinfo->src->next_input_byte = mybuffer;
+  cinfo->src->bytes_in_buffer = 2;
+
+  return TRUE;
+}
+#endif
+
 
 /*
  * Skip data --- used to skip over a potentially large amount of
@@ -206,6 +313,53 @@ term_source(j_decompress_ptr cinfo)
   /* no work necessary here */
 }
 
+#ifdef HAVE_MMAP
+METHODDEF(void)
+term_mmap_source(j_decompress_ptr cinfo)
+{
+  my_mmap_src_ptr src = (my_mmap_src_ptr)cinfo->src;
+  const JOCTET *next_input_byte = src->stdio.pub.next_input_byte;
+
+  if (src->map == NULL)
+    return;
+
+  /* Remember where the next image (if any) begins, and release the mapping.
+   * The stdio stream is not touched here, since the application may have
+   * already closed it.
+   */
+  if (next_input_byte >= src->map &&
+      next_input_byte <= src->map + src->map_size)
+    src->offset = src->map_offset + (long)(next_input_byte - src->map);
+  else                          /* fake EOI marker was inserted */
+    src->offset = src->map_offset + (long)src->map_size;
+  munmap(src->map, src->map_size);
+  src->map = NULL;
+  src->stdio.pub.bytes_in_buffer = 0;
+  src->stdio.pub.next_input_byte = NULL;
+}
+#endif
+
+
+/*
+ * Release the memory-mapped input file, if any --- called by jpeg_destroy.
+ * (jpeg_abort keeps the mapping, just as the stdio source manager keeps its
+ * buffer, so that the next image can be read from it.)
+ */
+
+GLOBAL(void)
+jrelease_mmap_src(j_decompress_ptr cinfo)
+{
+#ifdef HAVE_MMAP
+  my_mmap_src_ptr src = (my_mmap_src_ptr)cinfo->src;
+
+  if (src != NULL && src->stdio.pub.init_source == init_mmap_source &&
+      src->map != NULL) {
+    munmap(src->map, src->map_size);
+    src->map = NULL;
+  }
+#endif
+}
+
 
 /*
  * Prepare for input from a stdio stream.
@@ -253,6 +407,64 @@ jpeg_stdio_src(j_decompress_ptr cinfo, FILE *infile)
 }
 
 
+/*
+ * Prepare for input from a memory-mapped file.
+ * The caller must have already opened the stream, and is responsible
+ * for closing it after finishing decompression.  The remainder of the file,
+ * starting at the current position of the stream, is mapped into memory when
+ * the first image is read, and the mapping is passed to the decompressor
+ * without copying it.  The mapping is released by jpeg_finish_decompress(), so
+ * the stream can be closed before then.  If the file cannot be mapped (for
+ * instance, if it is a pipe), or if memory-mapped files are not supported on
+ * this platform, then the file is read as if jpeg_stdio_src() had been called.
+ */
+
+GLOBAL(void)
+jpeg_mmap_src(j_decompress_ptr cinfo, FILE *infile)
+{
+#ifdef HAVE_MMAP
+  my_mmap_src_ptr src;
+
+  /* As with jpeg_stdio_src(), the source object and input buffer are made
+   * permanent so that a series of JPEG images can be read from the same file.
+   */
+  if (cinfo->src == NULL) {     /* first time for this JPEG object? */
+    cinfo->src = (struct jpeg_source_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(my_mmap_source_mgr));
+    src = (my_mmap_src_ptr)cinfo->src;
+    src->stdio.buffer = (JOCTET *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  INPUT_BUF_SIZE * sizeof(JOCTET));
+    src->map = NULL;
+  } else if (cinfo->src->init_source != init_mmap_source) {
+    /* It is unsafe to reuse the existing source manager unless it was created
+     * by this function.
+     */
+    ERREXIT(cinfo, JERR_BAD_SRCDST_MGR);
+  }
+
+  src = (my_mmap_src_ptr)cinfo->src;
+  if (src->map != NULL) {       /* discard mapping of previous file */
+    munmap(src->map, src->map_size);
+    src->map = NULL;
+  }
+  src->stdio.pub.init_source = init_mmap_source;
+  src->stdio.pub.fill_input_buffer = fill_input_buffer;
+  src->stdio.pub.skip_input_data = skip_input_data;
+  src->stdio.pub.resync_to_restart = jpeg_resync_to_restart;
+  src->stdio.pub.term_source = term_mmap_source;
+  src->stdio.infile = infile;
+  src->stdio.pub.bytes_in_buffer = 0;
+  src->stdio.pub.next_input_byte = NULL;
+  src->offset = -1;             /* forces ftell() when first image is read */
+  src->use_stdio = FALSE;
+#else
+  jpeg_stdio_src(cinfo, infile);
+#endif
+}
+
+
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
 /*
  * Prepare for input from a supplied memory buffer.
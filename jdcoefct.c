@@ -92,19 +92,28 @@ decompress_onepass(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JSAMPARRAY output_ptr;
   JDIMENSION start_col, output_col;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
+  inverse_DCT_method_ptr inverse_DCT, inverse_DCT_pair;
 
   /* Loop to process as much as one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
        yoffset++) {
     for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
          MCU_col_num++) {
-      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
-      jzero_far((void *)coef->MCU_buffer[0],
-                (size_t)(cinfo->blocks_in_MCU * sizeof(JBLOCK)));
+      boolean in_crop = (MCU_col_num >= cinfo->master->first_iMCU_col &&
+                         MCU_col_num <= cinfo->master->last_iMCU_col);
+
+      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed.
+       * MCUs outside of the cropping region must still be entropy-decoded in
+       * order to find the next MCU and to maintain the DC predictors, but
+       * their coefficients are discarded rather than stored.
+       */
+      if (in_crop)
+        jzero_far((void *)coef->MCU_buffer[0],
+                  (size_t)(cinfo->blocks_in_MCU * sizeof(JBLOCK)));
       if (!cinfo->entropy->insufficient_data)
         cinfo->master->last_good_iMCU_row = cinfo->input_iMCU_row;
-      if (!(*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
+      if (!(*cinfo->entropy->decode_mcu) (cinfo,
+                                          in_crop ? coef->MCU_buffer : NULL)) {
         /* Suspension forced; update state counters and exit */
         coef->MCU_vert_offset = yoffset;
         coef->MCU_ctr = MCU_col_num;
@@ -114,8 +123,7 @@ decompress_onepass(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       /* Only perform the IDCT on blocks that are contained within the desired
        * cropping region.
        */
-      if (MCU_col_num >= cinfo->master->first_iMCU_col &&
-          MCU_col_num <= cinfo->master->last_iMCU_col) {
+      if (in_crop) {
         /* Determine where data should go in output_buf and do the IDCT thing.
          * We skip dummy blocks at the right and bottom edges (but blkn gets
          * incremented past them!).  Note the inner loop relies on having
@@ -130,6 +138,8 @@ decompress_onepass(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             continue;
           }
           inverse_DCT = cinfo->idct->inverse_DCT[compptr->component_index];
+          inverse_DCT_pair =
+            cinfo->idct->inverse_DCT_pair[compptr->component_index];
           useful_width = (MCU_col_num < last_MCU_col) ?
                          compptr->MCU_width : compptr->last_col_width;
           output_ptr = output_buf[compptr->component_index] +
@@ -140,7 +150,16 @@ decompress_onepass(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
             if (cinfo->input_iMCU_row < last_iMCU_row ||
                 yoffset + yindex < compptr->last_row_height) {
               output_col = start_col;
-              for (xindex = 0; xindex < useful_width; xindex++) {
+              xindex = 0;
+              if (inverse_DCT_pair != NULL) {
+                for (; xindex + 1 < useful_width; xindex += 2) {
+                  (*inverse_DCT_pair)
+                    (cinfo, compptr, (JCOEFPTR)coef->MCU_buffer[blkn + xindex],
+                     output_ptr, output_col);
+                  output_col += 2 * compptr->_DCT_scaled_size;
+                }
+              }
+              for (; xindex < useful_width; xindex++) {
                 (*inverse_DCT) (cinfo, compptr,
                                 (JCOEFPTR)coef->MCU_buffer[blkn + xindex],
                                 output_ptr, output_col);
@@ -273,7 +292,7 @@ decompress_data(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JSAMPARRAY output_ptr;
   JDIMENSION output_col;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
+  inverse_DCT_method_ptr inverse_DCT, inverse_DCT_pair;
 
   /* Force some input to be done if we are getting ahead of the input. */
   while (cinfo->input_scan_number < cinfo->output_scan_number ||
@@ -303,13 +322,22 @@ decompress_data(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       if (block_rows == 0) block_rows = compptr->v_samp_factor;
     }
     inverse_DCT = cinfo->idct->inverse_DCT[ci];
+    inverse_DCT_pair = cinfo->idct->inverse_DCT_pair[ci];
     output_ptr = output_buf[ci];
     /* Loop over all DCT blocks to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
       buffer_ptr = buffer[block_row] + cinfo->master->first_MCU_col[ci];
       output_col = 0;
-      for (block_num = cinfo->master->first_MCU_col[ci];
-           block_num <= cinfo->master->last_MCU_col[ci]; block_num++) {
+      block_num = cinfo->master->first_MCU_col[ci];
+      if (inverse_DCT_pair != NULL) {
+        for (; block_num < cinfo->master->last_MCU_col[ci]; block_num += 2) {
+          (*inverse_DCT_pair) (cinfo, compptr, (JCOEFPTR)buffer_ptr,
+                               output_ptr, output_col);
+          buffer_ptr += 2;
+          output_col += 2 * compptr->_DCT_scaled_size;
+        }
+      }
+      for (; block_num <= cinfo->master->last_MCU_col[ci]; block_num++) {
         (*inverse_DCT) (cinfo, compptr, (JCOEFPTR)buffer_ptr, output_ptr,
                         output_col);
         buffer_ptr++;
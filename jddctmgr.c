@@ -101,10 +101,12 @@ start_pass(j_decompress_ptr cinfo)
   jpeg_component_info *compptr;
   int method = 0;
   inverse_DCT_method_ptr method_ptr = NULL;
+  inverse_DCT_method_ptr pair_method_ptr;
   JQUANT_TBL *qtbl;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
+    pair_method_ptr = NULL;
     /* Select the proper IDCT routine for this component's scaling */
     switch (compptr->_DCT_scaled_size) {
 #ifdef IDCT_SCALING_SUPPORTED
@@ -156,6 +158,8 @@ start_pass(j_decompress_ptr cinfo)
           method_ptr = jsimd_idct_islow;
         else
           method_ptr = jpeg_idct_islow;
+        if (jsimd_can_idct_islow_pair())
+          pair_method_ptr = jsimd_idct_islow_pair;
         method = JDCT_ISLOW;
         break;
 #endif
@@ -226,6 +230,7 @@ start_pass(j_decompress_ptr cinfo)
       break;
     }
     idct->pub.inverse_DCT[ci] = method_ptr;
+    idct->pub.inverse_DCT_pair[ci] = pair_method_ptr;
     /* Create multiplier table from quant table.
      * However, we can skip this if the component is uninteresting
      * or if we already built the table.  Also, if no quant table
@@ -68,6 +68,20 @@ typedef struct {
 
 typedef huff_entropy_decoder *huff_entropy_ptr;
 
+/* Derived tables are retained across images, along with copies of the Huffman
+ * tables from which they were built, so that they need not be rebuilt unless
+ * the Huffman tables change.  (Many JPEG images use the same Huffman tables,
+ * and an image typically uses the same table for both chrominance
+ * components.)  The first index is 1 for DC tables and 0 for AC tables.
+ */
+
+struct jpeg_d_huff_cache {
+  d_derived_tbl derived_tbls[2][NUM_HUFF_TBLS];
+  UINT8 bits[2][NUM_HUFF_TBLS][17];
+  UINT8 huffval[2][NUM_HUFF_TBLS][256];
+  boolean valid[2][NUM_HUFF_TBLS];
+};
+
 
 /*
  * Initialize for a Huffman-compressed scan.
@@ -143,7 +157,8 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
 {
   JHUFF_TBL *htbl;
   d_derived_tbl *dtbl;
-  int p, i, l, si, numsymbols;
+  struct jpeg_d_huff_cache *cache = cinfo->master->huff_cache;
+  int p, i, l, si, numsymbols, dc = isDC ? 1 : 0;
   int lookbits, ctr;
   char huffsize[257];
   unsigned int huffcode[257];
@@ -167,6 +182,23 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
       (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
                                   sizeof(d_derived_tbl));
   dtbl = *pdtbl;
+
+  /* Reuse the derived table from a previous scan or image if possible */
+  if (cache == NULL) {
+    cache = cinfo->master->huff_cache = (struct jpeg_d_huff_cache *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(struct jpeg_d_huff_cache));
+    MEMZERO(cache, sizeof(struct jpeg_d_huff_cache));
+  }
+  if (cache->valid[dc][tblno] &&
+      !MEMCMP(cache->bits[dc][tblno], htbl->bits, sizeof(htbl->bits)) &&
+      !MEMCMP(cache->huffval[dc][tblno], htbl->huffval,
+              sizeof(htbl->huffval))) {
+    MEMCOPY(dtbl, &cache->derived_tbls[dc][tblno], sizeof(d_derived_tbl));
+    dtbl->pub = htbl;
+    return;
+  }
+
   dtbl->pub = htbl;             /* fill in back link */
 
   /* Figure C.1: make table of Huffman code length for each symbol */
@@ -243,6 +275,27 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
     }
   }
 
+  /* Compute the skip table for AC tables.  Each entry combines the length of
+   * the Huffman code with the number of magnitude bits that follow it, so
+   * that an unneeded coefficient can be discarded with a single DROP_BITS().
+   */
+
+  for (i = 0; i < (1 << HUFF_LOOKAHEAD); i++) {
+    int nb = dtbl->lookup[i] >> HUFF_LOOKAHEAD;
+    int sym = dtbl->lookup[i] & ((1 << HUFF_LOOKAHEAD) - 1);
+    int r = sym >> 4, s = sym & 15;
+
+    dtbl->skip[i] = 0;
+    if (isDC || nb > HUFF_LOOKAHEAD || nb + s > HUFF_SKIP_MAXBITS)
+      continue;
+    if (s)
+      dtbl->skip[i] = ((r + 1) << 8) | (nb + s);
+    else if (r == 15)
+      dtbl->skip[i] = (16 << 8) | nb;
+    else
+      dtbl->skip[i] = (DCTSIZE2 << 8) | nb;
+  }
+
   /* Validate symbols as being reasonable.
    * For AC tables, we make no check, but accept all byte values 0..255.
    * For DC tables, we require the symbols to be in range 0..15.
@@ -256,6 +309,11 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
         ERREXIT(cinfo, JERR_BAD_HUFF_TABLE);
     }
   }
+
+  MEMCOPY(&cache->derived_tbls[dc][tblno], dtbl, sizeof(d_derived_tbl));
+  MEMCOPY(cache->bits[dc][tblno], htbl->bits, sizeof(htbl->bits));
+  MEMCOPY(cache->huffval[dc][tblno], htbl->huffval, sizeof(htbl->huffval));
+  cache->valid[dc][tblno] = TRUE;
 }
 
 
@@ -382,49 +440,6 @@ no_more_bytes:
 }
 
 
-/* Macro version of the above, which performs much better but does not
-   handle markers.  We have to hand off any blocks with markers to the
-   slower routines. */
-
-#define GET_BYTE { \
-  register int c0, c1; \
-  c0 = *buffer++; \
-  c1 = *buffer; \
-  /* Pre-execute most common case */ \
-  get_buffer = (get_buffer << 8) | c0; \
-  bits_left += 8; \
-  if (c0 == 0xFF) { \
-    /* Pre-execute case of FF/00, which represents an FF data byte */ \
-    buffer++; \
-    if (c1 != 0) { \
-      /* Oops, it's actually a marker indicating end of compressed data. */ \
-      cinfo->unread_marker = c1; \
-      /* Back out pre-execution and fill the buffer with zero bits */ \
-      buffer -= 2; \
-      get_buffer &= ~0xFF; \
-    } \
-  } \
-}
-
-#if SIZEOF_SIZE_T == 8 || defined(_WIN64) || (defined(__x86_64__) && defined(__ILP32__))
-
-/* Pre-fetch 48 bytes, because the holding register is 64-bit */
-#define FILL_BIT_BUFFER_FAST \
-  if (bits_left <= 16) { \
-    GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE \
-  }
-
-#else
-
-/* Pre-fetch 16 bytes, because the holding register is 32-bit */
-#define FILL_BIT_BUFFER_FAST \
-  if (bits_left <= 16) { \
-    GET_BYTE GET_BYTE \
-  }
-
-#endif
-
-
 /*
  * Out-of-line code for Huffman code decoding.
  * See jdhuff.h for info about usage.
@@ -614,8 +629,17 @@ decode_mcu_slow(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     } else {
 
       /* Section F.2.2.2: decode the AC coefficients */
-      /* In this path we just discard the values */
+      /* In this path we just discard the values, using the skip table
+       * whenever the bit buffer already holds enough bits to do so.
+       */
       for (k = 1; k < DCTSIZE2; k++) {
+        if (bits_left >= HUFF_SKIP_MAXBITS &&
+            (s = actbl->skip[PEEK_BITS(HUFF_LOOKAHEAD)]) != 0) {
+          DROP_BITS(s & 0xFF);
+          k += (s >> 8) - 1;
+          continue;
+        }
+
         HUFF_DECODE(s, br_state, actbl, return FALSE, label3);
 
         r = s >> 4;
@@ -699,6 +723,14 @@ decode_mcu_fast(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     } else {
 
       for (k = 1; k < DCTSIZE2; k++) {
+        FILL_BIT_BUFFER_FAST
+        s = actbl->skip[PEEK_BITS(HUFF_LOOKAHEAD)];
+        if (s) {
+          DROP_BITS(s & 0xFF);
+          k += (s >> 8) - 1;
+          continue;
+        }
+
         HUFF_DECODE_FAST(s, l, actbl);
         r = s >> 4;
         s &= 15;
@@ -45,8 +45,23 @@ typedef struct {
    * symbol.
    */
   int lookup[1 << HUFF_LOOKAHEAD];
+
+  /* Skip table (AC tables only): indexed like lookup[].  This is used to
+   * discard AC coefficients that will never be used (for instance, when
+   * producing a 1/8-scaled image) without decoding them.  If the next
+   * Huffman code and the magnitude bits that follow it are no more than
+   * HUFF_SKIP_MAXBITS bits long in total, then the lower 8 bits of the
+   * corresponding entry contain that total, and the next 8 bits contain the
+   * number of coefficient positions to advance (DCTSIZE2 for EOB.)
+   * Otherwise, the entry is 0, and the code must be decoded the usual way.
+   */
+  int skip[1 << HUFF_LOOKAHEAD];
 } d_derived_tbl;
 
+/* The bit buffer is guaranteed to hold at least this many bits after
+   FILL_BIT_BUFFER_FAST */
+#define HUFF_SKIP_MAXBITS  16
+
 /* Expand a Huffman table definition into the derived format */
 EXTERN(void) jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC,
                                      int tblno, d_derived_tbl **pdtbl);
@@ -177,6 +192,50 @@ EXTERN(boolean) jpeg_fill_bit_buffer(bitread_working_state *state,
                                      register int bits_left, int nbits);
 
 
+/* Macro version of jpeg_fill_bit_buffer(), which performs much better but
+   does not handle markers.  We have to hand off any blocks with markers to the
+   slower routines.  The caller must declare a local JOCTET *buffer that
+   points to the next input byte. */
+
+#define GET_BYTE { \
+  register int c0, c1; \
+  c0 = *buffer++; \
+  c1 = *buffer; \
+  /* Pre-execute most common case */ \
+  get_buffer = (get_buffer << 8) | c0; \
+  bits_left += 8; \
+  if (c0 == 0xFF) { \
+    /* Pre-execute case of FF/00, which represents an FF data byte */ \
+    buffer++; \
+    if (c1 != 0) { \
+      /* Oops, it's actually a marker indicating end of compressed data. */ \
+      cinfo->unread_marker = c1; \
+      /* Back out pre-execution and fill the buffer with zero bits */ \
+      buffer -= 2; \
+      get_buffer &= ~0xFF; \
+    } \
+  } \
+}
+
+#if SIZEOF_SIZE_T == 8 || defined(_WIN64) || (defined(__x86_64__) && defined(__ILP32__))
+
+/* Pre-fetch 48 bytes, because the holding register is 64-bit */
+#define FILL_BIT_BUFFER_FAST \
+  if (bits_left <= 16) { \
+    GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE \
+  }
+
+#else
+
+/* Pre-fetch 16 bytes, because the holding register is 32-bit */
+#define FILL_BIT_BUFFER_FAST \
+  if (bits_left <= 16) { \
+    GET_BYTE GET_BYTE \
+  }
+
+#endif
+
+
 /*
  * Code for extracting next Huffman-coded symbol from input bit stream.
  * Again, this is time-critical and we make the main paths be macros.
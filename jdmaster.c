@@ -56,14 +56,27 @@ use_merged_upsample(j_decompress_ptr cinfo)
       (cinfo->out_color_space != JCS_RGB565 &&
        cinfo->out_color_components != rgb_pixelsize[cinfo->out_color_space]))
     return FALSE;
-  /* and it only handles 2h1v or 2h2v sampling ratios */
-  if (cinfo->comp_info[0].h_samp_factor != 2 ||
-      cinfo->comp_info[1].h_samp_factor != 1 ||
+  /* and it only handles 2h1v, 2h2v, 1h2v, or 4h1v sampling ratios */
+  if (cinfo->comp_info[1].h_samp_factor != 1 ||
       cinfo->comp_info[2].h_samp_factor != 1 ||
-      cinfo->comp_info[0].v_samp_factor >  2 ||
       cinfo->comp_info[1].v_samp_factor != 1 ||
       cinfo->comp_info[2].v_samp_factor != 1)
     return FALSE;
+  if (cinfo->comp_info[0].h_samp_factor == 2) {
+    if (cinfo->comp_info[0].v_samp_factor > 2)
+      return FALSE;
+  } else if (cinfo->comp_info[0].h_samp_factor == 1) {
+    if (cinfo->comp_info[0].v_samp_factor != 2)
+      return FALSE;
+  } else if (cinfo->comp_info[0].h_samp_factor == 4) {
+    if (cinfo->comp_info[0].v_samp_factor != 1)
+      return FALSE;
+  } else
+    return FALSE;
+  /* RGB565 output is supported only for 2h1v and 2h2v */
+  if (cinfo->out_color_space == JCS_RGB565 &&
+      cinfo->comp_info[0].h_samp_factor != 2)
+    return FALSE;
   /* furthermore, it doesn't work if we've scaled the IDCTs differently */
   if (cinfo->comp_info[0]._DCT_scaled_size != cinfo->_min_DCT_scaled_size ||
       cinfo->comp_info[1]._DCT_scaled_size != cinfo->_min_DCT_scaled_size ||
@@ -29,7 +29,8 @@
  *
  * This file currently provides implementations for the following cases:
  *      YCbCr => RGB color conversion only.
- *      Sampling ratios of 2h1v or 2h2v.
+ *      Sampling ratios of 2h1v, 2h2v, 1h2v, or 4h1v (RGB565 output is
+ *      supported only for 2h1v and 2h2v.)
  *      No scaling needed at upsample time.
  *      Corner-aligned (non-CCIR601) sampling alignment.
  * Other special cases could be added, but in most applications these are
@@ -66,6 +67,8 @@
 #define RGB_PIXELSIZE  EXT_RGB_PIXELSIZE
 #define h2v1_merged_upsample_internal  extrgb_h2v1_merged_upsample_internal
 #define h2v2_merged_upsample_internal  extrgb_h2v2_merged_upsample_internal
+#define h1v2_merged_upsample_internal  extrgb_h1v2_merged_upsample_internal
+#define h4v1_merged_upsample_internal  extrgb_h4v1_merged_upsample_internal
 #include "jdmrgext.c"
 #undef RGB_RED
 #undef RGB_GREEN
@@ -73,6 +76,8 @@
 #undef RGB_PIXELSIZE
 #undef h2v1_merged_upsample_internal
 #undef h2v2_merged_upsample_internal
+#undef h1v2_merged_upsample_internal
+#undef h4v1_merged_upsample_internal
 
 #define RGB_RED  EXT_RGBX_RED
 #define RGB_GREEN  EXT_RGBX_GREEN
@@ -81,6 +86,8 @@
 #define RGB_PIXELSIZE  EXT_RGBX_PIXELSIZE
 #define h2v1_merged_upsample_internal  extrgbx_h2v1_merged_upsample_internal
 #define h2v2_merged_upsample_internal  extrgbx_h2v2_merged_upsample_internal
+#define h1v2_merged_upsample_internal  extrgbx_h1v2_merged_upsample_internal
+#define h4v1_merged_upsample_internal  extrgbx_h4v1_merged_upsample_internal
 #include "jdmrgext.c"
 #undef RGB_RED
 #undef RGB_GREEN
@@ -89,6 +96,8 @@
 #undef RGB_PIXELSIZE
 #undef h2v1_merged_upsample_internal
 #undef h2v2_merged_upsample_internal
+#undef h1v2_merged_upsample_internal
+#undef h4v1_merged_upsample_internal
 
 #define RGB_RED  EXT_BGR_RED
 #define RGB_GREEN  EXT_BGR_GREEN
@@ -96,6 +105,8 @@
 #define RGB_PIXELSIZE  EXT_BGR_PIXELSIZE
 #define h2v1_merged_upsample_internal  extbgr_h2v1_merged_upsample_internal
 #define h2v2_merged_upsample_internal  extbgr_h2v2_merged_upsample_internal
+#define h1v2_merged_upsample_internal  extbgr_h1v2_merged_upsample_internal
+#define h4v1_merged_upsample_internal  extbgr_h4v1_merged_upsample_internal
 #include "jdmrgext.c"
 #undef RGB_RED
 #undef RGB_GREEN
@@ -103,6 +114,8 @@
 #undef RGB_PIXELSIZE
 #undef h2v1_merged_upsample_internal
 #undef h2v2_merged_upsample_internal
+#undef h1v2_merged_upsample_internal
+#undef h4v1_merged_upsample_internal
 
 #define RGB_RED  EXT_BGRX_RED
 #define RGB_GREEN  EXT_BGRX_GREEN
@@ -111,6 +124,8 @@
 #define RGB_PIXELSIZE  EXT_BGRX_PIXELSIZE
 #define h2v1_merged_upsample_internal  extbgrx_h2v1_merged_upsample_internal
 #define h2v2_merged_upsample_internal  extbgrx_h2v2_merged_upsample_internal
+#define h1v2_merged_upsample_internal  extbgrx_h1v2_merged_upsample_internal
+#define h4v1_merged_upsample_internal  extbgrx_h4v1_merged_upsample_internal
 #include "jdmrgext.c"
 #undef RGB_RED
 #undef RGB_GREEN
@@ -119,6 +134,8 @@
 #undef RGB_PIXELSIZE
 #undef h2v1_merged_upsample_internal
 #undef h2v2_merged_upsample_internal
+#undef h1v2_merged_upsample_internal
+#undef h4v1_merged_upsample_internal
 
 #define RGB_RED  EXT_XBGR_RED
 #define RGB_GREEN  EXT_XBGR_GREEN
@@ -127,6 +144,8 @@
 #define RGB_PIXELSIZE  EXT_XBGR_PIXELSIZE
 #define h2v1_merged_upsample_internal  extxbgr_h2v1_merged_upsample_internal
 #define h2v2_merged_upsample_internal  extxbgr_h2v2_merged_upsample_internal
+#define h1v2_merged_upsample_internal  extxbgr_h1v2_merged_upsample_internal
+#define h4v1_merged_upsample_internal  extxbgr_h4v1_merged_upsample_internal
 #include "jdmrgext.c"
 #undef RGB_RED
 #undef RGB_GREEN
@@ -135,6 +154,8 @@
 #undef RGB_PIXELSIZE
 #undef h2v1_merged_upsample_internal
 #undef h2v2_merged_upsample_internal
+#undef h1v2_merged_upsample_internal
+#undef h4v1_merged_upsample_internal
 
 #define RGB_RED  EXT_XRGB_RED
 #define RGB_GREEN  EXT_XRGB_GREEN
@@ -143,6 +164,8 @@
 #define RGB_PIXELSIZE  EXT_XRGB_PIXELSIZE
 #define h2v1_merged_upsample_internal  extxrgb_h2v1_merged_upsample_internal
 #define h2v2_merged_upsample_internal  extxrgb_h2v2_merged_upsample_internal
+#define h1v2_merged_upsample_internal  extxrgb_h1v2_merged_upsample_internal
+#define h4v1_merged_upsample_internal  extxrgb_h4v1_merged_upsample_internal
 #include "jdmrgext.c"
 #undef RGB_RED
 #undef RGB_GREEN
@@ -151,6 +174,8 @@
 #undef RGB_PIXELSIZE
 #undef h2v1_merged_upsample_internal
 #undef h2v2_merged_upsample_internal
+#undef h1v2_merged_upsample_internal
+#undef h4v1_merged_upsample_internal
 
 
 /*
@@ -388,6 +413,96 @@ h2v2_merged_upsample(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
 }
 
 
+/*
+ * Upsample and color convert for the case of 1:1 horizontal and 2:1 vertical.
+ */
+
+METHODDEF(void)
+h1v2_merged_upsample(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+                     JDIMENSION in_row_group_ctr, JSAMPARRAY output_buf)
+{
+  switch (cinfo->out_color_space) {
+  case JCS_EXT_RGB:
+    extrgb_h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                         output_buf);
+    break;
+  case JCS_EXT_RGBX:
+  case JCS_EXT_RGBA:
+    extrgbx_h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  case JCS_EXT_BGR:
+    extbgr_h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                         output_buf);
+    break;
+  case JCS_EXT_BGRX:
+  case JCS_EXT_BGRA:
+    extbgrx_h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  case JCS_EXT_XBGR:
+  case JCS_EXT_ABGR:
+    extxbgr_h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  case JCS_EXT_XRGB:
+  case JCS_EXT_ARGB:
+    extxrgb_h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  default:
+    h1v2_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                  output_buf);
+    break;
+  }
+}
+
+
+/*
+ * Upsample and color convert for the case of 4:1 horizontal and 1:1 vertical.
+ */
+
+METHODDEF(void)
+h4v1_merged_upsample(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+                     JDIMENSION in_row_group_ctr, JSAMPARRAY output_buf)
+{
+  switch (cinfo->out_color_space) {
+  case JCS_EXT_RGB:
+    extrgb_h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                         output_buf);
+    break;
+  case JCS_EXT_RGBX:
+  case JCS_EXT_RGBA:
+    extrgbx_h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  case JCS_EXT_BGR:
+    extbgr_h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                         output_buf);
+    break;
+  case JCS_EXT_BGRX:
+  case JCS_EXT_BGRA:
+    extbgrx_h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  case JCS_EXT_XBGR:
+  case JCS_EXT_ABGR:
+    extxbgr_h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  case JCS_EXT_XRGB:
+  case JCS_EXT_ARGB:
+    extxrgb_h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                          output_buf);
+    break;
+  default:
+    h4v1_merged_upsample_internal(cinfo, input_buf, in_row_group_ctr,
+                                  output_buf);
+    break;
+  }
+}
+
+
 /*
  * RGB565 conversion
  */
@@ -550,7 +665,9 @@ jinit_merged_upsampler(j_decompress_ptr cinfo)
 
   if (cinfo->max_v_samp_factor == 2) {
     upsample->pub.upsample = merged_2v_upsample;
-    if (jsimd_can_h2v2_merged_upsample())
+    if (cinfo->max_h_samp_factor == 1)
+      upsample->upmethod = h1v2_merged_upsample;
+    else if (jsimd_can_h2v2_merged_upsample())
       upsample->upmethod = jsimd_h2v2_merged_upsample;
     else
       upsample->upmethod = h2v2_merged_upsample;
@@ -567,7 +684,9 @@ jinit_merged_upsampler(j_decompress_ptr cinfo)
                 (size_t)(upsample->out_row_width * sizeof(JSAMPLE)));
   } else {
     upsample->pub.upsample = merged_1v_upsample;
-    if (jsimd_can_h2v1_merged_upsample())
+    if (cinfo->max_h_samp_factor == 4)
+      upsample->upmethod = h4v1_merged_upsample;
+    else if (jsimd_can_h2v1_merged_upsample())
       upsample->upmethod = jsimd_h2v1_merged_upsample;
     else
       upsample->upmethod = h2v1_merged_upsample;
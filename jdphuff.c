@@ -24,6 +24,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdhuff.h"             /* Declarations shared with jdhuff.c */
+#include "jpegcomp.h"
 #include <limits.h>
 
 
@@ -57,6 +58,10 @@ typedef struct {
   d_derived_tbl *derived_tbls[NUM_HUFF_TBLS];
 
   d_derived_tbl *ac_derived_tbl; /* active table during an AC scan */
+
+  /* State of skip_mcu_AC() */
+  boolean skip_done;            /* TRUE if end of scan has been found */
+  boolean skip_saw_FF;          /* TRUE if last byte examined was 0xFF */
 } phuff_entropy_decoder;
 
 typedef phuff_entropy_decoder *phuff_entropy_ptr;
@@ -70,6 +75,7 @@ METHODDEF(boolean) decode_mcu_DC_refine(j_decompress_ptr cinfo,
                                         JBLOCKROW *MCU_data);
 METHODDEF(boolean) decode_mcu_AC_refine(j_decompress_ptr cinfo,
                                         JBLOCKROW *MCU_data);
+METHODDEF(boolean) skip_mcu_AC(j_decompress_ptr cinfo, JBLOCKROW *MCU_data);
 
 
 /*
@@ -154,6 +160,19 @@ start_pass_phuff_decoder(j_decompress_ptr cinfo)
       entropy->pub.decode_mcu = decode_mcu_AC_refine;
   }
 
+  /* If we don't need the AC coefficients of the (single) component in this
+   * AC scan, because the component isn't needed or because we are producing
+   * a 1/8-scaled image, then skip the scan without decoding it.  This is
+   * only safe if the coefficients can never be requested later, so it is not
+   * done in buffered-image mode (which includes transcoding.)
+   */
+  if (!is_DC_band && !cinfo->buffered_image) {
+    compptr = cinfo->cur_comp_info[0];
+    if (!compptr->component_needed || compptr->_DCT_scaled_size == 1)
+      entropy->pub.decode_mcu = skip_mcu_AC;
+  }
+  entropy->skip_done = entropy->skip_saw_FF = FALSE;
+
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
     /* Make sure requested tables are present, and compute derived tables.
@@ -201,6 +220,12 @@ start_pass_phuff_decoder(j_decompress_ptr cinfo)
 #define HUFF_EXTEND(x, s) \
   ((x) < (1 << ((s) - 1)) ? (x) + (((NEG_1) << (s)) + 1) : (x))
 
+/* Branchless version (from jdhuff.c) used in the fast path.  Unlike
+   HUFF_EXTEND(), it does not mix signed and unsigned operands in a ?:
+   expression. */
+#define HUFF_EXTEND_FAST(x, s) \
+  ((x) + ((((x) - (1 << ((s) - 1))) >> 31) & (((NEG_1) << (s)) + 1)))
+
 #else
 
 #define HUFF_EXTEND(x, s) \
@@ -218,6 +243,8 @@ static const int extend_offset[16] = { /* entry n is (-1 << n) + 1 */
   ((-1) << 13) + 1, ((-1) << 14) + 1, ((-1) << 15) + 1
 };
 
+#define HUFF_EXTEND_FAST(x, s)  HUFF_EXTEND(x, s)
+
 #endif /* AVOID_TABLES */
 
 
@@ -354,6 +381,71 @@ decode_mcu_DC_first(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Fast paths for decode_mcu_AC_first() and decode_mcu_AC_refine().  These
+ * decode a block using HUFF_DECODE_FAST, which requires that the source buffer
+ * contain at least BUFSIZE bytes.  Returns FALSE if a marker was encountered,
+ * in which case no changes have been made to permanent state, no warnings
+ * have been issued, and the caller must decode the block using the slow path.
+ */
+
+#define BUFSIZE  (DCTSIZE2 * 8)
+
+LOCAL(boolean)
+decode_AC_first_fast(j_decompress_ptr cinfo, JBLOCKROW block,
+                     unsigned int *EOBRUNptr)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr)cinfo->entropy;
+  int Se = cinfo->Se;
+  int Al = cinfo->Al;
+  register int s, k, r, l;
+  unsigned int EOBRUN = 0;
+  BITREAD_STATE_VARS;
+  JOCTET *buffer;
+  d_derived_tbl *tbl = entropy->ac_derived_tbl;
+
+  BITREAD_LOAD_STATE(cinfo, entropy->bitstate);
+  buffer = (JOCTET *)br_state.next_input_byte;
+
+  for (k = cinfo->Ss; k <= Se; k++) {
+    HUFF_DECODE_FAST(s, l, tbl);
+    r = s >> 4;
+    s &= 15;
+    if (s) {
+      k += r;
+      FILL_BIT_BUFFER_FAST
+      r = GET_BITS(s);
+      s = HUFF_EXTEND_FAST(r, s);
+      (*block)[jpeg_natural_order[k]] = (JCOEF)LEFT_SHIFT(s, Al);
+    } else {
+      if (r == 15) {            /* ZRL */
+        k += 15;
+      } else {                  /* EOBr */
+        EOBRUN = 1 << r;
+        if (r) {
+          FILL_BIT_BUFFER_FAST
+          r = GET_BITS(r);
+          EOBRUN += r;
+        }
+        EOBRUN--;
+        break;
+      }
+    }
+  }
+
+  if (cinfo->unread_marker != 0) {
+    cinfo->unread_marker = 0;
+    return FALSE;
+  }
+
+  br_state.bytes_in_buffer -= (buffer - br_state.next_input_byte);
+  br_state.next_input_byte = buffer;
+  BITREAD_SAVE_STATE(cinfo, entropy->bitstate);
+  *EOBRUNptr = EOBRUN;
+  return TRUE;
+}
+
+
 /*
  * MCU decoding for AC initial scan (either spectral selection,
  * or first pass of successive approximation).
@@ -370,14 +462,19 @@ decode_mcu_AC_first(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   JBLOCKROW block;
   BITREAD_STATE_VARS;
   d_derived_tbl *tbl;
+  int usefast = 1;
 
   /* Process restart marker if needed; may have to suspend */
   if (cinfo->restart_interval) {
     if (entropy->restarts_to_go == 0)
       if (!process_restart(cinfo))
         return FALSE;
+    usefast = 0;
   }
 
+  if (cinfo->src->bytes_in_buffer < BUFSIZE || cinfo->unread_marker != 0)
+    usefast = 0;
+
   /* If we've run out of data, just leave the MCU set to zeroes.
    * This way, we return uniform gray for the remainder of the segment.
    */
@@ -392,7 +489,8 @@ decode_mcu_AC_first(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 
     if (EOBRUN > 0)             /* if it's a band of zeroes... */
       EOBRUN--;                 /* ...process it now (we do nothing) */
-    else {
+    else if (!usefast ||
+             !decode_AC_first_fast(cinfo, MCU_data[0], &EOBRUN)) {
       BITREAD_LOAD_STATE(cinfo, entropy->bitstate);
       block = MCU_data[0];
       tbl = entropy->ac_derived_tbl;
@@ -489,6 +587,153 @@ decode_mcu_DC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Fast path for decode_mcu_AC_refine() (see decode_AC_first_fast().)  Rather
+ * than testing each coefficient in the band as it is passed over, this
+ * builds a list of the coefficients that were already nonzero, so that the
+ * zero coefficients can be skipped in bulk and the correction bits for the
+ * nonzero coefficients can be fetched up to 16 at a time.  If a marker is
+ * encountered, then any newly nonzero coefficients are re-zeroed before
+ * returning.  Correction bits that were already appended are harmless, since
+ * each correction bit is only appended if the bit being coded is not already
+ * set.
+ */
+
+/* Append correction bits to the already-nonzero coefficients listed in
+ * nzk[first] .. nzk[last - 1].  A correction bit is 1 if the absolute value
+ * of the coefficient must be increased.
+ */
+#define APPEND_CORRECTIONS(first, last) { \
+  int i_ = (first); \
+  while (i_ < (last)) { \
+    int n_ = MIN((last) - i_, 16), bits_; \
+    FILL_BIT_BUFFER_FAST \
+    bits_ = GET_BITS(n_); \
+    while (n_-- > 0) { \
+      thiscoef = *block + jpeg_natural_order[nzk[i_++]]; \
+      if (((bits_ >> n_) & 1) && (*thiscoef & p1) == 0) \
+        *thiscoef += (*thiscoef >= 0) ? p1 : m1; \
+    } \
+  } \
+}
+
+LOCAL(boolean)
+decode_AC_refine_fast(j_decompress_ptr cinfo, JBLOCKROW block,
+                      unsigned int *EOBRUNptr)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr)cinfo->entropy;
+  int Se = cinfo->Se;
+  int p1 = 1 << cinfo->Al;        /* 1 in the bit position being coded */
+  int m1 = (NEG_1) << cinfo->Al;  /* -1 in the bit position being coded */
+  register int s, k, r, l;
+  unsigned int EOBRUN = *EOBRUNptr;
+  JCOEFPTR thiscoef;
+  BITREAD_STATE_VARS;
+  JOCTET *buffer;
+  d_derived_tbl *tbl = entropy->ac_derived_tbl;
+  int num_newnz = 0;
+  int newnz_pos[DCTSIZE2];
+  int nzk[DCTSIZE2];              /* zigzag indices of nonzero coefs */
+  int num_nz = 0, next_nz = 0;
+  int num_bad = 0;                /* number of corrupt coefficient sizes */
+
+  BITREAD_LOAD_STATE(cinfo, entropy->bitstate);
+  buffer = (JOCTET *)br_state.next_input_byte;
+
+  for (k = cinfo->Ss; k <= Se; k++) {
+    nzk[num_nz] = k;
+    num_nz += ((*block)[jpeg_natural_order[k]] != 0);
+  }
+
+  k = cinfo->Ss;
+
+  if (EOBRUN == 0) {
+    for (; k <= Se; k++) {
+      int first_nz = next_nz;
+
+      HUFF_DECODE_FAST(s, l, tbl);
+      r = s >> 4;
+      s &= 15;
+      if (s) {
+        if (s != 1)             /* size of new coef should always be 1 */
+          num_bad++;            /* warn later, if we keep this result */
+        FILL_BIT_BUFFER_FAST
+        if (GET_BITS(1))
+          s = p1;               /* newly nonzero coef is positive */
+        else
+          s = m1;               /* newly nonzero coef is negative */
+      } else {
+        if (r != 15) {
+          EOBRUN = 1 << r;      /* EOBr, run length is 2^r + appended bits */
+          if (r) {
+            FILL_BIT_BUFFER_FAST
+            r = GET_BITS(r);
+            EOBRUN += r;
+          }
+          break;                /* rest of block is handled by EOB logic */
+        }
+        /* note s = 0 for processing ZRL */
+      }
+      /* Advance over already-nonzero coefs and r still-zero coefs,
+       * appending correction bits to the nonzeroes.
+       */
+      for (;;) {
+        int gap = (next_nz < num_nz ? nzk[next_nz] : Se + 1) - k;
+
+        if (gap > r) {
+          k += r;               /* reached target zero coefficient */
+          break;
+        }
+        r -= gap;
+        k += gap;
+        if (next_nz >= num_nz)
+          break;                /* ran off the end of the band */
+        next_nz++;
+        k++;
+      }
+      APPEND_CORRECTIONS(first_nz, next_nz);
+      if (s) {
+        int pos = jpeg_natural_order[k];
+        /* Output newly nonzero coefficient */
+        (*block)[pos] = (JCOEF)s;
+        /* Remember its position in case we encounter a marker */
+        newnz_pos[num_newnz++] = pos;
+      }
+    }
+  }
+
+  if (EOBRUN > 0) {
+    /* Append a correction bit to each remaining already-nonzero
+     * coefficient.
+     */
+    APPEND_CORRECTIONS(next_nz, num_nz);
+    /* Count one block completed in EOB run */
+    EOBRUN--;
+  }
+
+  if (cinfo->unread_marker != 0) {
+    /* Re-zero any output coefficients that we made newly nonzero */
+    while (num_newnz > 0)
+      (*block)[newnz_pos[--num_newnz]] = 0;
+    cinfo->unread_marker = 0;
+    return FALSE;
+  }
+
+  br_state.bytes_in_buffer -= (buffer - br_state.next_input_byte);
+  br_state.next_input_byte = buffer;
+  BITREAD_SAVE_STATE(cinfo, entropy->bitstate);
+  *EOBRUNptr = EOBRUN;
+
+  /* The slow path would have issued one warning per corrupt coefficient size.
+   * Issuing them only now ensures that they are not issued twice if a marker
+   * forces the block to be decoded again by the slow path.
+   */
+  while (num_bad-- > 0)
+    WARNMS(cinfo, JWRN_HUFF_BAD_CODE);
+  return TRUE;
+}
+
+
 /*
  * MCU decoding for AC successive approximation refinement scan.
  */
@@ -508,21 +753,32 @@ decode_mcu_AC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   d_derived_tbl *tbl;
   int num_newnz;
   int newnz_pos[DCTSIZE2];
+  int usefast = 1;
 
   /* Process restart marker if needed; may have to suspend */
   if (cinfo->restart_interval) {
     if (entropy->restarts_to_go == 0)
       if (!process_restart(cinfo))
         return FALSE;
+    usefast = 0;
   }
 
+  if (cinfo->src->bytes_in_buffer < BUFSIZE || cinfo->unread_marker != 0)
+    usefast = 0;
+
   /* If we've run out of data, don't modify the MCU.
    */
   if (!entropy->pub.insufficient_data) {
 
+    EOBRUN = entropy->saved.EOBRUN; /* only part of saved state we need */
+    if (usefast && decode_AC_refine_fast(cinfo, MCU_data[0], &EOBRUN)) {
+      entropy->saved.EOBRUN = EOBRUN;
+      entropy->restarts_to_go--;
+      return TRUE;
+    }
+
     /* Load up working state */
     BITREAD_LOAD_STATE(cinfo, entropy->bitstate);
-    EOBRUN = entropy->saved.EOBRUN; /* only part of saved state we need */
 
     /* There is always only one block per MCU */
     block = MCU_data[0];
@@ -639,6 +895,59 @@ undoit:
 }
 
 
+/*
+ * MCU skipping routine for AC scans whose coefficients will never be used.
+ * Rather than decoding the scan, we search the entropy-coded data for the
+ * next marker that isn't a restart marker and leave it in unread_marker, just
+ * as jpeg_fill_bit_buffer() would have.  The first call for a scan does all
+ * of the work, and subsequent calls are no-ops.  The search state is kept in
+ * the entropy decoder object, so we can suspend at any point.
+ */
+
+METHODDEF(boolean)
+skip_mcu_AC(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr)cinfo->entropy;
+  struct jpeg_source_mgr *src = cinfo->src;
+  const JOCTET *ptr;
+  size_t nbytes;
+  int c;
+
+  while (!entropy->skip_done) {
+    if (src->bytes_in_buffer == 0) {
+      if (!(*src->fill_input_buffer) (cinfo))
+        return FALSE;
+      continue;
+    }
+    if (entropy->skip_saw_FF) {
+      c = *src->next_input_byte++;
+      src->bytes_in_buffer--;
+      if (c == 0xFF)            /* fill byte; keep looking */
+        continue;
+      entropy->skip_saw_FF = FALSE;
+      /* FF/00 is a stuffed data byte, and RSTn markers don't end the scan */
+      if (c != 0 && (c < JPEG_RST0 || c > JPEG_RST0 + 7)) {
+        cinfo->unread_marker = c;
+        entropy->skip_done = TRUE;
+      }
+      continue;
+    }
+    ptr = (const JOCTET *)memchr(src->next_input_byte, 0xFF,
+                                 src->bytes_in_buffer);
+    if (ptr == NULL)
+      nbytes = src->bytes_in_buffer;
+    else {
+      nbytes = (size_t)(ptr - src->next_input_byte) + 1;
+      entropy->skip_saw_FF = TRUE;
+    }
+    src->next_input_byte += nbytes;
+    src->bytes_in_buffer -= nbytes;
+  }
+
+  return TRUE;
+}
+
+
 /*
  * Module initialization routine for progressive Huffman entropy decoding.
  */
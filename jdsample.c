@@ -221,6 +221,37 @@ h2v1_upsample(j_decompress_ptr cinfo, jpeg_component_info *compptr,
 }
 
 
+/*
+ * Fast processing for the case of 4:1 horizontal and 1:1 vertical.
+ * This is a box filter; there is no fancy upsampling for this case.
+ */
+
+METHODDEF(void)
+h4v1_upsample(j_decompress_ptr cinfo, jpeg_component_info *compptr,
+              JSAMPARRAY input_data, JSAMPARRAY *output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  register JSAMPROW inptr, outptr;
+  register JSAMPLE invalue;
+  JSAMPROW outend;
+  int inrow;
+
+  for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
+    inptr = input_data[inrow];
+    outptr = output_data[inrow];
+    outend = outptr + cinfo->output_width;
+    while (outptr < outend) {
+      invalue = *inptr++;
+      outptr[0] = invalue;
+      outptr[1] = invalue;
+      outptr[2] = invalue;
+      outptr[3] = invalue;
+      outptr += 4;
+    }
+  }
+}
+
+
 /*
  * Fast processing for the common case of 2:1 horizontal and 2:1 vertical.
  * It's still a box filter.
@@ -500,6 +531,9 @@ jinit_upsampler(j_decompress_ptr cinfo)
         else
           upsample->methods[ci] = h2v2_upsample;
       }
+    } else if (h_in_group * 4 == h_out_group && v_in_group == v_out_group) {
+      /* Special case for 4h1v upsampling */
+      upsample->methods[ci] = h4v1_upsample;
     } else if ((h_out_group % h_in_group) == 0 &&
                (v_out_group % v_in_group) == 0) {
       /* Generic integral-factors upsampling method */
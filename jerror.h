@@ -211,6 +211,8 @@ JMESSAGE(JWRN_BOGUS_ICC, "Corrupt JPEG data: bad ICC marker")
 JMESSAGE(JERR_BAD_DROP_SAMPLING,
          "Component index %d: mismatching sampling ratio %d:%d, %d:%d, %c")
 #endif
+JMESSAGE(JERR_BAD_SRCDST_MGR,
+         "Data source/destination manager was created by a different function")
 
 #ifdef JMAKE_ENUM_LIST
 
@@ -101,6 +101,9 @@ round_up_pow2(size_t a, size_t b)
  * overhead within a pool, except for alignment padding.  Each pool has a
  * header with a link to the next pool of the same class.
  * Small and large pool headers are identical.
+ * Each pool also remembers the application-supplied allocator (if any) from
+ * which it was obtained, so that the application can safely install an
+ * allocator after the JPEG object has been created.
  */
 
 typedef struct small_pool_struct *small_pool_ptr;
@@ -109,6 +112,7 @@ typedef struct small_pool_struct {
   small_pool_ptr next;          /* next in list of pools */
   size_t bytes_used;            /* how many bytes already used within pool */
   size_t bytes_left;            /* bytes still available in this pool */
+  struct jpeg_allocator *allocator; /* allocator that provided pool, or NULL */
 } small_pool_hdr;
 
 typedef struct large_pool_struct *large_pool_ptr;
@@ -117,8 +121,14 @@ typedef struct large_pool_struct {
   large_pool_ptr next;          /* next in list of pools */
   size_t bytes_used;            /* how many bytes already used within pool */
   size_t bytes_left;            /* bytes still available in this pool */
+  struct jpeg_allocator *allocator; /* allocator that provided pool, or NULL */
 } large_pool_hdr;
 
+/* Total number of bytes obtained from the allocator for a pool */
+#define POOL_SPACE(hdr_ptr) \
+  ((hdr_ptr)->bytes_used + (hdr_ptr)->bytes_left + sizeof(*(hdr_ptr)) + \
+   ALIGN_SIZE - 1)
+
 /*
  * Here is the full definition of a memory manager object.
  */
@@ -130,6 +140,14 @@ typedef struct {
   small_pool_ptr small_list[JPOOL_NUMPOOLS];
   large_pool_ptr large_list[JPOOL_NUMPOOLS];
 
+  /* Pools retained by free_pool(JPOOL_IMAGE) for reuse by the next image.
+   * Pools that the next image does not reuse are released when it, in turn,
+   * is freed.
+   */
+  small_pool_ptr small_cache;
+  large_pool_ptr large_cache;
+  size_t cache_space;           /* total space held in the above lists */
+
   /* Since we only have one lifetime class of virtual arrays, only one
    * linked list is necessary (for each datatype).  Note that the virtual
    * array control blocks being linked together are actually stored somewhere
@@ -233,6 +251,128 @@ out_of_memory(j_common_ptr cinfo, int which)
 }
 
 
+/*
+ * Pool storage is obtained from the application-supplied allocator, if there
+ * is one, and from the system-dependent allocator otherwise.
+ */
+
+LOCAL(void *)
+get_pool_space(j_common_ptr cinfo, size_t sizeofobject, boolean large)
+{
+  struct jpeg_allocator *allocator = cinfo->mem->allocator;
+
+  if (allocator != NULL)
+    return (*allocator->alloc_mem) (cinfo, sizeofobject);
+  if (large)
+    return jpeg_get_large(cinfo, sizeofobject);
+  return jpeg_get_small(cinfo, sizeofobject);
+}
+
+LOCAL(void)
+free_pool_space(j_common_ptr cinfo, struct jpeg_allocator *allocator,
+                void *object, size_t sizeofobject, boolean large)
+{
+  if (allocator != NULL)
+    (*allocator->free_mem) (cinfo, object, sizeofobject);
+  else if (large)
+    jpeg_free_large(cinfo, object, sizeofobject);
+  else
+    jpeg_free_small(cinfo, object, sizeofobject);
+}
+
+
+/*
+ * Reuse of retained pools.
+ *
+ * Applications that process a stream of images using the same JPEG object
+ * can ask the memory manager to hang onto the IMAGE pools when an image is
+ * finished or aborted, rather than returning them to the system and
+ * reacquiring them for the next image.  Since consecutive images tend to have
+ * similar dimensions and parameters, the next image usually makes the same
+ * sequence of requests, so we look for the first retained small pool that can
+ * satisfy a request and for the best-fitting retained large pool that is no
+ * more than twice as large as the request.
+ */
+
+LOCAL(small_pool_ptr)
+reuse_small_pool(my_mem_ptr mem, size_t sizeofobject)
+{
+  small_pool_ptr hdr_ptr, prev_hdr_ptr = NULL;
+
+  for (hdr_ptr = mem->small_cache; hdr_ptr != NULL; hdr_ptr = hdr_ptr->next) {
+    if (hdr_ptr->bytes_used + hdr_ptr->bytes_left >= sizeofobject)
+      break;
+    prev_hdr_ptr = hdr_ptr;
+  }
+  if (hdr_ptr == NULL)
+    return NULL;
+
+  if (prev_hdr_ptr == NULL)
+    mem->small_cache = hdr_ptr->next;
+  else
+    prev_hdr_ptr->next = hdr_ptr->next;
+  mem->cache_space -= POOL_SPACE(hdr_ptr);
+  mem->total_space_allocated += POOL_SPACE(hdr_ptr);
+  hdr_ptr->bytes_left += hdr_ptr->bytes_used;
+  hdr_ptr->bytes_used = 0;
+  return hdr_ptr;
+}
+
+LOCAL(large_pool_ptr)
+reuse_large_pool(my_mem_ptr mem, size_t sizeofobject)
+{
+  large_pool_ptr hdr_ptr, prev_hdr_ptr = NULL;
+  large_pool_ptr best_ptr = NULL, prev_best_ptr = NULL;
+  size_t size, best_size = 0;
+
+  for (hdr_ptr = mem->large_cache; hdr_ptr != NULL; hdr_ptr = hdr_ptr->next) {
+    size = hdr_ptr->bytes_used + hdr_ptr->bytes_left;
+    if (size >= sizeofobject && size - sizeofobject <= sizeofobject &&
+        (best_ptr == NULL || size < best_size)) {
+      best_ptr = hdr_ptr;
+      prev_best_ptr = prev_hdr_ptr;
+      best_size = size;
+      if (size == sizeofobject)
+        break;
+    }
+    prev_hdr_ptr = hdr_ptr;
+  }
+  if (best_ptr == NULL)
+    return NULL;
+
+  if (prev_best_ptr == NULL)
+    mem->large_cache = best_ptr->next;
+  else
+    prev_best_ptr->next = best_ptr->next;
+  mem->cache_space -= POOL_SPACE(best_ptr);
+  mem->total_space_allocated += POOL_SPACE(best_ptr);
+  best_ptr->bytes_used = sizeofobject;
+  best_ptr->bytes_left = best_size - sizeofobject;
+  return best_ptr;
+}
+
+LOCAL(void)
+release_cache(j_common_ptr cinfo)
+/* Release any retained pools that were not reused */
+{
+  my_mem_ptr mem = (my_mem_ptr)cinfo->mem;
+  small_pool_ptr shdr_ptr;
+  large_pool_ptr lhdr_ptr;
+
+  while ((lhdr_ptr = mem->large_cache) != NULL) {
+    mem->large_cache = lhdr_ptr->next;
+    free_pool_space(cinfo, lhdr_ptr->allocator, (void *)lhdr_ptr,
+                    POOL_SPACE(lhdr_ptr), TRUE);
+  }
+  while ((shdr_ptr = mem->small_cache) != NULL) {
+    mem->small_cache = shdr_ptr->next;
+    free_pool_space(cinfo, shdr_ptr->allocator, (void *)shdr_ptr,
+                    POOL_SPACE(shdr_ptr), FALSE);
+  }
+  mem->cache_space = 0;
+}
+
+
 /*
  * Allocation of "small" objects.
  *
@@ -302,7 +442,15 @@ alloc_small(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
     hdr_ptr = hdr_ptr->next;
   }
 
-  /* Time to make a new pool? */
+  /* Time to make a new pool?  Try to reuse a retained pool first. */
+  if (hdr_ptr == NULL && pool_id == JPOOL_IMAGE &&
+      (hdr_ptr = reuse_small_pool(mem, sizeofobject)) != NULL) {
+    hdr_ptr->next = NULL;
+    if (prev_hdr_ptr == NULL)   /* first pool in class? */
+      mem->small_list[pool_id] = hdr_ptr;
+    else
+      prev_hdr_ptr->next = hdr_ptr;
+  }
   if (hdr_ptr == NULL) {
     /* min_request is what we need now, slop is what will be leftover */
     min_request = sizeof(small_pool_hdr) + sizeofobject + ALIGN_SIZE - 1;
@@ -315,7 +463,8 @@ alloc_small(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
       slop = (size_t)(MAX_ALLOC_CHUNK - min_request);
     /* Try to get space, if fail reduce slop and try again */
     for (;;) {
-      hdr_ptr = (small_pool_ptr)jpeg_get_small(cinfo, min_request + slop);
+      hdr_ptr = (small_pool_ptr)get_pool_space(cinfo, min_request + slop,
+                                               FALSE);
       if (hdr_ptr != NULL)
         break;
       slop /= 2;
@@ -327,6 +476,7 @@ alloc_small(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
     hdr_ptr->next = NULL;
     hdr_ptr->bytes_used = 0;
     hdr_ptr->bytes_left = sizeofobject + slop;
+    hdr_ptr->allocator = cinfo->mem->allocator;
     if (prev_hdr_ptr == NULL)   /* first pool in class? */
       mem->small_list[pool_id] = hdr_ptr;
     else
@@ -388,21 +538,29 @@ alloc_large(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id); /* safety check */
 
-  hdr_ptr = (large_pool_ptr)jpeg_get_large(cinfo, sizeofobject +
-                                           sizeof(large_pool_hdr) +
-                                           ALIGN_SIZE - 1);
-  if (hdr_ptr == NULL)
-    out_of_memory(cinfo, 4);    /* jpeg_get_large failed */
-  mem->total_space_allocated += sizeofobject + sizeof(large_pool_hdr) +
-                                ALIGN_SIZE - 1;
+  /* ...unless a retained pool is a good fit */
+  hdr_ptr = NULL;
+  if (pool_id == JPOOL_IMAGE)
+    hdr_ptr = reuse_large_pool(mem, sizeofobject);
+
+  if (hdr_ptr == NULL) {
+    hdr_ptr = (large_pool_ptr)get_pool_space(cinfo, sizeofobject +
+                                             sizeof(large_pool_hdr) +
+                                             ALIGN_SIZE - 1, TRUE);
+    if (hdr_ptr == NULL)
+      out_of_memory(cinfo, 4);  /* jpeg_get_large failed */
+    mem->total_space_allocated += sizeofobject + sizeof(large_pool_hdr) +
+                                  ALIGN_SIZE - 1;
+    /* We maintain space counts in each pool header for statistical purposes,
+     * even though they are not needed for allocation.
+     */
+    hdr_ptr->bytes_used = sizeofobject;
+    hdr_ptr->bytes_left = 0;
+    hdr_ptr->allocator = cinfo->mem->allocator;
+  }
 
-  /* Success, initialize the new pool header and add to list */
+  /* Success, add the pool to the list */
   hdr_ptr->next = mem->large_list[pool_id];
-  /* We maintain space counts in each pool header for statistical purposes,
-   * even though they are not needed for allocation.
-   */
-  hdr_ptr->bytes_used = sizeofobject;
-  hdr_ptr->bytes_left = 0;
   mem->large_list[pool_id] = hdr_ptr;
 
   data_ptr = (char *)hdr_ptr; /* point to first data byte in pool... */
@@ -991,9 +1149,10 @@ METHODDEF(void)
 free_pool(j_common_ptr cinfo, int pool_id)
 {
   my_mem_ptr mem = (my_mem_ptr)cinfo->mem;
-  small_pool_ptr shdr_ptr;
+  small_pool_ptr shdr_ptr, last_shdr_ptr = NULL;
   large_pool_ptr lhdr_ptr;
   size_t space_freed;
+  boolean retain = FALSE;
 
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id); /* safety check */
@@ -1022,6 +1181,15 @@ free_pool(j_common_ptr cinfo, int pool_id)
       }
     }
     mem->virt_barray_list = NULL;
+
+    /* Pools retained from the previous image that this image did not reuse
+     * are unlikely to be reused by the next image either.  (If the pool is
+     * already empty, then there was no image, so leave the cache alone.)
+     */
+    if (mem->small_list[pool_id] != NULL || mem->large_list[pool_id] != NULL) {
+      release_cache(cinfo);
+      retain = (mem->pub.max_memory_to_retain > 0);
+    }
   }
 
   /* Release large objects */
@@ -1030,11 +1198,16 @@ free_pool(j_common_ptr cinfo, int pool_id)
 
   while (lhdr_ptr != NULL) {
     large_pool_ptr next_lhdr_ptr = lhdr_ptr->next;
-    space_freed = lhdr_ptr->bytes_used +
-                  lhdr_ptr->bytes_left +
-                  sizeof(large_pool_hdr);
-    jpeg_free_large(cinfo, (void *)lhdr_ptr, space_freed);
+    space_freed = POOL_SPACE(lhdr_ptr);
     mem->total_space_allocated -= space_freed;
+    if (retain && mem->cache_space + space_freed <=
+                  (size_t)mem->pub.max_memory_to_retain) {
+      lhdr_ptr->next = mem->large_cache;
+      mem->large_cache = lhdr_ptr;
+      mem->cache_space += space_freed;
+    } else
+      free_pool_space(cinfo, lhdr_ptr->allocator, (void *)lhdr_ptr,
+                      space_freed, TRUE);
     lhdr_ptr = next_lhdr_ptr;
   }
 
@@ -1044,10 +1217,21 @@ free_pool(j_common_ptr cinfo, int pool_id)
 
   while (shdr_ptr != NULL) {
     small_pool_ptr next_shdr_ptr = shdr_ptr->next;
-    space_freed = shdr_ptr->bytes_used + shdr_ptr->bytes_left +
-                  sizeof(small_pool_hdr);
-    jpeg_free_small(cinfo, (void *)shdr_ptr, space_freed);
+    space_freed = POOL_SPACE(shdr_ptr);
     mem->total_space_allocated -= space_freed;
+    if (retain && mem->cache_space + space_freed <=
+                  (size_t)mem->pub.max_memory_to_retain) {
+      /* Keep the retained small pools in allocation order */
+      shdr_ptr->next = NULL;
+      if (last_shdr_ptr == NULL)
+        mem->small_cache = shdr_ptr;
+      else
+        last_shdr_ptr->next = shdr_ptr;
+      last_shdr_ptr = shdr_ptr;
+      mem->cache_space += space_freed;
+    } else
+      free_pool_space(cinfo, shdr_ptr->allocator, (void *)shdr_ptr,
+                      space_freed, FALSE);
     shdr_ptr = next_shdr_ptr;
   }
 }
@@ -1067,9 +1251,11 @@ self_destruct(j_common_ptr cinfo)
    * Releasing pools in reverse order might help avoid fragmentation
    * with some (brain-damaged) malloc libraries.
    */
+  cinfo->mem->max_memory_to_retain = 0;
   for (pool = JPOOL_NUMPOOLS - 1; pool >= JPOOL_PERMANENT; pool--) {
     free_pool(cinfo, pool);
   }
+  release_cache(cinfo);
 
   /* Release the memory manager control block too. */
   jpeg_free_small(cinfo, (void *)cinfo->mem, sizeof(my_memory_mgr));
@@ -1141,6 +1327,8 @@ jinit_memory_mgr(j_common_ptr cinfo)
 
   /* Initialize working state */
   mem->pub.max_memory_to_use = max_to_use;
+  mem->pub.max_memory_to_retain = 0;
+  mem->pub.allocator = NULL;
 
   for (pool = JPOOL_NUMPOOLS - 1; pool >= JPOOL_PERMANENT; pool--) {
     mem->small_list[pool] = NULL;
@@ -1148,6 +1336,9 @@ jinit_memory_mgr(j_common_ptr cinfo)
   }
   mem->virt_sarray_list = NULL;
   mem->virt_barray_list = NULL;
+  mem->small_cache = NULL;
+  mem->large_cache = NULL;
+  mem->cache_space = 0;
 
   mem->total_space_allocated = sizeof(my_memory_mgr);
 
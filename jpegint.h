@@ -67,6 +67,14 @@ struct jpeg_comp_master {
   /* State variables made visible to other modules */
   boolean call_pass_startup;    /* True if pass_startup must be called */
   boolean is_last_pass;         /* True during last pass */
+
+  /* Tables that are retained (in permanent storage) across images so that
+   * they need not be rebuilt for each image.  The master struct itself is
+   * allocated in permanent storage for this reason.
+   */
+  JLONG *rgb_ycc_tab;           /* RGB->YCC conversion table (jccolor.c) */
+  struct jpeg_fdct_cache *fdct_cache;   /* quant divisors (jcdctmgr.c) */
+  struct jpeg_huff_cache *huff_cache;   /* derived Huffman tbls (jchuff.c) */
 };
 
 /* Main buffer control (downsampled-data buffer) */
@@ -161,6 +169,11 @@ struct jpeg_decomp_master {
 
   /* Last iMCU row that was successfully decoded */
   JDIMENSION last_good_iMCU_row;
+
+  /* Derived Huffman tables that are retained (in permanent storage) across
+   * images so that they need not be rebuilt for each image (jdhuff.c)
+   */
+  struct jpeg_d_huff_cache *huff_cache;
 };
 
 /* Input control module */
@@ -243,6 +256,9 @@ struct jpeg_inverse_dct {
   void (*start_pass) (j_decompress_ptr cinfo);
   /* It is useful to allow each component to have a separate IDCT method. */
   inverse_DCT_method_ptr inverse_DCT[MAX_COMPONENTS];
+  /* Optional method that transforms two horizontally adjacent blocks in one
+   * call, writing 2 * DCTSIZE output columns (NULL if not available). */
+  inverse_DCT_method_ptr inverse_DCT_pair[MAX_COMPONENTS];
 };
 
 /* Upsampling (note that upsampler must also call color converter) */
@@ -342,6 +358,9 @@ EXTERN(void) jinit_2pass_quantizer(j_decompress_ptr cinfo);
 EXTERN(void) jinit_merged_upsampler(j_decompress_ptr cinfo);
 /* Memory manager initialization */
 EXTERN(void) jinit_memory_mgr(j_common_ptr cinfo);
+/* Memory-mapped file cleanup routines in jdatasrc.c and jdatadst.c */
+EXTERN(void) jrelease_mmap_src(j_decompress_ptr cinfo);
+EXTERN(void) jrelease_mmap_dest(j_compress_ptr cinfo);
 
 /* Utility routines in jutils.c */
 EXTERN(long) jdiv_round_up(long a, long b);
@@ -830,6 +830,17 @@ typedef struct jvirt_sarray_control *jvirt_sarray_ptr;
 typedef struct jvirt_barray_control *jvirt_barray_ptr;
 
 
+/* Application-supplied allocator for the memory manager's pools.
+ * alloc_mem must return NULL if unsuccessful.  free_mem is passed the same
+ * size that was passed to alloc_mem when the object was allocated.
+ */
+
+struct jpeg_allocator {
+  void *(*alloc_mem) (j_common_ptr cinfo, size_t sizeofobject);
+  void (*free_mem) (j_common_ptr cinfo, void *object, size_t sizeofobject);
+};
+
+
 struct jpeg_memory_mgr {
   /* Method pointers */
   void *(*alloc_small) (j_common_ptr cinfo, int pool_id, size_t sizeofobject);
@@ -868,6 +879,19 @@ struct jpeg_memory_mgr {
 
   /* Maximum allocation request accepted by alloc_large. */
   long max_alloc_chunk;
+
+  /* Maximum amount of JPOOL_IMAGE storage that is retained for reuse by the
+   * next image when the current image is finished or aborted.  (0 = return
+   * all storage to the system, which is the default.)  May be changed by
+   * outer application after creating the JPEG object.
+   */
+  long max_memory_to_retain;
+
+  /* If non-NULL, pool storage allocated from now on is obtained from this
+   * allocator rather than from the system.  (NULL by default.)  May be set by
+   * outer application after creating the JPEG object.
+   */
+  struct jpeg_allocator *allocator;
 };
 
 
@@ -916,6 +940,11 @@ EXTERN(void) jpeg_destroy_decompress(j_decompress_ptr cinfo);
 EXTERN(void) jpeg_stdio_dest(j_compress_ptr cinfo, FILE *outfile);
 EXTERN(void) jpeg_stdio_src(j_decompress_ptr cinfo, FILE *infile);
 
+/* Data source and destination managers: memory-mapped files. */
+/* These fall back to stdio streams if the file cannot be mapped. */
+EXTERN(void) jpeg_mmap_dest(j_compress_ptr cinfo, FILE *outfile);
+EXTERN(void) jpeg_mmap_src(j_decompress_ptr cinfo, FILE *infile);
+
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
 /* Data source and destination managers: memory buffers. */
 EXTERN(void) jpeg_mem_dest(j_compress_ptr cinfo, unsigned char **outbuffer,
@@ -44,6 +44,8 @@ static char *icc_filename;      /* for -icc switch */
 JDIMENSION max_scans;           /* for -maxscans switch */
 static char *outfilename;       /* for -outfile switch */
 static char *dropfilename;      /* for -drop switch */
+static char *qualityarg;        /* for -quality switch */
+boolean mmapio;                 /* for -mmap switch */
 boolean report;                 /* for -report switch */
 boolean strict;                 /* for -strict switch */
 static JCOPY_OPTION copyoption; /* -copy switch */
@@ -78,6 +80,7 @@ usage(void)
   fprintf(stderr, "  -flip [horizontal|vertical]  Mirror image (left-right or top-bottom)\n");
   fprintf(stderr, "  -grayscale     Reduce to grayscale (omit color data)\n");
   fprintf(stderr, "  -perfect       Fail if there is non-transformable edge blocks\n");
+  fprintf(stderr, "  -quality N[,...]             Requantize to quality N (lossy)\n");
   fprintf(stderr, "  -rotate [90|180|270]         Rotate image (degrees clockwise)\n");
 #endif
 #if TRANSFORMS_SUPPORTED
@@ -95,6 +98,7 @@ usage(void)
   fprintf(stderr, "  -restart N     Set restart interval in rows, or in blocks with B\n");
   fprintf(stderr, "  -maxmemory N   Maximum memory to use (in kbytes)\n");
   fprintf(stderr, "  -maxscans N    Maximum number of scans to allow in input file\n");
+  fprintf(stderr, "  -mmap          Memory-map input and output files instead of using stdio\n");
   fprintf(stderr, "  -outfile name  Specify name for output file\n");
   fprintf(stderr, "  -report        Report transformation progress\n");
   fprintf(stderr, "  -strict        Treat all warnings as fatal\n");
@@ -153,6 +157,8 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
   icc_filename = NULL;
   max_scans = 0;
   outfilename = NULL;
+  qualityarg = NULL;
+  mmapio = FALSE;
   report = FALSE;
   strict = FALSE;
   copyoption = JCOPYOPT_DEFAULT;
@@ -162,6 +168,7 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
   transformoption.force_grayscale = FALSE;
   transformoption.crop = FALSE;
   transformoption.slow_hflip = FALSE;
+  transformoption.streaming = TRUE;
   cinfo->err->trace_level = 0;
 
   /* Scan command line options, adjust parameters */
@@ -301,6 +308,10 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
       if (sscanf(argv[argn], "%u", &max_scans) != 1)
         usage();
 
+    } else if (keymatch(arg, "mmap", 2)) {
+      /* Use memory-mapped source and destination managers */
+      mmapio = TRUE;
+
     } else if (keymatch(arg, "optimize", 1) || keymatch(arg, "optimise", 1)) {
       /* Enable entropy parm optimization. */
 #ifdef ENTROPY_OPT_SUPPORTED
@@ -333,6 +344,16 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
       exit(EXIT_FAILURE);
 #endif
 
+    } else if (keymatch(arg, "quality", 1)) {
+      /* Requantize to the quality factor(s) given by the next argument. */
+#if TRANSFORMS_SUPPORTED
+      if (++argn >= argc)       /* advance to next argument */
+        usage();
+      qualityarg = argv[argn];  /* save it away for later use */
+#else
+      select_transform(JXFORM_NONE);    /* force an error */
+#endif
+
     } else if (keymatch(arg, "report", 3)) {
       report = TRUE;
 
@@ -418,8 +439,29 @@ parse_switches(j_compress_ptr cinfo, int argc, char **argv,
 
   /* Post-switch-scanning cleanup */
 
+#if TRANSFORMS_SUPPORTED
+  if (qualityarg != NULL && transformoption.transform == JXFORM_DROP) {
+    fprintf(stderr, "%s: cannot requantize when dropping an image\n",
+            progname);
+    exit(EXIT_FAILURE);
+  }
+#endif
+
   if (for_real) {
 
+#if TRANSFORMS_SUPPORTED
+    if (qualityarg != NULL) {   /* process -quality if it was present */
+      if (!set_quality_ratings(cinfo, qualityarg, FALSE))
+        usage();
+#ifdef ENTROPY_OPT_SUPPORTED
+      /* Requantization changes the coefficient statistics, so generate
+       * Huffman tables that match them.
+       */
+      cinfo->optimize_coding = TRUE;
+#endif
+    }
+#endif
+
 #ifdef C_PROGRESSIVE_SUPPORTED
     if (simple_progressive)     /* process -progressive; -scans can override */
       jpeg_simple_progression(cinfo);
@@ -598,7 +640,10 @@ main(int argc, char **argv)
 #endif
 
   /* Specify data source for decompression */
-  jpeg_stdio_src(&srcinfo, fp);
+  if (mmapio)
+    jpeg_mmap_src(&srcinfo, fp);
+  else
+    jpeg_stdio_src(&srcinfo, fp);
 
   /* Enable saving of extra markers that we want to copy */
   jcopy_markers_setup(&srcinfo, copyoption);
@@ -664,7 +709,8 @@ main(int argc, char **argv)
 
   /* Open the output file. */
   if (outfilename != NULL) {
-    if ((fp = fopen(outfilename, WRITE_BINARY)) == NULL) {
+    if ((fp = fopen(outfilename, mmapio ? UPDATE_BINARY : WRITE_BINARY)) ==
+        NULL) {
       fprintf(stderr, "%s: can't open %s for writing\n", progname,
               outfilename);
       exit(EXIT_FAILURE);
@@ -677,8 +723,18 @@ main(int argc, char **argv)
   /* Adjust default compression parameters by re-parsing the options */
   file_index = parse_switches(&dstinfo, argc, argv, 0, TRUE);
 
+#if TRANSFORMS_SUPPORTED
+  /* Requantize the source coefficients, if -quality was given */
+  if (qualityarg != NULL)
+    jtransform_requantize(&srcinfo, &dstinfo, src_coef_arrays,
+                          &transformoption);
+#endif
+
   /* Specify data destination for compression */
-  jpeg_stdio_dest(&dstinfo, fp);
+  if (mmapio)
+    jpeg_mmap_dest(&dstinfo, fp);
+  else
+    jpeg_stdio_dest(&dstinfo, fp);
 
   /* Start compressor (note no image data is actually written here) */
   jpeg_write_coefficients(&dstinfo, dst_coef_arrays);
@@ -714,6 +714,113 @@ quantize_fs_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 }
 
 
+METHODDEF(void)
+quantize3_fs_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
+                    JSAMPARRAY output_buf, int num_rows)
+/* Fast path for out_color_components==3, with Floyd-Steinberg dithering */
+{
+  my_cquantize_ptr cquantize = (my_cquantize_ptr)cinfo->cquantize;
+  register LOCFSERROR cur0, cur1, cur2; /* current error or pixel value */
+  LOCFSERROR belowerr0, belowerr1, belowerr2; /* error for pixel below cur */
+  LOCFSERROR bpreverr0, bpreverr1, bpreverr2; /* error for below/prev col */
+  register FSERRPTR errorptr0, errorptr1, errorptr2;
+  register JSAMPROW input_ptr;
+  register JSAMPROW output_ptr;
+  JSAMPROW colorindex0 = cquantize->colorindex[0];
+  JSAMPROW colorindex1 = cquantize->colorindex[1];
+  JSAMPROW colorindex2 = cquantize->colorindex[2];
+  JSAMPROW colormap0 = cquantize->sv_colormap[0];
+  JSAMPROW colormap1 = cquantize->sv_colormap[1];
+  JSAMPROW colormap2 = cquantize->sv_colormap[2];
+  int pixcode0, pixcode1, pixcode2;
+  int dir;                      /* 1 for left-to-right, -1 for right-to-left */
+  int dir3;                     /* 3*dir, for advancing input_ptr */
+  int row;
+  JDIMENSION col;
+  JDIMENSION width = cinfo->output_width;
+  JSAMPLE *range_limit = cinfo->sample_range_limit;
+  SHIFT_TEMPS
+
+  /* This is identical to quantize_fs_dither(), except that all three
+   * components are processed in a single pass over each row.  Since the
+   * components are dithered independently, their computations can be
+   * overlapped.
+   */
+  for (row = 0; row < num_rows; row++) {
+    input_ptr = input_buf[row];
+    output_ptr = output_buf[row];
+    errorptr0 = cquantize->fserrors[0];
+    errorptr1 = cquantize->fserrors[1];
+    errorptr2 = cquantize->fserrors[2];
+    if (cquantize->on_odd_row) {
+      /* work right to left in this row */
+      input_ptr += (width - 1) * 3; /* so point to rightmost pixel */
+      output_ptr += width - 1;
+      dir = -1;
+      dir3 = -3;
+      errorptr0 += width + 1;   /* => entry after last column */
+      errorptr1 += width + 1;
+      errorptr2 += width + 1;
+    } else {
+      /* work left to right in this row */
+      dir = 1;
+      dir3 = 3;
+    }
+    /* Preset error values: no error propagated to first pixel from left */
+    cur0 = cur1 = cur2 = 0;
+    /* and no error propagated to row below yet */
+    belowerr0 = belowerr1 = belowerr2 = 0;
+    bpreverr0 = bpreverr1 = bpreverr2 = 0;
+
+    for (col = width; col > 0; col--) {
+      /* See quantize_fs_dither() for an explanation of these steps. */
+      cur0 = RIGHT_SHIFT(cur0 + errorptr0[dir] + 8, 4);
+      cur1 = RIGHT_SHIFT(cur1 + errorptr1[dir] + 8, 4);
+      cur2 = RIGHT_SHIFT(cur2 + errorptr2[dir] + 8, 4);
+      cur0 = range_limit[cur0 + input_ptr[0]];
+      cur1 = range_limit[cur1 + input_ptr[1]];
+      cur2 = range_limit[cur2 + input_ptr[2]];
+      pixcode0 = colorindex0[cur0];
+      pixcode1 = colorindex1[cur1];
+      pixcode2 = colorindex2[cur2];
+      *output_ptr = (JSAMPLE)(pixcode0 + pixcode1 + pixcode2);
+      cur0 -= colormap0[pixcode0];
+      cur1 -= colormap1[pixcode1];
+      cur2 -= colormap2[pixcode2];
+      {
+        register LOCFSERROR bnexterr;
+
+        bnexterr = cur0;        /* Process component 0 */
+        errorptr0[0] = (FSERROR)(bpreverr0 + cur0 * 3);
+        bpreverr0 = belowerr0 + cur0 * 5;
+        belowerr0 = bnexterr;
+        cur0 *= 7;
+        bnexterr = cur1;        /* Process component 1 */
+        errorptr1[0] = (FSERROR)(bpreverr1 + cur1 * 3);
+        bpreverr1 = belowerr1 + cur1 * 5;
+        belowerr1 = bnexterr;
+        cur1 *= 7;
+        bnexterr = cur2;        /* Process component 2 */
+        errorptr2[0] = (FSERROR)(bpreverr2 + cur2 * 3);
+        bpreverr2 = belowerr2 + cur2 * 5;
+        belowerr2 = bnexterr;
+        cur2 *= 7;
+      }
+      input_ptr += dir3;        /* advance input ptr to next column */
+      output_ptr += dir;        /* advance output ptr to next column */
+      errorptr0 += dir;         /* advance errorptrs to current column */
+      errorptr1 += dir;
+      errorptr2 += dir;
+    }
+    /* Unload the final error values into the final fserrors[] entries. */
+    errorptr0[0] = (FSERROR)bpreverr0;
+    errorptr1[0] = (FSERROR)bpreverr1;
+    errorptr2[0] = (FSERROR)bpreverr2;
+    cquantize->on_odd_row = (cquantize->on_odd_row ? FALSE : TRUE);
+  }
+}
+
+
 /*
  * Allocate workspace for Floyd-Steinberg errors.
  */
@@ -773,7 +880,10 @@ start_pass_1_quant(j_decompress_ptr cinfo, boolean is_pre_scan)
       create_odither_tables(cinfo);
     break;
   case JDITHER_FS:
-    cquantize->pub.color_quantize = quantize_fs_dither;
+    if (cinfo->out_color_components == 3)
+      cquantize->pub.color_quantize = quantize3_fs_dither;
+    else
+      cquantize->pub.color_quantize = quantize_fs_dither;
     cquantize->on_odd_row = FALSE; /* initialize state for F-S dither */
     /* Allocate Floyd-Steinberg workspace if didn't already. */
     if (cquantize->fserrors[0] == NULL)
@@ -99,11 +99,14 @@ static const int c_scales[3] = { R_SCALE, G_SCALE, B_SCALE };
  * (In the second pass the histogram space is re-used for pixel mapping data;
  * in that capacity, each cell must be able to store zero to the number of
  * desired colors.  16 bits/cell is plenty for that too.)
- * Since the JPEG code is intended to run in small memory model on 80x86
- * machines, we can't just allocate the histogram in one chunk.  Instead
- * of a true 3-D array, we use a row of pointers to 2-D arrays.  Each
- * pointer corresponds to a C0 value (typically 2^5 = 32 pointers) and
- * each 2-D array has 2^6*2^5 = 2048 or 2^6*2^6 = 4096 entries.
+ * The JPEG code was originally intended to run in small memory model on
+ * 80x86 machines, so instead of a true 3-D array, we use a row of pointers to
+ * 2-D arrays.  Each pointer corresponds to a C0 value (typically 2^5 = 32
+ * pointers) and each 2-D array has 2^6*2^5 = 2048 or 2^6*2^6 = 4096 entries.
+ * The 2-D arrays are allocated contiguously, though, so the pixel mapping
+ * routines in pass 2 can use HIST_INDEX() to index the histogram directly.
+ * This saves a dependent memory load per pixel, which matters because F-S
+ * dithering cannot begin one pixel until the previous one is finished.
  */
 
 #define MAXNUMCOLORS  (MAXJSAMPLE + 1) /* maximum size of colormap */
@@ -134,6 +137,10 @@ typedef histcell hist1d[HIST_C2_ELEMS]; /* typedefs for the array */
 typedef hist1d *hist2d;         /* type for the 2nd-level pointers */
 typedef hist2d *hist3d;         /* type for top-level pointer */
 
+/* Offset of histogram cell c0/c1/c2 from the start of the histogram */
+#define HIST_INDEX(c0, c1, c2) \
+  (((c0) << (HIST_C1_BITS + HIST_C2_BITS)) + ((c1) << HIST_C2_BITS) + (c2))
+
 
 /* Declarations for Floyd-Steinberg dithering.
  *
@@ -896,7 +903,7 @@ pass2_no_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 /* This version performs no dithering */
 {
   my_cquantize_ptr cquantize = (my_cquantize_ptr)cinfo->cquantize;
-  hist3d histogram = cquantize->histogram;
+  histptr histbase = cquantize->histogram[0][0];
   register JSAMPROW inptr, outptr;
   register histptr cachep;
   register int c0, c1, c2;
@@ -912,7 +919,7 @@ pass2_no_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
       c0 = (*inptr++) >> C0_SHIFT;
       c1 = (*inptr++) >> C1_SHIFT;
       c2 = (*inptr++) >> C2_SHIFT;
-      cachep = &histogram[c0][c1][c2];
+      cachep = &histbase[HIST_INDEX(c0, c1, c2)];
       /* If we have not seen this color before, find nearest colormap entry */
       /* and update the cache */
       if (*cachep == 0)
@@ -930,7 +937,7 @@ pass2_fs_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 /* This version performs Floyd-Steinberg dithering */
 {
   my_cquantize_ptr cquantize = (my_cquantize_ptr)cinfo->cquantize;
-  hist3d histogram = cquantize->histogram;
+  histptr histbase = cquantize->histogram[0][0];
   register LOCFSERROR cur0, cur1, cur2; /* current error or pixel value */
   LOCFSERROR belowerr0, belowerr1, belowerr2; /* error for pixel below cur */
   LOCFSERROR bpreverr0, bpreverr1, bpreverr2; /* error for below/prev col */
@@ -1003,8 +1010,8 @@ pass2_fs_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
       cur1 = range_limit[cur1];
       cur2 = range_limit[cur2];
       /* Index into the cache with adjusted pixel value */
-      cachep =
-        &histogram[cur0 >> C0_SHIFT][cur1 >> C1_SHIFT][cur2 >> C2_SHIFT];
+      cachep = &histbase[HIST_INDEX(cur0 >> C0_SHIFT, cur1 >> C1_SHIFT,
+                                    cur2 >> C2_SHIFT)];
       /* If we have not seen this color before, find nearest colormap */
       /* entry and update the cache */
       if (*cachep == 0)
@@ -1236,11 +1243,11 @@ jinit_2pass_quantizer(j_decompress_ptr cinfo)
   /* Allocate the histogram/inverse colormap storage */
   cquantize->histogram = (hist3d)(*cinfo->mem->alloc_small)
     ((j_common_ptr)cinfo, JPOOL_IMAGE, HIST_C0_ELEMS * sizeof(hist2d));
-  for (i = 0; i < HIST_C0_ELEMS; i++) {
-    cquantize->histogram[i] = (hist2d)(*cinfo->mem->alloc_large)
-      ((j_common_ptr)cinfo, JPOOL_IMAGE,
-       HIST_C1_ELEMS * HIST_C2_ELEMS * sizeof(histcell));
-  }
+  cquantize->histogram[0] = (hist2d)(*cinfo->mem->alloc_large)
+    ((j_common_ptr)cinfo, JPOOL_IMAGE,
+     HIST_C0_ELEMS * HIST_C1_ELEMS * HIST_C2_ELEMS * sizeof(histcell));
+  for (i = 1; i < HIST_C0_ELEMS; i++)
+    cquantize->histogram[i] = cquantize->histogram[i - 1] + HIST_C1_ELEMS;
   cquantize->needs_zeroed = TRUE; /* histogram is garbage now */
 
   /* Allocate storage for the completed colormap, if required.
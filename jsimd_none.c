@@ -260,6 +260,12 @@ jsimd_can_fdct_float(void)
   return 0;
 }
 
+GLOBAL(int)
+jsimd_can_fdct_islow_pair(void)
+{
+  return 0;
+}
+
 GLOBAL(void)
 jsimd_fdct_islow(DCTELEM *data)
 {
@@ -275,6 +281,11 @@ jsimd_fdct_float(FAST_FLOAT *data)
 {
 }
 
+GLOBAL(void)
+jsimd_fdct_islow_pair(DCTELEM *data)
+{
+}
+
 GLOBAL(int)
 jsimd_can_quantize(void)
 {
@@ -368,6 +379,12 @@ jsimd_can_idct_float(void)
   return 0;
 }
 
+GLOBAL(int)
+jsimd_can_idct_islow_pair(void)
+{
+  return 0;
+}
+
 GLOBAL(void)
 jsimd_idct_islow(j_decompress_ptr cinfo, jpeg_component_info *compptr,
                  JCOEFPTR coef_block, JSAMPARRAY output_buf,
@@ -389,6 +406,13 @@ jsimd_idct_float(j_decompress_ptr cinfo, jpeg_component_info *compptr,
 {
 }
 
+GLOBAL(void)
+jsimd_idct_islow_pair(j_decompress_ptr cinfo, jpeg_component_info *compptr,
+                      JCOEFPTR coef_block, JSAMPARRAY output_buf,
+                      JDIMENSION output_col)
+{
+}
+
 GLOBAL(int)
 jsimd_can_huff_encode_one_block(void)
 {
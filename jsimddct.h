@@ -20,10 +20,12 @@ EXTERN(void) jsimd_convsamp_float(JSAMPARRAY sample_data, JDIMENSION start_col,
 EXTERN(int) jsimd_can_fdct_islow(void);
 EXTERN(int) jsimd_can_fdct_ifast(void);
 EXTERN(int) jsimd_can_fdct_float(void);
+EXTERN(int) jsimd_can_fdct_islow_pair(void);
 
 EXTERN(void) jsimd_fdct_islow(DCTELEM *data);
 EXTERN(void) jsimd_fdct_ifast(DCTELEM *data);
 EXTERN(void) jsimd_fdct_float(FAST_FLOAT *data);
+EXTERN(void) jsimd_fdct_islow_pair(DCTELEM *data);
 
 EXTERN(int) jsimd_can_quantize(void);
 EXTERN(int) jsimd_can_quantize_float(void);
@@ -55,6 +57,7 @@ EXTERN(void) jsimd_idct_12x12(j_decompress_ptr cinfo,
 EXTERN(int) jsimd_can_idct_islow(void);
 EXTERN(int) jsimd_can_idct_ifast(void);
 EXTERN(int) jsimd_can_idct_float(void);
+EXTERN(int) jsimd_can_idct_islow_pair(void);
 
 EXTERN(void) jsimd_idct_islow(j_decompress_ptr cinfo,
                               jpeg_component_info *compptr,
@@ -68,3 +71,7 @@ EXTERN(void) jsimd_idct_float(j_decompress_ptr cinfo,
                               jpeg_component_info *compptr,
                               JCOEFPTR coef_block, JSAMPARRAY output_buf,
                               JDIMENSION output_col);
+EXTERN(void) jsimd_idct_islow_pair(j_decompress_ptr cinfo,
+                                   jpeg_component_info *compptr,
+                                   JCOEFPTR coef_block, JSAMPARRAY output_buf,
+                                   JDIMENSION output_col);
@@ -8,8 +8,8 @@
  * For conditions of distribution and use, see the accompanying README.ijg
  * file.
  *
- * This file contains routines to set the default Huffman tables, if they are
- * not already set.
+ * This file contains routines to set the default Huffman tables.  For
+ * decompression, the default tables are only set if they are not already set.
  */
 
 /*
@@ -25,8 +25,11 @@ add_huff_table(j_common_ptr cinfo, JHUFF_TBL **htblptr, const UINT8 *bits,
 
   if (*htblptr == NULL)
     *htblptr = jpeg_alloc_huff_table(cinfo);
-  else
+  else if (cinfo->is_decompressor)
     return;
+  /* Otherwise, reset the table, since it may contain optimized values from a
+   * previous image compressed using the same object.
+   */
 
   /* Copy the number-of-symbols-of-each-code-length counts */
   MEMCOPY((*htblptr)->bits, bits, sizeof((*htblptr)->bits));
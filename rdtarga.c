@@ -50,17 +50,21 @@ typedef struct _tga_source_struct {
   jvirt_sarray_ptr whole_image; /* Needed if funny input row order */
   JDIMENSION current_row;       /* Current logical row number to read */
 
-  /* Pointer to routine to extract next Targa pixel from input file */
-  void (*read_pixel) (tga_source_ptr sinfo);
+  /* Pointer to routine to read the next row of Targa pixels from the input
+     file into iobuffer */
+  void (*read_row) (tga_source_ptr sinfo);
 
-  /* Result of read_pixel is delivered here: */
+  U_CHAR *iobuffer;             /* raw (RLE-expanded) Targa pixels for 1 row */
+  size_t buffer_width;          /* width of I/O buffer in bytes */
+
+  /* Pixel being duplicated by the current RLE run is kept here: */
   U_CHAR tga_pixel[4];
 
   int pixel_size;               /* Bytes per Targa pixel (1 to 4) */
   int cmap_length;              /* colormap length */
 
   /* State info for reading RLE-coded pixels; both counts must be init to 0 */
-  int block_count;              /* # of pixels remaining in RLE block */
+  int block_count;              /* # of literal pixels remaining in RLE block */
   int dup_pixel_count;          /* # of times to duplicate previous pixel */
 
   /* This saves the correct pixel-row-expansion method for preload_image */
@@ -111,48 +115,63 @@ read_colormap(tga_source_ptr sinfo, int cmaplen, int mapentrysize)
 
 
 /*
- * read_pixel methods: get a single pixel from Targa file into tga_pixel[]
+ * read_row methods: get a row of raw Targa pixels into iobuffer
  */
 
 METHODDEF(void)
-read_non_rle_pixel(tga_source_ptr sinfo)
-/* Read one Targa pixel from the input file; no RLE expansion */
+read_non_rle_row(tga_source_ptr sinfo)
+/* Read one row of Targa pixels from the input file; no RLE expansion */
 {
-  register int i;
-
-  for (i = 0; i < sinfo->pixel_size; i++) {
-    sinfo->tga_pixel[i] = (U_CHAR)read_byte(sinfo);
-  }
+  if (!ReadOK(sinfo->pub.input_file, sinfo->iobuffer, sinfo->buffer_width))
+    ERREXIT(sinfo->cinfo, JERR_INPUT_EOF);
 }
 
 
 METHODDEF(void)
-read_rle_pixel(tga_source_ptr sinfo)
-/* Read one Targa pixel from the input file, expanding RLE data as needed */
+read_rle_row(tga_source_ptr sinfo)
+/* Read one row of Targa pixels from the input file, expanding RLE data as
+ * needed.  RLE blocks may span rows, so the block state is kept in sinfo.
+ * Literal blocks are read with a single fread() call, and duplicate-pixel
+ * blocks are expanded by copying the saved pixel.
+ */
 {
-  register int i;
-
-  /* Duplicate previously read pixel? */
-  if (sinfo->dup_pixel_count > 0) {
-    sinfo->dup_pixel_count--;
-    return;
-  }
-
-  /* Time to read RLE block header? */
-  if (--sinfo->block_count < 0) { /* decrement pixels remaining in block */
-    i = read_byte(sinfo);
-    if (i & 0x80) {             /* Start of duplicate-pixel block? */
-      sinfo->dup_pixel_count = i & 0x7F; /* number of dups after this one */
-      sinfo->block_count = 0;   /* then read new block header */
+  register U_CHAR *ptr = sinfo->iobuffer;
+  register int i, pixel_size = sinfo->pixel_size;
+  JDIMENSION col = sinfo->cinfo->image_width, count;
+
+  while (col > 0) {
+    if (sinfo->dup_pixel_count > 0) {
+      /* Duplicate previously read pixel */
+      count = (JDIMENSION)sinfo->dup_pixel_count;
+      if (count > col) count = col;
+      sinfo->dup_pixel_count -= (int)count;
+      col -= count;
+      for (; count > 0; count--) {
+        for (i = 0; i < pixel_size; i++)
+          *ptr++ = sinfo->tga_pixel[i];
+      }
+    } else if (sinfo->block_count > 0) {
+      /* Read (the rest of) a block of literal pixels */
+      count = (JDIMENSION)sinfo->block_count;
+      if (count > col) count = col;
+      if (!ReadOK(sinfo->pub.input_file, ptr, (size_t)count * pixel_size))
+        ERREXIT(sinfo->cinfo, JERR_INPUT_EOF);
+      sinfo->block_count -= (int)count;
+      col -= count;
+      ptr += (size_t)count * pixel_size;
     } else {
-      sinfo->block_count = i & 0x7F; /* number of pixels after this one */
+      /* Time to read RLE block header */
+      i = read_byte(sinfo);
+      if (i & 0x80) {           /* Start of duplicate-pixel block? */
+        if (!ReadOK(sinfo->pub.input_file, sinfo->tga_pixel, pixel_size))
+          ERREXIT(sinfo->cinfo, JERR_INPUT_EOF);
+        /* number of pixels, including the one just read */
+        sinfo->dup_pixel_count = (i & 0x7F) + 1;
+      } else {
+        sinfo->block_count = (i & 0x7F) + 1; /* number of pixels in block */
+      }
     }
   }
-
-  /* Read next pixel */
-  for (i = 0; i < sinfo->pixel_size; i++) {
-    sinfo->tga_pixel[i] = (U_CHAR)read_byte(sinfo);
-  }
 }
 
 
@@ -169,12 +188,14 @@ get_8bit_gray_row(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 {
   tga_source_ptr source = (tga_source_ptr)sinfo;
   register JSAMPROW ptr;
+  register U_CHAR *bufferptr;
   register JDIMENSION col;
 
+  (*source->read_row) (source); /* Load next row into iobuffer */
   ptr = source->pub.buffer[0];
+  bufferptr = source->iobuffer;
   for (col = cinfo->image_width; col > 0; col--) {
-    (*source->read_pixel) (source); /* Load next pixel into tga_pixel */
-    *ptr++ = (JSAMPLE)UCH(source->tga_pixel[0]);
+    *ptr++ = (JSAMPLE)UCH(*bufferptr++);
   }
   return 1;
 }
@@ -186,14 +207,16 @@ get_8bit_row(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
   tga_source_ptr source = (tga_source_ptr)sinfo;
   register int t;
   register JSAMPROW ptr;
+  register U_CHAR *bufferptr;
   register JDIMENSION col;
   register JSAMPARRAY colormap = source->colormap;
   int cmaplen = source->cmap_length;
 
+  (*source->read_row) (source); /* Load next row into iobuffer */
   ptr = source->pub.buffer[0];
+  bufferptr = source->iobuffer;
   for (col = cinfo->image_width; col > 0; col--) {
-    (*source->read_pixel) (source); /* Load next pixel into tga_pixel */
-    t = UCH(source->tga_pixel[0]);
+    t = UCH(*bufferptr++);
     if (t >= cmaplen)
       ERREXIT(cinfo, JERR_TGA_BADPARMS);
     *ptr++ = colormap[0][t];
@@ -210,13 +233,16 @@ get_16bit_row(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
   tga_source_ptr source = (tga_source_ptr)sinfo;
   register int t;
   register JSAMPROW ptr;
+  register U_CHAR *bufferptr;
   register JDIMENSION col;
 
+  (*source->read_row) (source); /* Load next row into iobuffer */
   ptr = source->pub.buffer[0];
+  bufferptr = source->iobuffer;
   for (col = cinfo->image_width; col > 0; col--) {
-    (*source->read_pixel) (source); /* Load next pixel into tga_pixel */
-    t = UCH(source->tga_pixel[0]);
-    t += UCH(source->tga_pixel[1]) << 8;
+    t = UCH(bufferptr[0]);
+    t += UCH(bufferptr[1]) << 8;
+    bufferptr += 2;
     /* We expand 5 bit data to 8 bit sample width.
      * The format of the 16-bit (LSB first) input word is
      *     xRRRRRGGGGGBBBBB
@@ -237,26 +263,46 @@ get_24bit_row(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 {
   tga_source_ptr source = (tga_source_ptr)sinfo;
   register JSAMPROW ptr;
+  register U_CHAR *bufferptr;
   register JDIMENSION col;
 
+  (*source->read_row) (source); /* Load next row into iobuffer */
   ptr = source->pub.buffer[0];
+  bufferptr = source->iobuffer;
   for (col = cinfo->image_width; col > 0; col--) {
-    (*source->read_pixel) (source); /* Load next pixel into tga_pixel */
-    *ptr++ = (JSAMPLE)UCH(source->tga_pixel[2]); /* change BGR to RGB order */
-    *ptr++ = (JSAMPLE)UCH(source->tga_pixel[1]);
-    *ptr++ = (JSAMPLE)UCH(source->tga_pixel[0]);
+    ptr[0] = (JSAMPLE)UCH(bufferptr[2]); /* change BGR to RGB order */
+    ptr[1] = (JSAMPLE)UCH(bufferptr[1]);
+    ptr[2] = (JSAMPLE)UCH(bufferptr[0]);
+    ptr += 3;
+    bufferptr += 3;
   }
   return 1;
 }
 
-/*
- * Targa also defines a 32-bit pixel format with order B,G,R,A.
- * We presently ignore the attribute byte, so the code for reading
- * these pixels is identical to the 24-bit routine above.
- * This works because the actual pixel length is only known to read_pixel.
- */
+METHODDEF(JDIMENSION)
+get_32bit_row(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
+/* This version is for reading 32-bit pixels */
+{
+  tga_source_ptr source = (tga_source_ptr)sinfo;
+  register JSAMPROW ptr;
+  register U_CHAR *bufferptr;
+  register JDIMENSION col;
 
-#define get_32bit_row  get_24bit_row
+  /* Targa also defines a 32-bit pixel format with order B,G,R,A.
+   * We presently ignore the attribute byte.
+   */
+  (*source->read_row) (source); /* Load next row into iobuffer */
+  ptr = source->pub.buffer[0];
+  bufferptr = source->iobuffer;
+  for (col = cinfo->image_width; col > 0; col--) {
+    ptr[0] = (JSAMPLE)UCH(bufferptr[2]); /* change BGR to RGB order */
+    ptr[1] = (JSAMPLE)UCH(bufferptr[1]);
+    ptr[2] = (JSAMPLE)UCH(bufferptr[0]);
+    ptr += 3;
+    bufferptr += 4;
+  }
+  return 1;
+}
 
 
 /*
@@ -366,12 +412,12 @@ start_input_tga(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 
   if (subtype > 8) {
     /* It's an RLE-coded file */
-    source->read_pixel = read_rle_pixel;
+    source->read_row = read_rle_row;
     source->block_count = source->dup_pixel_count = 0;
     subtype -= 8;
   } else {
     /* Non-RLE file */
-    source->read_pixel = read_non_rle_pixel;
+    source->read_row = read_non_rle_row;
   }
 
   /* Now should have subtype 1, 2, or 3 */
@@ -439,6 +485,12 @@ start_input_tga(j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
     source->pub.get_pixel_rows = source->get_pixel_rows;
   }
 
+  /* Allocate space for I/O buffer: 1 to 4 bytes/pixel. */
+  source->buffer_width = (size_t)width * source->pixel_size;
+  source->iobuffer = (U_CHAR *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
+                                source->buffer_width);
+
   while (idlen--)               /* Throw away ID field */
     (void)read_byte(source);
 
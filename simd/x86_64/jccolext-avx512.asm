@@ -0,0 +1,200 @@
+;
+; jccolext.asm - colorspace conversion (64-bit AVX-512)
+;
+; Copyright (C) 2009, 2016, D. R. Commander.
+; Copyright (C) 2015, Intel Corporation.
+;
+; Based on the x86 SIMD extension for IJG JPEG library
+; Copyright (C) 1999-2006, MIYASAKA Masaru.
+; For conditions of distribution and use, see copyright notice in jsimdext.inc
+;
+; This file should be assembled with NASM (Netwide Assembler),
+; can *not* be assembled with Microsoft's MASM or any compatible
+; assembler (including Borland's Turbo Assembler).
+; NASM is available from http://nasm.sourceforge.net/ or
+; http://sourceforge.net/project/showfiles.php?group_id=6208
+
+; --------------------------------------------------------------------------
+;
+; Convert some rows of samples to the output colorspace.
+;
+; Each iteration of the column loop converts a strip of 64 pixels, 16 pixels
+; (one dword per pixel) at a time.  Partial strips at the end of a row are
+; handled with opmasks, so no pixels beyond the end of the row are read or
+; written.
+;
+; GLOBAL(void)
+; jsimd_rgb_ycc_convert_avx512(JDIMENSION img_width, JSAMPARRAY input_buf,
+;                              JSAMPIMAGE output_buf, JDIMENSION output_row,
+;                              int num_rows);
+;
+
+; r10d = JDIMENSION img_width
+; r11 = JSAMPARRAY input_buf
+; r12 = JSAMPIMAGE output_buf
+; r13d = JDIMENSION output_row
+; r14d = int num_rows
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_rgb_ycc_convert_avx512)
+
+EXTN(jsimd_rgb_ycc_convert_avx512):
+    push        rbp
+    mov         rax, rsp
+    mov         rbp, rsp
+    collect_args 5
+    push        rbx
+
+    mov         ecx, r10d
+    test        rcx, rcx
+    jz          near .return
+
+    vpbroadcastd zmm16, [rel PW_F0299_F0337]
+    vpbroadcastd zmm17, [rel PW_F0114_F0250]
+    vpbroadcastd zmm18, [rel PW_MF016_MF033]
+    vpbroadcastd zmm19, [rel PW_MF008_MF041]
+    vpbroadcastd zmm20, [rel PD_ONEHALFM1_CJ]
+    vpbroadcastd zmm21, [rel PD_ONEHALF]
+
+    ; zmm22 and zmm23 are vpshufb controls that move the (R, G) and (B, G)
+    ; components of each pixel in a 128-bit lane into the low and high words of
+    ; the corresponding dword.
+    mov         eax, RGB_PIXELSIZE * 0x00010001
+    vpbroadcastd zmm0, eax
+    vpmulld     zmm0, zmm0, ZMMWORD [rel PD_PIXELNUM]
+    mov         eax, RGB_RED | (0x80 << 8) | (RGB_GREEN << 16) | (0x80 << 24)
+    vpbroadcastd zmm22, eax
+    vpaddb      zmm22, zmm22, zmm0
+    mov         eax, RGB_BLUE | (0x80 << 8) | (RGB_GREEN << 16) | (0x80 << 24)
+    vpbroadcastd zmm23, eax
+    vpaddb      zmm23, zmm23, zmm0
+%if RGB_PIXELSIZE == 3
+    vmovdqu32   zmm24, ZMMWORD [rel PD_EXPAND3]
+%endif
+
+    mov         rsi, r12
+    mov         ecx, r13d
+    mov         rdip, JSAMPARRAY [rsi+0*SIZEOF_JSAMPARRAY]
+    mov         rbxp, JSAMPARRAY [rsi+1*SIZEOF_JSAMPARRAY]
+    mov         rdxp, JSAMPARRAY [rsi+2*SIZEOF_JSAMPARRAY]
+    lea         rdi, [rdi+rcx*SIZEOF_JSAMPROW]
+    lea         rbx, [rbx+rcx*SIZEOF_JSAMPROW]
+    lea         rdx, [rdx+rcx*SIZEOF_JSAMPROW]
+
+    mov         rsi, r11
+%if RGB_PIXELSIZE == 3
+    xor         r11, r11
+    mov         r12, 0xFFFFFFFFFFFF     ; r12=(byte mask for 16 pixels)
+%endif
+    mov         eax, r14d
+    test        rax, rax
+    jle         near .return
+.rowloop:
+    push        rdx
+    push        rbx
+    push        rdi
+    push        rsi
+
+    mov         ecx, r10d               ; num_cols
+    mov         rsip, JSAMPROW [rsi]    ; inptr
+    mov         rdip, JSAMPROW [rdi]    ; outptr0
+    mov         rbxp, JSAMPROW [rbx]    ; outptr1
+    mov         rdxp, JSAMPROW [rdx]    ; outptr2
+
+.columnloop:
+    mov         r9d, SIZEOF_ZMMWORD
+    cmp         rcx, r9
+    cmovb       r9, rcx                 ; r9=(number of pixels in the strip)
+    mov         r8, -1
+    bzhi        r8, r8, r9
+    kmovq       k5, r8                  ; k5=(pixel mask for the strip)
+%if RGB_PIXELSIZE == 3
+    lea         r9, [r9+r9*2]           ; r9=(number of bytes in the strip)
+%endif
+
+%assign GRP 0
+%rep 4
+    kshiftrq    k1, k5, GRP*16          ; k1=(pixel mask for this group)
+
+%if RGB_PIXELSIZE == 3
+    bzhi        r8, r12, r9
+    test        r9, r9
+    cmovle      r8, r11
+    kmovq       k2, r8                  ; k2=(byte mask for this group)
+    sub         r9, byte 16*RGB_PIXELSIZE
+
+    vmovdqu8    zmm0{k2}{z}, ZMMWORD [rsi+GRP*16*RGB_PIXELSIZE]
+    vpermd      zmm0, zmm24, zmm0       ; 4 pixels in each 128-bit lane
+%else
+    vmovdqu32   zmm0{k1}{z}, ZMMWORD [rsi+GRP*16*RGB_PIXELSIZE]
+%endif
+
+    vpshufb     zmm1, zmm0, zmm22       ; zmm1=RG=(R0 G0 R1 G1 ... R15 G15)
+    vpshufb     zmm0, zmm0, zmm23       ; zmm0=BG=(B0 G0 B1 G1 ... B15 G15)
+
+    ; (Original)
+    ; Y  =  0.29900 * R + 0.58700 * G + 0.11400 * B
+    ; Cb = -0.16874 * R - 0.33126 * G + 0.50000 * B + CENTERJSAMPLE
+    ; Cr =  0.50000 * R - 0.41869 * G - 0.08131 * B + CENTERJSAMPLE
+    ;
+    ; (This implementation)
+    ; Y  =  0.29900 * R + 0.33700 * G + 0.11400 * B + 0.25000 * G
+    ; Cb = -0.16874 * R - 0.33126 * G + 0.50000 * B + CENTERJSAMPLE
+    ; Cr =  0.50000 * R - 0.41869 * G - 0.08131 * B + CENTERJSAMPLE
+
+    vpmaddwd    zmm2, zmm1, zmm16       ; zmm2=RG*[FIX(0.299) FIX(0.337)]
+    vpmaddwd    zmm3, zmm0, zmm17       ; zmm3=BG*[FIX(0.114) FIX(0.250)]
+    vpaddd      zmm2, zmm2, zmm3
+    vpaddd      zmm2, zmm2, zmm21
+    vpsrld      zmm2, zmm2, SCALEBITS   ; zmm2=Y
+
+    vpmaddwd    zmm3, zmm1, zmm18       ; zmm3=RG*[-FIX(0.168) -FIX(0.331)]
+    vpslld      zmm4, zmm0, WORD_BIT
+    vpsrld      zmm4, zmm4, 1           ; zmm4=B*FIX(0.500)
+    vpaddd      zmm3, zmm3, zmm4
+    vpaddd      zmm3, zmm3, zmm20
+    vpsrld      zmm3, zmm3, SCALEBITS   ; zmm3=Cb
+
+    vpmaddwd    zmm4, zmm0, zmm19       ; zmm4=BG*[-FIX(0.081) -FIX(0.418)]
+    vpslld      zmm1, zmm1, WORD_BIT
+    vpsrld      zmm1, zmm1, 1           ; zmm1=R*FIX(0.500)
+    vpaddd      zmm4, zmm4, zmm1
+    vpaddd      zmm4, zmm4, zmm20
+    vpsrld      zmm4, zmm4, SCALEBITS   ; zmm4=Cr
+
+    vpmovdb     XMMWORD [rdi+GRP*SIZEOF_XMMWORD]{k1}, zmm2
+    vpmovdb     XMMWORD [rbx+GRP*SIZEOF_XMMWORD]{k1}, zmm3
+    vpmovdb     XMMWORD [rdx+GRP*SIZEOF_XMMWORD]{k1}, zmm4
+
+%assign GRP GRP+1
+%endrep
+
+    add         rsi, RGB_PIXELSIZE*SIZEOF_ZMMWORD  ; inptr
+    add         rdi, byte SIZEOF_ZMMWORD           ; outptr0
+    add         rbx, byte SIZEOF_ZMMWORD           ; outptr1
+    add         rdx, byte SIZEOF_ZMMWORD           ; outptr2
+    sub         rcx, byte SIZEOF_ZMMWORD
+    ja          near .columnloop
+
+    pop         rsi
+    pop         rdi
+    pop         rbx
+    pop         rdx
+
+    add         rsi, byte SIZEOF_JSAMPROW  ; input_buf
+    add         rdi, byte SIZEOF_JSAMPROW
+    add         rbx, byte SIZEOF_JSAMPROW
+    add         rdx, byte SIZEOF_JSAMPROW
+    dec         rax                        ; num_rows
+    jg          near .rowloop
+
+.return:
+    vzeroupper
+    pop         rbx
+    uncollect_args 5
+    pop         rbp
+    ret
+
+; For some reason, the OS X linker does not honor the request to align the
+; segment unless we do this.
+    align       32
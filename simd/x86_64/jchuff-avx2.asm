@@ -0,0 +1,593 @@
+;
+; jchuff-avx2.asm - Huffman entropy encoding (64-bit AVX2)
+;
+; Copyright (C) 2009-2011, 2014-2016, 2019, D. R. Commander.
+; Copyright (C) 2015, Matthieu Darbois.
+; Copyright (C) 2018, Matthias Räncker.
+;
+; Based on the x86 SIMD extension for IJG JPEG library
+; Copyright (C) 1999-2006, MIYASAKA Masaru.
+; For conditions of distribution and use, see copyright notice in jsimdext.inc
+;
+; This file should be assembled with NASM (Netwide Assembler),
+; can *not* be assembled with Microsoft's MASM or any compatible
+; assembler (including Borland's Turbo Assembler).
+; NASM is available from http://nasm.sourceforge.net/ or
+; http://sourceforge.net/project/showfiles.php?group_id=6208
+;
+; This file contains an AVX2 implementation for Huffman coding of one block.
+; The following code is based on jchuff.c and jchuff-sse2.asm; see jchuff.c
+; for more details.
+
+%include "jsimdext.inc"
+
+struc working_state
+.next_output_byte:   resp 1     ; => next byte to write in buffer
+.free_in_buffer:     resp 1     ; # of byte spaces remaining in buffer
+.cur.put_buffer.simd resq 1     ; current bit accumulation buffer
+.cur.free_bits       resd 1     ; # of bits available in it
+.cur.last_dc_val     resd 4     ; last DC coef for each component
+.cinfo:              resp 1     ; dump_buffer needs access to this
+endstruc
+
+struc c_derived_tbl
+.ehufco:             resd 256   ; code for each symbol
+.ehufsi:             resb 256   ; length of code for each symbol
+; If no code has been allocated for a symbol S, ehufsi[S] contains 0
+endstruc
+
+; vpshufb control words.  Wn selects word n of the source 128-bit lane, and ZZ
+; zeroes the destination word.
+%define W0  0x0100
+%define W1  0x0302
+%define W2  0x0504
+%define W3  0x0706
+%define W4  0x0908
+%define W5  0x0B0A
+%define W6  0x0D0C
+%define W7  0x0F0E
+%define ZZ  0x8080
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_CONST
+
+    alignz      32
+    GLOBAL_DATA(jconst_huff_encode_one_block_avx2)
+
+EXTN(jconst_huff_encode_one_block_avx2):
+
+; Shuffle masks used to re-arrange the input data according to
+; jpeg_natural_order.  Each 16-coefficient chunk of the output is the bitwise
+; OR of several shuffled copies of a row pair (with or without its 128-bit
+; lanes swapped), since vpshufb cannot move data across lanes.
+
+PB_ZIGZAG:
+    ;  0: t[ 0..15] from rows 0 and 1
+    dw          W1, ZZ, ZZ, ZZ, W2, W3, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, W3, ZZ, ZZ, W4
+    ;  1: t[ 0..15] from rows 0 and 1 (lanes swapped)
+    dw          ZZ, W0, ZZ, W1, ZZ, ZZ, W2, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, W4, W5, ZZ
+    ;  2: t[ 0..15] from rows 2 and 3
+    dw          ZZ, ZZ, W0, ZZ, ZZ, ZZ, ZZ, W1
+    dw          W0, ZZ, W1, ZZ, ZZ, ZZ, ZZ, ZZ
+    ;  3: t[ 0..15] from rows 2 and 3 (lanes swapped)
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, W2, ZZ, ZZ, ZZ, ZZ
+    ;  4: t[ 0..15] from rows 4 and 5 (lanes swapped)
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, W0, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    ;  5: t[16..31] from rows 0 and 1
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, W5, ZZ, ZZ, W6, ZZ, ZZ, ZZ
+    ;  6: t[16..31] from rows 0 and 1 (lanes swapped)
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, W6, W7, ZZ, ZZ, ZZ, ZZ
+    ;  7: t[16..31] from rows 2 and 3
+    dw          W3, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, W4, ZZ
+    ;  8: t[16..31] from rows 2 and 3 (lanes swapped)
+    dw          ZZ, W2, ZZ, ZZ, ZZ, ZZ, ZZ, W3
+    dw          W4, ZZ, ZZ, ZZ, ZZ, W5, ZZ, ZZ
+    ;  9: t[16..31] from rows 4 and 5
+    dw          ZZ, ZZ, W1, ZZ, ZZ, ZZ, W2, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    ; 10: t[16..31] from rows 4 and 5 (lanes swapped)
+    dw          ZZ, ZZ, ZZ, W0, ZZ, W1, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, W3
+    ; 11: t[16..31] from rows 6 and 7
+    dw          ZZ, ZZ, ZZ, ZZ, W0, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    ; 12: t[32..47] from rows 0 and 1
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, W7, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    ; 13: t[32..47] from rows 2 and 3
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, W6, ZZ, ZZ, ZZ, ZZ
+    ; 14: t[32..47] from rows 2 and 3 (lanes swapped)
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, W5
+    dw          W6, ZZ, W7, ZZ, ZZ, ZZ, ZZ, ZZ
+    ; 15: t[32..47] from rows 4 and 5
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, W4, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, W4, ZZ, ZZ
+    ; 16: t[32..47] from rows 4 and 5 (lanes swapped)
+    dw          W2, ZZ, ZZ, ZZ, ZZ, W3, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, W5, ZZ, ZZ, ZZ
+    ; 17: t[32..47] from rows 6 and 7
+    dw          ZZ, W1, ZZ, ZZ, W2, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, W2
+    ; 18: t[32..47] from rows 6 and 7 (lanes swapped)
+    dw          ZZ, ZZ, W0, W1, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, W3, ZZ
+    ; 19: t[48..63] from rows 2 and 3 (lanes swapped)
+    dw          ZZ, ZZ, ZZ, ZZ, W7, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    ; 20: t[48..63] from rows 4 and 5
+    dw          ZZ, ZZ, ZZ, W6, ZZ, W7, ZZ, ZZ
+    dw          ZZ, ZZ, ZZ, W7, ZZ, ZZ, ZZ, ZZ
+    ; 21: t[48..63] from rows 4 and 5 (lanes swapped)
+    dw          ZZ, ZZ, W5, ZZ, ZZ, ZZ, W6, ZZ
+    dw          ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    ; 22: t[48..63] from rows 6 and 7
+    dw          ZZ, W4, ZZ, ZZ, ZZ, ZZ, ZZ, W5
+    dw          W4, W5, ZZ, ZZ, ZZ, W6, W7, ZZ
+    ; 23: t[48..63] from rows 6 and 7 (lanes swapped)
+    dw          W3, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ, ZZ
+    dw          ZZ, ZZ, W6, ZZ, W7, ZZ, ZZ, ZZ
+
+    alignz      32
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_TEXT
+    BITS        64
+
+; Shorthand used to describe SIMD operations:
+; wN:  ymmN treated as 16 signed 16-bit values
+; wN[i]:  perform the same operation on all 16 signed 16-bit values, i=0..15
+; Contents of SIMD registers are shown in memory order.
+
+; Fill the bit buffer to capacity with the leading bits from code, then output
+; the bit buffer and put the remaining bits from code into the bit buffer.
+;
+; Usage:
+; code - contains the bits to shift into the bit buffer (LSB-aligned)
+; %1 - the label to which to jump when the macro completes
+; %2 (optional) - extra instructions to execute after nbits has been set
+;
+; Upon completion, free_bits will be set to the number of remaining bits from
+; code, and put_buffer will contain those remaining bits.  temp and code will
+; be clobbered.
+;
+; This macro encodes any 0xFF bytes as 0xFF 0x00, as does the EMIT_BYTE()
+; macro in jchuff.c.
+
+%macro EMIT_QWORD 1-2
+    add         nbitsb, free_bitsb      ; nbits += free_bits;
+    neg         free_bitsb              ; free_bits = -free_bits;
+    mov         tempd, code             ; temp = code;
+    shl         put_buffer, nbitsb      ; put_buffer <<= nbits;
+    mov         nbitsb, free_bitsb      ; nbits = free_bits;
+    neg         free_bitsb              ; free_bits = -free_bits;
+    shr         tempd, nbitsb           ; temp >>= nbits;
+    or          tempq, put_buffer       ; temp |= put_buffer;
+    movq        xmm0, tempq             ; xmm0.u64 = { temp, 0 };
+    bswap       tempq                   ; temp = htonl(temp);
+    mov         put_buffer, codeq       ; put_buffer = code;
+    pcmpeqb     xmm0, xmm1              ; b0[i] = (b0[i] == 0xFF ? 0xFF : 0);
+    %2
+    pmovmskb    code, xmm0              ; code = 0;  code |= ((b0[i] >> 7) << i);
+    mov         qword [buffer], tempq   ; memcpy(buffer, &temp, 8);
+                                        ; (speculative; will be overwritten if
+                                        ; code contains any 0xFF bytes)
+    add         free_bitsb, 64          ; free_bits += 64;
+    add         bufferp, 8              ; buffer += 8;
+    test        code, code              ; if (code == 0)  /* No 0xFF bytes */
+    jz          %1                      ;   return;
+    ; Execute the equivalent of the EMIT_BYTE() macro in jchuff.c for all 8
+    ; bytes in the qword.
+    cmp         tempb, 0xFF             ; Set CF if temp[0] < 0xFF
+    mov         byte [buffer-7], 0      ; buffer[-7] = 0;
+    sbb         bufferp, 6              ; buffer -= (6 + (temp[0] < 0xFF ? 1 : 0));
+    mov         byte [buffer], temph    ; buffer[0] = temp[1];
+    cmp         temph, 0xFF             ; Set CF if temp[1] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[1] < 0xFF ? 1 : 0));
+    shr         tempq, 16               ; temp >>= 16;
+    mov         byte [buffer], tempb    ; buffer[0] = temp[0];
+    cmp         tempb, 0xFF             ; Set CF if temp[0] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[0] < 0xFF ? 1 : 0));
+    mov         byte [buffer], temph    ; buffer[0] = temp[1];
+    cmp         temph, 0xFF             ; Set CF if temp[1] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[1] < 0xFF ? 1 : 0));
+    shr         tempq, 16               ; temp >>= 16;
+    mov         byte [buffer], tempb    ; buffer[0] = temp[0];
+    cmp         tempb, 0xFF             ; Set CF if temp[0] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[0] < 0xFF ? 1 : 0));
+    mov         byte [buffer], temph    ; buffer[0] = temp[1];
+    cmp         temph, 0xFF             ; Set CF if temp[1] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[1] < 0xFF ? 1 : 0));
+    shr         tempd, 16               ; temp >>= 16;
+    mov         byte [buffer], tempb    ; buffer[0] = temp[0];
+    cmp         tempb, 0xFF             ; Set CF if temp[0] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[0] < 0xFF ? 1 : 0));
+    mov         byte [buffer], temph    ; buffer[0] = temp[1];
+    cmp         temph, 0xFF             ; Set CF if temp[1] < 0xFF
+    mov         byte [buffer+1], 0      ; buffer[1] = 0;
+    sbb         bufferp, -2             ; buffer -= (-2 + (temp[1] < 0xFF ? 1 : 0));
+    jmp         %1                      ; return;
+%endmacro
+
+;
+; Encode a single block's worth of coefficients.
+;
+; GLOBAL(JOCTET *)
+; jsimd_huff_encode_one_block_avx2(working_state *state, JOCTET *buffer,
+;                                  JCOEFPTR block, int last_dc_val,
+;                                  c_derived_tbl *dctbl, c_derived_tbl *actbl)
+;
+; NOTES:
+; This is structurally identical to jsimd_huff_encode_one_block_sse2(), except
+; that:
+; - The coefficients are re-arranged with 256-bit vpshufb/vpor sequences
+;   rather than long pinsrw chains.
+; - The absolute values of the coefficients are stored alongside t_[], and
+;   JPEG_NBITS() is computed using lzcnt rather than looked up in a 64 KB
+;   table.  This keeps the table out of the L1 data cache, which is shared with
+;   the coefficient and output buffers.
+; - BMI2 bzhi and shlx replace the jpeg_mask_bits[] lookups and some of the
+;   shifts by cl.
+;
+; The caller must ensure that the CPU supports BMI2 and lzcnt.  (lzcnt is
+; executed as bsr on CPUs that don't support it, which would produce incorrect
+; results.)
+;
+; Initial register allocation
+; rax - buffer
+; rbx - temp
+; rcx - nbits
+; rdx - block --> free_bits
+; rdi - t
+; rbp - code
+; r8  - dctbl --> code_temp
+; r9  - actbl
+; r10 - state
+; r11 - index
+; r12 - put_buffer
+
+%define buffer       rax
+%ifdef WIN64
+%define bufferp      rax
+%else
+%define bufferp      raxp
+%endif
+%define tempq        rbx
+%define tempd        ebx
+%define tempb        bl
+%define temph        bh
+%define nbitsq       rcx
+%define nbits        ecx
+%define nbitsb       cl
+%define block        rdx
+%define t            rdi
+%define td           edi
+%define codeq        rbp
+%define code         ebp
+%define dctbl        r8
+%define actbl        r9
+%define state        r10
+%define index        r11
+%define indexd       r11d
+%define put_buffer   r12
+%define put_bufferd  r12d
+
+; t_[] is a 2 * DCTSIZE2-element array of words allocated on the stack.  The
+; first half contains the AC coefficients in zig-zag order (with 1 subtracted
+; from the negative ones, as in jchuff.c), and the second half contains their
+; absolute values (a_[] below.)
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_huff_encode_one_block_avx2)
+
+EXTN(jsimd_huff_encode_one_block_avx2):
+
+%ifdef WIN64
+
+; rcx = working_state *state
+; rdx = JOCTET *buffer
+; r8 = JCOEFPTR block
+; r9 = int last_dc_val
+; [rax+48] = c_derived_tbl *dctbl
+; [rax+56] = c_derived_tbl *actbl
+
+    mov         buffer, rdx
+    mov         block, r8
+    push        rbx
+    push        rbp
+    push        rdi
+    push        r12
+    vmovdqu     ymm0, YMMWORD [block + 0 * SIZEOF_WORD]   ; w0 = rows 0 and 1
+    vmovdqu     ymm1, YMMWORD [block + 16 * SIZEOF_WORD]  ; w1 = rows 2 and 3
+    vmovdqu     ymm2, YMMWORD [block + 32 * SIZEOF_WORD]  ; w2 = rows 4 and 5
+    vmovdqu     ymm3, YMMWORD [block + 48 * SIZEOF_WORD]  ; w3 = rows 6 and 7
+    mov         state, rcx
+    movsx       code, word [block]                        ; code = block[0];
+    sub         code, r9d                                 ; code -= last_dc_val;
+    mov         dctbl, POINTER [rsp+5*8+4*8]
+    mov         actbl, POINTER [rsp+5*8+5*8]
+    add         rsp, -2 * DCTSIZE2 * SIZEOF_WORD
+    mov         t, rsp
+
+%else
+
+; rdi = working_state *state
+; rsi = JOCTET *buffer
+; rdx = JCOEFPTR block
+; rcx = int last_dc_val
+; r8 = c_derived_tbl *dctbl
+; r9 = c_derived_tbl *actbl
+
+    push        rbx
+    push        rbp
+    push        r12
+    vmovdqu     ymm0, YMMWORD [block + 0 * SIZEOF_WORD]   ; w0 = rows 0 and 1
+    vmovdqu     ymm1, YMMWORD [block + 16 * SIZEOF_WORD]  ; w1 = rows 2 and 3
+    vmovdqu     ymm2, YMMWORD [block + 32 * SIZEOF_WORD]  ; w2 = rows 4 and 5
+    vmovdqu     ymm3, YMMWORD [block + 48 * SIZEOF_WORD]  ; w3 = rows 6 and 7
+    mov         state, rdi
+    mov         buffer, rsi
+    movsx       codeq, word [block]                       ; code = block[0];
+    sub         codeq, rcx                                ; code -= last_dc_val;
+    add         rsp, -2 * DCTSIZE2 * SIZEOF_WORD
+    mov         t, rsp
+
+%endif
+
+; Step 1: Re-arrange input data according to jpeg_natural_order, and store the
+; adjusted coefficients and their absolute values in t_[].
+
+    ; t_[0..15] = block[jpeg_natural_order[1..16]]
+    vpshufb     ymm5, ymm0, [rel PB_ZIGZAG + 0 * SIZEOF_YMMWORD]
+    vpermq      ymm4, ymm0, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 1 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm1, [rel PB_ZIGZAG + 2 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm1, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 3 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm2, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 4 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpabsw      ymm4, ymm5                                ; a_[i] = abs(w5[i]);
+    vmovdqu     YMMWORD [t + (DCTSIZE2 + 0) * SIZEOF_WORD], ymm4
+    vpsraw      ymm4, ymm5, 15                            ; w4[i] = (w5[i] < 0 ? -1 : 0);
+    vpaddw      ymm5, ymm5, ymm4                          ; w5[i] += w4[i];
+    vmovdqu     YMMWORD [t + 0 * SIZEOF_WORD], ymm5
+
+    ; t_[16..31] = block[jpeg_natural_order[17..32]]
+    vpshufb     ymm5, ymm0, [rel PB_ZIGZAG + 5 * SIZEOF_YMMWORD]
+    vpermq      ymm4, ymm0, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 6 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm1, [rel PB_ZIGZAG + 7 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm1, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 8 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm2, [rel PB_ZIGZAG + 9 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm2, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 10 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm3, [rel PB_ZIGZAG + 11 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpabsw      ymm4, ymm5                                ; a_[i] = abs(w5[i]);
+    vmovdqu     YMMWORD [t + (DCTSIZE2 + 16) * SIZEOF_WORD], ymm4
+    vpsraw      ymm4, ymm5, 15                            ; w4[i] = (w5[i] < 0 ? -1 : 0);
+    vpaddw      ymm5, ymm5, ymm4                          ; w5[i] += w4[i];
+    vmovdqu     YMMWORD [t + 16 * SIZEOF_WORD], ymm5
+
+    ; t_[32..47] = block[jpeg_natural_order[33..48]]
+    vpshufb     ymm5, ymm0, [rel PB_ZIGZAG + 12 * SIZEOF_YMMWORD]
+    vpshufb     ymm4, ymm1, [rel PB_ZIGZAG + 13 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm1, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 14 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm2, [rel PB_ZIGZAG + 15 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm2, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 16 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm3, [rel PB_ZIGZAG + 17 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm3, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 18 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpabsw      ymm4, ymm5                                ; a_[i] = abs(w5[i]);
+    vmovdqu     YMMWORD [t + (DCTSIZE2 + 32) * SIZEOF_WORD], ymm4
+    vpsraw      ymm4, ymm5, 15                            ; w4[i] = (w5[i] < 0 ? -1 : 0);
+    vpaddw      ymm5, ymm5, ymm4                          ; w5[i] += w4[i];
+    vmovdqu     YMMWORD [t + 32 * SIZEOF_WORD], ymm5
+
+    ; t_[48..63] = block[jpeg_natural_order[49..63]] (t_[63] = 0)
+    vpermq      ymm4, ymm1, 0x4E
+    vpshufb     ymm5, ymm4, [rel PB_ZIGZAG + 19 * SIZEOF_YMMWORD]
+    vpshufb     ymm4, ymm2, [rel PB_ZIGZAG + 20 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm2, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 21 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpshufb     ymm4, ymm3, [rel PB_ZIGZAG + 22 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpermq      ymm4, ymm3, 0x4E
+    vpshufb     ymm4, ymm4, [rel PB_ZIGZAG + 23 * SIZEOF_YMMWORD]
+    vpor        ymm5, ymm5, ymm4
+    vpabsw      ymm4, ymm5                                ; a_[i] = abs(w5[i]);
+    vmovdqu     YMMWORD [t + (DCTSIZE2 + 48) * SIZEOF_WORD], ymm4
+    vpsraw      ymm4, ymm5, 15                            ; w4[i] = (w5[i] < 0 ? -1 : 0);
+    vpaddw      ymm5, ymm5, ymm4                          ; w5[i] += w4[i];
+    vmovdqu     YMMWORD [t + 48 * SIZEOF_WORD], ymm5
+
+; Step 2: Compute index, a bitmap of the nonzero AC coefficients.
+
+    vpxor       ymm4, ymm4, ymm4                          ; w4[i] = 0;
+    vpcmpeqw    ymm0, ymm4, YMMWORD [t + (DCTSIZE2 + 0) * SIZEOF_WORD]
+    vpcmpeqw    ymm1, ymm4, YMMWORD [t + (DCTSIZE2 + 16) * SIZEOF_WORD]
+    vpcmpeqw    ymm2, ymm4, YMMWORD [t + (DCTSIZE2 + 32) * SIZEOF_WORD]
+    vpcmpeqw    ymm3, ymm4, YMMWORD [t + (DCTSIZE2 + 48) * SIZEOF_WORD]
+                                                          ; wN[i] = (a_[16*N+i] == 0 ? -1 : 0);
+    vpacksswb   ymm0, ymm0, ymm1                          ; b0 = 0-7 16-23 8-15 24-31
+    vpacksswb   ymm2, ymm2, ymm3                          ; b2 = 32-39 48-55 40-47 56-63
+    vpermq      ymm0, ymm0, 0xD8                          ; b0 = 0-7 8-15 16-23 24-31
+    vpermq      ymm2, ymm2, 0xD8                          ; b2 = 32-39 40-47 48-55 56-63
+    vpmovmskb   tempd, ymm0                               ; temp = 0;  temp |= ((b0[i] >> 7) << i);
+    vpmovmskb   indexd, ymm2                              ; index = 0;  index |= ((b2[i] >> 7) << i);
+    shl         index, 32                                 ; index <<= 32;
+    or          index, tempq                              ; index |= temp;
+    not         index                                     ; index = ~index;
+    vzeroupper
+
+; Step 3: Encode the DC coefficient.
+
+    cmp         code, 1 << 31                             ; Set CF if code < 0x80000000,
+                                                          ; i.e. if code is positive
+    adc         code, -1                                  ; code += -1 + (code >= 0 ? 1 : 0);
+    movsxd      codeq, code                               ; sign extend code
+    mov         tempd, code                               ; temp = code;
+    sar         tempd, 31                                 ; temp >>= 31;
+    xor         tempd, code                               ; temp ^= code;  /* abs(block[0] - last_dc_val) */
+    lzcnt       tempd, tempd                              ; temp = # of leading 0 bits in temp
+    mov         nbits, 32                                 ; nbits = 32 - temp;
+    sub         nbits, tempd                              ; /* nbits = JPEG_NBITS(code); */
+    mov         tempd, [dctbl + c_derived_tbl.ehufco + nbitsq * 4]
+                                                          ; temp = dctbl->ehufco[nbits];
+    bzhi        code, code, nbits                         ; code &= (1 << nbits) - 1;
+    shlx        tempq, tempq, nbitsq                      ; temp <<= nbits;
+    or          code, tempd                               ; code |= temp;
+    add         nbitsb, byte [dctbl + c_derived_tbl.ehufsi + nbitsq]
+                                                          ; nbits += dctbl->ehufsi[nbits];
+%undef block
+%define free_bitsq  rdx
+%define free_bitsd  edx
+%define free_bitsb  dl
+%undef dctbl
+%define code_temp  r8d
+    lea         t, [t - 2]                                ; t = &t[-1];
+    mov         free_bitsd, [state+working_state.cur.free_bits]
+                                                          ; free_bits = state->cur.free_bits;
+    pcmpeqw     xmm1, xmm1                                ; b1[i] = 0xFF;
+    mov         put_buffer, [state+working_state.cur.put_buffer.simd]
+                                                          ; put_buffer = state->cur.put_buffer.simd;
+    sub         free_bitsb, nbitsb                        ; if ((free_bits -= nbits) >= 0)
+    jnl         .ENTRY_SKIP_EMIT_CODE                     ;   goto .ENTRY_SKIP_EMIT_CODE;
+    align       16
+.EMIT_CODE:                                               ; .EMIT_CODE:
+    EMIT_QWORD  .BLOOP_COND                               ; insert code, flush buffer, goto .BLOOP_COND
+
+; ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    align       16
+.BRLOOP:                                                  ; do {
+    lea         code_temp, [nbitsq - 16]                  ;   code_temp = nbits - 16;
+    movzx       nbits, byte [actbl + c_derived_tbl.ehufsi + 0xf0]
+                                                          ;   nbits = actbl->ehufsi[0xf0];
+    mov         code, [actbl + c_derived_tbl.ehufco + 0xf0 * 4]
+                                                          ;   code = actbl->ehufco[0xf0];
+    sub         free_bitsb, nbitsb                        ;   if ((free_bits -= nbits) <= 0)
+    jle         .EMIT_BRLOOP_CODE                         ;     goto .EMIT_BRLOOP_CODE;
+    shlx        put_buffer, put_buffer, nbitsq            ;   put_buffer <<= nbits;
+    mov         nbits, code_temp                          ;   nbits = code_temp;
+    or          put_buffer, codeq                         ;   put_buffer |= code;
+    cmp         nbits, 16                                 ;   if (nbits <= 16)
+    jle         .ERLOOP                                   ;     break;
+    jmp         .BRLOOP                                   ; } while (1);
+
+; ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    align       16
+.ENTRY_SKIP_EMIT_CODE:                                    ; .ENTRY_SKIP_EMIT_CODE:
+    shlx        put_buffer, put_buffer, nbitsq            ; put_buffer <<= nbits;
+    or          put_buffer, codeq                         ; put_buffer |= code;
+.BLOOP_COND:                                              ; .BLOOP_COND:
+    test        index, index                              ; if (index != 0)
+    jz          .ELOOP                                    ; {
+.BLOOP:                                                   ;   do {
+    xor         nbits, nbits                              ;     nbits = 0;  /* kill tzcnt input dependency */
+    tzcnt       nbitsq, index                             ;     nbits = # of trailing 0 bits in index
+    inc         nbits                                     ;     ++nbits;
+    lea         t, [t + nbitsq * 2]                       ;     t = &t[nbits];
+    shrx        index, index, nbitsq                      ;     index >>= nbits;
+.EMIT_BRLOOP_CODE_END:                                    ; .EMIT_BRLOOP_CODE_END:
+    cmp         nbits, 16                                 ;     if (nbits > 16)
+    jg          .BRLOOP                                   ;       goto .BRLOOP;
+.ERLOOP:                                                  ; .ERLOOP:
+    movsx       codeq, word [t]                           ;     code = *t;
+    movzx       code_temp, word [t + DCTSIZE2 * SIZEOF_WORD]
+                                                          ;     code_temp = abs(*t);
+    shl         nbits, 4                                  ;     nbits <<= 4;
+    lzcnt       code_temp, code_temp                      ;     code_temp = 32 - JPEG_NBITS(code);
+    sub         nbits, code_temp                          ;     nbits -= code_temp;
+    lea         tempd, [nbitsq + 16]                      ;     temp = nbits + 16;  /* (r << 4) + nbits - 16 */
+    and         nbits, 15                                 ;     nbits &= 15;  /* nbits = JPEG_NBITS(code) */
+    mov         code_temp, [actbl + c_derived_tbl.ehufco + tempq * 4]
+                                                          ;     code_temp = actbl->ehufco[temp];
+    bzhi        code, code, nbits                         ;     code &= (1 << nbits) - 1;
+    shlx        code_temp, code_temp, nbits               ;     code_temp <<= nbits;
+    add         nbitsb, [actbl + c_derived_tbl.ehufsi + tempq]
+                                                          ;     nbits += actbl->ehufsi[temp];
+    or          code, code_temp                           ;     code |= code_temp;
+    sub         free_bitsb, nbitsb                        ;     if ((free_bits -= nbits) <= 0)
+    jle         .EMIT_CODE                                ;       goto .EMIT_CODE;
+    shlx        put_buffer, put_buffer, nbitsq            ;     put_buffer <<= nbits;
+    or          put_buffer, codeq                         ;     put_buffer |= code;
+    test        index, index
+    jnz         .BLOOP                                    ;   } while (index != 0);
+.ELOOP:                                                   ; }  /* index != 0 */
+    sub         td, esp                                   ; t -= &t_[0];
+    cmp         td, (DCTSIZE2 - 2) * SIZEOF_WORD          ; if (t != 62)
+    je          .EFN                                      ; {
+    movzx       nbits, byte [actbl + c_derived_tbl.ehufsi + 0]
+                                                          ;   nbits = actbl->ehufsi[0];
+    mov         code, [actbl + c_derived_tbl.ehufco + 0]  ;   code = actbl->ehufco[0];
+    sub         free_bitsb, nbitsb                        ;   if ((free_bits -= nbits) <= 0)
+    jg          .EFN_SKIP_EMIT_CODE                       ;   {
+    EMIT_QWORD  .EFN                                      ;     insert code, flush buffer
+    align       16
+.EFN_SKIP_EMIT_CODE:                                      ;   } else {
+    shlx        put_buffer, put_buffer, nbitsq            ;     put_buffer <<= nbits;
+    or          put_buffer, codeq                         ;     put_buffer |= code;
+.EFN:                                                     ; } }
+    mov         [state + working_state.cur.put_buffer.simd], put_buffer
+                                                          ; state->cur.put_buffer.simd = put_buffer;
+    mov         byte [state + working_state.cur.free_bits], free_bitsb
+                                                          ; state->cur.free_bits = free_bits;
+    sub         rsp, -2 * DCTSIZE2 * SIZEOF_WORD
+%ifdef WIN64
+    pop         r12
+    pop         rdi
+    pop         rbp
+    pop         rbx
+%else
+    pop         r12
+    pop         rbp
+    pop         rbx
+%endif
+    ret
+
+; ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+    align       16
+.EMIT_BRLOOP_CODE:
+    EMIT_QWORD  .EMIT_BRLOOP_CODE_END, { mov nbits, code_temp }
+                                                          ; insert code, flush buffer,
+                                                          ; nbits = code_temp, goto .EMIT_BRLOOP_CODE_END
+
+; For some reason, the OS X linker does not honor the request to align the
+; segment unless we do this.
+    align       32
@@ -0,0 +1,213 @@
+;
+; jdcolext.asm - colorspace conversion (64-bit AVX-512)
+;
+; Copyright 2009, 2012 Pierre Ossman <ossman@cendio.se> for Cendio AB
+; Copyright (C) 2009, 2012, 2016, D. R. Commander.
+; Copyright (C) 2015, Intel Corporation.
+;
+; Based on the x86 SIMD extension for IJG JPEG library
+; Copyright (C) 1999-2006, MIYASAKA Masaru.
+; For conditions of distribution and use, see copyright notice in jsimdext.inc
+;
+; This file should be assembled with NASM (Netwide Assembler),
+; can *not* be assembled with Microsoft's MASM or any compatible
+; assembler (including Borland's Turbo Assembler).
+; NASM is available from http://nasm.sourceforge.net/ or
+; http://sourceforge.net/project/showfiles.php?group_id=6208
+
+; --------------------------------------------------------------------------
+;
+; Convert some rows of samples to the output colorspace.
+;
+; Each iteration of the column loop converts a strip of 64 pixels, 16 pixels
+; (one dword per pixel) at a time.  Partial strips at the end of a row are
+; handled with opmasks, so no pixels beyond the end of the row are read or
+; written.
+;
+; GLOBAL(void)
+; jsimd_ycc_rgb_convert_avx512(JDIMENSION out_width, JSAMPIMAGE input_buf,
+;                              JDIMENSION input_row, JSAMPARRAY output_buf,
+;                              int num_rows)
+;
+
+; r10d = JDIMENSION out_width
+; r11 = JSAMPIMAGE input_buf
+; r12d = JDIMENSION input_row
+; r13 = JSAMPARRAY output_buf
+; r14d = int num_rows
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_ycc_rgb_convert_avx512)
+
+EXTN(jsimd_ycc_rgb_convert_avx512):
+    push        rbp
+    mov         rax, rsp
+    mov         rbp, rsp
+    collect_args 5
+    push        rbx
+
+    mov         ecx, r10d               ; num_cols
+    test        rcx, rcx
+    jz          near .return
+
+    vpbroadcastd zmm16, [rel PW_F0402]
+    vpbroadcastd zmm17, [rel PW_MF0228]
+    vpbroadcastd zmm18, [rel PW_MF0344_F0285]
+    vpbroadcastd zmm19, [rel PD_ONEHALF]
+    vpbroadcastd zmm20, [rel PD_CENTERJSAMP]
+    vpbroadcastd zmm21, [rel PD_MAXJSAMP]
+    vpxord      zmm22, zmm22, zmm22
+    mov         eax, 0xAAAAAAAA
+    kmovd       k6, eax                 ; k6=(odd words)
+%if RGB_PIXELSIZE == 4
+    mov         eax, 0xFF << (8 * (6 - RGB_RED - RGB_GREEN - RGB_BLUE))
+    vpbroadcastd zmm23, eax             ; zmm23=(alpha/padding byte)
+%else
+    vbroadcasti32x4 zmm23, XMMWORD [rel PB_PACK3]
+    vmovdqu32   zmm24, ZMMWORD [rel PD_PACK3]
+%endif
+
+    mov         rdi, r11
+    mov         ecx, r12d
+    mov         rsip, JSAMPARRAY [rdi+0*SIZEOF_JSAMPARRAY]
+    mov         rbxp, JSAMPARRAY [rdi+1*SIZEOF_JSAMPARRAY]
+    mov         rdxp, JSAMPARRAY [rdi+2*SIZEOF_JSAMPARRAY]
+    lea         rsi, [rsi+rcx*SIZEOF_JSAMPROW]
+    lea         rbx, [rbx+rcx*SIZEOF_JSAMPROW]
+    lea         rdx, [rdx+rcx*SIZEOF_JSAMPROW]
+
+    mov         rdi, r13
+%if RGB_PIXELSIZE == 3
+    xor         r11, r11
+    mov         r12, 0xFFFFFFFFFFFF     ; r12=(byte mask for 16 pixels)
+%endif
+    mov         eax, r14d
+    test        rax, rax
+    jle         near .return
+.rowloop:
+    push        rdi
+    push        rdx
+    push        rbx
+    push        rsi
+
+    mov         ecx, r10d               ; num_cols
+    mov         rsip, JSAMPROW [rsi]    ; inptr0
+    mov         rbxp, JSAMPROW [rbx]    ; inptr1
+    mov         rdxp, JSAMPROW [rdx]    ; inptr2
+    mov         rdip, JSAMPROW [rdi]    ; outptr
+
+.columnloop:
+    mov         r9d, SIZEOF_ZMMWORD
+    cmp         rcx, r9
+    cmovb       r9, rcx                 ; r9=(number of pixels in the strip)
+    mov         r8, -1
+    bzhi        r8, r8, r9
+    kmovq       k5, r8                  ; k5=(pixel mask for the strip)
+%if RGB_PIXELSIZE == 3
+    lea         r9, [r9+r9*2]           ; r9=(number of bytes in the strip)
+%endif
+
+%assign GRP 0
+%rep 4
+    kshiftrq    k1, k5, GRP*16          ; k1=(pixel mask for this group)
+
+    vmovdqu8    xmm0{k1}{z}, XMMWORD [rsi+GRP*SIZEOF_XMMWORD]
+    vmovdqu8    xmm1{k1}{z}, XMMWORD [rbx+GRP*SIZEOF_XMMWORD]
+    vmovdqu8    xmm2{k1}{z}, XMMWORD [rdx+GRP*SIZEOF_XMMWORD]
+    vpmovzxbd   zmm0, xmm0              ; zmm0=Y
+    vpmovzxbd   zmm1, xmm1
+    vpmovzxbd   zmm2, xmm2
+    vpsubd      zmm1, zmm1, zmm20       ; zmm1=Cb
+    vpsubd      zmm2, zmm2, zmm20       ; zmm2=Cr
+
+    ; (Original)
+    ; R = Y                + 1.40200 * Cr
+    ; G = Y - 0.34414 * Cb - 0.71414 * Cr
+    ; B = Y + 1.77200 * Cb
+    ;
+    ; (This implementation)
+    ; R = Y                + 0.40200 * Cr + Cr
+    ; G = Y - 0.34414 * Cb + 0.28586 * Cr - Cr
+    ; B = Y - 0.22800 * Cb + Cb + Cb
+
+    vpslld      zmm3, zmm2, WORD_BIT    ; zmm3=Cr*FIX(1)
+    vpmaddwd    zmm4, zmm2, zmm16       ; zmm4=Cr*FIX(0.402)
+    vpaddd      zmm4, zmm4, zmm3
+    vpaddd      zmm4, zmm4, zmm19
+    vpsrad      zmm4, zmm4, SCALEBITS   ; zmm4=(Cr*FIX(1.402)+ONE_HALF)>>16
+
+    vpslld      zmm25, zmm1, WORD_BIT+1 ; zmm25=Cb*FIX(2)
+    vpmaddwd    zmm5, zmm1, zmm17       ; zmm5=Cb*-FIX(0.228)
+    vpaddd      zmm5, zmm5, zmm25
+    vpaddd      zmm5, zmm5, zmm19
+    vpsrad      zmm5, zmm5, SCALEBITS   ; zmm5=(Cb*FIX(1.772)+ONE_HALF)>>16
+
+    vpblendmw   zmm1{k6}, zmm1, zmm3    ; zmm1=(Cb0 Cr0 Cb1 Cr1 ... Cb15 Cr15)
+    vpmaddwd    zmm1, zmm1, zmm18       ; zmm1=CbCr*[-FIX(0.344) FIX(0.285)]
+    vpsubd      zmm1, zmm1, zmm3
+    vpaddd      zmm1, zmm1, zmm19
+    vpsrad      zmm1, zmm1, SCALEBITS   ; zmm1=(Cb*-FIX(0.344)+Cr*-FIX(0.714)
+                                        ;       +ONE_HALF)>>16
+
+    vpaddd      zmm4, zmm4, zmm0        ; zmm4=R
+    vpaddd      zmm1, zmm1, zmm0        ; zmm1=G
+    vpaddd      zmm5, zmm5, zmm0        ; zmm5=B
+    vpmaxsd     zmm4, zmm4, zmm22
+    vpmaxsd     zmm1, zmm1, zmm22
+    vpmaxsd     zmm5, zmm5, zmm22
+    vpminsd     zmm4, zmm4, zmm21
+    vpminsd     zmm1, zmm1, zmm21
+    vpminsd     zmm5, zmm5, zmm21
+
+    vpslld      zmm4, zmm4, RGB_RED*BYTE_BIT
+    vpslld      zmm1, zmm1, RGB_GREEN*BYTE_BIT
+    vpslld      zmm5, zmm5, RGB_BLUE*BYTE_BIT
+    vpternlogd  zmm4, zmm1, zmm5, 0xFE  ; zmm4=(one pixel per dword)
+
+%if RGB_PIXELSIZE == 3
+    bzhi        r8, r12, r9
+    test        r9, r9
+    cmovle      r8, r11
+    kmovq       k2, r8                  ; k2=(byte mask for this group)
+    sub         r9, byte 16*RGB_PIXELSIZE
+
+    vpshufb     zmm4, zmm4, zmm23       ; 12 bytes in each 128-bit lane
+    vpermd      zmm4, zmm24, zmm4       ; 48 contiguous bytes
+    vmovdqu8    ZMMWORD [rdi+GRP*16*RGB_PIXELSIZE]{k2}, zmm4
+%else
+    vpord       zmm4, zmm4, zmm23
+    vmovdqu32   ZMMWORD [rdi+GRP*16*RGB_PIXELSIZE]{k1}, zmm4
+%endif
+
+%assign GRP GRP+1
+%endrep
+
+    add         rsi, byte SIZEOF_ZMMWORD           ; inptr0
+    add         rbx, byte SIZEOF_ZMMWORD           ; inptr1
+    add         rdx, byte SIZEOF_ZMMWORD           ; inptr2
+    add         rdi, RGB_PIXELSIZE*SIZEOF_ZMMWORD  ; outptr
+    sub         rcx, byte SIZEOF_ZMMWORD
+    ja          near .columnloop
+
+    pop         rsi
+    pop         rbx
+    pop         rdx
+    pop         rdi
+
+    add         rsi, byte SIZEOF_JSAMPROW
+    add         rbx, byte SIZEOF_JSAMPROW
+    add         rdx, byte SIZEOF_JSAMPROW
+    add         rdi, byte SIZEOF_JSAMPROW  ; output_buf
+    dec         rax                        ; num_rows
+    jg          near .rowloop
+
+.return:
+    vzeroupper
+    pop         rbx
+    uncollect_args 5
+    pop         rbp
+    ret
+
+; For some reason, the OS X linker does not honor the request to align the
+; segment unless we do this.
+    align       32
@@ -0,0 +1,335 @@
+;
+; jdsample.asm - upsampling (64-bit AVX-512)
+;
+; Copyright 2009 Pierre Ossman <ossman@cendio.se> for Cendio AB
+; Copyright (C) 2009, 2016, D. R. Commander.
+; Copyright (C) 2015, Intel Corporation.
+;
+; Based on the x86 SIMD extension for IJG JPEG library
+; Copyright (C) 1999-2006, MIYASAKA Masaru.
+; For conditions of distribution and use, see copyright notice in jsimdext.inc
+;
+; This file should be assembled with NASM (Netwide Assembler),
+; can *not* be assembled with Microsoft's MASM or any compatible
+; assembler (including Borland's Turbo Assembler).
+; NASM is available from http://nasm.sourceforge.net/ or
+; http://sourceforge.net/project/showfiles.php?group_id=6208
+
+%include "jsimdext.inc"
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_CONST
+
+; Each constant occupies a single dword and is broadcast to all lanes of a ZMM
+; register when it is loaded.
+
+    alignz      32
+    GLOBAL_DATA(jconst_fancy_upsample_avx512)
+
+EXTN(jconst_fancy_upsample_avx512):
+
+PW_ONE   times 2 dw 1
+PW_TWO   times 2 dw 2
+PW_SEVEN times 2 dw 7
+PW_EIGHT times 2 dw 8
+
+    alignz      32
+
+; --------------------------------------------------------------------------
+;
+; Compute the opmasks for one iteration of the column loop.
+;
+; Input:  rax = number of input samples remaining in the row
+;         k4 = first lane if this is the first iteration, 0 otherwise
+; Output: k1 = input samples in this iteration
+;         k2 = input samples in this iteration that have a left neighbor
+;         k3 = input samples in this iteration that have a right neighbor
+;         k5 = last input sample of the row, if it is in this iteration
+;         k7 = output samples in this iteration
+; Clobbers r8, r9, and r11
+
+%macro GET_MASKS 0
+    mov         r9d, SIZEOF_YMMWORD
+    cmp         rax, r9
+    cmovb       r9, rax                 ; r9=(number of input samples)
+    mov         r8, -1
+    bzhi        r11, r8, r9
+    kmovd       k1, r11d
+    add         r9, r9
+    bzhi        r8, r8, r9
+    kmovq       k7, r8
+    mov         r8, r11
+    shr         r11d, 1
+    cmp         rax, byte SIZEOF_YMMWORD
+    cmova       r11d, r8d
+    kmovd       k3, r11d
+    kandnd      k2, k4, k1
+    kxord       k5, k1, k3
+%endmacro
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_TEXT
+    BITS        64
+;
+; Fancy processing for the common case of 2:1 horizontal and 1:1 vertical.
+;
+; The upsampling algorithm is linear interpolation between pixel centers,
+; also known as a "triangle filter".  This is a good compromise between
+; speed and visual quality.  The centers of the output pixels are 1/4 and 3/4
+; of the way between input pixel centers.
+;
+; Each iteration of the column loop produces a strip of 64 output samples
+; from 32 input samples.  The neighboring samples are read using unaligned,
+; masked loads, and the first and last columns are replicated using opmasks,
+; so (unlike the AVX2 implementation) this implementation does not need to
+; insert a dummy sample at the end of each input row.
+;
+; GLOBAL(void)
+; jsimd_h2v1_fancy_upsample_avx512(int max_v_samp_factor,
+;                                  JDIMENSION downsampled_width,
+;                                  JSAMPARRAY input_data,
+;                                  JSAMPARRAY *output_data_ptr);
+;
+
+; r10 = int max_v_samp_factor
+; r11d = JDIMENSION downsampled_width
+; r12 = JSAMPARRAY input_data
+; r13 = JSAMPARRAY *output_data_ptr
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_h2v1_fancy_upsample_avx512)
+
+EXTN(jsimd_h2v1_fancy_upsample_avx512):
+    push        rbp
+    mov         rax, rsp
+    mov         rbp, rsp
+    collect_args 4
+
+    mov         eax, r11d               ; colctr
+    test        rax, rax
+    jz          near .return
+
+    mov         rcx, r10                ; rowctr
+    test        rcx, rcx
+    jz          near .return
+
+    mov         rsi, r12                ; input_data
+    mov         rdi, r13
+    mov         rdip, JSAMPARRAY [rdi]  ; output_data
+
+    vpbroadcastd zmm16, [rel PW_ONE]
+    vpbroadcastd zmm17, [rel PW_TWO]
+    mov         edx, 1
+    kmovd       k6, edx                 ; k6=(first lane)
+
+.rowloop:
+    push        rax                     ; colctr
+    push        rdi
+    push        rsi
+
+    mov         rsip, JSAMPROW [rsi]    ; inptr
+    mov         rdip, JSAMPROW [rdi]    ; outptr
+    kmovd       k4, k6                  ; k4=(first column of the row)
+
+.columnloop:
+    GET_MASKS
+
+    vmovdqu8    ymm0{k1}{z}, YMMWORD [rsi]
+    vmovdqu8    ymm1{k2}{z}, YMMWORD [rsi-1*SIZEOF_JSAMPLE]
+    vmovdqu8    ymm2{k3}{z}, YMMWORD [rsi+1*SIZEOF_JSAMPLE]
+    vpmovzxbw   zmm0, ymm0              ; zmm0=( 0  1  2 ... 29 30 31)
+    vpmovzxbw   zmm1, ymm1              ; zmm1=(--  0  1 ... 28 29 30)
+    vpmovzxbw   zmm2, ymm2              ; zmm2=( 1  2  3 ... 30 31 32)
+    vmovdqu16   zmm1{k4}, zmm0          ; zmm1=( 0  0  1 ... 28 29 30)
+    vmovdqu16   zmm2{k5}, zmm0          ; (last column of the row)
+
+    vpaddw      zmm3, zmm0, zmm0
+    vpaddw      zmm0, zmm0, zmm3        ; zmm0=Int*3
+
+    vpaddw      zmm1, zmm1, zmm0
+    vpaddw      zmm1, zmm1, zmm16
+    vpsrlw      zmm1, zmm1, 2           ; zmm1=OutLE=(Int*3+Int[-1]+1)>>2
+    vpaddw      zmm2, zmm2, zmm0
+    vpaddw      zmm2, zmm2, zmm17
+    vpsrlw      zmm2, zmm2, 2           ; zmm2=OutLO=(Int*3+Int[+1]+2)>>2
+
+    vpsllw      zmm2, zmm2, BYTE_BIT
+    vpord       zmm1, zmm1, zmm2        ; zmm1=(OutL0 OutL1 OutL2 ... OutL63)
+    vmovdqu8    ZMMWORD [rdi]{k7}, zmm1
+
+    kxord       k4, k4, k4
+    add         rsi, byte SIZEOF_YMMWORD  ; inptr
+    add         rdi, byte SIZEOF_ZMMWORD  ; outptr
+    sub         rax, byte SIZEOF_YMMWORD
+    ja          near .columnloop
+
+    pop         rsi
+    pop         rdi
+    pop         rax
+
+    add         rsi, byte SIZEOF_JSAMPROW  ; input_data
+    add         rdi, byte SIZEOF_JSAMPROW  ; output_data
+    dec         rcx                        ; rowctr
+    jg          near .rowloop
+
+.return:
+    vzeroupper
+    uncollect_args 4
+    pop         rbp
+    ret
+
+; --------------------------------------------------------------------------
+;
+; Fancy processing for the common case of 2:1 horizontal and 2:1 vertical.
+; Again a triangle filter; see comments for h2v1 case, above.
+;
+; GLOBAL(void)
+; jsimd_h2v2_fancy_upsample_avx512(int max_v_samp_factor,
+;                                  JDIMENSION downsampled_width,
+;                                  JSAMPARRAY input_data,
+;                                  JSAMPARRAY *output_data_ptr);
+;
+
+; r10 = int max_v_samp_factor
+; r11d = JDIMENSION downsampled_width
+; r12 = JSAMPARRAY input_data
+; r13 = JSAMPARRAY *output_data_ptr
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_h2v2_fancy_upsample_avx512)
+
+EXTN(jsimd_h2v2_fancy_upsample_avx512):
+    push        rbp
+    mov         rax, rsp
+    mov         rbp, rsp
+    collect_args 4
+    push        rbx
+
+    mov         eax, r11d               ; colctr
+    test        rax, rax
+    jz          near .return
+
+    mov         rcx, r10                ; rowctr
+    test        rcx, rcx
+    jz          near .return
+
+    mov         rsi, r12                ; input_data
+    mov         rdi, r13
+    mov         rdip, JSAMPARRAY [rdi]  ; output_data
+
+    vpbroadcastd zmm16, [rel PW_SEVEN]
+    vpbroadcastd zmm17, [rel PW_EIGHT]
+    mov         edx, 1
+    kmovd       k6, edx                 ; k6=(first lane)
+
+.rowloop:
+    push        rax                     ; colctr
+    push        rcx
+    push        rdi
+    push        rsi
+
+    mov         rcxp, JSAMPROW [rsi-1*SIZEOF_JSAMPROW]  ; inptr1(above)
+    mov         rbxp, JSAMPROW [rsi+0*SIZEOF_JSAMPROW]  ; inptr0
+    mov         rsip, JSAMPROW [rsi+1*SIZEOF_JSAMPROW]  ; inptr1(below)
+    mov         rdxp, JSAMPROW [rdi+0*SIZEOF_JSAMPROW]  ; outptr0
+    mov         rdip, JSAMPROW [rdi+1*SIZEOF_JSAMPROW]  ; outptr1
+    kmovd       k4, k6                  ; k4=(first column of the row)
+
+.columnloop:
+    GET_MASKS
+
+    vmovdqu8    ymm0{k1}{z}, YMMWORD [rbx]
+    vmovdqu8    ymm1{k1}{z}, YMMWORD [rcx]
+    vmovdqu8    ymm2{k1}{z}, YMMWORD [rsi]
+    vmovdqu8    ymm3{k2}{z}, YMMWORD [rbx-1*SIZEOF_JSAMPLE]
+    vmovdqu8    ymm4{k2}{z}, YMMWORD [rcx-1*SIZEOF_JSAMPLE]
+    vmovdqu8    ymm5{k2}{z}, YMMWORD [rsi-1*SIZEOF_JSAMPLE]
+    vmovdqu8    ymm24{k3}{z}, YMMWORD [rbx+1*SIZEOF_JSAMPLE]
+    vmovdqu8    ymm25{k3}{z}, YMMWORD [rcx+1*SIZEOF_JSAMPLE]
+    vmovdqu8    ymm26{k3}{z}, YMMWORD [rsi+1*SIZEOF_JSAMPLE]
+    vpmovzxbw   zmm0, ymm0
+    vpmovzxbw   zmm1, ymm1
+    vpmovzxbw   zmm2, ymm2
+    vpmovzxbw   zmm3, ymm3
+    vpmovzxbw   zmm4, ymm4
+    vpmovzxbw   zmm5, ymm5
+    vpmovzxbw   zmm24, ymm24
+    vpmovzxbw   zmm25, ymm25
+    vpmovzxbw   zmm26, ymm26
+
+    ; Compute the column sums (Int0*3+Int1) for this column and for the
+    ; columns to the left and right of it.
+
+    vpaddw      zmm27, zmm0, zmm0
+    vpaddw      zmm0, zmm0, zmm27
+    vpaddw      zmm1, zmm1, zmm0        ; zmm1=Int0U=( 0  1 ... 31)
+    vpaddw      zmm2, zmm2, zmm0        ; zmm2=Int0D=( 0  1 ... 31)
+    vpaddw      zmm27, zmm3, zmm3
+    vpaddw      zmm3, zmm3, zmm27
+    vpaddw      zmm4, zmm4, zmm3        ; zmm4=Int-1U=(-- 0 ... 30)
+    vpaddw      zmm5, zmm5, zmm3        ; zmm5=Int-1D=(-- 0 ... 30)
+    vpaddw      zmm27, zmm24, zmm24
+    vpaddw      zmm24, zmm24, zmm27
+    vpaddw      zmm25, zmm25, zmm24     ; zmm25=Int+1U=( 1 2 ... 32)
+    vpaddw      zmm26, zmm26, zmm24     ; zmm26=Int+1D=( 1 2 ... 32)
+
+    vmovdqu16   zmm4{k4}, zmm1          ; (first column of the row)
+    vmovdqu16   zmm5{k4}, zmm2
+    vmovdqu16   zmm25{k5}, zmm1         ; (last column of the row)
+    vmovdqu16   zmm26{k5}, zmm2
+
+    vpaddw      zmm27, zmm1, zmm1
+    vpaddw      zmm1, zmm1, zmm27       ; zmm1=Int0U*3
+    vpaddw      zmm27, zmm2, zmm2
+    vpaddw      zmm2, zmm2, zmm27       ; zmm2=Int0D*3
+
+    vpaddw      zmm4, zmm4, zmm1
+    vpaddw      zmm4, zmm4, zmm17
+    vpsrlw      zmm4, zmm4, 4           ; zmm4=OutUE=(Int0U*3+Int-1U+8)>>4
+    vpaddw      zmm25, zmm25, zmm1
+    vpaddw      zmm25, zmm25, zmm16
+    vpsrlw      zmm25, zmm25, 4         ; zmm25=OutUO=(Int0U*3+Int+1U+7)>>4
+    vpsllw      zmm25, zmm25, BYTE_BIT
+    vpord       zmm4, zmm4, zmm25       ; zmm4=(OutU0 OutU1 ... OutU63)
+
+    vpaddw      zmm5, zmm5, zmm2
+    vpaddw      zmm5, zmm5, zmm17
+    vpsrlw      zmm5, zmm5, 4           ; zmm5=OutDE=(Int0D*3+Int-1D+8)>>4
+    vpaddw      zmm26, zmm26, zmm2
+    vpaddw      zmm26, zmm26, zmm16
+    vpsrlw      zmm26, zmm26, 4         ; zmm26=OutDO=(Int0D*3+Int+1D+7)>>4
+    vpsllw      zmm26, zmm26, BYTE_BIT
+    vpord       zmm5, zmm5, zmm26       ; zmm5=(OutD0 OutD1 ... OutD63)
+
+    vmovdqu8    ZMMWORD [rdx]{k7}, zmm4
+    vmovdqu8    ZMMWORD [rdi]{k7}, zmm5
+
+    kxord       k4, k4, k4
+    add         rcx, byte SIZEOF_YMMWORD  ; inptr1(above)
+    add         rbx, byte SIZEOF_YMMWORD  ; inptr0
+    add         rsi, byte SIZEOF_YMMWORD  ; inptr1(below)
+    add         rdx, byte SIZEOF_ZMMWORD  ; outptr0
+    add         rdi, byte SIZEOF_ZMMWORD  ; outptr1
+    sub         rax, byte SIZEOF_YMMWORD
+    ja          near .columnloop
+
+    pop         rsi
+    pop         rdi
+    pop         rcx
+    pop         rax
+
+    add         rsi, byte 1*SIZEOF_JSAMPROW  ; input_data
+    add         rdi, byte 2*SIZEOF_JSAMPROW  ; output_data
+    sub         rcx, byte 2                  ; rowctr
+    jg          near .rowloop
+
+.return:
+    vzeroupper
+    pop         rbx
+    uncollect_args 4
+    pop         rbp
+    ret
+
+; For some reason, the OS X linker does not honor the request to align the
+; segment unless we do this.
+    align       32
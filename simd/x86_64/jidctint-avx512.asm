@@ -0,0 +1,474 @@
+;
+; jidctint.asm - accurate integer IDCT (64-bit AVX-512)
+;
+; Copyright 2009 Pierre Ossman <ossman@cendio.se> for Cendio AB
+; Copyright (C) 2009, 2016, 2018, 2020, D. R. Commander.
+; Copyright (C) 2018, Matthias Räncker.
+;
+; Based on the x86 SIMD extension for IJG JPEG library
+; Copyright (C) 1999-2006, MIYASAKA Masaru.
+; For conditions of distribution and use, see copyright notice in jsimdext.inc
+;
+; This file should be assembled with NASM (Netwide Assembler),
+; can *not* be assembled with Microsoft's MASM or any compatible
+; assembler (including Borland's Turbo Assembler).
+; NASM is available from http://nasm.sourceforge.net/ or
+; http://sourceforge.net/project/showfiles.php?group_id=6208
+;
+; This file contains a slower but more accurate integer implementation of the
+; inverse DCT (Discrete Cosine Transform). The following code is based
+; directly on the IJG's original jidctint.c; see the jidctint.c for
+; more details.
+
+%include "jsimdext.inc"
+%include "jdct.inc"
+
+; --------------------------------------------------------------------------
+
+%define CONST_BITS  13
+%define PASS1_BITS  2
+
+%define DESCALE_P1  (CONST_BITS - PASS1_BITS)
+%define DESCALE_P2  (CONST_BITS + PASS1_BITS + 3)
+
+%if CONST_BITS == 13
+F_0_298 equ  2446  ; FIX(0.298631336)
+F_0_390 equ  3196  ; FIX(0.390180644)
+F_0_541 equ  4433  ; FIX(0.541196100)
+F_0_765 equ  6270  ; FIX(0.765366865)
+F_0_899 equ  7373  ; FIX(0.899976223)
+F_1_175 equ  9633  ; FIX(1.175875602)
+F_1_501 equ 12299  ; FIX(1.501321110)
+F_1_847 equ 15137  ; FIX(1.847759065)
+F_1_961 equ 16069  ; FIX(1.961570560)
+F_2_053 equ 16819  ; FIX(2.053119869)
+F_2_562 equ 20995  ; FIX(2.562915447)
+F_3_072 equ 25172  ; FIX(3.072711026)
+%else
+; NASM cannot do compile-time arithmetic on floating-point constants.
+%define DESCALE(x, n)  (((x) + (1 << ((n) - 1))) >> (n))
+F_0_298 equ DESCALE( 320652955, 30 - CONST_BITS)  ; FIX(0.298631336)
+F_0_390 equ DESCALE( 418953276, 30 - CONST_BITS)  ; FIX(0.390180644)
+F_0_541 equ DESCALE( 581104887, 30 - CONST_BITS)  ; FIX(0.541196100)
+F_0_765 equ DESCALE( 821806413, 30 - CONST_BITS)  ; FIX(0.765366865)
+F_0_899 equ DESCALE( 966342111, 30 - CONST_BITS)  ; FIX(0.899976223)
+F_1_175 equ DESCALE(1262586813, 30 - CONST_BITS)  ; FIX(1.175875602)
+F_1_501 equ DESCALE(1612031267, 30 - CONST_BITS)  ; FIX(1.501321110)
+F_1_847 equ DESCALE(1984016188, 30 - CONST_BITS)  ; FIX(1.847759065)
+F_1_961 equ DESCALE(2106220350, 30 - CONST_BITS)  ; FIX(1.961570560)
+F_2_053 equ DESCALE(2204520673, 30 - CONST_BITS)  ; FIX(2.053119869)
+F_2_562 equ DESCALE(2751909506, 30 - CONST_BITS)  ; FIX(2.562915447)
+F_3_072 equ DESCALE(3299298341, 30 - CONST_BITS)  ; FIX(3.072711026)
+%endif
+
+
+; --------------------------------------------------------------------------
+; Register assignments
+;
+; Each ZMM register holds the same data for two blocks: the low 256 bits hold
+; the first block, and the high 256 bits hold the second block, in the same
+; layout that jsimd_idct_islow_avx2() uses for one block.
+
+%define ZERO                        zmm16
+%define PERM_0x20                   zmm17
+%define PERM_0x31                   zmm18
+%define PERM_IN0_4_IN3_1            zmm19
+%define PERM_IN2_6_IN7_5            zmm20
+%define ZMM_F130_F054_MF130_F054    zmm21
+%define ZMM_MF078_F117_F078_F117    zmm22
+%define ZMM_MF060_MF089_MF050_MF256 zmm23
+%define ZMM_MF089_F060_MF256_F050   zmm24
+%define ZMM_DESCALE_P1              zmm25
+%define ZMM_DESCALE_P2              zmm26
+%define ZMM_CENTERJSAMP             zmm27
+
+; --------------------------------------------------------------------------
+; In-place 2x8x8x16-bit inverse matrix transpose using AVX-512 instructions
+; %1-%4: Input/output registers
+; %5-%8: Temp registers
+
+%macro dotranspose 8
+    ; Each 256-bit half:
+    ; %5=(00 10 20 30 40 50 60 70  01 11 21 31 41 51 61 71)
+    ; %6=(03 13 23 33 43 53 63 73  02 12 22 32 42 52 62 72)
+    ; %7=(04 14 24 34 44 54 64 74  05 15 25 35 45 55 65 75)
+    ; %8=(07 17 27 37 47 57 67 77  06 16 26 36 46 56 66 76)
+
+    vpermq      %5, %1, 0xD8
+    vpermq      %6, %2, 0x72
+    vpermq      %7, %3, 0xD8
+    vpermq      %8, %4, 0x72
+    ; transpose coefficients(phase 1)
+    ; %5=(00 10 20 30 01 11 21 31  40 50 60 70 41 51 61 71)
+    ; %6=(02 12 22 32 03 13 23 33  42 52 62 72 43 53 63 73)
+    ; %7=(04 14 24 34 05 15 25 35  44 54 64 74 45 55 65 75)
+    ; %8=(06 16 26 36 07 17 27 37  46 56 66 76 47 57 67 77)
+
+    vpunpcklwd  %1, %5, %6
+    vpunpckhwd  %2, %5, %6
+    vpunpcklwd  %3, %7, %8
+    vpunpckhwd  %4, %7, %8
+    ; transpose coefficients(phase 2)
+    ; %1=(00 02 10 12 20 22 30 32  40 42 50 52 60 62 70 72)
+    ; %2=(01 03 11 13 21 23 31 33  41 43 51 53 61 63 71 73)
+    ; %3=(04 06 14 16 24 26 34 36  44 46 54 56 64 66 74 76)
+    ; %4=(05 07 15 17 25 27 35 37  45 47 55 57 65 67 75 77)
+
+    vpunpcklwd  %5, %1, %2
+    vpunpcklwd  %6, %3, %4
+    vpunpckhwd  %7, %1, %2
+    vpunpckhwd  %8, %3, %4
+    ; transpose coefficients(phase 3)
+    ; %5=(00 01 02 03 10 11 12 13  40 41 42 43 50 51 52 53)
+    ; %6=(04 05 06 07 14 15 16 17  44 45 46 47 54 55 56 57)
+    ; %7=(20 21 22 23 30 31 32 33  60 61 62 63 70 71 72 73)
+    ; %8=(24 25 26 27 34 35 36 37  64 65 66 67 74 75 76 77)
+
+    vpunpcklqdq %1, %5, %6
+    vpunpckhqdq %2, %5, %6
+    vpunpcklqdq %3, %7, %8
+    vpunpckhqdq %4, %7, %8
+    ; transpose coefficients(phase 4)
+    ; %1=(00 01 02 03 04 05 06 07  40 41 42 43 44 45 46 47)
+    ; %2=(10 11 12 13 14 15 16 17  50 51 52 53 54 55 56 57)
+    ; %3=(20 21 22 23 24 25 26 27  60 61 62 63 64 65 66 67)
+    ; %4=(30 31 32 33 34 35 36 37  70 71 72 73 74 75 76 77)
+%endmacro
+
+; --------------------------------------------------------------------------
+; In-place 2x8x8x16-bit accurate integer inverse DCT using AVX-512
+; instructions
+; %1-%4:  Input/output registers
+; %5-%12: Temp registers
+; %9:     Pass (1 or 2)
+
+%macro dodct 13
+    ; -- Even part
+
+    ; (Original)
+    ; z1 = (z2 + z3) * 0.541196100;
+    ; tmp2 = z1 + z3 * -1.847759065;
+    ; tmp3 = z1 + z2 * 0.765366865;
+    ;
+    ; (This implementation)
+    ; tmp2 = z2 * 0.541196100 + z3 * (0.541196100 - 1.847759065);
+    ; tmp3 = z2 * (0.541196100 + 0.765366865) + z3 * 0.541196100;
+
+    vshufi64x2  %6, %3, %3, 0xB1        ; %6=in6_2
+    vpunpcklwd  %5, %3, %6              ; %5=in26_62L
+    vpunpckhwd  %6, %3, %6              ; %6=in26_62H
+    vpmaddwd    %5, %5, ZMM_F130_F054_MF130_F054  ; %5=tmp3_2L
+    vpmaddwd    %6, %6, ZMM_F130_F054_MF130_F054  ; %6=tmp3_2H
+
+    vshufi64x2  %7, %1, %1, 0xB1        ; %7=in4_0
+    vpsubw      %1{k1}, ZERO, %1
+    vpaddw      %7, %7, %1              ; %7=(in0+in4)_(in0-in4)
+
+    vpxord      %1, %1, %1
+    vpunpcklwd  %8, %1, %7              ; %8=tmp0_1L
+    vpunpckhwd  %1, %1, %7              ; %1=tmp0_1H
+    vpsrad      %8, %8, (16-CONST_BITS)  ; vpsrad %8,16 & vpslld %8,CONST_BITS
+    vpsrad      %1, %1, (16-CONST_BITS)  ; vpsrad %1,16 & vpslld %1,CONST_BITS
+
+    vpsubd      %11, %8, %5             ; %11=tmp0_1L-tmp3_2L=tmp13_12L
+    vpaddd      %9, %8, %5              ; %9=tmp0_1L+tmp3_2L=tmp10_11L
+    vpsubd      %12, %1, %6             ; %12=tmp0_1H-tmp3_2H=tmp13_12H
+    vpaddd      %10, %1, %6             ; %10=tmp0_1H+tmp3_2H=tmp10_11H
+
+    ; -- Odd part
+
+    vpaddw      %1, %4, %2              ; %1=in7_5+in3_1=z3_4
+
+    ; (Original)
+    ; z5 = (z3 + z4) * 1.175875602;
+    ; z3 = z3 * -1.961570560;  z4 = z4 * -0.390180644;
+    ; z3 += z5;  z4 += z5;
+    ;
+    ; (This implementation)
+    ; z3 = z3 * (1.175875602 - 1.961570560) + z4 * 1.175875602;
+    ; z4 = z3 * 1.175875602 + z4 * (1.175875602 - 0.390180644);
+
+    vshufi64x2  %8, %1, %1, 0xB1        ; %8=z4_3
+    vpunpcklwd  %7, %1, %8              ; %7=z34_43L
+    vpunpckhwd  %8, %1, %8              ; %8=z34_43H
+    vpmaddwd    %7, %7, ZMM_MF078_F117_F078_F117  ; %7=z3_4L
+    vpmaddwd    %8, %8, ZMM_MF078_F117_F078_F117  ; %8=z3_4H
+
+    ; (Original)
+    ; z1 = tmp0 + tmp3;  z2 = tmp1 + tmp2;
+    ; tmp0 = tmp0 * 0.298631336;  tmp1 = tmp1 * 2.053119869;
+    ; tmp2 = tmp2 * 3.072711026;  tmp3 = tmp3 * 1.501321110;
+    ; z1 = z1 * -0.899976223;  z2 = z2 * -2.562915447;
+    ; tmp0 += z1 + z3;  tmp1 += z2 + z4;
+    ; tmp2 += z2 + z3;  tmp3 += z1 + z4;
+    ;
+    ; (This implementation)
+    ; tmp0 = tmp0 * (0.298631336 - 0.899976223) + tmp3 * -0.899976223;
+    ; tmp1 = tmp1 * (2.053119869 - 2.562915447) + tmp2 * -2.562915447;
+    ; tmp2 = tmp1 * -2.562915447 + tmp2 * (3.072711026 - 2.562915447);
+    ; tmp3 = tmp0 * -0.899976223 + tmp3 * (1.501321110 - 0.899976223);
+    ; tmp0 += z3;  tmp1 += z4;
+    ; tmp2 += z3;  tmp3 += z4;
+
+    vshufi64x2  %2, %2, %2, 0xB1        ; %2=in1_3
+    vpunpcklwd  %3, %4, %2              ; %3=in71_53L
+    vpunpckhwd  %4, %4, %2              ; %4=in71_53H
+
+    vpmaddwd    %5, %3, ZMM_MF060_MF089_MF050_MF256  ; %5=tmp0_1L
+    vpmaddwd    %6, %4, ZMM_MF060_MF089_MF050_MF256  ; %6=tmp0_1H
+    vpaddd      %5, %5, %7              ; %5=tmp0_1L+z3_4L=tmp0_1L
+    vpaddd      %6, %6, %8              ; %6=tmp0_1H+z3_4H=tmp0_1H
+
+    vpmaddwd    %3, %3, ZMM_MF089_F060_MF256_F050  ; %3=tmp3_2L
+    vpmaddwd    %4, %4, ZMM_MF089_F060_MF256_F050  ; %4=tmp3_2H
+    vshufi64x2  %7, %7, %7, 0xB1        ; %7=z4_3L
+    vshufi64x2  %8, %8, %8, 0xB1        ; %8=z4_3H
+    vpaddd      %7, %3, %7              ; %7=tmp3_2L+z4_3L=tmp3_2L
+    vpaddd      %8, %4, %8              ; %8=tmp3_2H+z4_3H=tmp3_2H
+
+    ; -- Final output stage
+
+    vpaddd      %1, %9, %7              ; %1=tmp10_11L+tmp3_2L=data0_1L
+    vpaddd      %2, %10, %8             ; %2=tmp10_11H+tmp3_2H=data0_1H
+    vpaddd      %1, %1, ZMM_DESCALE_P %+ %13
+    vpaddd      %2, %2, ZMM_DESCALE_P %+ %13
+    vpsrad      %1, %1, DESCALE_P %+ %13
+    vpsrad      %2, %2, DESCALE_P %+ %13
+    vpackssdw   %1, %1, %2              ; %1=data0_1
+
+    vpsubd      %3, %9, %7              ; %3=tmp10_11L-tmp3_2L=data7_6L
+    vpsubd      %4, %10, %8             ; %4=tmp10_11H-tmp3_2H=data7_6H
+    vpaddd      %3, %3, ZMM_DESCALE_P %+ %13
+    vpaddd      %4, %4, ZMM_DESCALE_P %+ %13
+    vpsrad      %3, %3, DESCALE_P %+ %13
+    vpsrad      %4, %4, DESCALE_P %+ %13
+    vpackssdw   %4, %3, %4              ; %4=data7_6
+
+    vpaddd      %7, %11, %5             ; %7=tmp13_12L+tmp0_1L=data3_2L
+    vpaddd      %8, %12, %6             ; %8=tmp13_12H+tmp0_1H=data3_2H
+    vpaddd      %7, %7, ZMM_DESCALE_P %+ %13
+    vpaddd      %8, %8, ZMM_DESCALE_P %+ %13
+    vpsrad      %7, %7, DESCALE_P %+ %13
+    vpsrad      %8, %8, DESCALE_P %+ %13
+    vpackssdw   %2, %7, %8              ; %2=data3_2
+
+    vpsubd      %7, %11, %5             ; %7=tmp13_12L-tmp0_1L=data4_5L
+    vpsubd      %8, %12, %6             ; %8=tmp13_12H-tmp0_1H=data4_5H
+    vpaddd      %7, %7, ZMM_DESCALE_P %+ %13
+    vpaddd      %8, %8, ZMM_DESCALE_P %+ %13
+    vpsrad      %7, %7, DESCALE_P %+ %13
+    vpsrad      %8, %8, DESCALE_P %+ %13
+    vpackssdw   %3, %7, %8              ; %3=data4_5
+%endmacro
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_CONST
+
+; The multiplier and rounding constants are the same 256-bit vectors that
+; jsimd_idct_islow_avx2() uses, and they are broadcast to both halves of a ZMM
+; register when they are loaded.  The qword indices emulate vperm2i128 within
+; each half, or they gather four rows of one block from two ZMM registers.
+
+    alignz      32
+    GLOBAL_DATA(jconst_idct_islow_avx512)
+
+EXTN(jconst_idct_islow_avx512):
+
+PQ_PERM_0x20               dq  0, 1,  8,  9,  4,  5, 12, 13
+PQ_PERM_0x31               dq  2, 3, 10, 11,  6,  7, 14, 15
+PQ_PERM_IN0_4_IN3_1        dq  0, 1,  8,  9,  6,  7,  2,  3
+PQ_PERM_IN2_6_IN7_5        dq  4, 5, 12, 13, 14, 15, 10, 11
+PW_F130_F054_MF130_F054    times 4  dw  (F_0_541 + F_0_765),  F_0_541
+                           times 4  dw  (F_0_541 - F_1_847),  F_0_541
+PW_MF078_F117_F078_F117    times 4  dw  (F_1_175 - F_1_961),  F_1_175
+                           times 4  dw  (F_1_175 - F_0_390),  F_1_175
+PW_MF060_MF089_MF050_MF256 times 4  dw  (F_0_298 - F_0_899), -F_0_899
+                           times 4  dw  (F_2_053 - F_2_562), -F_2_562
+PW_MF089_F060_MF256_F050   times 4  dw -F_0_899, (F_1_501 - F_0_899)
+                           times 4  dw -F_2_562, (F_3_072 - F_2_562)
+PD_DESCALE_P1              times 8  dd  1 << (DESCALE_P1 - 1)
+PD_DESCALE_P2              times 8  dd  1 << (DESCALE_P2 - 1)
+PB_CENTERJSAMP             times 32 db  CENTERJSAMPLE
+
+    alignz      32
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_TEXT
+    BITS        64
+;
+; Perform dequantization and inverse DCT on two horizontally adjacent blocks
+; of coefficients.
+;
+; GLOBAL(void)
+; jsimd_idct_islow_avx512(void *dct_table, JCOEFPTR coef_block,
+;                         JSAMPARRAY output_buf, JDIMENSION output_col)
+;
+; coef_block points to two consecutive DCTSIZE2-element blocks that share the
+; same quantization table.  Rows 0-7 below are the first block, and rows 8-15
+; are the second block.  The first block is written to columns
+; output_col..output_col+7 of output_buf, and the second block is written to
+; the next 8 columns.
+;
+
+; r10 = jpeg_component_info *compptr
+; r11 = JCOEFPTR coef_block
+; r12 = JSAMPARRAY output_buf
+; r13d = JDIMENSION output_col
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_idct_islow_avx512)
+
+EXTN(jsimd_idct_islow_avx512):
+    push        rbp
+    mov         rax, rsp                     ; rax = original rbp
+    mov         rbp, rsp                     ; rbp = aligned rbp
+    push_xmm    4
+    collect_args 4
+
+    vmovdqu64   PERM_0x20, ZMMWORD [rel PQ_PERM_0x20]
+    vmovdqu64   PERM_0x31, ZMMWORD [rel PQ_PERM_0x31]
+    vmovdqu64   PERM_IN0_4_IN3_1, ZMMWORD [rel PQ_PERM_IN0_4_IN3_1]
+    vmovdqu64   PERM_IN2_6_IN7_5, ZMMWORD [rel PQ_PERM_IN2_6_IN7_5]
+    vbroadcasti64x4 ZMM_F130_F054_MF130_F054, [rel PW_F130_F054_MF130_F054]
+    vbroadcasti64x4 ZMM_MF078_F117_F078_F117, [rel PW_MF078_F117_F078_F117]
+    vbroadcasti64x4 ZMM_MF060_MF089_MF050_MF256, [rel PW_MF060_MF089_MF050_MF256]
+    vbroadcasti64x4 ZMM_MF089_F060_MF256_F050, [rel PW_MF089_F060_MF256_F050]
+    vbroadcasti64x4 ZMM_DESCALE_P1, [rel PD_DESCALE_P1]
+    vbroadcasti64x4 ZMM_DESCALE_P2, [rel PD_DESCALE_P2]
+    vbroadcasti64x4 ZMM_CENTERJSAMP, [rel PB_CENTERJSAMP]
+    vpxord      ZERO, ZERO, ZERO
+    mov         eax, 0xFF00FF00
+    kmovd       k1, eax                 ; k1=(upper 128 bits of each block)
+
+    ; ---- Pass 1: process columns.
+
+    ; zmm4/zmm5=(rows 0-3/4-7 of block 1), zmm6/zmm7=(rows 0-3/4-7 of block 2)
+    vmovdqu64   zmm4, ZMMWORD [ZMMBLOCK(0,0,r11,SIZEOF_JCOEF)]
+    vmovdqu64   zmm5, ZMMWORD [ZMMBLOCK(4,0,r11,SIZEOF_JCOEF)]
+    vmovdqu64   zmm6, ZMMWORD [ZMMBLOCK(8,0,r11,SIZEOF_JCOEF)]
+    vmovdqu64   zmm7, ZMMWORD [ZMMBLOCK(12,0,r11,SIZEOF_JCOEF)]
+
+%ifndef NO_ZERO_COLUMN_TEST_ISLOW_AVX512
+    vpord       zmm0, zmm4, zmm6
+    vpord       zmm1, zmm5, zmm7
+    vptestmq    k2, zmm0, zmm0          ; k2=(nonzero qwords in rows 0-3)
+    vptestmq    k3, zmm1, zmm1          ; k3=(nonzero qwords in rows 4-7)
+    kmovd       eax, k2
+    kmovd       edx, k3
+    and         eax, 0xFC               ; ignore the DC row
+    or          eax, edx
+    jnz         near .columnDCT
+
+    ; -- AC terms all zero in both blocks
+
+    vinserti128 ymm4, ymm4, xmm6, 1     ; ymm4=(row 0 of block 1, block 2)
+    vbroadcasti128 ymm5, XMMWORD [XMMBLOCK(0,0,r10,SIZEOF_ISLOW_MULT_TYPE)]
+    vpmullw     ymm4, ymm4, ymm5
+
+    vpsllw      ymm4, ymm4, PASS1_BITS
+
+    vpunpcklwd  ymm5, ymm4, ymm4        ; ymm5=(00 00 01 01 02 02 03 03  ...)
+    vpunpckhwd  ymm4, ymm4, ymm4        ; ymm4=(04 04 05 05 06 06 07 07  ...)
+    vinserti64x4 zmm5, zmm5, ymm4, 1
+    vshufi64x2  zmm4, zmm5, zmm5, 0xD8  ; (block 1 in low half, block 2 in high)
+
+    vpshufd     zmm0, zmm4, 0x00        ; zmm0=col0_4=(00 00 00 00 00 00 00 00  04 04 04 04 04 04 04 04)
+    vpshufd     zmm1, zmm4, 0x55        ; zmm1=col1_5=(01 01 01 01 01 01 01 01  05 05 05 05 05 05 05 05)
+    vpshufd     zmm2, zmm4, 0xAA        ; zmm2=col2_6=(02 02 02 02 02 02 02 02  06 06 06 06 06 06 06 06)
+    vpshufd     zmm3, zmm4, 0xFF        ; zmm3=col3_7=(03 03 03 03 03 03 03 03  07 07 07 07 07 07 07 07)
+
+    jmp         near .column_end
+%endif
+.columnDCT:
+
+    vpmullw     zmm4, zmm4, ZMMWORD [ZMMBLOCK(0,0,r10,SIZEOF_ISLOW_MULT_TYPE)]
+    vpmullw     zmm5, zmm5, ZMMWORD [ZMMBLOCK(4,0,r10,SIZEOF_ISLOW_MULT_TYPE)]
+    vpmullw     zmm6, zmm6, ZMMWORD [ZMMBLOCK(0,0,r10,SIZEOF_ISLOW_MULT_TYPE)]
+    vpmullw     zmm7, zmm7, ZMMWORD [ZMMBLOCK(4,0,r10,SIZEOF_ISLOW_MULT_TYPE)]
+
+    vmovdqa64   zmm0, PERM_IN0_4_IN3_1
+    vmovdqa64   zmm1, PERM_IN0_4_IN3_1
+    vpermi2q    zmm0, zmm4, zmm5        ; zmm0=(in0_4 in3_1) of block 1
+    vpermi2q    zmm1, zmm6, zmm7        ; zmm1=(in0_4 in3_1) of block 2
+    vpermt2q    zmm4, PERM_IN2_6_IN7_5, zmm5  ; zmm4=(in2_6 in7_5) of block 1
+    vpermt2q    zmm6, PERM_IN2_6_IN7_5, zmm7  ; zmm6=(in2_6 in7_5) of block 2
+
+    vshufi64x2  zmm2, zmm4, zmm6, 0x44  ; zmm2=in2_6
+    vshufi64x2  zmm3, zmm4, zmm6, 0xEE  ; zmm3=in7_5
+    vshufi64x2  zmm4, zmm0, zmm1, 0x44
+    vshufi64x2  zmm1, zmm0, zmm1, 0xEE  ; zmm1=in3_1
+    vmovdqa64   zmm0, zmm4              ; zmm0=in0_4
+
+    dodct zmm0, zmm1, zmm2, zmm3, zmm4, zmm5, zmm6, zmm7, zmm8, zmm9, zmm10, zmm11, 1
+    ; zmm0=data0_1, zmm1=data3_2, zmm2=data4_5, zmm3=data7_6
+
+    dotranspose zmm0, zmm1, zmm2, zmm3, zmm4, zmm5, zmm6, zmm7
+    ; zmm0=data0_4, zmm1=data1_5, zmm2=data2_6, zmm3=data3_7
+
+.column_end:
+
+    ; -- Prefetch the next pair of coefficient blocks
+
+    prefetchnta [r11 + 2*DCTSIZE2*SIZEOF_JCOEF + 0*64]
+    prefetchnta [r11 + 2*DCTSIZE2*SIZEOF_JCOEF + 1*64]
+    prefetchnta [r11 + 2*DCTSIZE2*SIZEOF_JCOEF + 2*64]
+    prefetchnta [r11 + 2*DCTSIZE2*SIZEOF_JCOEF + 3*64]
+
+    ; ---- Pass 2: process rows.
+
+    vmovdqa64   zmm4, zmm3
+    vpermt2q    zmm4, PERM_0x31, zmm1   ; zmm4=in7_5
+    vpermt2q    zmm3, PERM_0x20, zmm1   ; zmm3=in3_1
+
+    dodct zmm0, zmm3, zmm2, zmm4, zmm1, zmm5, zmm6, zmm7, zmm8, zmm9, zmm10, zmm11, 2
+    ; zmm0=data0_1, zmm3=data3_2, zmm2=data4_5, zmm4=data7_6
+
+    dotranspose zmm0, zmm3, zmm2, zmm4, zmm1, zmm5, zmm6, zmm7
+    ; zmm0=data0_4, zmm3=data1_5, zmm2=data2_6, zmm4=data3_7
+
+    vpacksswb   zmm0, zmm0, zmm3        ; zmm0=data01_45
+    vpacksswb   zmm1, zmm2, zmm4        ; zmm1=data23_67
+    vpaddb      zmm0, zmm0, ZMM_CENTERJSAMP
+    vpaddb      zmm1, zmm1, ZMM_CENTERJSAMP
+
+    ; Interleave the rows of the two blocks so that each 128-bit lane holds
+    ; 16 consecutive output samples.
+
+    vextracti64x4 ymm2, zmm0, 1
+    vextracti64x4 ymm3, zmm1, 1
+    vpunpcklqdq ymm4, ymm0, ymm2        ; ymm4=(row0 row4)
+    vpunpckhqdq ymm5, ymm0, ymm2        ; ymm5=(row1 row5)
+    vpunpcklqdq ymm6, ymm1, ymm3        ; ymm6=(row2 row6)
+    vpunpckhqdq ymm7, ymm1, ymm3        ; ymm7=(row3 row7)
+
+    mov         eax, r13d
+
+    mov         rdxp, JSAMPROW [r12+0*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    mov         rsip, JSAMPROW [r12+1*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    vmovdqu     XMMWORD [rdx+rax*SIZEOF_JSAMPLE], xmm4
+    vmovdqu     XMMWORD [rsi+rax*SIZEOF_JSAMPLE], xmm5
+
+    mov         rdxp, JSAMPROW [r12+2*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    mov         rsip, JSAMPROW [r12+3*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    vmovdqu     XMMWORD [rdx+rax*SIZEOF_JSAMPLE], xmm6
+    vmovdqu     XMMWORD [rsi+rax*SIZEOF_JSAMPLE], xmm7
+
+    mov         rdxp, JSAMPROW [r12+4*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    mov         rsip, JSAMPROW [r12+5*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    vextracti128 XMMWORD [rdx+rax*SIZEOF_JSAMPLE], ymm4, 1
+    vextracti128 XMMWORD [rsi+rax*SIZEOF_JSAMPLE], ymm5, 1
+
+    mov         rdxp, JSAMPROW [r12+6*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    mov         rsip, JSAMPROW [r12+7*SIZEOF_JSAMPROW]  ; (JSAMPLE *)
+    vextracti128 XMMWORD [rdx+rax*SIZEOF_JSAMPLE], ymm6, 1
+    vextracti128 XMMWORD [rsi+rax*SIZEOF_JSAMPLE], ymm7, 1
+
+    vzeroupper
+    uncollect_args 4
+    pop_xmm     4
+    pop         rbp
+    ret
+
+; For some reason, the OS X linker does not honor the request to align the
+; segment unless we do this.
+    align       32
@@ -0,0 +1,86 @@
+;
+; jquanti.asm - sample data conversion and quantization (64-bit AVX-512)
+;
+; Copyright 2009 Pierre Ossman <ossman@cendio.se> for Cendio AB
+; Copyright (C) 2009, 2016, 2018, D. R. Commander.
+; Copyright (C) 2016, Matthieu Darbois.
+; Copyright (C) 2018, Matthias Räncker.
+;
+; Based on the x86 SIMD extension for IJG JPEG library
+; Copyright (C) 1999-2006, MIYASAKA Masaru.
+; For conditions of distribution and use, see copyright notice in jsimdext.inc
+;
+; This file should be assembled with NASM (Netwide Assembler),
+; can *not* be assembled with Microsoft's MASM or any compatible
+; assembler (including Borland's Turbo Assembler).
+; NASM is available from http://nasm.sourceforge.net/ or
+; http://sourceforge.net/project/showfiles.php?group_id=6208
+
+%include "jsimdext.inc"
+%include "jdct.inc"
+
+; --------------------------------------------------------------------------
+    SECTION     SEG_TEXT
+    BITS        64
+;
+; Quantize/descale the coefficients, and store into coef_block
+;
+; This is the same algorithm as jsimd_quantize_avx2(), except that the entire
+; block fits in two ZMM registers.  AVX-512 has no equivalent of vpsignw, so
+; the sign of each coefficient is restored by negating the lanes selected by
+; an opmask that holds the sign bits of the original coefficients.
+;
+; GLOBAL(void)
+; jsimd_quantize_avx512(JCOEFPTR coef_block, DCTELEM *divisors,
+;                       DCTELEM *workspace);
+;
+
+%define RECIPROCAL(m, n, b) \
+  ZMMBLOCK(DCTSIZE * 0 + (m), (n), (b), SIZEOF_DCTELEM)
+%define CORRECTION(m, n, b) \
+  ZMMBLOCK(DCTSIZE * 1 + (m), (n), (b), SIZEOF_DCTELEM)
+%define SCALE(m, n, b) \
+  ZMMBLOCK(DCTSIZE * 2 + (m), (n), (b), SIZEOF_DCTELEM)
+
+; r10 = JCOEFPTR coef_block
+; r11 = DCTELEM *divisors
+; r12 = DCTELEM *workspace
+
+    align       32
+    GLOBAL_FUNCTION(jsimd_quantize_avx512)
+
+EXTN(jsimd_quantize_avx512):
+    push        rbp
+    mov         rax, rsp
+    mov         rbp, rsp
+    collect_args 3
+
+    vmovdqu64   zmm4, ZMMWORD [ZMMBLOCK(0,0,r12,SIZEOF_DCTELEM)]
+    vmovdqu64   zmm5, ZMMWORD [ZMMBLOCK(4,0,r12,SIZEOF_DCTELEM)]
+    vpabsw      zmm0, zmm4
+    vpabsw      zmm1, zmm5
+
+    vpaddw      zmm0, zmm0, ZMMWORD [CORRECTION(0,0,r11)]  ; correction + roundfactor
+    vpaddw      zmm1, zmm1, ZMMWORD [CORRECTION(4,0,r11)]
+    vpmulhuw    zmm0, zmm0, ZMMWORD [RECIPROCAL(0,0,r11)]  ; reciprocal
+    vpmulhuw    zmm1, zmm1, ZMMWORD [RECIPROCAL(4,0,r11)]
+    vpmulhuw    zmm0, zmm0, ZMMWORD [SCALE(0,0,r11)]       ; scale
+    vpmulhuw    zmm1, zmm1, ZMMWORD [SCALE(4,0,r11)]
+
+    vpmovw2m    k1, zmm4                ; k1=(sign bits of coefficients)
+    vpmovw2m    k2, zmm5
+    vpxord      zmm2, zmm2, zmm2
+    vpsubw      zmm0{k1}, zmm2, zmm0
+    vpsubw      zmm1{k2}, zmm2, zmm1
+
+    vmovdqu64   ZMMWORD [ZMMBLOCK(0,0,r10,SIZEOF_DCTELEM)], zmm0
+    vmovdqu64   ZMMWORD [ZMMBLOCK(4,0,r10,SIZEOF_DCTELEM)], zmm1
+
+    vzeroupper
+    uncollect_args 3
+    pop         rbp
+    ret
+
+; For some reason, the OS X linker does not honor the request to align the
+; segment unless we do this.
+    align       32
@@ -32,6 +32,38 @@
 #define IS_ALIGNED_SSE(ptr)  (IS_ALIGNED(ptr, 4)) /* 16 byte alignment */
 #define IS_ALIGNED_AVX(ptr)  (IS_ALIGNED(ptr, 5)) /* 32 byte alignment */
 
+#ifndef WITH_AVX512
+/*
+ * The AVX-512 routines can only be assembled with NASM.  If they were not
+ * built, then init_simd() never reports AVX-512 support, and these
+ * definitions merely allow the dispatch code below to compile.
+ */
+#define jconst_rgb_ycc_convert_avx512  jconst_rgb_ycc_convert_avx2
+#define jsimd_rgb_ycc_convert_avx512  jsimd_rgb_ycc_convert_avx2
+#define jsimd_extrgb_ycc_convert_avx512  jsimd_extrgb_ycc_convert_avx2
+#define jsimd_extrgbx_ycc_convert_avx512  jsimd_extrgbx_ycc_convert_avx2
+#define jsimd_extbgr_ycc_convert_avx512  jsimd_extbgr_ycc_convert_avx2
+#define jsimd_extbgrx_ycc_convert_avx512  jsimd_extbgrx_ycc_convert_avx2
+#define jsimd_extxbgr_ycc_convert_avx512  jsimd_extxbgr_ycc_convert_avx2
+#define jsimd_extxrgb_ycc_convert_avx512  jsimd_extxrgb_ycc_convert_avx2
+#define jconst_ycc_rgb_convert_avx512  jconst_ycc_rgb_convert_avx2
+#define jsimd_ycc_rgb_convert_avx512  jsimd_ycc_rgb_convert_avx2
+#define jsimd_ycc_extrgb_convert_avx512  jsimd_ycc_extrgb_convert_avx2
+#define jsimd_ycc_extrgbx_convert_avx512  jsimd_ycc_extrgbx_convert_avx2
+#define jsimd_ycc_extbgr_convert_avx512  jsimd_ycc_extbgr_convert_avx2
+#define jsimd_ycc_extbgrx_convert_avx512  jsimd_ycc_extbgrx_convert_avx2
+#define jsimd_ycc_extxbgr_convert_avx512  jsimd_ycc_extxbgr_convert_avx2
+#define jsimd_ycc_extxrgb_convert_avx512  jsimd_ycc_extxrgb_convert_avx2
+#define jconst_fancy_upsample_avx512  jconst_fancy_upsample_avx2
+#define jsimd_h2v1_fancy_upsample_avx512  jsimd_h2v1_fancy_upsample_avx2
+#define jsimd_h2v2_fancy_upsample_avx512  jsimd_h2v2_fancy_upsample_avx2
+#define jsimd_quantize_avx512  jsimd_quantize_avx2
+#define jconst_fdct_islow_avx512  jconst_fdct_islow_avx2
+#define jsimd_fdct_islow_avx512  jsimd_fdct_islow_avx2
+#define jconst_idct_islow_avx512  jconst_idct_islow_avx2
+#define jsimd_idct_islow_avx512  jsimd_idct_islow_avx2
+#endif
+
 static unsigned int simd_support = (unsigned int)(~0);
 static unsigned int simd_huffman = 1;
 
@@ -51,6 +83,9 @@ init_simd(void)
     return;
 
   simd_support = jpeg_simd_cpu_support();
+#ifndef WITH_AVX512
+  simd_support &= ~JSIMD_AVX512;
+#endif
 
 #ifndef NO_GETENV
   /* Force different settings through environment variables */
@@ -59,7 +94,10 @@ init_simd(void)
     simd_support &= JSIMD_SSE2;
   env = getenv("JSIMD_FORCEAVX2");
   if ((env != NULL) && (strcmp(env, "1") == 0))
-    simd_support &= JSIMD_AVX2;
+    simd_support &= JSIMD_AVX2 | JSIMD_BMI2;
+  env = getenv("JSIMD_FORCEAVX512");
+  if ((env != NULL) && (strcmp(env, "1") == 0))
+    simd_support &= JSIMD_AVX512 | JSIMD_AVX2 | JSIMD_BMI2;
   env = getenv("JSIMD_FORCENONE");
   if ((env != NULL) && (strcmp(env, "1") == 0))
     simd_support = 0;
@@ -82,6 +120,9 @@ jsimd_can_rgb_ycc(void)
   if ((RGB_PIXELSIZE != 3) && (RGB_PIXELSIZE != 4))
     return 0;
 
+  if ((simd_support & JSIMD_AVX512) &&
+      IS_ALIGNED_AVX(jconst_rgb_ycc_convert_avx512))
+    return 1;
   if ((simd_support & JSIMD_AVX2) &&
       IS_ALIGNED_AVX(jconst_rgb_ycc_convert_avx2))
     return 1;
@@ -128,6 +169,9 @@ jsimd_can_ycc_rgb(void)
   if ((RGB_PIXELSIZE != 3) && (RGB_PIXELSIZE != 4))
     return 0;
 
+  if ((simd_support & JSIMD_AVX512) &&
+      IS_ALIGNED_AVX(jconst_ycc_rgb_convert_avx512))
+    return 1;
   if ((simd_support & JSIMD_AVX2) &&
       IS_ALIGNED_AVX(jconst_ycc_rgb_convert_avx2))
     return 1;
@@ -149,45 +193,55 @@ jsimd_rgb_ycc_convert(j_compress_ptr cinfo, JSAMPARRAY input_buf,
                       JSAMPIMAGE output_buf, JDIMENSION output_row,
                       int num_rows)
 {
+  void (*avx512fct) (JDIMENSION, JSAMPARRAY, JSAMPIMAGE, JDIMENSION, int);
   void (*avx2fct) (JDIMENSION, JSAMPARRAY, JSAMPIMAGE, JDIMENSION, int);
   void (*sse2fct) (JDIMENSION, JSAMPARRAY, JSAMPIMAGE, JDIMENSION, int);
 
   switch (cinfo->in_color_space) {
   case JCS_EXT_RGB:
+    avx512fct = jsimd_extrgb_ycc_convert_avx512;
     avx2fct = jsimd_extrgb_ycc_convert_avx2;
     sse2fct = jsimd_extrgb_ycc_convert_sse2;
     break;
   case JCS_EXT_RGBX:
   case JCS_EXT_RGBA:
+    avx512fct = jsimd_extrgbx_ycc_convert_avx512;
     avx2fct = jsimd_extrgbx_ycc_convert_avx2;
     sse2fct = jsimd_extrgbx_ycc_convert_sse2;
     break;
   case JCS_EXT_BGR:
+    avx512fct = jsimd_extbgr_ycc_convert_avx512;
     avx2fct = jsimd_extbgr_ycc_convert_avx2;
     sse2fct = jsimd_extbgr_ycc_convert_sse2;
     break;
   case JCS_EXT_BGRX:
   case JCS_EXT_BGRA:
+    avx512fct = jsimd_extbgrx_ycc_convert_avx512;
     avx2fct = jsimd_extbgrx_ycc_convert_avx2;
     sse2fct = jsimd_extbgrx_ycc_convert_sse2;
     break;
   case JCS_EXT_XBGR:
   case JCS_EXT_ABGR:
+    avx512fct = jsimd_extxbgr_ycc_convert_avx512;
     avx2fct = jsimd_extxbgr_ycc_convert_avx2;
     sse2fct = jsimd_extxbgr_ycc_convert_sse2;
     break;
   case JCS_EXT_XRGB:
   case JCS_EXT_ARGB:
+    avx512fct = jsimd_extxrgb_ycc_convert_avx512;
     avx2fct = jsimd_extxrgb_ycc_convert_avx2;
     sse2fct = jsimd_extxrgb_ycc_convert_sse2;
     break;
   default:
+    avx512fct = jsimd_rgb_ycc_convert_avx512;
     avx2fct = jsimd_rgb_ycc_convert_avx2;
     sse2fct = jsimd_rgb_ycc_convert_sse2;
     break;
   }
 
-  if (simd_support & JSIMD_AVX2)
+  if (simd_support & JSIMD_AVX512)
+    avx512fct(cinfo->image_width, input_buf, output_buf, output_row, num_rows);
+  else if (simd_support & JSIMD_AVX2)
     avx2fct(cinfo->image_width, input_buf, output_buf, output_row, num_rows);
   else
     sse2fct(cinfo->image_width, input_buf, output_buf, output_row, num_rows);
@@ -247,45 +301,55 @@ jsimd_ycc_rgb_convert(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
                       JDIMENSION input_row, JSAMPARRAY output_buf,
                       int num_rows)
 {
+  void (*avx512fct) (JDIMENSION, JSAMPIMAGE, JDIMENSION, JSAMPARRAY, int);
   void (*avx2fct) (JDIMENSION, JSAMPIMAGE, JDIMENSION, JSAMPARRAY, int);
   void (*sse2fct) (JDIMENSION, JSAMPIMAGE, JDIMENSION, JSAMPARRAY, int);
 
   switch (cinfo->out_color_space) {
   case JCS_EXT_RGB:
+    avx512fct = jsimd_ycc_extrgb_convert_avx512;
     avx2fct = jsimd_ycc_extrgb_convert_avx2;
     sse2fct = jsimd_ycc_extrgb_convert_sse2;
     break;
   case JCS_EXT_RGBX:
   case JCS_EXT_RGBA:
+    avx512fct = jsimd_ycc_extrgbx_convert_avx512;
     avx2fct = jsimd_ycc_extrgbx_convert_avx2;
     sse2fct = jsimd_ycc_extrgbx_convert_sse2;
     break;
   case JCS_EXT_BGR:
+    avx512fct = jsimd_ycc_extbgr_convert_avx512;
     avx2fct = jsimd_ycc_extbgr_convert_avx2;
     sse2fct = jsimd_ycc_extbgr_convert_sse2;
     break;
   case JCS_EXT_BGRX:
   case JCS_EXT_BGRA:
+    avx512fct = jsimd_ycc_extbgrx_convert_avx512;
     avx2fct = jsimd_ycc_extbgrx_convert_avx2;
     sse2fct = jsimd_ycc_extbgrx_convert_sse2;
     break;
   case JCS_EXT_XBGR:
   case JCS_EXT_ABGR:
+    avx512fct = jsimd_ycc_extxbgr_convert_avx512;
     avx2fct = jsimd_ycc_extxbgr_convert_avx2;
     sse2fct = jsimd_ycc_extxbgr_convert_sse2;
     break;
   case JCS_EXT_XRGB:
   case JCS_EXT_ARGB:
+    avx512fct = jsimd_ycc_extxrgb_convert_avx512;
     avx2fct = jsimd_ycc_extxrgb_convert_avx2;
     sse2fct = jsimd_ycc_extxrgb_convert_sse2;
     break;
   default:
+    avx512fct = jsimd_ycc_rgb_convert_avx512;
     avx2fct = jsimd_ycc_rgb_convert_avx2;
     sse2fct = jsimd_ycc_rgb_convert_sse2;
     break;
   }
 
-  if (simd_support & JSIMD_AVX2)
+  if (simd_support & JSIMD_AVX512)
+    avx512fct(cinfo->output_width, input_buf, input_row, output_buf, num_rows);
+  else if (simd_support & JSIMD_AVX2)
     avx2fct(cinfo->output_width, input_buf, input_row, output_buf, num_rows);
   else
     sse2fct(cinfo->output_width, input_buf, input_row, output_buf, num_rows);
@@ -441,6 +505,9 @@ jsimd_can_h2v2_fancy_upsample(void)
   if (sizeof(JDIMENSION) != 4)
     return 0;
 
+  if ((simd_support & JSIMD_AVX512) &&
+      IS_ALIGNED_AVX(jconst_fancy_upsample_avx512))
+    return 1;
   if ((simd_support & JSIMD_AVX2) &&
       IS_ALIGNED_AVX(jconst_fancy_upsample_avx2))
     return 1;
@@ -462,6 +529,9 @@ jsimd_can_h2v1_fancy_upsample(void)
   if (sizeof(JDIMENSION) != 4)
     return 0;
 
+  if ((simd_support & JSIMD_AVX512) &&
+      IS_ALIGNED_AVX(jconst_fancy_upsample_avx512))
+    return 1;
   if ((simd_support & JSIMD_AVX2) &&
       IS_ALIGNED_AVX(jconst_fancy_upsample_avx2))
     return 1;
@@ -476,7 +546,11 @@ GLOBAL(void)
 jsimd_h2v2_fancy_upsample(j_decompress_ptr cinfo, jpeg_component_info *compptr,
                           JSAMPARRAY input_data, JSAMPARRAY *output_data_ptr)
 {
-  if (simd_support & JSIMD_AVX2)
+  if (simd_support & JSIMD_AVX512)
+    jsimd_h2v2_fancy_upsample_avx512(cinfo->max_v_samp_factor,
+                                     compptr->downsampled_width, input_data,
+                                     output_data_ptr);
+  else if (simd_support & JSIMD_AVX2)
     jsimd_h2v2_fancy_upsample_avx2(cinfo->max_v_samp_factor,
                                    compptr->downsampled_width, input_data,
                                    output_data_ptr);
@@ -490,7 +564,11 @@ GLOBAL(void)
 jsimd_h2v1_fancy_upsample(j_decompress_ptr cinfo, jpeg_component_info *compptr,
                           JSAMPARRAY input_data, JSAMPARRAY *output_data_ptr)
 {
-  if (simd_support & JSIMD_AVX2)
+  if (simd_support & JSIMD_AVX512)
+    jsimd_h2v1_fancy_upsample_avx512(cinfo->max_v_samp_factor,
+                                     compptr->downsampled_width, input_data,
+                                     output_data_ptr);
+  else if (simd_support & JSIMD_AVX2)
     jsimd_h2v1_fancy_upsample_avx2(cinfo->max_v_samp_factor,
                                    compptr->downsampled_width, input_data,
                                    output_data_ptr);
@@ -752,6 +830,24 @@ jsimd_can_fdct_float(void)
   return 0;
 }
 
+GLOBAL(int)
+jsimd_can_fdct_islow_pair(void)
+{
+  init_simd();
+
+  /* The code is optimised for these values only */
+  if (DCTSIZE != 8)
+    return 0;
+  if (sizeof(DCTELEM) != 2)
+    return 0;
+
+  if ((simd_support & JSIMD_AVX512) &&
+      IS_ALIGNED_AVX(jconst_fdct_islow_avx512))
+    return 1;
+
+  return 0;
+}
+
 GLOBAL(void)
 jsimd_fdct_islow(DCTELEM *data)
 {
@@ -773,6 +869,12 @@ jsimd_fdct_float(FAST_FLOAT *data)
   jsimd_fdct_float_sse(data);
 }
 
+GLOBAL(void)
+jsimd_fdct_islow_pair(DCTELEM *data)
+{
+  jsimd_fdct_islow_avx512(data);
+}
+
 GLOBAL(int)
 jsimd_can_quantize(void)
 {
@@ -786,6 +888,8 @@ jsimd_can_quantize(void)
   if (sizeof(DCTELEM) != 2)
     return 0;
 
+  if (simd_support & JSIMD_AVX512)
+    return 1;
   if (simd_support & JSIMD_AVX2)
     return 1;
   if (simd_support & JSIMD_SSE2)
@@ -816,7 +920,9 @@ jsimd_can_quantize_float(void)
 GLOBAL(void)
 jsimd_quantize(JCOEFPTR coef_block, DCTELEM *divisors, DCTELEM *workspace)
 {
-  if (simd_support & JSIMD_AVX2)
+  if (simd_support & JSIMD_AVX512)
+    jsimd_quantize_avx512(coef_block, divisors, workspace);
+  else if (simd_support & JSIMD_AVX2)
     jsimd_quantize_avx2(coef_block, divisors, workspace);
   else
     jsimd_quantize_sse2(coef_block, divisors, workspace);
@@ -965,6 +1071,30 @@ jsimd_can_idct_float(void)
   return 0;
 }
 
+GLOBAL(int)
+jsimd_can_idct_islow_pair(void)
+{
+  init_simd();
+
+  /* The code is optimised for these values only */
+  if (DCTSIZE != 8)
+    return 0;
+  if (sizeof(JCOEF) != 2)
+    return 0;
+  if (BITS_IN_JSAMPLE != 8)
+    return 0;
+  if (sizeof(JDIMENSION) != 4)
+    return 0;
+  if (sizeof(ISLOW_MULT_TYPE) != 2)
+    return 0;
+
+  if ((simd_support & JSIMD_AVX512) &&
+      IS_ALIGNED_AVX(jconst_idct_islow_avx512))
+    return 1;
+
+  return 0;
+}
+
 GLOBAL(void)
 jsimd_idct_islow(j_decompress_ptr cinfo, jpeg_component_info *compptr,
                  JCOEFPTR coef_block, JSAMPARRAY output_buf,
@@ -996,6 +1126,15 @@ jsimd_idct_float(j_decompress_ptr cinfo, jpeg_component_info *compptr,
                         output_col);
 }
 
+GLOBAL(void)
+jsimd_idct_islow_pair(j_decompress_ptr cinfo, jpeg_component_info *compptr,
+                      JCOEFPTR coef_block, JSAMPARRAY output_buf,
+                      JDIMENSION output_col)
+{
+  jsimd_idct_islow_avx512(compptr->dct_table, coef_block, output_buf,
+                          output_col);
+}
+
 GLOBAL(int)
 jsimd_can_huff_encode_one_block(void)
 {
@@ -1006,6 +1145,9 @@ jsimd_can_huff_encode_one_block(void)
   if (sizeof(JCOEF) != 2)
     return 0;
 
+  if ((simd_support & JSIMD_AVX2) && (simd_support & JSIMD_BMI2) &&
+      simd_huffman && IS_ALIGNED_AVX(jconst_huff_encode_one_block_avx2))
+    return 1;
   if ((simd_support & JSIMD_SSE2) && simd_huffman &&
       IS_ALIGNED_SSE(jconst_huff_encode_one_block))
     return 1;
@@ -1018,6 +1160,10 @@ jsimd_huff_encode_one_block(void *state, JOCTET *buffer, JCOEFPTR block,
                             int last_dc_val, c_derived_tbl *dctbl,
                             c_derived_tbl *actbl)
 {
+  if ((simd_support & JSIMD_AVX2) && (simd_support & JSIMD_BMI2) &&
+      IS_ALIGNED_AVX(jconst_huff_encode_one_block_avx2))
+    return jsimd_huff_encode_one_block_avx2(state, buffer, block, last_dc_val,
+                                            dctbl, actbl);
   return jsimd_huff_encode_one_block_sse2(state, buffer, block, last_dc_val,
                                           dctbl, actbl);
 }
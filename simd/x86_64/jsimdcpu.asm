@@ -52,6 +52,7 @@ EXTN(jpeg_simd_cpu_support):
     xor         rcx, rcx
     cpuid
     mov         rax, rbx                ; rax = Extended feature flags
+    mov         r8, rbx                 ; (saved for the BMI2 check below)
 
     test        rax, 1<<5               ; bit5:AVX2
     jz          short .return
@@ -74,6 +75,42 @@ EXTN(jpeg_simd_cpu_support):
 
     or          rdi, JSIMD_AVX2
 
+    ; Check for BMI2 and LZCNT instruction support
+    ; (JSIMD_BMI2 is only meaningful in conjunction with JSIMD_AVX2.)
+    test        r8, 1<<8                ; bit8:BMI2
+    jz          short .return
+
+    mov         rax, 0x80000000
+    cpuid
+    cmp         eax, 0x80000001
+    jb          short .return           ; Maximum extended leaf < 80000001H
+
+    mov         rax, 0x80000001
+    xor         rcx, rcx
+    cpuid
+    test        rcx, 1<<5               ; bit5:LZCNT (ABM)
+    jz          short .return
+
+    or          rdi, JSIMD_BMI2
+
+    ; Check for AVX-512 instruction support
+    ; (JSIMD_AVX512 is only meaningful in conjunction with JSIMD_BMI2.  Only
+    ; the Foundation, Byte/Word, and Vector Length subsets are used.)
+    mov         eax, r8d
+    and         eax, (1<<16)|(1<<30)|(1<<31)  ; bit16:AVX512F bit30:AVX512BW
+    cmp         eax, (1<<16)|(1<<30)|(1<<31)  ; bit31:AVX512VL
+    jne         short .return
+
+    ; Check for AVX-512 O/S support
+    xor         rcx, rcx
+    xgetbv
+    and         rax, 0xE6
+    cmp         rax, 0xE6               ; O/S does not manage opmask/ZMM state
+                                        ; using XSAVE
+    jnz         short .return
+
+    or          rdi, JSIMD_AVX512
+
 .return:
     mov         rax, rdi
 
@@ -76,7 +76,8 @@ int tjErrorLine = -1, tjErrorCode = -1;
 }
 
 int flags = TJFLAG_NOREALLOC, compOnly = 0, decompOnly = 0, doYUV = 0,
-  quiet = 0, doTile = 0, pf = TJPF_BGR, yuvPad = 1, doWrite = 1;
+  quiet = 0, doTile = 0, pf = TJPF_BGR, yuvPad = 1, doWrite = 1,
+  numThreads = 1;
 char *ext = "ppm";
 const char *pixFormatStr[TJ_NUMPF] = {
   "RGB", "BGR", "RGBX", "BGRX", "XBGR", "XRGB", "GRAY", "", "", "", "", "CMYK"
@@ -160,6 +161,8 @@ static int decomp(unsigned char *srcBuf, unsigned char **jpegBuf,
 
   if ((handle = tjInitDecompress()) == NULL)
     THROW_TJ("executing tjInitDecompress()");
+  if (tjSetNumThreads(handle, numThreads) == -1)
+    THROW_TJ("executing tjSetNumThreads()");
 
   if (dstBuf == NULL) {
     if ((unsigned long long)pitch * (unsigned long long)scaledh >
@@ -371,6 +374,8 @@ static int fullTest(unsigned char *srcBuf, int w, int h, int subsamp,
       memcpy(&tmpBuf[pitch * i], &srcBuf[w * ps * i], w * ps);
     if ((handle = tjInitCompress()) == NULL)
       THROW_TJ("executing tjInitCompress()");
+    if (tjSetNumThreads(handle, numThreads) == -1)
+      THROW_TJ("executing tjSetNumThreads()");
 
     if (doYUV) {
       yuvSize = tjBufSizeYUV2(tilew, yuvPad, tileh, subsamp);
@@ -550,6 +555,8 @@ static int decompTest(char *fileName)
 
   if ((handle = tjInitTransform()) == NULL)
     THROW_TJ("executing tjInitTransform()");
+  if (tjSetNumThreads(handle, numThreads) == -1)
+    THROW_TJ("executing tjSetNumThreads()");
   if (tjDecompressHeader3(handle, srcBuf, srcSize, &w, &h, &subsamp,
                           &cs) == -1)
     THROW_TJ("executing tjDecompressHeader3()");
@@ -802,7 +809,9 @@ static void usage(char *progName)
   printf("     performance measurements.)\n");
   printf("-stoponwarning = Immediately discontinue the current\n");
   printf("     compression/decompression/transform operation if the underlying codec\n");
-  printf("     throws a warning (non-fatal error)\n\n");
+  printf("     throws a warning (non-fatal error)\n");
+  printf("-threads <n> = Allow TurboJPEG to use up to <n> threads (0 = one thread per\n");
+  printf("     CPU) for the operations that support multithreading (default = 1)\n\n");
   printf("NOTE:  If the quality is specified as a range (e.g. 90-100), a separate\n");
   printf("test will be performed for all quality values in the range.\n\n");
   exit(1);
@@ -957,6 +966,12 @@ int main(int argc, char *argv[])
         doWrite = 0;
       else if (!strcasecmp(argv[i], "-stoponwarning"))
         flags |= TJFLAG_STOPONWARNING;
+      else if (!strcasecmp(argv[i], "-threads") && i < argc - 1) {
+        int tempi = atoi(argv[++i]);
+
+        if (tempi >= 0) numThreads = tempi;
+        else usage(argv[0]);
+      }
       else usage(argv[0]);
     }
   }
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C)2026 The libjpeg-turbo Project.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the libjpeg-turbo Project nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS",
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This file contains a separable image resampler that the TurboJPEG API
+ * library uses to scale decompressed images to arbitrary sizes.
+ *
+ * For each axis, we precompute the (clamped) range of source pixels that
+ * contribute to each destination pixel along with the corresponding filter
+ * weights, in WEIGHT_BITS-bit fixed point.  Each source row is resampled
+ * horizontally as it arrives, and the unclamped result (with HORIZ_BITS
+ * extra bits of precision) is stored in a ring buffer that is just large
+ * enough to hold the rows needed to produce the next destination row.  All of
+ * the inner loops are simple multiply-accumulate loops over contiguous arrays,
+ * which modern compilers vectorize well.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "turbojpeg.h"
+#include "tjresize.h"
+
+#define WEIGHT_BITS  14
+#define HORIZ_BITS  6
+#define MAXVAL  255
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+
+static double sinc(double x)
+{
+  if (x == 0.0) return 1.0;
+  x *= M_PI;
+  return sin(x) / x;
+}
+
+
+/* Compute the weights for one axis.  Returns the number of source rows that
+   must be buffered in order to produce each destination row in turn, or -1 if
+   memory could not be allocated. */
+
+static int initAxis(tjresizeaxis *axis, int srcSize, int dstSize, int filter)
+{
+  double scale = (double)dstSize / (double)srcSize;
+  double fscale = scale < 1.0 ? scale : 1.0;
+  double support, *tmp = NULL;
+  int i, j, k, bufRows = 1, maxEnd = -1;
+
+  switch (filter) {
+  case TJFILTER_BILINEAR:  support = 1.0 / fscale;  break;
+  case TJFILTER_LANCZOS3:  support = 3.0 / fscale;  break;
+  default:  support = 0.5 / scale;  break;  /* TJFILTER_AREA */
+  }
+  axis->maxTaps = (int)ceil(2.0 * support) + 2;
+  if (axis->maxTaps > srcSize) axis->maxTaps = srcSize;
+
+  axis->start = (int *)malloc(sizeof(int) * dstSize);
+  axis->count = (int *)malloc(sizeof(int) * dstSize);
+  axis->weights =
+    (short *)malloc(sizeof(short) * (size_t)dstSize * axis->maxTaps);
+  tmp = (double *)malloc(sizeof(double) * (axis->maxTaps + 2));
+  if (!axis->start || !axis->count || !axis->weights || !tmp) {
+    free(tmp);
+    return -1;
+  }
+
+  for (i = 0; i < dstSize; i++) {
+    double center = ((double)i + 0.5) / scale, total = 0.0;
+    int left = (int)floor(center - support);
+    int right = (int)ceil(center + support);
+    int start, end, sum = 0, maxk = 0;
+    short *weights = &axis->weights[(size_t)i * axis->maxTaps];
+
+    start = left < 0 ? 0 : left;
+    end = right > srcSize - 1 ? srcSize - 1 : right;
+    if (start > srcSize - 1) start = srcSize - 1;
+    if (end < start) end = start;
+    for (k = 0; k <= end - start; k++) tmp[k] = 0.0;
+
+    for (j = left; j <= right; j++) {
+      double x = ((double)j + 0.5 - center) * fscale, w;
+      int jj = j < start ? start : (j > end ? end : j);
+
+      switch (filter) {
+      case TJFILTER_BILINEAR:
+        w = 1.0 - fabs(x);
+        break;
+      case TJFILTER_LANCZOS3:
+        w = fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+        break;
+      default:
+      {
+        /* Overlap between source pixel j and the footprint of destination
+           pixel i */
+        double a = center - support, b = center + support;
+
+        w = ((double)j + 1.0 < b ? (double)j + 1.0 : b) -
+            ((double)j > a ? (double)j : a);
+      }
+      }
+      if (w > 0.0 || (w < 0.0 && filter == TJFILTER_LANCZOS3))
+        tmp[jj - start] += w;
+    }
+
+    /* Trim taps with zero weight from both ends */
+    while (end > start && tmp[end - start] == 0.0) end--;
+    while (start < end && tmp[0] == 0.0) {
+      memmove(tmp, &tmp[1], sizeof(double) * (end - start));
+      start++;
+    }
+
+    for (k = 0; k <= end - start; k++) total += tmp[k];
+    if (total == 0.0) {
+      tmp[0] = total = 1.0;  end = start;
+    }
+    /* Normalize the weights so that they sum to exactly 1.0 in fixed point,
+       assigning any rounding error to the largest weight. */
+    for (k = 0; k <= end - start; k++) {
+      weights[k] = (short)floor(tmp[k] / total * (1 << WEIGHT_BITS) + 0.5);
+      sum += weights[k];
+      if (weights[k] > weights[maxk]) maxk = k;
+    }
+    weights[maxk] += (short)((1 << WEIGHT_BITS) - sum);
+
+    axis->start[i] = start;
+    axis->count[i] = end - start + 1;
+    if (end > maxEnd) maxEnd = end;
+    if (maxEnd - start + 1 > bufRows) bufRows = maxEnd - start + 1;
+  }
+
+  free(tmp);
+  return bufRows;
+}
+
+
+int tjResizerInit(tjresizer *resizer, int srcWidth, int srcHeight,
+                  int dstWidth, int dstHeight, int pixelSize, int filter)
+{
+  int ringRows;
+
+  memset(resizer, 0, sizeof(tjresizer));
+  resizer->srcWidth = srcWidth;  resizer->srcHeight = srcHeight;
+  resizer->dstWidth = dstWidth;  resizer->dstHeight = dstHeight;
+  resizer->pixelSize = pixelSize;
+
+  if (initAxis(&resizer->horiz, srcWidth, dstWidth, filter) < 0 ||
+      (ringRows = initAxis(&resizer->vert, srcHeight, dstHeight,
+                           filter)) < 0)
+    goto bailout;
+  resizer->ringRows = ringRows;
+  if ((resizer->ring = (short *)malloc(sizeof(short) * ringRows *
+                                       (size_t)dstWidth * pixelSize)) ==
+      NULL ||
+      (resizer->accum = (int *)malloc(sizeof(int) * (size_t)dstWidth *
+                                      pixelSize)) == NULL)
+    goto bailout;
+  return 0;
+
+bailout:
+  tjResizerFree(resizer);
+  return -1;
+}
+
+
+static void resampleRow(tjresizer *resizer, const unsigned char *src,
+                        short *dst)
+{
+  const tjresizeaxis *axis = &resizer->horiz;
+  int ps = resizer->pixelSize, x, k, c;
+
+  for (x = 0; x < resizer->dstWidth; x++, dst += ps) {
+    const short *weights = &axis->weights[(size_t)x * axis->maxTaps];
+    const unsigned char *in = &src[axis->start[x] * ps];
+    int count = axis->count[x], sum[4] = { 0, 0, 0, 0 };
+
+    switch (ps) {
+    case 1:
+      for (k = 0; k < count; k++)
+        sum[0] += in[k] * weights[k];
+      break;
+    case 3:
+      for (k = 0; k < count; k++, in += 3) {
+        sum[0] += in[0] * weights[k];
+        sum[1] += in[1] * weights[k];
+        sum[2] += in[2] * weights[k];
+      }
+      break;
+    default:
+      for (k = 0; k < count; k++, in += 4) {
+        sum[0] += in[0] * weights[k];
+        sum[1] += in[1] * weights[k];
+        sum[2] += in[2] * weights[k];
+        sum[3] += in[3] * weights[k];
+      }
+    }
+    for (c = 0; c < ps; c++) {
+      int v = (sum[c] + (1 << (WEIGHT_BITS - HORIZ_BITS - 1))) >>
+              (WEIGHT_BITS - HORIZ_BITS);
+
+      /* The Lanczos filter can overshoot, so the intermediate values are
+         only clamped to the range of a short.  They are clamped to the range
+         of a sample after the vertical pass. */
+      dst[c] = (short)(v < SHRT_MIN ? SHRT_MIN :
+                       (v > SHRT_MAX ? SHRT_MAX : v));
+    }
+  }
+}
+
+
+static void resampleColumn(tjresizer *resizer, unsigned char *dst)
+{
+  const tjresizeaxis *axis = &resizer->vert;
+  const short *weights =
+    &axis->weights[(size_t)resizer->dstRow * axis->maxTaps];
+  int start = axis->start[resizer->dstRow];
+  int count = axis->count[resizer->dstRow];
+  int n = resizer->dstWidth * resizer->pixelSize, k, x;
+  int *accum = resizer->accum;
+
+  for (x = 0; x < n; x++) accum[x] = 0;
+  for (k = 0; k < count; k++) {
+    const short *in =
+      &resizer->ring[(size_t)((start + k) % resizer->ringRows) * n];
+    int w = weights[k];
+
+    for (x = 0; x < n; x++)
+      accum[x] += in[x] * w;
+  }
+  for (x = 0; x < n; x++) {
+    int v = (accum[x] + (1 << (WEIGHT_BITS + HORIZ_BITS - 1))) >>
+            (WEIGHT_BITS + HORIZ_BITS);
+
+    dst[x] = (unsigned char)(v < 0 ? 0 : (v > MAXVAL ? MAXVAL : v));
+  }
+}
+
+
+int tjResizerPushRow(tjresizer *resizer, const unsigned char *srcRow,
+                     unsigned char **dstRows)
+{
+  const tjresizeaxis *axis = &resizer->vert;
+
+  if (resizer->srcRow >= resizer->srcHeight) return resizer->dstRow;
+
+  resampleRow(resizer, srcRow,
+              &resizer->ring[(size_t)(resizer->srcRow % resizer->ringRows) *
+                             resizer->dstWidth * resizer->pixelSize]);
+  resizer->srcRow++;
+
+  while (resizer->dstRow < resizer->dstHeight &&
+         axis->start[resizer->dstRow] + axis->count[resizer->dstRow] <=
+         resizer->srcRow) {
+    resampleColumn(resizer, dstRows[resizer->dstRow]);
+    resizer->dstRow++;
+  }
+  return resizer->dstRow;
+}
+
+
+void tjResizerFree(tjresizer *resizer)
+{
+  free(resizer->horiz.start);  resizer->horiz.start = NULL;
+  free(resizer->horiz.count);  resizer->horiz.count = NULL;
+  free(resizer->horiz.weights);  resizer->horiz.weights = NULL;
+  free(resizer->vert.start);  resizer->vert.start = NULL;
+  free(resizer->vert.count);  resizer->vert.count = NULL;
+  free(resizer->vert.weights);  resizer->vert.weights = NULL;
+  free(resizer->ring);  resizer->ring = NULL;
+  free(resizer->accum);  resizer->accum = NULL;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C)2026 The libjpeg-turbo Project.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the libjpeg-turbo Project nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS",
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Separable image resampler used by tjDecompressResized().  Source rows are
+   pushed one at a time, in order, and each destination row is produced as
+   soon as all of the source rows that contribute to it are available, so only
+   a small window of the source image is ever held in memory. */
+
+#ifndef __TJRESIZE_H__
+#define __TJRESIZE_H__
+
+/* Contributions of source pixels to each destination pixel along one axis */
+typedef struct {
+  int *start;                   /* index of first contributing source pixel */
+  int *count;                   /* number of contributing source pixels */
+  short *weights;               /* maxTaps weights per destination pixel */
+  int maxTaps;
+} tjresizeaxis;
+
+typedef struct {
+  int srcWidth, srcHeight, dstWidth, dstHeight, pixelSize;
+  tjresizeaxis horiz, vert;
+  short *ring;                  /* ringRows horizontally resampled rows */
+  int ringRows;
+  int *accum;                   /* vertical accumulator (dstWidth samples) */
+  int srcRow, dstRow;           /* next source and destination row */
+} tjresizer;
+
+/* Initialize a resampler that scales srcWidth x srcHeight images with
+   pixelSize interleaved 8-bit samples per pixel to dstWidth x dstHeight using
+   the specified filter (TJFILTER_*).  Returns 0 if successful or -1 if memory
+   could not be allocated. */
+extern int tjResizerInit(tjresizer *resizer, int srcWidth, int srcHeight,
+                         int dstWidth, int dstHeight, int pixelSize,
+                         int filter);
+
+/* Push the next source row.  dstRows[] holds the destination row pointers
+   for the whole destination image, and any destination rows that can be
+   completed using this source row are written.  Returns the number of
+   destination rows completed so far. */
+extern int tjResizerPushRow(tjresizer *resizer, const unsigned char *srcRow,
+                            unsigned char **dstRows);
+
+/* Release the memory used by a resampler */
+extern void tjResizerFree(tjresizer *resizer);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C)2026 The libjpeg-turbo Project.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the libjpeg-turbo Project nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS",
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include "tjthread.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+typedef struct {
+  tjthread_func func;
+  void *arg;
+} tjthread_start;
+
+
+#ifdef _WIN32
+
+static DWORD WINAPI threadStart(LPVOID param)
+{
+  tjthread_start start = *(tjthread_start *)param;
+
+  free(param);
+  start.func(start.arg);
+  return 0;
+}
+
+int tjThreadCreate(tjthread *thread, tjthread_func func, void *arg)
+{
+  tjthread_start *start;
+
+  if ((start = (tjthread_start *)malloc(sizeof(tjthread_start))) == NULL)
+    return -1;
+  start->func = func;  start->arg = arg;
+  if ((*thread = CreateThread(NULL, 0, threadStart, start, 0, NULL)) ==
+      NULL) {
+    free(start);
+    return -1;
+  }
+  return 0;
+}
+
+int tjThreadJoin(tjthread thread)
+{
+  int retval = 0;
+
+  if (WaitForSingleObject(thread, INFINITE) != WAIT_OBJECT_0) retval = -1;
+  CloseHandle(thread);
+  return retval;
+}
+
+int tjGetNumCPUs(void)
+{
+  SYSTEM_INFO sysinfo;
+
+  GetSystemInfo(&sysinfo);
+  return sysinfo.dwNumberOfProcessors > 0 ?
+         (int)sysinfo.dwNumberOfProcessors : 1;
+}
+
+#else
+
+static void *threadStart(void *param)
+{
+  tjthread_start start = *(tjthread_start *)param;
+
+  free(param);
+  start.func(start.arg);
+  return NULL;
+}
+
+int tjThreadCreate(tjthread *thread, tjthread_func func, void *arg)
+{
+  tjthread_start *start;
+
+  if ((start = (tjthread_start *)malloc(sizeof(tjthread_start))) == NULL)
+    return -1;
+  start->func = func;  start->arg = arg;
+  if (pthread_create(thread, NULL, threadStart, start) != 0) {
+    free(start);
+    return -1;
+  }
+  return 0;
+}
+
+int tjThreadJoin(tjthread thread)
+{
+  return pthread_join(thread, NULL) == 0 ? 0 : -1;
+}
+
+int tjGetNumCPUs(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n > 0) return (int)n;
+#endif
+  return 1;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C)2026 The libjpeg-turbo Project.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the libjpeg-turbo Project nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS",
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Minimal portable thread wrappers used by the multithreaded code paths in
+   the TurboJPEG API library.  These are only available if the library was
+   built with WITH_THREADS. */
+
+#ifndef __TJTHREAD_H__
+#define __TJTHREAD_H__
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE tjthread;
+#else
+#include <pthread.h>
+typedef pthread_t tjthread;
+#endif
+
+typedef void (*tjthread_func) (void *arg);
+
+/* Start a new thread that calls func(arg).  Returns 0 if successful or -1 if
+   the thread could not be created. */
+extern int tjThreadCreate(tjthread *thread, tjthread_func func, void *arg);
+
+/* Wait for a thread created by tjThreadCreate() to terminate and release its
+   resources.  Returns 0 if successful or -1 if an error occurred. */
+extern int tjThreadJoin(tjthread thread);
+
+/* Return the number of logical CPUs available to this process, or 1 if that
+   cannot be determined. */
+extern int tjGetNumCPUs(void);
+
+#endif
@@ -34,13 +34,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
 #include "tjutil.h"
 #include "turbojpeg.h"
 #include "md5/md5.h"
 #include "cmyk.h"
 #ifdef _WIN32
 #include <time.h>
+#include <process.h>
 #define random()  rand()
+#define getpid()  _getpid()
 #else
 #include <unistd.h>
 #endif
@@ -54,7 +57,8 @@ static void usage(char *progName)
   printf("-noyuvpad = do not pad each line of each Y, U, and V plane to the nearest\n");
   printf("            4-byte boundary\n");
   printf("-alloc = test automatic buffer allocation\n");
-  printf("-bmp = tjLoadImage()/tjSaveImage() unit test\n\n");
+  printf("-bmp = tjLoadImage()/tjSaveImage() unit test\n");
+  printf("-threads = multithreaded code path unit test\n\n");
   exit(1);
 }
 
@@ -507,6 +511,194 @@ bailout:
 }
 
 
+/* Decompress the JPEG image generated by compTest() using tjDecompressFile().
+   The image is written to a file whose name is unique to this process, since
+   tjDecompressFile() memory-maps the file, and the file written by compTest()
+   may be overwritten by another instance of tjunittest that is running in
+   parallel. */
+
+static void decompFileTest(tjhandle handle, unsigned char *jpegBuf,
+                           unsigned long jpegSize, int w, int h, int pf,
+                           char *basename, int subsamp, int flags)
+{
+  char filename[1024];
+  unsigned char *dstBuf = NULL;
+  tjscalingfactor sf = { 1, 2 };
+  int scaledWidth = TJSCALED(w, sf), scaledHeight = 0;
+
+  snprintf(filename, 1024, "%s_file_%d.jpg", basename, (int)getpid());
+  writeJPEG(jpegBuf, jpegSize, filename);
+  printf("JPEG file -> %s %s %d/%d ... ", pixFormatStr[pf],
+         (flags & TJFLAG_BOTTOMUP) ? "Bottom-Up" : "Top-Down ", sf.num,
+         sf.denom);
+  if ((dstBuf = tjDecompressFile(handle, filename, &scaledWidth, 1,
+                                 &scaledHeight, pf, flags)) == NULL)
+    THROW_TJ();
+  if (scaledWidth != TJSCALED(w, sf) || scaledHeight != TJSCALED(h, sf))
+    THROW("Incorrect scaled image dimensions");
+
+  if (checkBuf(dstBuf, scaledWidth, scaledHeight, pf, subsamp, sf, flags))
+    printf("Passed.\n");
+  else printf("FAILED!\n");
+
+bailout:
+  tjFree(dstBuf);
+  remove(filename);
+}
+
+
+/* Verify tjDecompressResized() against a straightforward floating point
+   implementation of the same resampling filters, applied to the output of
+   tjDecompress2() at the scaling factor that tjDecompressResized() uses */
+
+static double filterWeight(int filter, double x)
+{
+  switch (filter) {
+  case TJFILTER_BILINEAR:
+    return fabs(x) < 1.0 ? 1.0 - fabs(x) : 0.0;
+  case TJFILTER_LANCZOS3:
+    if (x == 0.0) return 1.0;
+    if (fabs(x) >= 3.0) return 0.0;
+    return 3.0 * sin(M_PI * x) * sin(M_PI * x / 3.0) / (M_PI * M_PI * x * x);
+  }
+  return 0.0;
+}
+
+static void resizeAxis(int srcSize, int dstSize, int filter, int i,
+                       double *weights)
+{
+  double scale = (double)dstSize / srcSize, fscale = scale < 1. ? scale : 1.;
+  double total = 0.0;
+  int j;
+
+  for (j = 0; j < srcSize; j++) weights[j] = 0.0;
+  for (j = -srcSize; j < 2 * srcSize; j++) {
+    int jj = j < 0 ? 0 : (j >= srcSize ? srcSize - 1 : j);
+    double w;
+
+    if (filter == TJFILTER_AREA) {
+      double a = i / scale, b = (i + 1) / scale;
+
+      w = (j + 1 < b ? j + 1 : b) - (j > a ? j : a);
+      if (w < 0.0) w = 0.0;
+    } else
+      w = filterWeight(filter, (j + 0.5 - (i + 0.5) / scale) * fscale);
+    weights[jj] += w;
+    total += w;
+  }
+  for (j = 0; j < srcSize; j++) weights[j] /= total;
+}
+
+static void resizeTest(tjhandle handle, unsigned char *jpegBuf,
+                       unsigned long jpegSize, int w, int h, int pf,
+                       int subsamp, int flags, int dstw, int dsth, int filter)
+{
+  static const char *filterName[TJ_NUMFILTER] = {
+    "Area", "Bilinear", "Lanczos3"
+  };
+  unsigned char *srcBuf = NULL, *dstBuf = NULL;
+  double *hw = NULL, *vw = NULL, *tmp = NULL;
+  int n = 0, i, srcw = w, srch = h, ps = tjPixelSize[pf], x, y, c, j;
+  tjscalingfactor *sf = tjGetScalingFactors(&n);
+
+  if (!sf || !n) THROW_TJ();
+  for (i = n - 1; i > 0; i--) {
+    if (TJSCALED(w, sf[i]) >= dstw && TJSCALED(h, sf[i]) >= dsth)
+      break;
+  }
+  srcw = TJSCALED(w, sf[i]);  srch = TJSCALED(h, sf[i]);
+
+  printf("JPEG -> %s %s %dx%d %s ... ", pixFormatStr[pf],
+         (flags & TJFLAG_BOTTOMUP) ? "Bottom-Up" : "Top-Down ", dstw, dsth,
+         filterName[filter]);
+  if ((srcBuf = (unsigned char *)malloc(srcw * srch * ps)) == NULL ||
+      (dstBuf = (unsigned char *)malloc(dstw * dsth * ps)) == NULL ||
+      (hw = (double *)malloc(sizeof(double) * srcw)) == NULL ||
+      (vw = (double *)malloc(sizeof(double) * srch)) == NULL ||
+      (tmp = (double *)malloc(sizeof(double) * srch * ps)) == NULL)
+    THROW("Memory allocation failure");
+  TRY_TJ(tjDecompress2(handle, jpegBuf, jpegSize, srcBuf, srcw, 0, srch, pf,
+                       flags & ~TJFLAG_BOTTOMUP));
+  TRY_TJ(tjDecompressResized(handle, jpegBuf, jpegSize, dstBuf, dstw, 0, dsth,
+                             pf, filter, flags));
+
+  for (x = 0; x < dstw; x++) {
+    resizeAxis(srcw, dstw, filter, x, hw);
+    /* Resample column x of all source rows, then resample vertically */
+    for (y = 0; y < srch; y++) {
+      for (c = 0; c < ps; c++) {
+        double sum = 0.0;
+
+        for (j = 0; j < srcw; j++)
+          sum += hw[j] * srcBuf[(y * srcw + j) * ps + c];
+        tmp[y * ps + c] = sum;
+      }
+    }
+    for (y = 0; y < dsth; y++) {
+      int row = (flags & TJFLAG_BOTTOMUP) ? dsth - y - 1 : y;
+
+      resizeAxis(srch, dsth, filter, y, vw);
+      for (c = 0; c < ps; c++) {
+        double sum = 0.0;
+        int val = dstBuf[(row * dstw + x) * ps + c];
+
+        for (j = 0; j < srch; j++)
+          sum += vw[j] * tmp[j * ps + c];
+        sum = sum < 0.0 ? 0.0 : (sum > 255.0 ? 255.0 : sum);
+        if (abs(val - (int)(sum + 0.5)) > 2) {
+          printf("\nComp. %d at %d,%d should be %f, not %d\n", c, x, y, sum,
+                 val);
+          printf("FAILED!\n");
+          exitStatus = -1;
+          goto bailout;
+        }
+      }
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  free(srcBuf);  free(dstBuf);  free(hw);  free(vw);  free(tmp);
+}
+
+
+static void regionTest(tjhandle handle, unsigned char *jpegBuf,
+                       unsigned long jpegSize, int w, int h, int pf,
+                       int flags, int x, int y, int rw, int rh)
+{
+  unsigned char *srcBuf = NULL, *dstBuf = NULL;
+  int ps = tjPixelSize[pf], row;
+
+  printf("JPEG -> %s %s %s%dx%d+%d+%d ... ", pixFormatStr[pf],
+         (flags & TJFLAG_BOTTOMUP) ? "Bottom-Up" : "Top-Down ",
+         (flags & TJFLAG_FASTUPSAMPLE) ? "Fast " : "", rw, rh, x, y);
+  if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (dstBuf = (unsigned char *)malloc(rw * rh * ps)) == NULL)
+    THROW("Memory allocation failure");
+  TRY_TJ(tjDecompress2(handle, jpegBuf, jpegSize, srcBuf, w, 0, h, pf,
+                       flags & ~TJFLAG_BOTTOMUP));
+  TRY_TJ(tjDecompressRegion(handle, jpegBuf, jpegSize, dstBuf, x, y, rw, 0,
+                            rh, pf, flags));
+
+  /* The region must be identical to the same region of the whole image. */
+  for (row = 0; row < rh; row++) {
+    int dstRow = (flags & TJFLAG_BOTTOMUP) ? rh - row - 1 : row;
+
+    if (memcmp(&dstBuf[dstRow * rw * ps], &srcBuf[((y + row) * w + x) * ps],
+               rw * ps)) {
+      printf("\nRow %d of region does not match\n", row);
+      printf("FAILED!\n");
+      exitStatus = -1;
+      goto bailout;
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  free(srcBuf);  free(dstBuf);
+}
+
+
 static void doTest(int w, int h, const int *formats, int nformats, int subsamp,
                    char *basename)
 {
@@ -537,6 +729,29 @@ static void doTest(int w, int h, const int *formats, int nformats, int subsamp,
       compTest(chandle, &dstBuf, &size, w, h, pf, basename, subsamp, 100,
                flags);
       decompTest(dhandle, dstBuf, size, w, h, pf, basename, subsamp, flags);
+      if (!doYUV) {
+        int filter, j;
+
+        decompFileTest(dhandle, dstBuf, size, w, h, pf, basename, subsamp,
+                       flags);
+        for (filter = 0; filter < TJ_NUMFILTER; filter++) {
+          resizeTest(dhandle, dstBuf, size, w, h, pf, subsamp, flags,
+                     w * 5 / 7, h * 3 / 4, filter);
+          resizeTest(dhandle, dstBuf, size, w, h, pf, subsamp, flags, w + 3,
+                     h + 5, filter);
+        }
+        for (j = 0; j < 2; j++) {
+          int rflags = j ? flags | TJFLAG_FASTUPSAMPLE :
+                           flags & ~TJFLAG_FASTUPSAMPLE;
+
+          regionTest(dhandle, dstBuf, size, w, h, pf, rflags, w / 4, h / 3,
+                     w / 2, h / 3);
+          regionTest(dhandle, dstBuf, size, w, h, pf, rflags, 0, 0, w / 3 + 1,
+                     h);
+          regionTest(dhandle, dstBuf, size, w, h, pf, rflags, w / 2 + 1,
+                     h / 2 + 1, w - w / 2 - 1, h - h / 2 - 1);
+        }
+      }
       if (pf >= TJPF_RGBX && pf <= TJPF_XRGB) {
         printf("\n");
         decompTest(dhandle, dstBuf, size, w, h, pf + (TJPF_RGBA - TJPF_RGBX),
@@ -554,6 +769,408 @@ bailout:
 }
 
 
+/* Verify that the multithreaded code paths produce the same output as the
+   single-threaded code paths */
+
+#define NUMTHREADS  4
+
+static void mtDecompTest(tjhandle chandle, tjhandle dhandle1,
+                         tjhandle dhandleN, int w, int h, int subsamp,
+                         const char *restart)
+{
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *dstBuf1 = NULL,
+    *dstBufN = NULL;
+  unsigned long jpegSize = 0;
+  char env[80];
+  int i, j, n = 0;
+  tjscalingfactor *sf = tjGetScalingFactors(&n);
+
+  if (!sf || !n) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (dstBuf1 = (unsigned char *)malloc(w * 2 * h * 2 * 4)) == NULL ||
+      (dstBufN = (unsigned char *)malloc(w * 2 * h * 2 * 4)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 7 + (i / (w * 3)) * 3 + random() % 32) &
+                                0xFF);
+
+  snprintf(env, 80, "TJ_RESTART=%s", restart);
+  putenv(env);
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     subsamp, 95, 0));
+  putenv("TJ_RESTART=");
+
+  printf("%s restart=%-3s ... ", subNameLong[subsamp], restart);
+  for (i = 0; i < n; i++) {
+    int sw = TJSCALED(w, sf[i]), sh = TJSCALED(h, sf[i]);
+
+    for (j = 0; j < 3; j++) {
+      int flags = j == 1 ? TJFLAG_FASTUPSAMPLE :
+                  (j == 2 ? TJFLAG_BOTTOMUP : 0);
+      int pf = j == 2 ? TJPF_BGRX : TJPF_RGB;
+      unsigned long dstSize = sw * sh * tjPixelSize[pf];
+
+      memset(dstBuf1, 0, dstSize);
+      memset(dstBufN, 0xFF, dstSize);
+      TRY_TJ(tjDecompress2(dhandle1, jpegBuf, jpegSize, dstBuf1, sw, 0, sh,
+                           pf, flags));
+      TRY_TJ(tjDecompress2(dhandleN, jpegBuf, jpegSize, dstBufN, sw, 0, sh,
+                           pf, flags));
+      if (memcmp(dstBuf1, dstBufN, dstSize)) {
+        printf("FAILED! (scaling factor %d/%d, flags %d)\n", sf[i].num,
+               sf[i].denom, flags);
+        BAILOUT()
+      }
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf);
+  free(dstBuf1);
+  free(dstBufN);
+}
+
+
+static void mtCompTest(tjhandle chandle1, tjhandle chandleN, int w, int h,
+                       int subsamp, const char *restart)
+{
+  unsigned char *srcBuf = NULL, *jpegBuf1 = NULL, *jpegBufN = NULL;
+  unsigned long jpegSize1 = 0, jpegSizeN = 0;
+  char env[80];
+  int i, j;
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * 4)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 4; i++)
+    srcBuf[i] = (unsigned char)((i * 5 + (i / (w * 4)) * 3 + random() % 32) &
+                                0xFF);
+
+  printf("%s restart=%-3s ... ", subNameLong[subsamp], restart);
+  for (j = 0; j < 4; j++) {
+    int flags = j == 1 ? TJFLAG_BOTTOMUP :
+                (j == 2 ? TJFLAG_NOREALLOC : (j == 3 ? TJFLAG_PROGRESSIVE : 0));
+    int pf = j == 1 ? TJPF_BGRX : TJPF_RGB;
+
+    if (j == 2) {
+      tjFree(jpegBufN);
+      if ((jpegBufN = tjAlloc(tjBufSize(w, h, subsamp))) == NULL)
+        THROW("Memory allocation failure");
+    }
+
+    /* If no restart interval is specified, then the multithreaded baseline
+       code path uses one restart interval per MCU row. */
+    snprintf(env, 80, "TJ_RESTART=%s",
+             strlen(restart) || (flags & TJFLAG_PROGRESSIVE) ? restart : "1");
+    putenv(env);
+    TRY_TJ(tjCompress2(chandle1, srcBuf, w, 0, h, pf, &jpegBuf1, &jpegSize1,
+                       subsamp, 95, flags & ~TJFLAG_NOREALLOC));
+    snprintf(env, 80, "TJ_RESTART=%s", restart);
+    putenv(env);
+    TRY_TJ(tjCompress2(chandleN, srcBuf, w, 0, h, pf, &jpegBufN, &jpegSizeN,
+                       subsamp, 95, flags));
+    putenv("TJ_RESTART=");
+
+    if (jpegSize1 != jpegSizeN || memcmp(jpegBuf1, jpegBufN, jpegSize1)) {
+      printf("FAILED! (flags %d, sizes %lu, %lu)\n", flags, jpegSize1,
+             jpegSizeN);
+      BAILOUT()
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf1);
+  tjFree(jpegBufN);
+}
+
+
+#define NUMBATCH  7
+
+static void batchCompTest(tjhandle chandle1, tjhandle chandleB, int w, int h,
+                          int subsamp)
+{
+  unsigned char *srcBufs[NUMBATCH], *jpegBufs1[NUMBATCH],
+    *jpegBufsB[NUMBATCH];
+  unsigned long jpegSizes1[NUMBATCH], jpegSizesB[NUMBATCH];
+  int i, j, n;
+
+  memset(srcBufs, 0, sizeof(srcBufs));
+  memset(jpegBufs1, 0, sizeof(jpegBufs1));
+  memset(jpegBufsB, 0, sizeof(jpegBufsB));
+  for (n = 0; n < NUMBATCH; n++) {
+    if ((srcBufs[n] = (unsigned char *)malloc(w * h * 4)) == NULL)
+      THROW("Memory allocation failure");
+    for (i = 0; i < w * h * 4; i++)
+      srcBufs[n][i] = (unsigned char)((i * (n + 1) + (i / (w * 4)) * 3 +
+                                       random() % 32) & 0xFF);
+  }
+
+  printf("%s %d x %d ... ", subNameLong[subsamp], w, h);
+  for (j = 0; j < 4; j++) {
+    int flags = j == 1 ? TJFLAG_BOTTOMUP :
+                (j == 2 ? TJFLAG_NOREALLOC : (j == 3 ? TJFLAG_PROGRESSIVE : 0));
+    int pf = j == 1 ? TJPF_BGRX : TJPF_RGB, qual = 95 - j * 10;
+
+    for (n = 0; n < NUMBATCH; n++) {
+      TRY_TJ(tjCompress2(chandle1, srcBufs[n], w, 0, h, pf, &jpegBufs1[n],
+                         &jpegSizes1[n], subsamp, qual,
+                         flags & ~TJFLAG_NOREALLOC));
+      if (j == 2) {
+        tjFree(jpegBufsB[n]);
+        if ((jpegBufsB[n] = tjAlloc(tjBufSize(w, h, subsamp))) == NULL)
+          THROW("Memory allocation failure");
+      }
+    }
+    TRY_TJ(tjCompressBatch(chandleB, NUMBATCH,
+                           (const unsigned char **)srcBufs, w, 0, h, pf,
+                           jpegBufsB, jpegSizesB, subsamp, qual, flags));
+
+    for (n = 0; n < NUMBATCH; n++) {
+      if (jpegSizes1[n] != jpegSizesB[n] ||
+          memcmp(jpegBufs1[n], jpegBufsB[n], jpegSizes1[n])) {
+        printf("FAILED! (flags %d, image %d, sizes %lu, %lu)\n", flags, n,
+               jpegSizes1[n], jpegSizesB[n]);
+        BAILOUT()
+      }
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  for (n = 0; n < NUMBATCH; n++) {
+    free(srcBufs[n]);
+    tjFree(jpegBufs1[n]);
+    tjFree(jpegBufsB[n]);
+  }
+}
+
+
+static void batchDecompTest(tjhandle chandle, tjhandle dhandle1,
+                            tjhandle dhandleB, int truncate)
+{
+  unsigned char *srcBuf = NULL, *jpegBufs[NUMBATCH], *dstBufs1[NUMBATCH],
+    *dstBufsB[NUMBATCH];
+  unsigned long jpegSizes[NUMBATCH];
+  int w[NUMBATCH], h[NUMBATCH], i, n, retval1 = 0, retvalB;
+
+  memset(jpegBufs, 0, sizeof(jpegBufs));
+  memset(dstBufs1, 0, sizeof(dstBufs1));
+  memset(dstBufsB, 0, sizeof(dstBufsB));
+  if ((srcBuf = (unsigned char *)malloc(117 * 407 * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < 117 * 407 * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 5 + (i / (117 * 3)) * 3 +
+                                 random() % 32) & 0xFF);
+
+  /* Vary the dimensions, subsampling, quality, and Huffman tables among the
+     images in the batch. */
+  for (n = 0; n < NUMBATCH; n++) {
+    int subsamp = n % TJ_NUMSAMP;
+
+    w[n] = 117 - n * 11;  h[n] = 407 - n * 37;
+    TRY_TJ(tjCompress2(chandle, srcBuf, w[n], 117 * 3, h[n], TJPF_RGB,
+                       &jpegBufs[n], &jpegSizes[n], subsamp, 95 - n * 5,
+                       n % 3 == 2 ? TJFLAG_PROGRESSIVE : 0));
+    if (truncate && n == NUMBATCH / 2) jpegSizes[n] /= 2;
+    if ((dstBufs1[n] = (unsigned char *)malloc(w[n] * h[n] * 4)) == NULL ||
+        (dstBufsB[n] = (unsigned char *)calloc(w[n] * h[n], 4)) == NULL)
+      THROW("Memory allocation failure");
+  }
+
+  printf("%s ... ", truncate ? "Truncated" : "Normal   ");
+  for (n = 0; n < NUMBATCH; n++) {
+    if (tjDecompress2(dhandle1, jpegBufs[n], jpegSizes[n], dstBufs1[n], 0, 0,
+                      0, TJPF_BGRX, 0) < 0) {
+      if (tjGetErrorCode(dhandle1) != TJERR_WARNING) THROW_TJ();
+      retval1 = -1;
+    }
+  }
+  retvalB = tjDecompressBatch(dhandleB, NUMBATCH,
+                              (const unsigned char **)jpegBufs, jpegSizes,
+                              dstBufsB, 0, 0, 0, TJPF_BGRX, 0);
+  if (retvalB != retval1 ||
+      (retvalB < 0 && tjGetErrorCode(dhandleB) != TJERR_WARNING)) {
+    printf("FAILED! (return value %d, %s)\n", retvalB,
+           tjGetErrorStr2(dhandleB));
+    BAILOUT()
+  }
+  for (n = 0; n < NUMBATCH; n++) {
+    if (memcmp(dstBufs1[n], dstBufsB[n], w[n] * h[n] * 4)) {
+      printf("FAILED! (image %d)\n", n);
+      BAILOUT()
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  free(srcBuf);
+  for (n = 0; n < NUMBATCH; n++) {
+    tjFree(jpegBufs[n]);
+    free(dstBufs1[n]);
+    free(dstBufsB[n]);
+  }
+}
+
+
+#define NUMXFORMS  6
+
+static int negateFilter(short *coeffs, tjregion arrayRegion,
+                        tjregion planeRegion, int componentIndex,
+                        int transformIndex, tjtransform *transform)
+{
+  int i;
+
+  for (i = 0; i < arrayRegion.w * arrayRegion.h; i++)
+    coeffs[i] = -coeffs[i];
+  return 0;
+}
+
+
+static void mtXformTest(tjhandle chandle, tjhandle thandle1,
+                        tjhandle thandleN, int w, int h, int subsamp)
+{
+  /* Little-endian TIFF structure containing an Exif sub-IFD with
+     PixelXDimension and PixelYDimension tags, which the transformer
+     modifies */
+  static const unsigned char exif[66] = {
+    0xFF, 0xE1, 0, 64, 'E', 'x', 'i', 'f', 0, 0,
+    'I', 'I', 42, 0, 8, 0, 0, 0,
+    1, 0, 0x69, 0x87, 4, 0, 1, 0, 0, 0, 26, 0, 0, 0, 0, 0, 0, 0,
+    2, 0, 0x02, 0xA0, 4, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+    0x03, 0xA0, 4, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *exifBuf = NULL,
+    *dstBufs1[NUMXFORMS], *dstBufsN[NUMXFORMS];
+  unsigned long jpegSize = 0, dstSizes1[NUMXFORMS], dstSizesN[NUMXFORMS];
+  tjtransform t[NUMXFORMS];
+  int i;
+
+  memset(dstBufs1, 0, sizeof(dstBufs1));
+  memset(dstBufsN, 0, sizeof(dstBufsN));
+  memset(t, 0, sizeof(t));
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 3 + (i / (w * 3)) * 7 + random() % 32) &
+                                0xFF);
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     subsamp, 90, 0));
+  if ((exifBuf = (unsigned char *)malloc(jpegSize + 66)) == NULL)
+    THROW("Memory allocation failure");
+  memcpy(exifBuf, jpegBuf, 2);
+  memcpy(&exifBuf[2], exif, 66);
+  exifBuf[2 + 46] = w & 0xFF;  exifBuf[2 + 47] = (w >> 8) & 0xFF;
+  exifBuf[2 + 58] = h & 0xFF;  exifBuf[2 + 59] = (h >> 8) & 0xFF;
+  memcpy(&exifBuf[68], &jpegBuf[2], jpegSize - 2);
+  jpegSize += 66;
+
+  t[1].op = TJXOP_ROT90;
+  t[1].customFilter = negateFilter;
+  t[2].op = TJXOP_HFLIP;
+  t[2].options = TJXOPT_CROP;
+  t[2].r.x = tjMCUWidth[subsamp];  t[2].r.y = tjMCUHeight[subsamp];
+  t[2].r.w = w / 2;  t[2].r.h = h / 2;
+  t[3].op = TJXOP_TRANSPOSE;
+  t[3].options = TJXOPT_GRAY;
+  t[4].op = TJXOP_ROT180;
+  t[4].options = TJXOPT_PROGRESSIVE | TJXOPT_TRIM;
+  t[5].op = TJXOP_VFLIP;
+  t[5].options = TJXOPT_COPYNONE;
+
+  printf("%-4s %3dx%-3d ... ", subNameLong[subsamp], w, h);
+  TRY_TJ(tjTransform(thandle1, exifBuf, jpegSize, NUMXFORMS, dstBufs1,
+                     dstSizes1, t, 0));
+  TRY_TJ(tjTransform(thandleN, exifBuf, jpegSize, NUMXFORMS, dstBufsN,
+                     dstSizesN, t, 0));
+  for (i = 0; i < NUMXFORMS; i++) {
+    if (dstSizes1[i] != dstSizesN[i] ||
+        memcmp(dstBufs1[i], dstBufsN[i], dstSizes1[i])) {
+      printf("FAILED! (transform %d)\n", i);
+      BAILOUT()
+    }
+  }
+  printf("Passed.\n");
+
+bailout:
+  free(srcBuf);
+  free(exifBuf);
+  tjFree(jpegBuf);
+  for (i = 0; i < NUMXFORMS; i++) {
+    tjFree(dstBufs1[i]);
+    tjFree(dstBufsN[i]);
+  }
+}
+
+
+static void mtTest(void)
+{
+  tjhandle chandle = NULL, chandleN = NULL, dhandle1 = NULL, dhandleN = NULL,
+    thandle1 = NULL, thandleN = NULL;
+  int subsamp;
+
+  if ((chandle = tjInitCompress()) == NULL ||
+      (chandleN = tjInitCompress()) == NULL ||
+      (dhandle1 = tjInitDecompress()) == NULL ||
+      (dhandleN = tjInitDecompress()) == NULL ||
+      (thandle1 = tjInitTransform()) == NULL ||
+      (thandleN = tjInitTransform()) == NULL)
+    THROW_TJ();
+  TRY_TJ(tjSetNumThreads(chandleN, NUMTHREADS));
+  TRY_TJ(tjSetNumThreads(dhandleN, NUMTHREADS));
+  TRY_TJ(tjSetNumThreads(thandleN, NUMTHREADS));
+
+  printf("Multithreaded compression test\n");
+  for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+    mtCompTest(chandle, chandleN, 301, 233, subsamp, "");
+    mtCompTest(chandle, chandleN, 301, 233, subsamp, "3B");
+    mtCompTest(chandle, chandleN, 117, 407, subsamp, "2");
+    mtCompTest(chandle, chandleN, 35, 39, subsamp, "5B");
+  }
+  printf("--------------------\n\n");
+
+  printf("Batch compression test\n");
+  for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+    batchCompTest(chandle, chandle, 35, 39, subsamp);
+    batchCompTest(chandle, chandleN, 48, 48, subsamp);
+    batchCompTest(chandle, chandleN, 117, 407, subsamp);
+  }
+  printf("--------------------\n\n");
+
+  printf("Batch decompression test\n");
+  batchDecompTest(chandle, dhandle1, dhandle1, 0);
+  batchDecompTest(chandle, dhandle1, dhandleN, 0);
+  batchDecompTest(chandle, dhandle1, dhandleN, 1);
+  printf("--------------------\n\n");
+
+  printf("Multithreaded decompression test\n");
+  for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+    mtDecompTest(chandle, dhandle1, dhandleN, 301, 233, subsamp, "1");
+    mtDecompTest(chandle, dhandle1, dhandleN, 301, 233, subsamp, "3B");
+    mtDecompTest(chandle, dhandle1, dhandleN, 117, 407, subsamp, "2");
+  }
+  printf("--------------------\n\n");
+
+  printf("Multithreaded transform test\n");
+  for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+    mtXformTest(chandle, thandle1, thandleN, 301, 233, subsamp);
+    mtXformTest(chandle, thandle1, thandleN, 117, 407, subsamp);
+  }
+  printf("--------------------\n\n");
+
+bailout:
+  if (chandle) tjDestroy(chandle);
+  if (chandleN) tjDestroy(chandleN);
+  if (dhandle1) tjDestroy(dhandle1);
+  if (dhandleN) tjDestroy(dhandleN);
+  if (thandle1) tjDestroy(thandle1);
+  if (thandleN) tjDestroy(thandleN);
+}
+
+
 #if SIZEOF_SIZE_T == 8
 #define CHECKSIZE(function) { \
   if ((unsigned long long)size < (unsigned long long)0xFFFFFFFF) \
@@ -670,6 +1287,690 @@ bailout:
   if (handle) tjDestroy(handle);
 }
 
+static void tablesTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL, dhandleN = NULL, dhandle0 = NULL;
+  unsigned char *srcBuf = NULL, *tablesBuf = NULL, *jpegBuf = NULL,
+    *abbrBuf = NULL, *otherBuf = NULL, *dstBuf1 = NULL, *dstBuf2 = NULL;
+  unsigned long tablesSize = 0, jpegSize = 0, abbrSize = 0, otherSize = 0;
+  int w = 301, h = 233, i, subsamp, prog, n;
+
+  if ((chandle = tjInitCompress()) == NULL ||
+      (dhandle = tjInitDecompress()) == NULL ||
+      (dhandleN = tjInitDecompress()) == NULL ||
+      (dhandle0 = tjInitDecompress()) == NULL)
+    THROW_TJ();
+  TRY_TJ(tjSetNumThreads(dhandleN, NUMTHREADS));
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (dstBuf1 = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (dstBuf2 = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 7 + (i / (w * 3)) * 5 + random() % 16) &
+                                0xFF);
+
+  printf("Abbreviated JPEG image test\n");
+  TRY_TJ(tjCompressTables(chandle, &tablesBuf, &tablesSize, 75, 0));
+  if (tjDecompressTables(dhandle0, srcBuf, w * h * 3) == 0)
+    THROW("tjDecompressTables() accepted an invalid datastream");
+  TRY_TJ(tjDecompressTables(dhandle, tablesBuf, tablesSize));
+  TRY_TJ(tjDecompressTables(dhandleN, tablesBuf, tablesSize));
+  /* An abbreviated image cannot be decompressed by a fresh instance unless
+     tables have been loaded into it. */
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &abbrBuf, &abbrSize,
+                     TJSAMP_444, 75, TJFLAG_ABBREVIATED));
+  if (tjDecompress2(dhandle0, abbrBuf, abbrSize, dstBuf2, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Abbreviated image was decompressed without tables");
+
+  for (prog = 0; prog < 2; prog++) {
+    for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+      int flags = prog ? TJFLAG_PROGRESSIVE : 0;
+
+      printf("%s %-4s ... ", prog ? "Progressive" : "Baseline   ",
+             subNameLong[subsamp]);
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                         &jpegSize, subsamp, 75, flags));
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &abbrBuf,
+                         &abbrSize, subsamp, 75, flags | TJFLAG_ABBREVIATED));
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &otherBuf,
+                         &otherSize, subsamp, 20, flags));
+      if (abbrSize >= jpegSize) {
+        printf("FAILED! (abbreviated image is not smaller)\n");
+        BAILOUT()
+      }
+      if (tjDecompressTables(dhandle0, jpegBuf, jpegSize) == 0) {
+        printf("FAILED! (tables-only datastream expected)\n");
+        BAILOUT()
+      }
+      TRY_TJ(tjDecompress2(dhandle0, jpegBuf, jpegSize, dstBuf1, w, 0, h,
+                           TJPF_RGB, 0));
+
+      /* Decompressing an image that defines its own tables must not affect
+         subsequent abbreviated images. */
+      for (n = 0; n < 4; n++) {
+        tjhandle handle = n < 2 ? dhandle : dhandleN;
+
+        if (n & 1)
+          TRY_TJ(tjDecompress2(handle, otherBuf, otherSize, dstBuf2, w, 0, h,
+                               TJPF_RGB, 0));
+        memset(dstBuf2, 0, w * h * 3);
+        TRY_TJ(tjDecompress2(handle, abbrBuf, abbrSize, dstBuf2, w, 0, h,
+                             TJPF_RGB, 0));
+        if (memcmp(dstBuf1, dstBuf2, w * h * 3)) {
+          printf("FAILED! (%s)\n", n & 1 ? "after full image" : "initial");
+          BAILOUT()
+        }
+      }
+      printf("Passed.\n");
+    }
+  }
+  printf("--------------------\n\n");
+
+bailout:
+  free(srcBuf);
+  free(dstBuf1);
+  free(dstBuf2);
+  tjFree(tablesBuf);
+  tjFree(jpegBuf);
+  tjFree(abbrBuf);
+  tjFree(otherBuf);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+  if (dhandleN) tjDestroy(dhandleN);
+  if (dhandle0) tjDestroy(dhandle0);
+}
+
+static void streamTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *dstBuf1 = NULL,
+    *dstBuf2 = NULL;
+  unsigned long jpegSize = 0, pos, chunk, firstRowPos;
+  int w = 301, h = 233, i, subsamp, prog, rows, retval1, dw, dh, dflags,
+    hdrw, hdrh, hdrSubsamp, hdrColorspace, gotHeader;
+
+  if ((chandle = tjInitCompress()) == NULL ||
+      (dhandle = tjInitDecompress()) == NULL)
+    THROW_TJ();
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (dstBuf1 = (unsigned char *)malloc(w * h * 4)) == NULL ||
+      (dstBuf2 = (unsigned char *)malloc(w * h * 4)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 3 + (i / (w * 3)) * 7 + random() % 16) &
+                                0xFF);
+
+  printf("Incremental decompression test\n");
+  for (prog = 0; prog < 3; prog++) {
+    for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+      /* Exercise scaling, bottom-up output, and truncated streams using
+         different subsampling levels. */
+      dw = (subsamp == TJSAMP_420) ? (w + 1) / 2 : 0;
+      dh = (subsamp == TJSAMP_420) ? (h + 1) / 2 : h;
+      dflags = (subsamp == TJSAMP_422) ? TJFLAG_BOTTOMUP : 0;
+
+      printf("%s %-4s ... ", prog == 0 ? "Baseline   " :
+             (prog == 1 ? "Progressive" : "Truncated  "),
+             subNameLong[subsamp]);
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                         &jpegSize, subsamp, 90,
+                         prog == 1 ? TJFLAG_PROGRESSIVE : 0));
+      if (prog == 2) jpegSize = jpegSize * 2 / 3;
+
+      retval1 = tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf1, dw, 0, 0,
+                              TJPF_BGRX, dflags);
+      if (retval1 < 0 && (prog != 2 ||
+                          tjGetErrorCode(dhandle) != TJERR_WARNING))
+        THROW_TJ();
+      memset(dstBuf2, 0, w * h * 4);
+
+      TRY_TJ(tjDecompressStreamStart(dhandle));
+      pos = 0;  firstRowPos = 0;  rows = 0;  gotHeader = 0;
+      while (pos < jpegSize) {
+        chunk = 1 + random() % 1000;
+        chunk = min(chunk, jpegSize - pos);
+        TRY_TJ(tjDecompressStreamPush(dhandle, &jpegBuf[pos], chunk,
+                                      pos + chunk == jpegSize));
+        pos += chunk;
+        /* A stream in progress must not interfere with the other
+           decompression functions. */
+        if (subsamp == TJSAMP_440 && prog != 2)
+          TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf1, dw, 0, 0,
+                               TJPF_BGRX, dflags));
+        if (!gotHeader) {
+          if ((gotHeader = tjDecompressStreamHeader(dhandle, &hdrw, &hdrh,
+                                                    &hdrSubsamp,
+                                                    &hdrColorspace)) < 0)
+            THROW_TJ();
+          if (gotHeader &&
+              (hdrw != w || hdrh != h || hdrSubsamp != subsamp)) {
+            printf("FAILED! (header)\n");
+            BAILOUT()
+          }
+        }
+        if ((rows = tjDecompressStreamRows(dhandle, dstBuf2, dw, 0, 0,
+                                           TJPF_BGRX, dflags)) < 0) {
+          if (prog != 2 || tjGetErrorCode(dhandle) != TJERR_WARNING)
+            THROW_TJ();
+          /* The stream can be resumed after a warning. */
+          TRY_TJ(rows = tjDecompressStreamRows(dhandle, dstBuf2, dw, 0, 0,
+                                               TJPF_BGRX, dflags));
+        }
+        if (rows > 0 && firstRowPos == 0) firstRowPos = pos;
+      }
+      if (rows != dh) {
+        printf("FAILED! (%d rows)\n", rows);
+        BAILOUT()
+      }
+      if (prog == 0 && firstRowPos >= jpegSize) {
+        printf("FAILED! (no rows before end of stream)\n");
+        BAILOUT()
+      }
+      if (memcmp(dstBuf1, dstBuf2, (dw ? dw : w) * dh * 4)) {
+        printf("FAILED! (image differs from tjDecompress2())\n");
+        BAILOUT()
+      }
+      printf("Passed.\n");
+    }
+  }
+  printf("--------------------\n\n");
+
+bailout:
+  free(srcBuf);
+  free(dstBuf1);
+  free(dstBuf2);
+  tjFree(jpegBuf);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
+typedef struct {
+  unsigned char *buf;
+  unsigned long size;
+  int failAfter;
+  /* If nonzero, all chunks except the last must be this size. */
+  unsigned long chunkSize, lastChunk;
+  int badChunk;
+} streamdest;
+
+static int writeCallback(const unsigned char *buf, unsigned long size,
+                         void *callbackData)
+{
+  streamdest *dest = (streamdest *)callbackData;
+  unsigned char *newBuf;
+
+  if (dest->failAfter >= 0 && dest->failAfter-- == 0) return -1;
+  if (dest->chunkSize &&
+      (size > dest->chunkSize ||
+       (dest->lastChunk && dest->lastChunk != dest->chunkSize)))
+    dest->badChunk = 1;
+  dest->lastChunk = size;
+  if ((newBuf = (unsigned char *)realloc(dest->buf, dest->size + size)) ==
+      NULL)
+    return -1;
+  memcpy(&newBuf[dest->size], buf, size);
+  dest->buf = newBuf;  dest->size += size;
+  return 0;
+}
+
+
+static void compStreamTest(void)
+{
+  tjhandle chandle1 = NULL, chandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL;
+  unsigned long jpegSize = 0;
+  streamdest dest = { NULL, 0, -1, 0, 0, 0 };
+  int w = 301, h = 233, i, subsamp, mode, row, numRows, flags;
+
+  if ((chandle1 = tjInitCompress()) == NULL ||
+      (chandle = tjInitCompress()) == NULL)
+    THROW_TJ();
+  if ((srcBuf = (unsigned char *)malloc(w * h * 4)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 4; i++)
+    srcBuf[i] = (unsigned char)((i * 5 + (i / (w * 4)) * 3 + random() % 16) &
+                                0xFF);
+
+  printf("Incremental compression test\n");
+  for (mode = 0; mode < 3; mode++) {
+    for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+      flags = mode == 1 ? TJFLAG_PROGRESSIVE :
+              (mode == 2 ? TJFLAG_BOTTOMUP : 0);
+
+      printf("%s %-4s ... ", mode == 0 ? "Baseline   " :
+             (mode == 1 ? "Progressive" : "Bottom-up  "),
+             subNameLong[subsamp]);
+      TRY_TJ(tjCompress2(chandle1, srcBuf, w, 0, h, TJPF_XBGR, &jpegBuf,
+                         &jpegSize, subsamp, 90, flags));
+
+      dest.size = 0;
+      TRY_TJ(tjCompressStreamStart(chandle, w, h, TJPF_XBGR, writeCallback,
+                                   &dest, subsamp, 90, flags));
+      /* A stream in progress must not interfere with the other compression
+         functions. */
+      if (subsamp == TJSAMP_440)
+        TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_XBGR, &jpegBuf,
+                           &jpegSize, subsamp, 90, flags));
+      for (row = 0; row < h; row += numRows) {
+        numRows = 1 + random() % 40;
+        numRows = min(numRows, h - row);
+        if (flags & TJFLAG_BOTTOMUP)
+          TRY_TJ(tjCompressStreamRows(chandle,
+                                      &srcBuf[(h - row - numRows) * w * 4], 0,
+                                      numRows))
+        else
+          TRY_TJ(tjCompressStreamRows(chandle, &srcBuf[row * w * 4], w * 4,
+                                      numRows))
+        if (row == 0 && tjCompressStreamFinish(chandle) == 0) {
+          printf("FAILED! (finished an incomplete image)\n");
+          BAILOUT()
+        }
+      }
+      TRY_TJ(tjCompressStreamFinish(chandle));
+      if (dest.size != jpegSize || memcmp(dest.buf, jpegBuf, jpegSize)) {
+        printf("FAILED! (JPEG image differs from tjCompress2())\n");
+        BAILOUT()
+      }
+      printf("Passed.\n");
+    }
+  }
+
+  printf("Callback failure ... ");
+  dest.size = 0;  dest.failAfter = 2;
+  TRY_TJ(tjCompressStreamStart(chandle, w, h, TJPF_XBGR, writeCallback, &dest,
+                               TJSAMP_444, 100, 0));
+  if (tjCompressStreamRows(chandle, srcBuf, 0, h) == 0 ||
+      tjCompressStreamFinish(chandle) == 0) {
+    printf("FAILED!\n");
+    BAILOUT()
+  }
+  printf("Passed.\n");
+  printf("--------------------\n\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf);
+  free(dest.buf);
+  if (chandle1) tjDestroy(chandle1);
+  if (chandle) tjDestroy(chandle);
+}
+
+
+static void destTest(void)
+{
+  tjhandle chandle1 = NULL, chandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *listBuf = NULL;
+  unsigned long jpegSize = 0, size = 0;
+  streamdest dest = { NULL, 0, -1, 0, 0, 0 };
+  tjbuffer buffers[3];
+  int w = 301, h = 233, i, subsamp, mode, flags;
+
+  if ((chandle1 = tjInitCompress()) == NULL ||
+      (chandle = tjInitCompress()) == NULL)
+    THROW_TJ();
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 7 + (i / (w * 3)) * 5 + random() % 16) &
+                                0xFF);
+
+  printf("Destination test\n");
+  for (mode = 0; mode < 3; mode++) {
+    for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+      flags = mode == 1 ? TJFLAG_PROGRESSIVE : 0;
+      /* The multithreaded code path inserts restart markers, so the reference
+         image must be generated with the same number of threads. */
+      TRY_TJ(tjSetNumThreads(chandle1, mode == 2 ? NUMTHREADS : 1));
+      TRY_TJ(tjSetNumThreads(chandle, mode == 2 ? NUMTHREADS : 1));
+
+      printf("%s %-4s ... ", mode == 0 ? "Baseline   " :
+             (mode == 1 ? "Progressive" : "Threaded   "),
+             subNameLong[subsamp]);
+      TRY_TJ(tjCompress2(chandle1, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                         &jpegSize, subsamp, 90, flags));
+
+      /* Callback function */
+      dest.size = 0;  dest.chunkSize = 1000 + subsamp;  dest.lastChunk = 0;
+      TRY_TJ(tjSetWriteCallback(chandle, writeCallback, &dest,
+                                dest.chunkSize));
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, NULL, &size,
+                         subsamp, 90, flags));
+      if (size != jpegSize || dest.size != jpegSize ||
+          memcmp(dest.buf, jpegBuf, jpegSize)) {
+        printf("FAILED! (callback output differs from tjCompress2())\n");
+        BAILOUT()
+      }
+      if (dest.badChunk) {
+        printf("FAILED! (incorrect chunk size)\n");
+        BAILOUT()
+      }
+
+      /* Buffer list (with an empty buffer in the middle and gaps between the
+         buffers) */
+      free(listBuf);
+      if ((listBuf = (unsigned char *)malloc(jpegSize + 64)) == NULL)
+        THROW("Memory allocation failure");
+      memset(listBuf, 0, jpegSize + 64);
+      buffers[0].buf = listBuf;  buffers[0].size = jpegSize / 3;
+      buffers[1].buf = NULL;  buffers[1].size = 0;
+      buffers[2].buf = &listBuf[buffers[0].size + 32];
+      buffers[2].size = jpegSize - buffers[0].size + 32;
+      TRY_TJ(tjSetDestBuffers(chandle, buffers, 3));
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, NULL, &size,
+                         subsamp, 90, flags));
+      if (size != jpegSize ||
+          memcmp(buffers[0].buf, jpegBuf, buffers[0].size) ||
+          memcmp(buffers[2].buf, &jpegBuf[buffers[0].size],
+                 jpegSize - buffers[0].size) ||
+          listBuf[buffers[0].size] != 0) {
+        printf("FAILED! (buffer list output differs from tjCompress2())\n");
+        BAILOUT()
+      }
+
+      /* Buffer list that is too small */
+      buffers[2].size = jpegSize - buffers[0].size - 1;
+      TRY_TJ(tjSetDestBuffers(chandle, buffers, 3));
+      if (tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, NULL, &size,
+                      subsamp, 90, flags) == 0) {
+        printf("FAILED! (overflowed the buffer list)\n");
+        BAILOUT()
+      }
+
+      /* Default destination */
+      TRY_TJ(tjSetDestBuffers(chandle, NULL, 0));
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &dest.buf,
+                         &dest.size, subsamp, 90, flags));
+      if (dest.size != jpegSize || memcmp(dest.buf, jpegBuf, jpegSize)) {
+        printf("FAILED! (could not restore the default destination)\n");
+        BAILOUT()
+      }
+      printf("Passed.\n");
+    }
+  }
+
+  printf("Callback failure ... ");
+  dest.size = 0;  dest.failAfter = 2;  dest.chunkSize = 0;
+  TRY_TJ(tjSetNumThreads(chandle, 1));
+  TRY_TJ(tjSetWriteCallback(chandle, writeCallback, &dest, 100));
+  if (tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, NULL, &size,
+                  TJSAMP_444, 100, 0) == 0) {
+    printf("FAILED!\n");
+    BAILOUT()
+  }
+  printf("Passed.\n");
+  printf("--------------------\n\n");
+
+bailout:
+  free(srcBuf);
+  free(listBuf);
+  tjFree(jpegBuf);
+  free(dest.buf);
+  if (chandle1) tjDestroy(chandle1);
+  if (chandle) tjDestroy(chandle);
+}
+
+
+static void requantTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL, thandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *dstBuf = NULL,
+    *dstBuf2 = NULL, *rgbBuf = NULL, *rgbBuf2 = NULL;
+  unsigned long jpegSize = 0, dstSize = 0, dstSize2 = 0;
+  int w = 301, h = 233, i, subsamp, flags, dw, dh, dsubsamp, dcs;
+  double err, refErr;
+
+  if ((chandle = tjInitCompress()) == NULL ||
+      (dhandle = tjInitDecompress()) == NULL ||
+      (thandle = tjInitTransform()) == NULL)
+    THROW_TJ();
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (rgbBuf = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (rgbBuf2 = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * 3; i++)
+    srcBuf[i] = (unsigned char)((i * 7 + (i / (w * 3)) * 5 + random() % 16) &
+                                0xFF);
+
+  printf("Requantization test\n");
+  for (flags = 0; flags <= TJFLAG_PROGRESSIVE; flags += TJFLAG_PROGRESSIVE) {
+    for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+      printf("%s %-4s ... ",
+             flags & TJFLAG_PROGRESSIVE ? "Progressive" : "Baseline   ",
+             subNameLong[subsamp]);
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                         &jpegSize, subsamp, 95, 0));
+      TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, rgbBuf, w, 0, h,
+                           TJPF_RGB, 0));
+
+      /* A higher quality must not change the image. */
+      TRY_TJ(tjRequantize(thandle, jpegBuf, jpegSize, &dstBuf, &dstSize, 100,
+                          flags));
+      TRY_TJ(tjDecompress2(dhandle, dstBuf, dstSize, rgbBuf2, w, 0, h,
+                           TJPF_RGB, 0));
+      if (memcmp(rgbBuf, rgbBuf2, w * h * 3)) {
+        printf("FAILED! (higher quality changed the image)\n");
+        BAILOUT()
+      }
+
+      /* A lower quality must shrink the image without changing its
+         dimensions or subsampling. */
+      TRY_TJ(tjRequantize(thandle, jpegBuf, jpegSize, &dstBuf, &dstSize, 50,
+                          flags));
+      TRY_TJ(tjDecompressHeader3(dhandle, dstBuf, dstSize, &dw, &dh,
+                                 &dsubsamp, &dcs));
+      if (dw != w || dh != h || dsubsamp != subsamp) {
+        printf("FAILED! (incorrect header)\n");
+        BAILOUT()
+      }
+      if (dstSize >= jpegSize) {
+        printf("FAILED! (image did not shrink)\n");
+        BAILOUT()
+      }
+      TRY_TJ(tjDecompress2(dhandle, dstBuf, dstSize, rgbBuf2, w, 0, h,
+                           TJPF_RGB, 0));
+
+      /* Requantizing to the same quality again must not change the
+         coefficients. */
+      TRY_TJ(tjRequantize(thandle, dstBuf, dstSize, &dstBuf2, &dstSize2, 50,
+                          flags));
+      TRY_TJ(tjDecompress2(dhandle, dstBuf2, dstSize2, rgbBuf, w, 0, h,
+                           TJPF_RGB, 0));
+      if (memcmp(rgbBuf, rgbBuf2, w * h * 3)) {
+        printf("FAILED! (requantization is not idempotent)\n");
+        BAILOUT()
+      }
+
+      /* The error should be comparable to that of compressing the original
+         image with the same quality. */
+      for (i = 0, err = 0.; i < w * h * 3; i++)
+        err += abs(srcBuf[i] - rgbBuf2[i]);
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &dstBuf2,
+                         &dstSize2, subsamp, 50, 0));
+      TRY_TJ(tjDecompress2(dhandle, dstBuf2, dstSize2, rgbBuf, w, 0, h,
+                           TJPF_RGB, 0));
+      for (i = 0, refErr = 0.; i < w * h * 3; i++)
+        refErr += abs(srcBuf[i] - rgbBuf[i]);
+      if (err > refErr * 1.1) {
+        printf("FAILED! (mean error = %f, expected %f)\n", err / (w * h * 3),
+               refErr / (w * h * 3));
+        BAILOUT()
+      }
+      printf("Passed.\n");
+    }
+  }
+  printf("--------------------\n\n");
+
+bailout:
+  free(srcBuf);
+  free(rgbBuf);
+  free(rgbBuf2);
+  tjFree(jpegBuf);
+  tjFree(dstBuf);
+  tjFree(dstBuf2);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+  if (thandle) tjDestroy(thandle);
+}
+
+
+#define NUMNVSF  4
+
+/* Compare the output of tjDecompressToNV() with semi-planar images generated
+   from the output of tjDecompressToYUVPlanes() */
+
+static void nvTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *yuvPlanes[3] = { 0, 0, 0 },
+    *nvPlanes[2] = { 0, 0 };
+  unsigned long jpegSize = 0;
+  const tjscalingfactor nvsf[NUMNVSF] = { { 1, 1 }, { 1, 2 }, { 3, 8 },
+                                          { 1, 8 } };
+  int sizes[2][2] = { { 301, 233 }, { 35, 39 } };
+  int n, i, subsamp, s, nvFormat, pad;
+
+  if ((chandle = tjInitCompress()) == NULL ||
+      (dhandle = tjInitDecompress()) == NULL)
+    THROW_TJ();
+
+  printf("Semi-planar YUV decompression test\n");
+  for (n = 0; n < 2; n++) {
+    int w = sizes[n][0], h = sizes[n][1];
+
+    free(srcBuf);
+    if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+      THROW("Memory allocation failure");
+    for (i = 0; i < w * h * 3; i++)
+      srcBuf[i] = (unsigned char)((i * 3 + (i / (w * 3)) * 7 +
+                                   random() % 32) & 0xFF);
+
+    for (subsamp = 0; subsamp < TJ_NUMSAMP; subsamp++) {
+      int strides[2];
+
+      printf("%s %d x %d ... ", subNameLong[subsamp], w, h);
+      TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                         &jpegSize, subsamp, 90, 0));
+
+      if (subsamp == TJSAMP_411) {
+        if ((nvPlanes[0] = (unsigned char *)malloc(w * h)) == NULL ||
+            (nvPlanes[1] = (unsigned char *)malloc(w * h)) == NULL)
+          THROW("Memory allocation failure");
+        if (tjDecompressToNV(dhandle, jpegBuf, jpegSize, nvPlanes, 0, NULL,
+                             0, TJNV_NV12, 0) == 0) {
+          printf("FAILED! (4:1:1 was not rejected)\n");
+          BAILOUT()
+        }
+        free(nvPlanes[0]);  nvPlanes[0] = NULL;
+        free(nvPlanes[1]);  nvPlanes[1] = NULL;
+        printf("Passed.\n");
+        continue;
+      }
+
+      for (s = 0; s < NUMNVSF; s++) {
+        int dw = TJSCALED(w, nvsf[s]), dh = TJSCALED(h, nvsf[s]);
+        int pw0 = tjPlaneWidth(0, dw, TJSAMP_420),
+          ph0 = tjPlaneHeight(0, dh, TJSAMP_420),
+          pw1 = tjPlaneWidth(1, dw, TJSAMP_420),
+          ph1 = tjPlaneHeight(1, dh, TJSAMP_420);
+        int nc = subsamp == TJSAMP_GRAY ? 1 : 3;
+        int yw[3], yh[3], fx = 16 / tjMCUWidth[subsamp],
+          fy = 16 / tjMCUHeight[subsamp];
+
+        for (i = 0; i < nc; i++) {
+          yw[i] = tjPlaneWidth(i, dw, subsamp);
+          yh[i] = tjPlaneHeight(i, dh, subsamp);
+          if ((yuvPlanes[i] = (unsigned char *)malloc(yw[i] * yh[i])) == NULL)
+            THROW("Memory allocation failure");
+        }
+        TRY_TJ(tjDecompressToYUVPlanes(dhandle, jpegBuf, jpegSize, yuvPlanes,
+                                       dw, NULL, dh, 0));
+
+        for (pad = 0; pad < 2; pad++) {
+          strides[0] = pw0 + pad * 5;  strides[1] = pw1 * 2 + pad * 3;
+          if ((nvPlanes[0] =
+               (unsigned char *)malloc(strides[0] * ph0)) == NULL ||
+              (nvPlanes[1] =
+               (unsigned char *)malloc(strides[1] * ph1)) == NULL)
+            THROW("Memory allocation failure");
+
+          for (nvFormat = 0; nvFormat < TJ_NUMNV; nvFormat++) {
+            int row, col;
+
+            memset(nvPlanes[0], 0xAA, strides[0] * ph0);
+            memset(nvPlanes[1], 0xAA, strides[1] * ph1);
+            TRY_TJ(tjDecompressToNV(dhandle, jpegBuf, jpegSize, nvPlanes, dw,
+                                    pad ? strides : NULL, dh, nvFormat, 0));
+
+            for (row = 0; row < ph0; row++) {
+              for (col = 0; col < strides[0]; col++) {
+                int yrow = row < yh[0] ? row : yh[0] - 1;
+                int ycol = col < yw[0] ? col : yw[0] - 1;
+                int expected = col < pw0 ?
+                               yuvPlanes[0][yrow * yw[0] + ycol] : 0xAA;
+
+                if (nvPlanes[0][row * strides[0] + col] != expected) {
+                  printf("FAILED! (scale %d/%d, %s, Y %d,%d = %d, "
+                         "expected %d)\n",
+                         nvsf[s].num, nvsf[s].denom,
+                         nvFormat == TJNV_NV12 ? "NV12" : "NV21", col, row,
+                         nvPlanes[0][row * strides[0] + col], expected);
+                  BAILOUT()
+                }
+              }
+            }
+
+            for (row = 0; row < ph1; row++) {
+              for (col = 0; col < strides[1]; col++) {
+                int expected = 0xAA;
+
+                if (col < pw1 * 2 && nc == 1)
+                  expected = 128;
+                else if (col < pw1 * 2) {
+                  int c = ((col & 1) ^ (nvFormat == TJNV_NV21)) + 1;
+                  int r0 = row * fy, r1 = r0 + fy - 1;
+                  int c0 = (col / 2) * fx, c1 = c0 + fx - 1;
+
+                  if (r1 >= yh[c]) r1 = yh[c] - 1;
+                  if (c1 >= yw[c]) c1 = yw[c] - 1;
+                  expected = (yuvPlanes[c][r0 * yw[c] + c0] +
+                              yuvPlanes[c][r0 * yw[c] + c1] +
+                              yuvPlanes[c][r1 * yw[c] + c0] +
+                              yuvPlanes[c][r1 * yw[c] + c1] + 2) >> 2;
+                }
+                if (nvPlanes[1][row * strides[1] + col] != expected) {
+                  printf("FAILED! (scale %d/%d, %s, UV %d,%d = %d, "
+                         "expected %d)\n",
+                         nvsf[s].num, nvsf[s].denom,
+                         nvFormat == TJNV_NV12 ? "NV12" : "NV21", col, row,
+                         nvPlanes[1][row * strides[1] + col], expected);
+                  BAILOUT()
+                }
+              }
+            }
+          }
+          free(nvPlanes[0]);  nvPlanes[0] = NULL;
+          free(nvPlanes[1]);  nvPlanes[1] = NULL;
+        }
+        for (i = 0; i < 3; i++) {
+          free(yuvPlanes[i]);  yuvPlanes[i] = NULL;
+        }
+      }
+      printf("Passed.\n");
+    }
+  }
+  printf("\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf);
+  for (i = 0; i < 3; i++) free(yuvPlanes[i]);
+  free(nvPlanes[0]);
+  free(nvPlanes[1]);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
 
 static void initBitmap(unsigned char *buf, int width, int pitch, int height,
                        int pf, int flags)
@@ -896,6 +2197,10 @@ int main(int argc, char *argv[])
       else if (!strcasecmp(argv[i], "-noyuvpad")) pad = 1;
       else if (!strcasecmp(argv[i], "-alloc")) alloc = 1;
       else if (!strcasecmp(argv[i], "-bmp")) return bmpTest();
+      else if (!strcasecmp(argv[i], "-threads")) {
+        mtTest();
+        return exitStatus;
+      }
       else usage(argv[0]);
     }
   }
@@ -916,6 +2221,13 @@ int main(int argc, char *argv[])
   doTest(41, 35, _3byteFormats, 2, TJSAMP_GRAY, "test");
   doTest(35, 39, _4byteFormats, 4, TJSAMP_GRAY, "test");
   bufSizeTest();
+  if (!doYUV) {
+    tablesTest();
+    compStreamTest();
+    destTest();
+    requantTest();
+    streamTest();
+  }
   if (doYUV) {
     printf("\n--------------------\n\n");
     doTest(48, 48, _onlyRGB, 1, TJSAMP_444, "test_yuv0");
@@ -925,6 +2237,8 @@ int main(int argc, char *argv[])
     doTest(48, 48, _onlyRGB, 1, TJSAMP_411, "test_yuv0");
     doTest(48, 48, _onlyRGB, 1, TJSAMP_GRAY, "test_yuv0");
     doTest(48, 48, _onlyGray, 1, TJSAMP_GRAY, "test_yuv0");
+    printf("\n--------------------\n\n");
+    nvTest();
   }
 
   return exitStatus;
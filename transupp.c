@@ -57,6 +57,11 @@
  * arrays for most of the transforms.  That could result in much thrashing
  * if the image is larger than main memory.
  *
+ * In streaming mode, these routines instead generate one iMCU row of the
+ * destination at a time, as the compressor requests it, so only the source
+ * arrays need to be kept in memory.  (See the streaming coefficient
+ * controller below.)
+ *
  * If cropping or trimming is involved, the destination arrays may be smaller
  * than the source arrays.  Note it is not possible to do horizontal flip
  * in-place when a nonzero Y crop offset is specified, since we'd have to move
@@ -128,7 +133,7 @@ requant_comp(j_decompress_ptr cinfo, jpeg_component_info *compptr,
   JBLOCKARRAY buffer;
   JBLOCKROW block;
   JCOEFPTR ptr;
-  JCOEF temp, qval;
+  long temp, qval;
 
   qtblptr = compptr->quant_table;
   for (blk_y = 0; blk_y < compptr->height_in_blocks;
@@ -160,7 +165,7 @@ requant_comp(j_decompress_ptr cinfo, jpeg_component_info *compptr,
               temp += qval >> 1; /* for rounding */
               DIVIDE_BY(temp, qval);
             }
-            ptr[k] = temp;
+            ptr[k] = (JCOEF)temp;
           }
         }
       }
@@ -271,11 +276,57 @@ do_drop(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 }
 
 
+/* Destination of the transform routines below.  Normally, the routines
+ * generate the whole destination image into a set of virtual arrays.  In
+ * streaming mode, they generate only one iMCU row of one component, into a
+ * buffer supplied by the streaming coefficient controller.
+ */
+
+typedef struct {
+  jvirt_barray_ptr *coef_arrays; /* destination arrays, or NULL if streaming */
+  int ci;                       /* component to generate (streaming mode) */
+  JDIMENSION iMCU_row;          /* iMCU row to generate (streaming mode) */
+  JBLOCKARRAY row_buffer;       /* receives the iMCU row (streaming mode) */
+} transform_dest;
+
+
+LOCAL(JDIMENSION)
+dst_start_row(transform_dest *dst, jpeg_component_info *compptr)
+{
+  if (dst->coef_arrays != NULL)
+    return 0;
+  return dst->iMCU_row * (JDIMENSION)compptr->v_samp_factor;
+}
+
+
+LOCAL(JDIMENSION)
+dst_end_row(transform_dest *dst, int ci, jpeg_component_info *compptr)
+{
+  if (dst->coef_arrays != NULL)
+    return compptr->height_in_blocks;
+  if (ci != dst->ci)
+    return 0;                   /* skip this component */
+  return MIN((dst->iMCU_row + 1) * (JDIMENSION)compptr->v_samp_factor,
+             compptr->height_in_blocks);
+}
+
+
+LOCAL(JBLOCKARRAY)
+access_dst_rows(j_decompress_ptr srcinfo, transform_dest *dst, int ci,
+                JDIMENSION start_row, JDIMENSION num_rows)
+{
+  if (dst->coef_arrays == NULL)
+    return dst->row_buffer;
+  return (*srcinfo->mem->access_virt_barray)
+    ((j_common_ptr)srcinfo, dst->coef_arrays[ci], start_row, num_rows, TRUE);
+}
+
+
 LOCAL(void)
 do_crop(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
         JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
         jvirt_barray_ptr *src_coef_arrays,
-        jvirt_barray_ptr *dst_coef_arrays)
+        transform_dest *dst)
 /* Crop.  This is only used when no rotate/flip is requested with the crop. */
 {
   JDIMENSION dst_blk_y, x_crop_blocks, y_crop_blocks;
@@ -290,11 +341,11 @@ do_crop(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     compptr = dstinfo->comp_info + ci;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       src_buffer = (*srcinfo->mem->access_virt_barray)
         ((j_common_ptr)srcinfo, src_coef_arrays[ci], dst_blk_y + y_crop_blocks,
          (JDIMENSION)compptr->v_samp_factor, FALSE);
@@ -787,7 +838,7 @@ LOCAL(void)
 do_flip_h(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
           JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
           jvirt_barray_ptr *src_coef_arrays,
-          jvirt_barray_ptr *dst_coef_arrays)
+          transform_dest *dst)
 /* Horizontal flip in general cropping case */
 {
   JDIMENSION MCU_cols, comp_width, dst_blk_x, dst_blk_y;
@@ -810,11 +861,11 @@ do_flip_h(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     comp_width = MCU_cols * compptr->h_samp_factor;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       src_buffer = (*srcinfo->mem->access_virt_barray)
         ((j_common_ptr)srcinfo, src_coef_arrays[ci], dst_blk_y + y_crop_blocks,
          (JDIMENSION)compptr->v_samp_factor, FALSE);
@@ -849,7 +900,7 @@ LOCAL(void)
 do_flip_v(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
           JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
           jvirt_barray_ptr *src_coef_arrays,
-          jvirt_barray_ptr *dst_coef_arrays)
+          transform_dest *dst)
 /* Vertical flip */
 {
   JDIMENSION MCU_rows, comp_height, dst_blk_x, dst_blk_y;
@@ -875,11 +926,11 @@ do_flip_v(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     comp_height = MCU_rows * compptr->v_samp_factor;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       if (y_crop_blocks + dst_blk_y < comp_height) {
         /* Row is within the mirrorable area. */
         src_buffer = (*srcinfo->mem->access_virt_barray)
@@ -928,7 +979,7 @@ LOCAL(void)
 do_transpose(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
              JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
              jvirt_barray_ptr *src_coef_arrays,
-             jvirt_barray_ptr *dst_coef_arrays)
+             transform_dest *dst)
 /* Transpose source into destination */
 {
   JDIMENSION dst_blk_x, dst_blk_y, x_crop_blocks, y_crop_blocks;
@@ -946,11 +997,11 @@ do_transpose(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     compptr = dstinfo->comp_info + ci;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
         for (dst_blk_x = 0; dst_blk_x < compptr->width_in_blocks;
              dst_blk_x += compptr->h_samp_factor) {
@@ -977,7 +1028,7 @@ LOCAL(void)
 do_rot_90(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
           JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
           jvirt_barray_ptr *src_coef_arrays,
-          jvirt_barray_ptr *dst_coef_arrays)
+          transform_dest *dst)
 /* 90 degree rotation is equivalent to
  *   1. Transposing the image;
  *   2. Horizontal mirroring.
@@ -1003,11 +1054,11 @@ do_rot_90(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     comp_width = MCU_cols * compptr->h_samp_factor;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
         for (dst_blk_x = 0; dst_blk_x < compptr->width_in_blocks;
              dst_blk_x += compptr->h_samp_factor) {
@@ -1058,7 +1109,7 @@ LOCAL(void)
 do_rot_270(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
            JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
            jvirt_barray_ptr *src_coef_arrays,
-           jvirt_barray_ptr *dst_coef_arrays)
+           transform_dest *dst)
 /* 270 degree rotation is equivalent to
  *   1. Horizontal mirroring;
  *   2. Transposing the image.
@@ -1084,11 +1135,11 @@ do_rot_270(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     comp_height = MCU_rows * compptr->v_samp_factor;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
         for (dst_blk_x = 0; dst_blk_x < compptr->width_in_blocks;
              dst_blk_x += compptr->h_samp_factor) {
@@ -1129,7 +1180,7 @@ LOCAL(void)
 do_rot_180(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
            JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
            jvirt_barray_ptr *src_coef_arrays,
-           jvirt_barray_ptr *dst_coef_arrays)
+           transform_dest *dst)
 /* 180 degree rotation is equivalent to
  *   1. Vertical mirroring;
  *   2. Horizontal mirroring.
@@ -1155,11 +1206,11 @@ do_rot_180(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     comp_height = MCU_rows * compptr->v_samp_factor;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       if (y_crop_blocks + dst_blk_y < comp_height) {
         /* Row is within the vertically mirrorable area. */
         src_buffer = (*srcinfo->mem->access_virt_barray)
@@ -1240,7 +1291,7 @@ LOCAL(void)
 do_transverse(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
               JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
               jvirt_barray_ptr *src_coef_arrays,
-              jvirt_barray_ptr *dst_coef_arrays)
+              transform_dest *dst)
 /* Transverse transpose is equivalent to
  *   1. 180 degree rotation;
  *   2. Transposition;
@@ -1269,11 +1320,11 @@ do_transverse(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
     comp_height = MCU_rows * compptr->v_samp_factor;
     x_crop_blocks = x_crop_offset * compptr->h_samp_factor;
     y_crop_blocks = y_crop_offset * compptr->v_samp_factor;
-    for (dst_blk_y = 0; dst_blk_y < compptr->height_in_blocks;
+    for (dst_blk_y = dst_start_row(dst, compptr);
+         dst_blk_y < dst_end_row(dst, ci, compptr);
          dst_blk_y += compptr->v_samp_factor) {
-      dst_buffer = (*srcinfo->mem->access_virt_barray)
-        ((j_common_ptr)srcinfo, dst_coef_arrays[ci], dst_blk_y,
-         (JDIMENSION)compptr->v_samp_factor, TRUE);
+      dst_buffer = access_dst_rows(srcinfo, dst, ci, dst_blk_y,
+                                   (JDIMENSION)compptr->v_samp_factor);
       for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
         for (dst_blk_x = 0; dst_blk_x < compptr->width_in_blocks;
              dst_blk_x += compptr->h_samp_factor) {
@@ -1782,6 +1833,18 @@ jtransform_request_workspace(j_decompress_ptr srcinfo,
     break;
   }
 
+  /* In streaming mode, the destination rows are generated on demand, so no
+   * workspace is needed.  Crop extension is not supported in this mode.
+   */
+  info->stream_rows = FALSE;
+  if (need_workspace && info->streaming &&
+      (info->transform != JXFORM_NONE ||
+       (info->output_width <= srcinfo->output_width &&
+        info->output_height <= srcinfo->output_height))) {
+    need_workspace = FALSE;
+    info->stream_rows = TRUE;
+  }
+
   /* Allocate workspace if needed.
    * Note that we allocate arrays padded out to the next iMCU boundary,
    * so that transform routines need not worry about missing edge blocks.
@@ -2143,12 +2206,272 @@ jtransform_adjust_parameters(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 }
 
 
+LOCAL(void)
+transform_rows(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+               jvirt_barray_ptr *src_coef_arrays, jpeg_transform_info *info,
+               transform_dest *dst)
+/* Run one of the transforms that generate a separate destination image */
+{
+  switch (info->transform) {
+  case JXFORM_NONE:
+    do_crop(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+            src_coef_arrays, dst);
+    break;
+  case JXFORM_FLIP_H:
+    do_flip_h(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+              src_coef_arrays, dst);
+    break;
+  case JXFORM_FLIP_V:
+    do_flip_v(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+              src_coef_arrays, dst);
+    break;
+  case JXFORM_TRANSPOSE:
+    do_transpose(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+                 src_coef_arrays, dst);
+    break;
+  case JXFORM_TRANSVERSE:
+    do_transverse(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+                  src_coef_arrays, dst);
+    break;
+  case JXFORM_ROT_90:
+    do_rot_90(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+              src_coef_arrays, dst);
+    break;
+  case JXFORM_ROT_180:
+    do_rot_180(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+               src_coef_arrays, dst);
+    break;
+  case JXFORM_ROT_270:
+    do_rot_270(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
+               src_coef_arrays, dst);
+    break;
+  default:
+    break;
+  }
+}
+
+
+/*
+ * Streaming coefficient controller.  This is similar to the one in
+ * jctrans.c, but rather than reading the destination image from a set of
+ * presupplied virtual arrays, it generates each iMCU row of each component
+ * from the source arrays just before the row is encoded.  Thus, the
+ * destination image never exists in memory all at once.
+ *
+ * Each row may be generated more than once (once per scan and once per
+ * Huffman optimization pass), but that is much cheaper than the entropy
+ * coding itself.
+ */
+
+typedef struct {
+  struct jpeg_c_coef_controller pub; /* public fields */
+
+  JDIMENSION iMCU_row_num;      /* iMCU row # within image */
+  JDIMENSION mcu_ctr;           /* counts MCUs processed in current row */
+  int MCU_vert_offset;          /* counts MCU rows within iMCU row */
+  int MCU_rows_per_iMCU_row;    /* number of such rows needed */
+
+  /* Source of the transform */
+  j_decompress_ptr srcinfo;
+  jvirt_barray_ptr *src_coef_arrays;
+  jpeg_transform_info *info;
+
+  /* One iMCU row of each destination component, and the iMCU row # (plus
+   * one, so that 0 means "none") that it currently holds.
+   */
+  JBLOCKARRAY row_buffer[MAX_COMPONENTS];
+  JDIMENSION buffered_row[MAX_COMPONENTS];
+
+  /* Workspace for constructing dummy blocks at right/bottom edges. */
+  JBLOCKROW dummy_buffer[C_MAX_BLOCKS_IN_MCU];
+} stream_coef_controller;
+
+typedef stream_coef_controller *stream_coef_ptr;
+
+
+LOCAL(void)
+stream_start_iMCU_row(j_compress_ptr cinfo)
+/* Reset within-iMCU-row counters for a new row */
+{
+  stream_coef_ptr coef = (stream_coef_ptr)cinfo->coef;
+
+  /* In an interleaved scan, an MCU row is the same as an iMCU row.
+   * In a noninterleaved scan, an iMCU row has v_samp_factor MCU rows.
+   * But at the bottom of the image, process only what's left.
+   */
+  if (cinfo->comps_in_scan > 1) {
+    coef->MCU_rows_per_iMCU_row = 1;
+  } else {
+    if (coef->iMCU_row_num < (cinfo->total_iMCU_rows - 1))
+      coef->MCU_rows_per_iMCU_row = cinfo->cur_comp_info[0]->v_samp_factor;
+    else
+      coef->MCU_rows_per_iMCU_row = cinfo->cur_comp_info[0]->last_row_height;
+  }
+
+  coef->mcu_ctr = 0;
+  coef->MCU_vert_offset = 0;
+}
+
+
+METHODDEF(void)
+stream_start_pass(j_compress_ptr cinfo, J_BUF_MODE pass_mode)
+{
+  stream_coef_ptr coef = (stream_coef_ptr)cinfo->coef;
+
+  if (pass_mode != JBUF_CRANK_DEST)
+    ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
+
+  coef->iMCU_row_num = 0;
+  stream_start_iMCU_row(cinfo);
+}
+
+
+/*
+ * Generate and encode one iMCU row.  Returns TRUE if the iMCU row is
+ * completed, FALSE if suspended.
+ */
+
+METHODDEF(boolean)
+stream_compress_output(j_compress_ptr cinfo, JSAMPIMAGE input_buf)
+{
+  stream_coef_ptr coef = (stream_coef_ptr)cinfo->coef;
+  JDIMENSION MCU_col_num;       /* index of current MCU within row */
+  JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
+  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
+  int blkn, ci, xindex, yindex, yoffset, blockcnt;
+  JDIMENSION start_col;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  JBLOCKROW MCU_buffer[C_MAX_BLOCKS_IN_MCU];
+  JBLOCKROW buffer_ptr;
+  jpeg_component_info *compptr;
+  transform_dest dst;
+
+  /* Generate the current iMCU row of the components used in this scan, if
+   * it isn't already buffered.
+   */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (coef->buffered_row[compptr->component_index] !=
+        coef->iMCU_row_num + 1) {
+      dst.coef_arrays = NULL;
+      dst.ci = compptr->component_index;
+      dst.iMCU_row = coef->iMCU_row_num;
+      dst.row_buffer = coef->row_buffer[compptr->component_index];
+      transform_rows(coef->srcinfo, cinfo, coef->src_coef_arrays, coef->info,
+                     &dst);
+      coef->buffered_row[compptr->component_index] = coef->iMCU_row_num + 1;
+    }
+    buffer[ci] = coef->row_buffer[compptr->component_index];
+  }
+
+  /* Loop to process one whole iMCU row */
+  for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
+       yoffset++) {
+    for (MCU_col_num = coef->mcu_ctr; MCU_col_num < cinfo->MCUs_per_row;
+         MCU_col_num++) {
+      /* Construct list of pointers to DCT blocks belonging to this MCU */
+      blkn = 0;                 /* index of current DCT block within MCU */
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        compptr = cinfo->cur_comp_info[ci];
+        start_col = MCU_col_num * compptr->MCU_width;
+        blockcnt = (MCU_col_num < last_MCU_col) ? compptr->MCU_width :
+                                                  compptr->last_col_width;
+        for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+          if (coef->iMCU_row_num < last_iMCU_row ||
+              yindex + yoffset < compptr->last_row_height) {
+            /* Fill in pointers to real blocks in this row */
+            buffer_ptr = buffer[ci][yindex + yoffset] + start_col;
+            for (xindex = 0; xindex < blockcnt; xindex++)
+              MCU_buffer[blkn++] = buffer_ptr++;
+          } else {
+            /* At bottom of image, need a whole row of dummy blocks */
+            xindex = 0;
+          }
+          /* Fill in any dummy blocks needed in this row (see jctrans.c) */
+          for (; xindex < compptr->MCU_width; xindex++) {
+            MCU_buffer[blkn] = coef->dummy_buffer[blkn];
+            MCU_buffer[blkn][0][0] = MCU_buffer[blkn - 1][0][0];
+            blkn++;
+          }
+        }
+      }
+      /* Try to write the MCU. */
+      if (!(*cinfo->entropy->encode_mcu) (cinfo, MCU_buffer)) {
+        /* Suspension forced; update state counters and exit */
+        coef->MCU_vert_offset = yoffset;
+        coef->mcu_ctr = MCU_col_num;
+        return FALSE;
+      }
+    }
+    /* Completed an MCU row, but perhaps not an iMCU row */
+    coef->mcu_ctr = 0;
+  }
+  /* Completed the iMCU row, advance counters for next one */
+  coef->iMCU_row_num++;
+  stream_start_iMCU_row(cinfo);
+  return TRUE;
+}
+
+
+/*
+ * Replace the coefficient controller installed by jpeg_write_coefficients()
+ * with the streaming one.
+ */
+
+LOCAL(void)
+stream_coef_controller_init(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+                            jvirt_barray_ptr *src_coef_arrays,
+                            jpeg_transform_info *info)
+{
+  stream_coef_ptr coef;
+  JBLOCKROW buffer;
+  jpeg_component_info *compptr;
+  int ci, i;
+
+  coef = (stream_coef_ptr)
+    (*dstinfo->mem->alloc_small) ((j_common_ptr)dstinfo, JPOOL_IMAGE,
+                                  sizeof(stream_coef_controller));
+  dstinfo->coef = (struct jpeg_c_coef_controller *)coef;
+  coef->pub.start_pass = stream_start_pass;
+  coef->pub.compress_data = stream_compress_output;
+
+  coef->srcinfo = srcinfo;
+  coef->src_coef_arrays = src_coef_arrays;
+  coef->info = info;
+
+  /* The transform routines may write up to the next iMCU boundary, so the
+   * row buffers are padded accordingly.
+   */
+  for (ci = 0, compptr = dstinfo->comp_info; ci < dstinfo->num_components;
+       ci++, compptr++) {
+    coef->row_buffer[ci] = (*dstinfo->mem->alloc_barray)
+      ((j_common_ptr)dstinfo, JPOOL_IMAGE,
+       (JDIMENSION)jround_up((long)compptr->width_in_blocks,
+                             (long)compptr->h_samp_factor),
+       (JDIMENSION)compptr->v_samp_factor);
+    coef->buffered_row[ci] = 0;
+  }
+
+  /* Allocate and pre-zero space for dummy DCT blocks. */
+  buffer = (JBLOCKROW)
+    (*dstinfo->mem->alloc_large) ((j_common_ptr)dstinfo, JPOOL_IMAGE,
+                                  C_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+  jzero_far((void *)buffer, C_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+  for (i = 0; i < C_MAX_BLOCKS_IN_MCU; i++) {
+    coef->dummy_buffer[i] = buffer + i;
+  }
+}
+
+
 /* Execute the actual transformation, if any.
  *
  * This must be called *after* jpeg_write_coefficients, because it depends
  * on jpeg_write_coefficients to have computed subsidiary values such as
  * the per-component width and height fields in the destination object.
  *
+ * In streaming mode, this merely sets up the destination object so that the
+ * transformation is performed during jpeg_finish_compress().
+ *
  * Note that some transformations will modify the source data arrays!
  */
 
@@ -2158,6 +2481,13 @@ jtransform_execute_transform(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
                              jpeg_transform_info *info)
 {
   jvirt_barray_ptr *dst_coef_arrays = info->workspace_coef_arrays;
+  transform_dest dst;
+
+  if (info->stream_rows) {
+    stream_coef_controller_init(srcinfo, dstinfo, src_coef_arrays, info);
+    return;
+  }
+  dst.coef_arrays = dst_coef_arrays;
 
   /* Note: conditions tested here should match those in switch statement
    * in jtransform_request_workspace()
@@ -2181,40 +2511,22 @@ jtransform_execute_transform(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
                          info->x_crop_offset, info->y_crop_offset,
                          src_coef_arrays, dst_coef_arrays);
     } else if (info->x_crop_offset != 0 || info->y_crop_offset != 0)
-      do_crop(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-              src_coef_arrays, dst_coef_arrays);
+      transform_rows(srcinfo, dstinfo, src_coef_arrays, info, &dst);
     break;
   case JXFORM_FLIP_H:
     if (info->y_crop_offset != 0 || info->slow_hflip)
-      do_flip_h(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-                src_coef_arrays, dst_coef_arrays);
+      transform_rows(srcinfo, dstinfo, src_coef_arrays, info, &dst);
     else
       do_flip_h_no_crop(srcinfo, dstinfo, info->x_crop_offset,
                         src_coef_arrays);
     break;
   case JXFORM_FLIP_V:
-    do_flip_v(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-              src_coef_arrays, dst_coef_arrays);
-    break;
   case JXFORM_TRANSPOSE:
-    do_transpose(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-                 src_coef_arrays, dst_coef_arrays);
-    break;
   case JXFORM_TRANSVERSE:
-    do_transverse(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-                  src_coef_arrays, dst_coef_arrays);
-    break;
   case JXFORM_ROT_90:
-    do_rot_90(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-              src_coef_arrays, dst_coef_arrays);
-    break;
   case JXFORM_ROT_180:
-    do_rot_180(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-               src_coef_arrays, dst_coef_arrays);
-    break;
   case JXFORM_ROT_270:
-    do_rot_270(srcinfo, dstinfo, info->x_crop_offset, info->y_crop_offset,
-               src_coef_arrays, dst_coef_arrays);
+    transform_rows(srcinfo, dstinfo, src_coef_arrays, info, &dst);
     break;
   case JXFORM_WIPE:
     if (info->crop_width_set == JCROP_REFLECT &&
@@ -2243,6 +2555,87 @@ jtransform_execute_transform(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
   }
 }
 
+/* Requantize the image to the destination's quantization tables.
+ *
+ * This must be called after jtransform_adjust_parameters() and after the
+ * caller has installed new quantization tables in the destination object
+ * (for instance, with jpeg_set_quality()), but before
+ * jtransform_execute_transform().  Since the tables describe the destination
+ * image, they are transposed as necessary to match the source coefficients,
+ * and any destination quantizer that is finer than the corresponding source
+ * quantizer is raised to match it (there is no point in spending bits on
+ * precision that the source does not have.)  The source coefficients are
+ * requantized in place.  This is not supported with JXFORM_DROP.
+ */
+
+GLOBAL(void)
+jtransform_requantize(j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+                      jvirt_barray_ptr *src_coef_arrays,
+                      jpeg_transform_info *info)
+{
+  jpeg_component_info *compptr;
+  JQUANT_TBL *qtblptr, qtbl;
+  boolean transpose_it = FALSE;
+  int ci, i, j, tblno;
+  UINT16 qval;
+
+  switch (info->transform) {
+  case JXFORM_TRANSPOSE:
+  case JXFORM_TRANSVERSE:
+  case JXFORM_ROT_90:
+  case JXFORM_ROT_270:
+    transpose_it = TRUE;
+    break;
+  case JXFORM_DROP:
+    ERREXIT(srcinfo, JERR_CONVERSION_NOTIMPL);
+    break;
+  default:
+    break;
+  }
+
+  /* First, ensure that the destination quantizers are no finer than the
+   * source quantizers.
+   */
+  for (ci = 0; ci < dstinfo->num_components; ci++) {
+    compptr = srcinfo->comp_info + ci;
+    tblno = dstinfo->comp_info[ci].quant_tbl_no;
+    qtblptr = dstinfo->quant_tbl_ptrs[tblno];
+    if (qtblptr == NULL || compptr->quant_table == NULL)
+      ERREXIT1(dstinfo, JERR_NO_QUANT_TABLE, tblno);
+    for (i = 0; i < DCTSIZE; i++) {
+      for (j = 0; j < DCTSIZE; j++) {
+        if (transpose_it)
+          qval = compptr->quant_table->quantval[j * DCTSIZE + i];
+        else
+          qval = compptr->quant_table->quantval[i * DCTSIZE + j];
+        if (qtblptr->quantval[i * DCTSIZE + j] < qval)
+          qtblptr->quantval[i * DCTSIZE + j] = qval;
+      }
+    }
+  }
+
+  /* Then requantize each component in the source's orientation.  The
+   * source object's copy of the quantization table is updated as well, so
+   * that it continues to describe the source coefficients.
+   */
+  for (ci = 0; ci < dstinfo->num_components; ci++) {
+    compptr = srcinfo->comp_info + ci;
+    qtblptr = dstinfo->quant_tbl_ptrs[dstinfo->comp_info[ci].quant_tbl_no];
+    for (i = 0; i < DCTSIZE; i++) {
+      for (j = 0; j < DCTSIZE; j++) {
+        if (transpose_it)
+          qtbl.quantval[i * DCTSIZE + j] = qtblptr->quantval[j * DCTSIZE + i];
+        else
+          qtbl.quantval[i * DCTSIZE + j] = qtblptr->quantval[i * DCTSIZE + j];
+      }
+    }
+    requant_comp(srcinfo, compptr, src_coef_arrays[ci], &qtbl);
+    MEMCOPY(compptr->quant_table->quantval, qtbl.quantval,
+            sizeof(qtbl.quantval));
+  }
+}
+
+
 /* jtransform_perfect_transform
  *
  * Determine whether lossless transformation is perfectly
@@ -142,6 +142,15 @@ typedef struct {
                           coefficients in tact (necessary if other transformed
                           images must be generated from the same set of
                           coefficients. */
+  boolean streaming;   /* If TRUE, then transforms that would otherwise
+                          require a full-size workspace will instead generate
+                          each iMCU row of the destination image as it is
+                          compressed.  This halves the memory usage, and it
+                          leaves the source coefficients in tact, but it
+                          requires that jtransform_execute_transform() be
+                          followed by jpeg_finish_compress() while the source
+                          object, its coefficient arrays, and this struct
+                          remain valid. */
 
   /* Crop parameters: application need not set these unless crop is TRUE.
    * These can be filled in by jtransform_parse_crop_spec().
@@ -162,6 +171,7 @@ typedef struct {
   /* Internal workspace: caller should not touch these */
   int num_components;           /* # of components in workspace */
   jvirt_barray_ptr *workspace_coef_arrays; /* workspace for transformations */
+  boolean stream_rows;          /* TRUE if generating rows on demand */
   JDIMENSION output_width;      /* cropped destination dimensions */
   JDIMENSION output_height;
   JDIMENSION x_crop_offset;     /* destination crop offsets measured in iMCUs */
@@ -190,6 +200,11 @@ EXTERN(void) jtransform_execute_transform(j_decompress_ptr srcinfo,
                                           j_compress_ptr dstinfo,
                                           jvirt_barray_ptr *src_coef_arrays,
                                           jpeg_transform_info *info);
+/* Requantize the source coefficients to the destination's quantization */
+EXTERN(void) jtransform_requantize(j_decompress_ptr srcinfo,
+                                   j_compress_ptr dstinfo,
+                                   jvirt_barray_ptr *src_coef_arrays,
+                                   jpeg_transform_info *info);
 /* Determine whether lossless transformation is perfectly
  * possible for a specified image and transformation.
  */
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include <jinclude.h>
 #define JPEG_INTERNALS
 #include <jerror.h>
@@ -43,15 +44,39 @@
 #include "./jpegcomp.h"
 #include "./cdjpeg.h"
 #include "jconfigint.h"
+#include "./tjresize.h"
+#ifdef WITH_THREADS
+#include "./tjthread.h"
+#endif
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 extern void jpeg_mem_dest_tj(j_compress_ptr, unsigned char **, unsigned long *,
                              boolean);
 extern void jpeg_mem_src_tj(j_decompress_ptr, const unsigned char *,
                             unsigned long);
+extern void jpeg_callback_dest_tj(j_compress_ptr,
+                                  int (*) (const unsigned char *,
+                                           unsigned long, void *),
+                                  void *, unsigned char *, unsigned long);
+extern void jpeg_buffers_dest_tj(j_compress_ptr, unsigned char **,
+                                 const unsigned long *, int,
+                                 unsigned long *);
 
 #define PAD(v, p)  ((v + (p) - 1) & (~((p) - 1)))
 #define IS_POW2(x)  (((x) & (x - 1)) == 0)
 
+/* Each instance retains up to this much of the libjpeg per-image working
+   memory between calls, so that a sequence of similar images does not
+   repeatedly allocate and free the same buffers. */
+#define MAX_RETAINED_MEMORY  (64L * 1024L * 1024L)
+
+/* Size of the chunks passed to the callback function specified in
+   tjSetWriteCallback(), if the caller does not specify a size */
+#define DEFAULT_CHUNK_SIZE  65536
+
 
 /* Error handling (based on example in example.txt) */
 
@@ -102,6 +127,44 @@ static void my_emit_message(j_common_ptr cinfo, int msg_level)
 
 enum { COMPRESS = 1, DECOMPRESS = 2 };
 
+/* Quantization and Huffman tables loaded using tjDecompressTables() */
+typedef struct {
+  JQUANT_TBL quantTbls[NUM_QUANT_TBLS];
+  JHUFF_TBL dcHuffTbls[NUM_HUFF_TBLS], acHuffTbls[NUM_HUFF_TBLS];
+  boolean haveQuantTbl[NUM_QUANT_TBLS];
+  boolean haveDCHuffTbl[NUM_HUFF_TBLS], haveACHuffTbl[NUM_HUFF_TBLS];
+} tjtables;
+
+/* State of a JPEG image that is being decompressed incrementally using the
+   tjDecompressStream*() functions.  The image is read using a separate
+   decompression object with a suspending source manager, so a stream in
+   progress does not interfere with the other decompression functions. */
+enum { STREAM_NONE, STREAM_HEADER, STREAM_READY, STREAM_START, STREAM_ROWS,
+       STREAM_DONE };
+
+typedef struct {
+  struct jpeg_source_mgr pub;
+  struct jpeg_decompress_struct dinfo;
+  /* Data that has been pushed but not yet consumed */
+  unsigned char *buf;
+  size_t bufSize, skipBytes;
+  boolean endOfStream;
+  int state, pixelFormat, width, height, rows;
+  JSAMPROW *rowPointers;
+} tjdecompstream;
+
+/* State of a JPEG image that is being compressed incrementally using the
+   tjCompressStream*() functions.  The image is written using a separate
+   compression object, so a stream in progress does not interfere with the
+   other compression functions. */
+typedef struct {
+  struct jpeg_compress_struct cinfo;
+  boolean active;
+  int pixelFormat, flags;
+  JSAMPROW *rowPointers;
+  int numRowPointers;
+} tjcompstream;
+
 typedef struct _tjinstance {
   struct jpeg_compress_struct cinfo;
   struct jpeg_decompress_struct dinfo;
@@ -109,6 +172,22 @@ typedef struct _tjinstance {
   int init, headerRead;
   char errStr[JMSG_LENGTH_MAX];
   boolean isInstanceError;
+  int numThreads;
+  /* Instances used by worker threads (created on demand and reused across
+     calls) */
+  struct _tjinstance **workers;
+  int numWorkers;
+  tjtables *tables;
+  tjcompstream *cstream;
+  tjdecompstream *dstream;
+  /* Destination set with tjSetWriteCallback() or tjSetDestBuffers() */
+  tjwritecallback writeCallback;
+  void *writeCallbackData;
+  unsigned char *chunkBuf;
+  unsigned long chunkSize, *writeSize;
+  unsigned char **destBufs;
+  unsigned long *destSizes;
+  int numDestBufs;
 } tjinstance;
 
 static const int pixelsize[TJ_NUMSAMP] = { 3, 3, 3, 1, 3, 3 };
@@ -190,6 +269,18 @@ static int cs2pf[JPEG_NUMCS] = {
   this->jerr.warning = FALSE; \
   this->isInstanceError = FALSE;
 
+/* Validate the handle of a function that does not use the libjpeg
+   compressor or decompressor object directly */
+#define GET_TJINSTANCE(handle) \
+  tjinstance *this = (tjinstance *)handle; \
+  \
+  if (!this) { \
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle"); \
+    return -1; \
+  } \
+  this->jerr.warning = FALSE; \
+  this->isInstanceError = FALSE;
+
 #define GET_CINSTANCE(handle) \
   tjinstance *this = (tjinstance *)handle; \
   j_compress_ptr cinfo = NULL; \
@@ -299,6 +390,8 @@ static void setCompDefaults(struct jpeg_compress_struct *cinfo,
   cinfo->comp_info[2].v_samp_factor = 1;
   if (cinfo->num_components > 3)
     cinfo->comp_info[3].v_samp_factor = tjMCUHeight[subsamp] / 8;
+
+  if (flags & TJFLAG_ABBREVIATED) jpeg_suppress_tables(cinfo, TRUE);
 }
 
 
@@ -418,11 +511,135 @@ DLLEXPORT int tjDestroy(tjhandle handle)
   if (setjmp(this->jerr.setjmp_buffer)) return -1;
   if (this->init & COMPRESS) jpeg_destroy_compress(cinfo);
   if (this->init & DECOMPRESS) jpeg_destroy_decompress(dinfo);
+  if (this->workers) {
+    int i;
+
+    for (i = 0; i < this->numWorkers; i++)
+      if (this->workers[i]) tjDestroy((tjhandle)this->workers[i]);
+    free(this->workers);
+  }
+  free(this->tables);
+  if (this->cstream) {
+    jpeg_destroy_compress(&this->cstream->cinfo);
+    free(this->cstream->rowPointers);
+    free(this->cstream);
+  }
+  if (this->dstream) {
+    jpeg_destroy_decompress(&this->dstream->dinfo);
+    free(this->dstream->buf);
+    free(this->dstream->rowPointers);
+    free(this->dstream);
+  }
+  free(this->chunkBuf);
+  free(this->destBufs);
+  free(this->destSizes);
   free(this);
   return 0;
 }
 
 
+DLLEXPORT int tjSetNumThreads(tjhandle handle, int numThreads)
+{
+  tjinstance *this = (tjinstance *)handle;
+  int retval = 0;
+
+  if (!this) {
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle");
+    return -1;
+  }
+  this->isInstanceError = FALSE;
+
+  if (numThreads < 0)
+    THROW("tjSetNumThreads(): Invalid argument");
+
+#ifdef WITH_THREADS
+  if (numThreads == 0) numThreads = tjGetNumCPUs();
+#else
+  numThreads = 1;
+#endif
+  this->numThreads = numThreads;
+
+bailout:
+  return retval;
+}
+
+
+DLLEXPORT int tjSetWriteCallback(tjhandle handle, tjwritecallback callback,
+                                 void *callbackData, unsigned long chunkSize)
+{
+  tjinstance *this = (tjinstance *)handle;
+  int retval = 0;
+
+  if (!this) {
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle");
+    return -1;
+  }
+  this->isInstanceError = FALSE;
+
+  if (chunkSize == 0) chunkSize = DEFAULT_CHUNK_SIZE;
+  if (callback && chunkSize != this->chunkSize) {
+    free(this->chunkBuf);
+    this->chunkSize = 0;
+    if ((this->chunkBuf = (unsigned char *)malloc(chunkSize)) == NULL)
+      THROW("tjSetWriteCallback(): Memory allocation failure");
+    this->chunkSize = chunkSize;
+  }
+  this->writeCallback = callback;
+  this->writeCallbackData = callbackData;
+  if (callback) tjSetDestBuffers(handle, NULL, 0);
+
+bailout:
+  if (retval < 0) this->writeCallback = NULL;
+  return retval;
+}
+
+
+DLLEXPORT int tjSetDestBuffers(tjhandle handle, const tjbuffer *buffers,
+                               int numBuffers)
+{
+  tjinstance *this = (tjinstance *)handle;
+  int i, retval = 0;
+
+  if (!this) {
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle");
+    return -1;
+  }
+  this->isInstanceError = FALSE;
+
+  free(this->destBufs);  this->destBufs = NULL;
+  free(this->destSizes);  this->destSizes = NULL;
+  this->numDestBufs = 0;
+  if (buffers == NULL && numBuffers == 0) return 0;
+
+  if (buffers == NULL || numBuffers < 0)
+    THROW("tjSetDestBuffers(): Invalid argument");
+  for (i = 0; i < numBuffers; i++) {
+    if (buffers[i].buf == NULL && buffers[i].size > 0)
+      THROW("tjSetDestBuffers(): Invalid argument");
+  }
+
+  if ((this->destBufs =
+       (unsigned char **)malloc(sizeof(unsigned char *) * numBuffers)) ==
+      NULL ||
+      (this->destSizes =
+       (unsigned long *)malloc(sizeof(unsigned long) * numBuffers)) == NULL)
+    THROW("tjSetDestBuffers(): Memory allocation failure");
+  for (i = 0; i < numBuffers; i++) {
+    this->destBufs[i] = buffers[i].buf;
+    this->destSizes[i] = buffers[i].size;
+  }
+  this->numDestBufs = numBuffers;
+  this->writeCallback = NULL;
+
+bailout:
+  if (retval < 0) {
+    free(this->destBufs);  this->destBufs = NULL;
+    free(this->destSizes);  this->destSizes = NULL;
+  }
+  return retval;
+}
+
+
 /* These are exposed mainly because Windows can't malloc() and free() across
    DLL boundaries except when the CRT DLL is used, and we don't use the CRT DLL
    with turbojpeg.dll for compatibility reasons.  However, these functions
@@ -465,6 +682,7 @@ static tjhandle _tjInitCompress(tjinstance *this)
   }
 
   jpeg_create_compress(&this->cinfo);
+  this->cinfo.mem->max_memory_to_retain = MAX_RETAINED_MEMORY;
   /* Make an initial call so it will create the destination manager */
   jpeg_mem_dest_tj(&this->cinfo, &buf, &size, 0);
 
@@ -631,6 +849,55 @@ bailout:
 }
 
 
+/* Pass each chunk of JPEG data to the callback function specified in
+   tjSetWriteCallback(), and keep a running total of the JPEG image size. */
+
+static int writeCallbackTJ(const unsigned char *buf, unsigned long size,
+                           void *callbackData)
+{
+  tjinstance *this = (tjinstance *)callbackData;
+
+  *this->writeSize += size;
+  return this->writeCallback(buf, size, this->writeCallbackData);
+}
+
+
+/* Set up the destination for the JPEG image produced by the "one-shot"
+   compression functions.  If tjSetWriteCallback() or tjSetDestBuffers() has
+   been called, then the JPEG image is written to the specified callback
+   function or buffers rather than to *jpegBuf, and *jpegSize receives the
+   total size of the image. */
+
+static void setDestination(tjinstance *this, unsigned char **jpegBuf,
+                           unsigned long *jpegSize, boolean alloc)
+{
+  j_compress_ptr cinfo = &this->cinfo;
+
+  if (this->writeCallback) {
+    *jpegSize = 0;
+    this->writeSize = jpegSize;
+    jpeg_callback_dest_tj(cinfo, writeCallbackTJ, this, this->chunkBuf,
+                          this->chunkSize);
+  } else if (this->numDestBufs > 0)
+    jpeg_buffers_dest_tj(cinfo, this->destBufs, this->destSizes,
+                         this->numDestBufs, jpegSize);
+  else
+    jpeg_mem_dest_tj(cinfo, jpegBuf, jpegSize, alloc);
+}
+
+#define HAS_DESTINATION(this)  ((this)->writeCallback || (this)->numDestBufs)
+
+
+#ifdef WITH_THREADS
+static int compressParallel(tjinstance *this, JSAMPROW *row_pointer,
+                            int width, int height, int pixelFormat,
+                            int jpegSubsamp, int jpegQual, int flags);
+static int compressScansParallel(tjinstance *this, JSAMPROW *row_pointer,
+                                 int width, int height, int pixelFormat,
+                                 int jpegSubsamp, int jpegQual, int flags);
+static tjinstance *getWorker(tjinstance *this, int index, int init);
+#endif
+
 DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
                           int width, int pitch, int height, int pixelFormat,
                           unsigned char **jpegBuf, unsigned long *jpegSize,
@@ -645,9 +912,10 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
     THROW("tjCompress2(): Instance has not been initialized for compression");
 
   if (srcBuf == NULL || width <= 0 || pitch < 0 || height <= 0 ||
-      pixelFormat < 0 || pixelFormat >= TJ_NUMPF || jpegBuf == NULL ||
-      jpegSize == NULL || jpegSubsamp < 0 || jpegSubsamp >= NUMSUBOPT ||
-      jpegQual < 0 || jpegQual > 100)
+      pixelFormat < 0 || pixelFormat >= TJ_NUMPF ||
+      (jpegBuf == NULL && !HAS_DESTINATION(this)) || jpegSize == NULL ||
+      jpegSubsamp < 0 || jpegSubsamp >= NUMSUBOPT || jpegQual < 0 ||
+      jpegQual > 100)
     THROW("tjCompress2(): Invalid argument");
 
   if (pitch == 0) pitch = width * tjPixelSize[pixelFormat];
@@ -672,16 +940,26 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
   if (flags & TJFLAG_NOREALLOC) {
     alloc = 0;  *jpegSize = tjBufSize(width, height, jpegSubsamp);
   }
-  jpeg_mem_dest_tj(cinfo, jpegBuf, jpegSize, alloc);
+  setDestination(this, jpegBuf, jpegSize, alloc);
   setCompDefaults(cinfo, pixelFormat, jpegSubsamp, jpegQual, flags);
 
-  jpeg_start_compress(cinfo, TRUE);
   for (i = 0; i < height; i++) {
     if (flags & TJFLAG_BOTTOMUP)
       row_pointer[i] = (JSAMPROW)&srcBuf[(height - i - 1) * (size_t)pitch];
     else
       row_pointer[i] = (JSAMPROW)&srcBuf[i * (size_t)pitch];
   }
+#ifdef WITH_THREADS
+  if ((i = compressParallel(this, row_pointer, width, height, pixelFormat,
+                            jpegSubsamp, jpegQual, flags)) != 1 ||
+      (i = compressScansParallel(this, row_pointer, width, height,
+                                 pixelFormat, jpegSubsamp, jpegQual,
+                                 flags)) != 1) {
+    retval = i;  goto bailout;
+  }
+#endif
+
+  jpeg_start_compress(cinfo, (flags & TJFLAG_ABBREVIATED) ? FALSE : TRUE);
   while (cinfo->next_scanline < cinfo->image_height) {
     tjProcYuv444ScanLine(&row_pointer[cinfo->next_scanline], width, cinfo->image_height - cinfo->next_scanline);
     jpeg_write_scanlines(cinfo, &row_pointer[cinfo->next_scanline],
@@ -720,6 +998,391 @@ DLLEXPORT int tjCompress(tjhandle handle, unsigned char *srcBuf, int width,
 }
 
 
+/* Batch compression
+
+   tjCompressBatch() sets the compression parameters only once per compressor
+   instance and then compresses all of the images in the batch with that
+   instance, so the per-image overhead is limited to the work that actually
+   depends on the image data.  (The underlying compressor retains the color
+   conversion table, the quantization divisors, and the derived Huffman tables
+   across images.)  If multiple threads have been requested, then the batch is
+   split into slices of consecutive images, and each slice is compressed by a
+   separate instance in a separate thread. */
+
+typedef struct {
+  tjinstance *inst;
+  const unsigned char **srcBufs;
+  unsigned char **jpegBufs;
+  unsigned long *jpegSizes;
+  int numImages, width, pitch, height, pixelFormat, subsamp, jpegQual, flags;
+  int retval;
+  boolean warning;
+  char errStr[JMSG_LENGTH_MAX];
+} tjbatchslice;
+
+
+static void compressSlice(void *arg)
+{
+  tjbatchslice *slice = (tjbatchslice *)arg;
+  tjinstance *this = slice->inst;
+  j_compress_ptr cinfo = &this->cinfo;
+  JSAMPROW *row_pointer = NULL;
+  int i, n, retval = 0;
+
+  this->jerr.warning = FALSE;
+  this->isInstanceError = FALSE;
+  this->jerr.stopOnWarning =
+    (slice->flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+
+  if ((row_pointer =
+       (JSAMPROW *)malloc(sizeof(JSAMPROW) * slice->height)) == NULL)
+    THROW("tjCompressBatch(): Memory allocation failure");
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  cinfo->image_width = slice->width;
+  cinfo->image_height = slice->height;
+  setCompDefaults(cinfo, slice->pixelFormat, slice->subsamp, slice->jpegQual,
+                  slice->flags);
+
+  for (n = 0; n < slice->numImages; n++) {
+    const unsigned char *srcBuf = slice->srcBufs[n];
+    int alloc = 1;
+
+    for (i = 0; i < slice->height; i++) {
+      if (slice->flags & TJFLAG_BOTTOMUP)
+        row_pointer[i] = (JSAMPROW)&srcBuf[(slice->height - i - 1) *
+                                           (size_t)slice->pitch];
+      else
+        row_pointer[i] = (JSAMPROW)&srcBuf[i * (size_t)slice->pitch];
+    }
+    if (slice->flags & TJFLAG_NOREALLOC) {
+      alloc = 0;
+      slice->jpegSizes[n] =
+        tjBufSize(slice->width, slice->height, slice->subsamp);
+    }
+    jpeg_mem_dest_tj(cinfo, &slice->jpegBufs[n], &slice->jpegSizes[n],
+                     alloc);
+
+    jpeg_start_compress(cinfo,
+                        (slice->flags & TJFLAG_ABBREVIATED) ? FALSE : TRUE);
+    while (cinfo->next_scanline < cinfo->image_height) {
+      tjProcYuv444ScanLine(&row_pointer[cinfo->next_scanline], slice->width,
+                           cinfo->image_height - cinfo->next_scanline);
+      jpeg_write_scanlines(cinfo, &row_pointer[cinfo->next_scanline],
+                           cinfo->image_height - cinfo->next_scanline);
+    }
+    jpeg_finish_compress(cinfo);
+  }
+
+bailout:
+  if (cinfo->global_state > CSTATE_START) jpeg_abort_compress(cinfo);
+  free(row_pointer);
+  slice->warning = this->jerr.warning;
+  if (slice->warning) retval = -1;
+  slice->retval = retval;
+  if (retval < 0) snprintf(slice->errStr, JMSG_LENGTH_MAX, "%s", errStr);
+  this->jerr.stopOnWarning = FALSE;
+}
+
+
+DLLEXPORT int tjCompressBatch(tjhandle handle, int numImages,
+                              const unsigned char **srcBufs, int width,
+                              int pitch, int height, int pixelFormat,
+                              unsigned char **jpegBufs,
+                              unsigned long *jpegSizes, int jpegSubsamp,
+                              int jpegQual, int flags)
+{
+  tjbatchslice *slices = NULL;
+  int i, numSlices = 1, numStarted = 0, retval = 0;
+#ifdef WITH_THREADS
+  tjthread *threads = NULL;
+#endif
+
+  GET_TJINSTANCE(handle)
+  if ((this->init & COMPRESS) == 0)
+    THROW("tjCompressBatch(): Instance has not been initialized for compression");
+
+  if (numImages <= 0 || srcBufs == NULL || width <= 0 || pitch < 0 ||
+      height <= 0 || pixelFormat < 0 || pixelFormat >= TJ_NUMPF ||
+      jpegBufs == NULL || jpegSizes == NULL || jpegSubsamp < 0 ||
+      jpegSubsamp >= NUMSUBOPT || jpegQual < 0 || jpegQual > 100)
+    THROW("tjCompressBatch(): Invalid argument");
+  for (i = 0; i < numImages; i++) {
+    if (srcBufs[i] == NULL)
+      THROW("tjCompressBatch(): Invalid argument");
+  }
+
+  if (pitch == 0) pitch = width * tjPixelSize[pixelFormat];
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+#ifdef WITH_THREADS
+  numSlices = max(min(this->numThreads, numImages), 1);
+  if (numSlices > 1 &&
+      (threads = (tjthread *)malloc(sizeof(tjthread) * numSlices)) == NULL)
+    THROW("tjCompressBatch(): Memory allocation failure");
+#endif
+  if ((slices =
+       (tjbatchslice *)malloc(sizeof(tjbatchslice) * numSlices)) == NULL)
+    THROW("tjCompressBatch(): Memory allocation failure");
+  MEMZERO(slices, sizeof(tjbatchslice) * numSlices);
+
+  for (i = 0; i < numSlices; i++) {
+    tjbatchslice *slice = &slices[i];
+    int first = (int)((long)numImages * i / numSlices);
+    int next = (int)((long)numImages * (i + 1) / numSlices);
+
+    slice->srcBufs = &srcBufs[first];
+    slice->jpegBufs = &jpegBufs[first];
+    slice->jpegSizes = &jpegSizes[first];
+    slice->numImages = next - first;
+    slice->width = width;
+    slice->pitch = pitch;
+    slice->height = height;
+    slice->pixelFormat = pixelFormat;
+    slice->subsamp = jpegSubsamp;
+    slice->jpegQual = jpegQual;
+    slice->flags = flags;
+    slice->inst = this;
+#ifdef WITH_THREADS
+    if (i > 0 && (slice->inst = getWorker(this, i - 1, COMPRESS)) == NULL)
+      THROW("tjCompressBatch(): Memory allocation failure");
+#endif
+  }
+
+#ifdef WITH_THREADS
+  for (i = 1; i < numSlices; i++) {
+    if (tjThreadCreate(&threads[i], compressSlice, &slices[i]) < 0) {
+      snprintf(errStr, JMSG_LENGTH_MAX,
+               "tjCompressBatch(): Could not create thread");
+      retval = -1;  break;
+    }
+    numStarted++;
+  }
+#endif
+  if (retval == 0) compressSlice(&slices[0]);
+
+  for (i = 0; i <= numStarted; i++) {
+#ifdef WITH_THREADS
+    if (i > 0) tjThreadJoin(threads[i]);
+#endif
+    if (retval == 0 && slices[i].retval < 0) {
+      if (i > 0) snprintf(errStr, JMSG_LENGTH_MAX, "%s", slices[i].errStr);
+      retval = -1;
+    }
+    if (slices[i].warning) this->jerr.warning = TRUE;
+  }
+
+bailout:
+  free(slices);
+#ifdef WITH_THREADS
+  free(threads);
+#endif
+  return retval;
+}
+
+
+DLLEXPORT int tjCompressTables(tjhandle handle, unsigned char **tablesBuf,
+                               unsigned long *tablesSize, int jpegQual,
+                               int flags)
+{
+  int retval = 0;
+
+  GET_CINSTANCE(handle)
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & COMPRESS) == 0)
+    THROW("tjCompressTables(): Instance has not been initialized for compression");
+
+  if (tablesBuf == NULL || tablesSize == NULL || jpegQual < 0 ||
+      jpegQual > 100)
+    THROW("tjCompressTables(): Invalid argument");
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_dest_tj(cinfo, tablesBuf, tablesSize,
+                   (flags & TJFLAG_NOREALLOC) ? FALSE : TRUE);
+  /* The tables do not depend on the pixel format or subsampling level. */
+  setCompDefaults(cinfo, TJPF_RGB, TJSAMP_444, jpegQual,
+                  flags & ~TJFLAG_ABBREVIATED);
+  jpeg_write_tables(cinfo);
+
+bailout:
+  if (cinfo->global_state > CSTATE_START) jpeg_abort_compress(cinfo);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+DLLEXPORT int tjCompressStreamStart(tjhandle handle, int width, int height,
+                                    int pixelFormat, tjwritecallback callback,
+                                    void *callbackData, int jpegSubsamp,
+                                    int jpegQual, int flags)
+{
+  tjcompstream *stream = NULL;
+  int retval = 0;
+
+  GET_CINSTANCE(handle)
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & COMPRESS) == 0)
+    THROW("tjCompressStreamStart(): Instance has not been initialized for compression");
+
+  if (width <= 0 || height <= 0 || pixelFormat < 0 ||
+      pixelFormat >= TJ_NUMPF || callback == NULL || jpegSubsamp < 0 ||
+      jpegSubsamp >= NUMSUBOPT || jpegQual < 0 || jpegQual > 100)
+    THROW("tjCompressStreamStart(): Invalid argument");
+
+  if (this->cstream == NULL) {
+    if ((this->cstream =
+         (tjcompstream *)malloc(sizeof(tjcompstream))) == NULL)
+      THROW("tjCompressStreamStart(): Memory allocation failure");
+    MEMZERO(this->cstream, sizeof(tjcompstream));
+  }
+  stream = this->cstream;
+  cinfo = &stream->cinfo;
+  stream->active = FALSE;
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  if (cinfo->global_state == 0) {
+    cinfo->err = &this->jerr.pub;
+    jpeg_create_compress(cinfo);
+  } else if (cinfo->global_state > CSTATE_START)
+    jpeg_abort_compress(cinfo);
+
+  cinfo->image_width = width;
+  cinfo->image_height = height;
+  jpeg_callback_dest_tj(cinfo, callback, callbackData, NULL, 0);
+  setCompDefaults(cinfo, pixelFormat, jpegSubsamp, jpegQual, flags);
+  jpeg_start_compress(cinfo, (flags & TJFLAG_ABBREVIATED) ? FALSE : TRUE);
+  stream->pixelFormat = pixelFormat;
+  stream->flags = flags;
+  stream->active = TRUE;
+
+bailout:
+  if (retval < 0 && stream && cinfo->global_state > CSTATE_START)
+    jpeg_abort_compress(cinfo);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+DLLEXPORT int tjCompressStreamRows(tjhandle handle,
+                                   const unsigned char *srcBuf, int pitch,
+                                   int numRows)
+{
+  tjcompstream *stream;
+  int i, retval = 0;
+
+  GET_CINSTANCE(handle)
+  if ((this->init & COMPRESS) == 0)
+    THROW("tjCompressStreamRows(): Instance has not been initialized for compression");
+
+  if ((stream = this->cstream) == NULL || !stream->active)
+    THROW("tjCompressStreamRows(): No stream is in progress");
+  cinfo = &stream->cinfo;
+  this->jerr.stopOnWarning =
+    (stream->flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+
+  if (srcBuf == NULL || pitch < 0 || numRows < 0 ||
+      (JDIMENSION)numRows > cinfo->image_height - cinfo->next_scanline)
+    THROW("tjCompressStreamRows(): Invalid argument");
+
+  if (pitch == 0)
+    pitch = cinfo->image_width * tjPixelSize[stream->pixelFormat];
+
+  if (numRows > stream->numRowPointers) {
+    JSAMPROW *rowPointers =
+      (JSAMPROW *)realloc(stream->rowPointers, sizeof(JSAMPROW) * numRows);
+
+    if (rowPointers == NULL)
+      THROW("tjCompressStreamRows(): Memory allocation failure");
+    stream->rowPointers = rowPointers;
+    stream->numRowPointers = numRows;
+  }
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error, and the stream
+       cannot be resumed. */
+    jpeg_abort_compress(cinfo);
+    stream->active = FALSE;
+    retval = -1;  goto bailout;
+  }
+
+  for (i = 0; i < numRows; i++) {
+    if (stream->flags & TJFLAG_BOTTOMUP)
+      stream->rowPointers[i] =
+        (JSAMPROW)&srcBuf[(numRows - i - 1) * (size_t)pitch];
+    else
+      stream->rowPointers[i] = (JSAMPROW)&srcBuf[i * (size_t)pitch];
+  }
+  tjProcYuv444ScanLine(stream->rowPointers, cinfo->image_width, numRows);
+  for (i = 0; i < numRows; )
+    i += jpeg_write_scanlines(cinfo, &stream->rowPointers[i], numRows - i);
+
+bailout:
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+DLLEXPORT int tjCompressStreamFinish(tjhandle handle)
+{
+  tjcompstream *stream;
+  int retval = 0;
+
+  GET_CINSTANCE(handle)
+  if ((this->init & COMPRESS) == 0)
+    THROW("tjCompressStreamFinish(): Instance has not been initialized for compression");
+
+  if ((stream = this->cstream) == NULL || !stream->active)
+    THROW("tjCompressStreamFinish(): No stream is in progress");
+  cinfo = &stream->cinfo;
+  this->jerr.stopOnWarning =
+    (stream->flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+
+  if (cinfo->next_scanline < cinfo->image_height)
+    THROW("tjCompressStreamFinish(): Not all rows of the image have been supplied");
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    jpeg_abort_compress(cinfo);
+    stream->active = FALSE;
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_finish_compress(cinfo);
+  stream->active = FALSE;
+
+bailout:
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
 DLLEXPORT int tjEncodeYUVPlanes(tjhandle handle, const unsigned char *srcBuf,
                                 int width, int pitch, int height,
                                 int pixelFormat, unsigned char **dstPlanes,
@@ -960,8 +1623,9 @@ DLLEXPORT int tjCompressFromYUVPlanes(tjhandle handle,
     THROW("tjCompressFromYUVPlanes(): Instance has not been initialized for compression");
 
   if (!srcPlanes || !srcPlanes[0] || width <= 0 || height <= 0 ||
-      subsamp < 0 || subsamp >= NUMSUBOPT || jpegBuf == NULL ||
-      jpegSize == NULL || jpegQual < 0 || jpegQual > 100)
+      subsamp < 0 || subsamp >= NUMSUBOPT ||
+      (jpegBuf == NULL && !HAS_DESTINATION(this)) || jpegSize == NULL ||
+      jpegQual < 0 || jpegQual > 100)
     THROW("tjCompressFromYUVPlanes(): Invalid argument");
   if (subsamp != TJSAMP_GRAY && (!srcPlanes[1] || !srcPlanes[2]))
     THROW("tjCompressFromYUVPlanes(): Invalid argument");
@@ -983,11 +1647,11 @@ DLLEXPORT int tjCompressFromYUVPlanes(tjhandle handle,
   if (flags & TJFLAG_NOREALLOC) {
     alloc = 0;  *jpegSize = tjBufSize(width, height, subsamp);
   }
-  jpeg_mem_dest_tj(cinfo, jpegBuf, jpegSize, alloc);
+  setDestination(this, jpegBuf, jpegSize, alloc);
   setCompDefaults(cinfo, TJPF_RGB, subsamp, jpegQual, flags);
   cinfo->raw_data_in = TRUE;
 
-  jpeg_start_compress(cinfo, TRUE);
+  jpeg_start_compress(cinfo, (flags & TJFLAG_ABBREVIATED) ? FALSE : TRUE);
   for (i = 0; i < cinfo->num_components; i++) {
     jpeg_component_info *compptr = &cinfo->comp_info[i];
     int ih;
@@ -1133,6 +1797,7 @@ static tjhandle _tjInitDecompress(tjinstance *this)
   }
 
   jpeg_create_decompress(&this->dinfo);
+  this->dinfo.mem->max_memory_to_retain = MAX_RETAINED_MEMORY;
   /* Make an initial call so it will create the source manager */
   jpeg_mem_src_tj(&this->dinfo, buffer, 1);
 
@@ -1155,13 +1820,121 @@ DLLEXPORT tjhandle tjInitDecompress(void)
 }
 
 
-DLLEXPORT int tjDecompressHeader3(tjhandle handle,
-                                  const unsigned char *jpegBuf,
-                                  unsigned long jpegSize, int *width,
-                                  int *height, int *jpegSubsamp,
-                                  int *jpegColorspace)
-{
-  int retval = 0;
+/* Tables-only datastreams
+
+   libjpeg allows an abbreviated JPEG image to use tables that were defined by
+   a previous datastream, but tables defined by a previously-decompressed JPEG
+   image also remain in effect.  Thus, tjDecompressTables() saves a copy of
+   the tables that are defined by the tables-only datastream, and the saved
+   tables are restored before each JPEG header is read.  That ensures that an
+   abbreviated JPEG image is always decompressed using the loaded tables,
+   regardless of which images were previously decompressed by the instance.
+   Worker instances receive their own copy of the saved tables. */
+
+static void restoreTables(tjtables *tables, j_decompress_ptr dinfo)
+{
+  int i;
+
+  if (tables == NULL) return;
+
+  for (i = 0; i < NUM_QUANT_TBLS; i++) {
+    if (!tables->haveQuantTbl[i]) continue;
+    if (dinfo->quant_tbl_ptrs[i] == NULL)
+      dinfo->quant_tbl_ptrs[i] = jpeg_alloc_quant_table((j_common_ptr)dinfo);
+    MEMCOPY(dinfo->quant_tbl_ptrs[i], &tables->quantTbls[i],
+            sizeof(JQUANT_TBL));
+  }
+  for (i = 0; i < NUM_HUFF_TBLS; i++) {
+    if (tables->haveDCHuffTbl[i]) {
+      if (dinfo->dc_huff_tbl_ptrs[i] == NULL)
+        dinfo->dc_huff_tbl_ptrs[i] =
+          jpeg_alloc_huff_table((j_common_ptr)dinfo);
+      MEMCOPY(dinfo->dc_huff_tbl_ptrs[i], &tables->dcHuffTbls[i],
+              sizeof(JHUFF_TBL));
+    }
+    if (tables->haveACHuffTbl[i]) {
+      if (dinfo->ac_huff_tbl_ptrs[i] == NULL)
+        dinfo->ac_huff_tbl_ptrs[i] =
+          jpeg_alloc_huff_table((j_common_ptr)dinfo);
+      MEMCOPY(dinfo->ac_huff_tbl_ptrs[i], &tables->acHuffTbls[i],
+              sizeof(JHUFF_TBL));
+    }
+  }
+}
+
+
+DLLEXPORT int tjDecompressTables(tjhandle handle,
+                                 const unsigned char *tablesBuf,
+                                 unsigned long tablesSize)
+{
+  struct jpeg_decompress_struct tinfo;
+  tjtables *tables = NULL;
+  int i, retval = 0;
+
+  GET_TJINSTANCE(handle);
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressTables(): Instance has not been initialized for decompression");
+
+  if (tablesBuf == NULL || tablesSize <= 0)
+    THROW("tjDecompressTables(): Invalid argument");
+
+  if ((tables = (tjtables *)malloc(sizeof(tjtables))) == NULL)
+    THROW("tjDecompressTables(): Memory allocation failure");
+  MEMZERO(tables, sizeof(tjtables));
+
+  /* The tables are read using a temporary decompressor, so the tables defined
+     by the tables-only datastream can be distinguished from any tables that
+     the instance already has.  (jpeg_destroy_decompress() does nothing if
+     jpeg_create_decompress() was never called.) */
+  MEMZERO(&tinfo, sizeof(struct jpeg_decompress_struct));
+  tinfo.err = &this->jerr.pub;
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_create_decompress(&tinfo);
+  jpeg_mem_src_tj(&tinfo, tablesBuf, tablesSize);
+  if (jpeg_read_header(&tinfo, FALSE) != JPEG_HEADER_TABLES_ONLY)
+    THROW("tjDecompressTables(): Not a tables-only JPEG datastream");
+
+  for (i = 0; i < NUM_QUANT_TBLS; i++) {
+    if (tinfo.quant_tbl_ptrs[i] == NULL) continue;
+    MEMCOPY(&tables->quantTbls[i], tinfo.quant_tbl_ptrs[i],
+            sizeof(JQUANT_TBL));
+    tables->haveQuantTbl[i] = TRUE;
+  }
+  for (i = 0; i < NUM_HUFF_TBLS; i++) {
+    if (tinfo.dc_huff_tbl_ptrs[i] != NULL) {
+      MEMCOPY(&tables->dcHuffTbls[i], tinfo.dc_huff_tbl_ptrs[i],
+              sizeof(JHUFF_TBL));
+      tables->haveDCHuffTbl[i] = TRUE;
+    }
+    if (tinfo.ac_huff_tbl_ptrs[i] != NULL) {
+      MEMCOPY(&tables->acHuffTbls[i], tinfo.ac_huff_tbl_ptrs[i],
+              sizeof(JHUFF_TBL));
+      tables->haveACHuffTbl[i] = TRUE;
+    }
+  }
+  free(this->tables);
+  this->tables = tables;
+  tables = NULL;
+
+bailout:
+  jpeg_destroy_decompress(&tinfo);
+  free(tables);
+  if (this->jerr.warning) retval = -1;
+  return retval;
+}
+
+
+DLLEXPORT int tjDecompressHeader3(tjhandle handle,
+                                  const unsigned char *jpegBuf,
+                                  unsigned long jpegSize, int *width,
+                                  int *height, int *jpegSubsamp,
+                                  int *jpegColorspace)
+{
+  int retval = 0;
 
   GET_DINSTANCE(handle);
   if ((this->init & DECOMPRESS) == 0)
@@ -1177,6 +1950,7 @@ DLLEXPORT int tjDecompressHeader3(tjhandle handle,
   }
 
   jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  restoreTables(this->tables, dinfo);
   jpeg_read_header(dinfo, TRUE);
 
   *width = dinfo->image_width;
@@ -1239,6 +2013,906 @@ DLLEXPORT tjscalingfactor *tjGetScalingFactors(int *numscalingfactors)
 }
 
 
+#ifdef WITH_THREADS
+
+/* Return the worker instance with the given index, creating it and
+   initializing it for compression and/or decompression if necessary. */
+
+static tjinstance *getWorker(tjinstance *this, int index, int init)
+{
+  tjinstance *worker;
+
+  if (index >= this->numWorkers) {
+    tjinstance **workers =
+      (tjinstance **)realloc(this->workers, sizeof(tjinstance *) * (index + 1));
+
+    if (!workers) return NULL;
+    MEMZERO(&workers[this->numWorkers],
+            sizeof(tjinstance *) * (index + 1 - this->numWorkers));
+    this->workers = workers;
+    this->numWorkers = index + 1;
+  }
+
+  if ((worker = this->workers[index]) == NULL) {
+    if ((worker = (tjinstance *)malloc(sizeof(tjinstance))) == NULL)
+      return NULL;
+    MEMZERO(worker, sizeof(tjinstance));
+    snprintf(worker->errStr, JMSG_LENGTH_MAX, "No error");
+    this->workers[index] = worker;
+  }
+  /* _tjInitCompress() and _tjInitDecompress() free the instance if they
+     fail. */
+  if ((init & COMPRESS) && !(worker->init & COMPRESS) &&
+      !_tjInitCompress(worker)) {
+    this->workers[index] = NULL;  return NULL;
+  }
+  if ((init & DECOMPRESS) && !(worker->init & DECOMPRESS) &&
+      !_tjInitDecompress(worker)) {
+    this->workers[index] = NULL;  return NULL;
+  }
+  if ((init & DECOMPRESS) && this->tables) {
+    if (!worker->tables &&
+        (worker->tables = (tjtables *)malloc(sizeof(tjtables))) == NULL)
+      return NULL;
+    MEMCOPY(worker->tables, this->tables, sizeof(tjtables));
+  }
+  return worker;
+}
+
+
+/* Restart-interval parallel decompression
+
+   If a single-scan (sequential) JPEG image contains restart markers, then the
+   entropy-coded data following each restart marker can be decoded without
+   reference to any of the preceding data.  tjDecompress2() takes advantage of
+   that by splitting the image into horizontal bands whose first iMCU row
+   begins at a restart boundary.  The first band is decompressed by the
+   calling thread, using the main decompressor instance.  Each of the other
+   bands is decompressed by a worker thread, using its own decompressor
+   instance, from a copy of the JPEG header (with the image height adjusted so
+   that the band appears to be the bottom of a complete image) followed by the
+   entropy-coded data starting at the band's restart boundary.
+
+   If fancy upsampling requires context rows, then each worker starts
+   decompressing at the restart boundary preceding its band and discards the
+   extra rows, and since a worker always has access to all of the entropy-
+   coded data below its band, the decompressed pixels are identical to those
+   produced by the single-threaded code path. */
+
+typedef struct {
+  tjinstance *inst;
+  unsigned char *hdrBuf;
+  unsigned long hdrSize;
+  const unsigned char *dataBuf;
+  unsigned long dataSize;
+  int restartNum, skipRows, numRows, finish;
+  JSAMPROW *rows;
+  int pixelFormat, flags, scaleNum, scaleDenom;
+  int retval;
+  boolean warning;
+  char errStr[JMSG_LENGTH_MAX];
+} tjdecompband;
+
+
+static void decompressBand(void *arg)
+{
+  tjdecompband *band = (tjdecompband *)arg;
+  tjinstance *this = band->inst;
+  j_decompress_ptr dinfo = &this->dinfo;
+  int endRow = band->skipRows + band->numRows;
+
+  this->jerr.warning = FALSE;
+  this->isInstanceError = FALSE;
+  this->jerr.stopOnWarning =
+    (band->flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  band->retval = 0;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    band->retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, band->hdrBuf, band->hdrSize);
+  restoreTables(this->tables, dinfo);
+  jpeg_read_header(dinfo, TRUE);
+  /* The header buffer ends with the SOS marker segment, so the source manager
+     is now positioned at the beginning of the entropy-coded data.  Point it at
+     the entropy-coded data for this band instead. */
+  dinfo->src->next_input_byte = band->dataBuf;
+  dinfo->src->bytes_in_buffer = (size_t)band->dataSize;
+  dinfo->marker->next_restart_num = band->restartNum;
+
+  dinfo->out_color_space = pf2cs[band->pixelFormat];
+  if (band->flags & TJFLAG_FASTDCT) dinfo->dct_method = JDCT_FASTEST;
+  if (band->flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+  dinfo->scale_num = band->scaleNum;
+  dinfo->scale_denom = band->scaleDenom;
+
+  jpeg_start_decompress(dinfo);
+  if ((int)dinfo->output_height < endRow) {
+    snprintf(errStr, JMSG_LENGTH_MAX,
+             "tjDecompress2(): Band dimensions do not match image dimensions");
+    band->retval = -1;  goto bailout;
+  }
+
+  if (band->skipRows > 0) {
+    JSAMPARRAY discard = (*dinfo->mem->alloc_sarray)
+      ((j_common_ptr)dinfo, JPOOL_IMAGE,
+       dinfo->output_width * tjPixelSize[band->pixelFormat], 1);
+
+    while ((int)dinfo->output_scanline < band->skipRows)
+      jpeg_read_scanlines(dinfo, discard, 1);
+  }
+  while ((int)dinfo->output_scanline < endRow)
+    jpeg_read_scanlines(dinfo,
+                        &band->rows[dinfo->output_scanline - band->skipRows],
+                        endRow - dinfo->output_scanline);
+  if (band->finish) jpeg_finish_decompress(dinfo);
+
+bailout:
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  band->warning = this->jerr.warning;
+  if (band->retval < 0 || band->warning)
+    snprintf(band->errStr, JMSG_LENGTH_MAX, "%s", errStr);
+  this->jerr.stopOnWarning = FALSE;
+}
+
+
+/* Return the offset of the length field of the first SOFn marker segment (if
+   sof is TRUE) or the first SOS marker segment (if sof is FALSE) in the given
+   JPEG header, or 0 if the header could not be parsed. */
+
+static unsigned long findSegment(const unsigned char *buf, unsigned long size,
+                                 boolean sof)
+{
+  unsigned long pos = 2;
+
+  if (size < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return 0;
+
+  while (pos < size) {
+    int marker;
+
+    if (buf[pos] != 0xFF) return 0;
+    while (pos < size && buf[pos] == 0xFF) pos++;
+    if (pos + 2 >= size) return 0;
+    marker = buf[pos++];
+    if (sof && marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC)
+      return pos;
+    if (!sof && marker == 0xDA) return pos;
+    if (marker == 0xDA || (marker >= 0xD0 && marker <= 0xD9)) return 0;
+    pos += (buf[pos] << 8) + buf[pos + 1];
+  }
+  return 0;
+}
+
+
+/* Return the offset of the image height field in the SOF marker segment of
+   the given JPEG header, or 0 if the header could not be parsed. */
+
+static unsigned long findSOFHeight(const unsigned char *buf,
+                                   unsigned long size)
+{
+  unsigned long pos = findSegment(buf, size, TRUE);
+
+  return pos && pos + 5 <= size ? pos + 3 : 0;
+}
+
+
+/* Scan the entropy-coded data that begins at buf[start] for restart markers,
+   and store the offset of the data following restart marker wanted[i] - 1 in
+   offsets[i].  wanted[] must be in ascending order and must not contain 0.
+   Returns 0 if all of the requested offsets were found or -1 otherwise. */
+
+static int findRestartOffsets(const unsigned char *buf, unsigned long start,
+                              unsigned long size, const int *wanted,
+                              unsigned long *offsets, int count)
+{
+  unsigned long pos = start;
+  int segment = 0, i = 0;
+
+  while (i < count) {
+    const unsigned char *ptr;
+    int marker;
+
+    if (pos >= size ||
+        (ptr = (const unsigned char *)memchr(&buf[pos], 0xFF,
+                                             size - pos)) == NULL)
+      return -1;
+    pos = (unsigned long)(ptr - buf) + 1;
+    while (pos < size && buf[pos] == 0xFF) pos++;
+    if (pos >= size) return -1;
+    marker = buf[pos++];
+    if (marker == 0) continue;           /* stuffed zero byte */
+    if (marker < JPEG_RST0 || marker > JPEG_RST0 + 7 ||
+        marker - JPEG_RST0 != (segment & 7))
+      return -1;
+    segment++;
+    if (segment == wanted[i]) offsets[i++] = pos;
+  }
+  return 0;
+}
+
+
+/* Decompress the image in parallel, if possible.  This must be called after
+   jpeg_start_decompress().  Returns 0 if the image was successfully
+   decompressed, -1 if an error occurred, or 1 if the image cannot be
+   decompressed in parallel (in which case the decompressor state is
+   unchanged.) */
+
+static int decompressParallel(tjinstance *this, const unsigned char *jpegBuf,
+                              unsigned long jpegSize, unsigned long hdrSize,
+                              JSAMPROW *row_pointer, int pixelFormat,
+                              int flags)
+{
+  j_decompress_ptr dinfo = &this->dinfo;
+  tjdecompband *bands = NULL;
+  tjthread *threads = NULL;
+  int *wanted = NULL;
+  unsigned long *offsets = NULL, heightPos;
+  unsigned char *hdrBufs = NULL;
+  int mcusPerRow, step, numUnits, numBands, overlap, rowHeight, i, a, b;
+  int numStarted = 0, retval = 1;
+  jmp_buf savedJmpBuf;
+
+  if (this->numThreads < 2 || dinfo->progressive_mode ||
+      dinfo->restart_interval == 0 ||
+      dinfo->comps_in_scan != dinfo->num_components)
+    return 1;
+  if (dinfo->comps_in_scan == 1) {
+    if (dinfo->cur_comp_info[0]->v_samp_factor != 1) return 1;
+    mcusPerRow = dinfo->cur_comp_info[0]->width_in_blocks;
+  } else
+    mcusPerRow = (dinfo->image_width +
+                  dinfo->max_h_samp_factor * DCTSIZE - 1) /
+                 (dinfo->max_h_samp_factor * DCTSIZE);
+  if ((heightPos = findSOFHeight(jpegBuf, hdrSize)) == 0) return 1;
+
+  /* Band boundaries must fall on iMCU rows that begin at a restart
+     boundary. */
+  a = dinfo->restart_interval;  b = mcusPerRow;
+  while (b) { int t = a % b;  a = b;  b = t; }
+  step = dinfo->restart_interval / a;
+  numUnits = (dinfo->total_iMCU_rows + step - 1) / step;
+  overlap = dinfo->upsample->need_context_rows ? 1 : 0;
+  numBands = min(this->numThreads, numUnits / (overlap + 1));
+  if (numBands < 2) return 1;
+  rowHeight = dinfo->max_v_samp_factor * dinfo->_min_DCT_v_scaled_size;
+
+  if ((bands = (tjdecompband *)malloc(sizeof(tjdecompband) * numBands)) ==
+      NULL ||
+      (threads = (tjthread *)malloc(sizeof(tjthread) * numBands)) == NULL ||
+      (wanted = (int *)malloc(sizeof(int) * numBands)) == NULL ||
+      (offsets = (unsigned long *)malloc(sizeof(unsigned long) *
+                                         numBands)) == NULL ||
+      (hdrBufs = (unsigned char *)malloc(hdrSize * numBands)) == NULL)
+    goto bailout;
+  MEMZERO(bands, sizeof(tjdecompband) * numBands);
+
+  for (i = 0; i < numBands; i++) {
+    tjdecompband *band = &bands[i];
+    int firstRow = (int)((long)numUnits * i / numBands) * step;
+    int decodeRow = i > 0 ? firstRow - overlap * step : 0;
+    int nextRow = (int)((long)numUnits * (i + 1) / numBands) * step;
+    int outRow = firstRow * rowHeight;
+    int nextOutRow = i < numBands - 1 ?
+                     nextRow * rowHeight : (int)dinfo->output_height;
+    long height = (long)dinfo->image_height -
+                  (long)decodeRow * dinfo->max_v_samp_factor * DCTSIZE;
+
+    if (i > 0) wanted[i - 1] = decodeRow * mcusPerRow /
+                               dinfo->restart_interval;
+    band->restartNum = (i > 0 ? wanted[i - 1] : 0) & 7;
+    band->skipRows = (firstRow - decodeRow) * rowHeight;
+    band->numRows = nextOutRow - outRow;
+    band->rows = &row_pointer[outRow];
+    band->finish = (i == numBands - 1);
+    band->pixelFormat = pixelFormat;
+    band->flags = flags;
+    band->scaleNum = dinfo->scale_num;
+    band->scaleDenom = dinfo->scale_denom;
+    band->hdrBuf = &hdrBufs[hdrSize * i];
+    band->hdrSize = hdrSize;
+    memcpy(band->hdrBuf, jpegBuf, hdrSize);
+    band->hdrBuf[heightPos] = (unsigned char)(height >> 8);
+    band->hdrBuf[heightPos + 1] = (unsigned char)(height & 0xFF);
+  }
+  if (findRestartOffsets(jpegBuf, hdrSize, jpegSize, wanted, offsets,
+                         numBands - 1) < 0)
+    goto bailout;
+  for (i = 1; i < numBands; i++) {
+    bands[i].dataBuf = &jpegBuf[offsets[i - 1]];
+    bands[i].dataSize = jpegSize - offsets[i - 1];
+    if ((bands[i].inst = getWorker(this, i - 1, DECOMPRESS)) == NULL)
+      goto bailout;
+  }
+
+  /* From this point on, the decompressor state has changed, so the image
+     must either be decompressed in parallel or not at all. */
+  retval = 0;
+  for (i = 1; i < numBands; i++) {
+    if (tjThreadCreate(&threads[i], decompressBand, &bands[i]) < 0) {
+      snprintf(errStr, JMSG_LENGTH_MAX,
+               "tjDecompress2(): Could not create thread");
+      retval = -1;  break;
+    }
+    numStarted++;
+  }
+
+  if (retval == 0) {
+    /* The caller's setjmp() buffer becomes invalid when this function returns,
+       so it must be restored once the first band has been decompressed. */
+    MEMCOPY(savedJmpBuf, this->jerr.setjmp_buffer, sizeof(jmp_buf));
+    if (setjmp(this->jerr.setjmp_buffer)) {
+      /* If we get here, the JPEG code has signaled an error. */
+      retval = -1;
+    } else {
+      while ((int)dinfo->output_scanline < bands[0].numRows)
+        jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline],
+                            bands[0].numRows - dinfo->output_scanline);
+    }
+    MEMCOPY(this->jerr.setjmp_buffer, savedJmpBuf, sizeof(jmp_buf));
+  }
+
+  for (i = 1; i <= numStarted; i++) {
+    tjThreadJoin(threads[i]);
+    if (retval == 0 && (bands[i].retval < 0 || bands[i].warning))
+      snprintf(errStr, JMSG_LENGTH_MAX, "%s", bands[i].errStr);
+    if (bands[i].retval < 0) retval = -1;
+    if (bands[i].warning) this->jerr.warning = TRUE;
+  }
+
+bailout:
+  free(bands);
+  free(threads);
+  free(wanted);
+  free(offsets);
+  free(hdrBufs);
+  return retval;
+}
+
+
+/* Restart-interval parallel compression
+
+   The entropy-coded data for each restart interval in a single-scan JPEG image
+   is independent of the data for the other restart intervals, so an image can
+   be compressed in parallel by splitting it into horizontal bands whose first
+   iMCU row begins at a restart boundary and compressing each band as a
+   separate image.  The compressed bands are then stitched together by taking
+   the JPEG header from the first band (with the image height adjusted), and
+   for each subsequent band, inserting the restart marker that would have
+   preceded its first restart interval and appending its entropy-coded data
+   (with its restart markers renumbered accordingly.)  Since flushing the
+   entropy encoder at the end of an image is equivalent to flushing it at a
+   restart boundary, the JPEG image is identical to the image produced by the
+   single-threaded code path with the same restart interval.  This does not
+   work with Huffman table optimization or progressive JPEG images, since the
+   Huffman tables would differ among bands.  If no restart interval was
+   specified, then one restart interval per MCU row is used. */
+
+typedef struct {
+  tjinstance *inst;
+  JSAMPROW *rows;
+  int width, height, pixelFormat, subsamp, jpegQual, flags;
+  unsigned int restartInterval;
+  const jpeg_scan_info *scanInfo;
+  int numScans;
+  unsigned char *jpegBuf;
+  unsigned long jpegSize;
+  int retval;
+  boolean warning;
+  char errStr[JMSG_LENGTH_MAX];
+} tjcompband;
+
+
+static void compressBand(void *arg)
+{
+  tjcompband *band = (tjcompband *)arg;
+  tjinstance *this = band->inst;
+  j_compress_ptr cinfo = &this->cinfo;
+
+  this->jerr.warning = FALSE;
+  this->isInstanceError = FALSE;
+  this->jerr.stopOnWarning =
+    (band->flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  band->retval = 0;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    band->retval = -1;  goto bailout;
+  }
+
+  cinfo->image_width = band->width;
+  cinfo->image_height = band->height;
+  jpeg_mem_dest_tj(cinfo, &band->jpegBuf, &band->jpegSize, FALSE);
+  setCompDefaults(cinfo, band->pixelFormat, band->subsamp, band->jpegQual,
+                  band->flags);
+  if (band->scanInfo) {
+    cinfo->scan_info = band->scanInfo;
+    cinfo->num_scans = band->numScans;
+  } else {
+    cinfo->restart_interval = band->restartInterval;
+    cinfo->restart_in_rows = 0;
+  }
+
+  jpeg_start_compress(cinfo,
+                      (band->flags & TJFLAG_ABBREVIATED) ? FALSE : TRUE);
+  while (cinfo->next_scanline < cinfo->image_height)
+    jpeg_write_scanlines(cinfo, &band->rows[cinfo->next_scanline],
+                         cinfo->image_height - cinfo->next_scanline);
+  jpeg_finish_compress(cinfo);
+
+bailout:
+  if (cinfo->global_state > CSTATE_START) jpeg_abort_compress(cinfo);
+  band->warning = this->jerr.warning;
+  if (band->retval < 0 || band->warning)
+    snprintf(band->errStr, JMSG_LENGTH_MAX, "%s", errStr);
+  this->jerr.stopOnWarning = FALSE;
+}
+
+
+/* Compress the given bands, using the calling thread for the first band and a
+   separate thread for each of the others.  Returns 0 if successful or -1 if
+   an error occurred. */
+
+static int compressBands(tjinstance *this, tjcompband *bands, int numBands)
+{
+  tjthread *threads;
+  int i, numStarted = 0, retval = 0;
+
+  if ((threads = (tjthread *)malloc(sizeof(tjthread) * numBands)) == NULL) {
+    snprintf(errStr, JMSG_LENGTH_MAX,
+             "tjCompress2(): Memory allocation failure");
+    return -1;
+  }
+  for (i = 1; i < numBands; i++) {
+    if (tjThreadCreate(&threads[i], compressBand, &bands[i]) < 0) {
+      snprintf(errStr, JMSG_LENGTH_MAX,
+               "tjCompress2(): Could not create thread");
+      retval = -1;  break;
+    }
+    numStarted++;
+  }
+  if (retval == 0) compressBand(&bands[0]);
+
+  for (i = 0; i <= numStarted; i++) {
+    if (i > 0) tjThreadJoin(threads[i]);
+    if (retval == 0 && (bands[i].retval < 0 || bands[i].warning))
+      snprintf(errStr, JMSG_LENGTH_MAX, "%s", bands[i].errStr);
+    if (bands[i].retval < 0) retval = -1;
+    if (bands[i].warning) this->jerr.warning = TRUE;
+  }
+  free(threads);
+  return retval;
+}
+
+
+/* Write the given data to the compressor's destination manager. */
+
+static void writeData(j_compress_ptr cinfo, const unsigned char *buf,
+                      unsigned long size)
+{
+  struct jpeg_destination_mgr *dest = cinfo->dest;
+
+  while (size > 0) {
+    size_t count;
+
+    if (dest->free_in_buffer == 0 && !(*dest->empty_output_buffer) (cinfo))
+      ERREXIT(cinfo, JERR_CANT_SUSPEND);
+    count = min(size, dest->free_in_buffer);
+    memcpy(dest->next_output_byte, buf, count);
+    dest->next_output_byte += count;
+    dest->free_in_buffer -= count;
+    buf += count;  size -= count;
+  }
+}
+
+
+/* Compress the image in parallel, if possible.  This must be called after
+   setCompDefaults() and before jpeg_start_compress().  Returns 0 if the image
+   was successfully compressed, -1 if an error occurred, or 1 if the image
+   cannot be compressed in parallel. */
+
+static int compressParallel(tjinstance *this, JSAMPROW *row_pointer,
+                            int width, int height, int pixelFormat,
+                            int jpegSubsamp, int jpegQual, int flags)
+{
+  j_compress_ptr cinfo = &this->cinfo;
+  tjcompband *bands = NULL;
+  unsigned int restartInterval;
+  int mcuw = tjMCUWidth[jpegSubsamp], mcuh = tjMCUHeight[jpegSubsamp];
+  int mcusPerRow, totalRows, step, numUnits, numBands, i, a, b, retval = 1;
+  jmp_buf savedJmpBuf;
+
+  if (this->numThreads < 2 || cinfo->optimize_coding ||
+      cinfo->scan_info != NULL)
+    return 1;
+
+  mcusPerRow = (width + mcuw - 1) / mcuw;
+  totalRows = (height + mcuh - 1) / mcuh;
+  if (cinfo->restart_interval > 0)
+    restartInterval = cinfo->restart_interval;
+  else if (cinfo->restart_in_rows > 0)
+    restartInterval = (unsigned int)min((long)cinfo->restart_in_rows *
+                                        mcusPerRow, 65535L);
+  else
+    restartInterval = mcusPerRow;
+
+  /* Band boundaries must fall on iMCU rows that begin at a restart
+     boundary. */
+  a = restartInterval;  b = mcusPerRow;
+  while (b) { int t = a % b;  a = b;  b = t; }
+  step = restartInterval / a;
+  numUnits = (totalRows + step - 1) / step;
+  numBands = min(this->numThreads, numUnits);
+  if (numBands < 2) return 1;
+
+  if ((bands = (tjcompband *)malloc(sizeof(tjcompband) * numBands)) == NULL)
+    return 1;
+  MEMZERO(bands, sizeof(tjcompband) * numBands);
+
+  for (i = 0; i < numBands; i++) {
+    tjcompband *band = &bands[i];
+    int firstRow = (int)((long)numUnits * i / numBands) * step * mcuh;
+    int nextRow = i < numBands - 1 ?
+                  (int)((long)numUnits * (i + 1) / numBands) * step * mcuh :
+                  height;
+
+    band->rows = &row_pointer[firstRow];
+    band->width = width;
+    band->height = nextRow - firstRow;
+    band->pixelFormat = pixelFormat;
+    band->subsamp = jpegSubsamp;
+    band->jpegQual = jpegQual;
+    band->flags = flags;
+    band->restartInterval = restartInterval;
+    band->jpegSize = tjBufSize(width, band->height, jpegSubsamp);
+    if (band->jpegSize == (unsigned long)-1 ||
+        (band->jpegBuf = (unsigned char *)malloc(band->jpegSize)) == NULL ||
+        (band->inst = getWorker(this, i, COMPRESS)) == NULL)
+      goto bailout;
+  }
+
+  /* From this point on, the image must either be compressed in parallel or
+     not at all. */
+  tjProcYuv444ScanLine(row_pointer, width, height);
+  if ((retval = compressBands(this, bands, numBands)) < 0) goto bailout;
+
+  /* Stitch the bands together.  The caller's setjmp() buffer becomes invalid
+     when this function returns, so it must be restored afterward. */
+  MEMCOPY(savedJmpBuf, this->jerr.setjmp_buffer, sizeof(jmp_buf));
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto restore;
+  }
+  (*cinfo->dest->init_destination) (cinfo);
+  for (i = 0; i < numBands; i++) {
+    tjcompband *band = &bands[i];
+    unsigned long start = 0, end = band->jpegSize - 2, pos;
+    int firstRow = (int)((long)numUnits * i / numBands) * step;
+    int restartNum = (int)((long)firstRow * mcusPerRow / restartInterval);
+
+    if (band->jpegSize < 4 || band->jpegBuf[end] != 0xFF ||
+        band->jpegBuf[end + 1] != JPEG_EOI)
+      goto badband;
+    if (i == 0) {
+      unsigned long heightPos = findSOFHeight(band->jpegBuf, band->jpegSize);
+
+      if (heightPos == 0) goto badband;
+      band->jpegBuf[heightPos] = (unsigned char)(height >> 8);
+      band->jpegBuf[heightPos + 1] = (unsigned char)(height & 0xFF);
+    } else {
+      unsigned char rst[2];
+
+      if ((start = findSegment(band->jpegBuf, band->jpegSize, FALSE)) == 0)
+        goto badband;
+      start += (band->jpegBuf[start] << 8) + band->jpegBuf[start + 1];
+      if (start > end) goto badband;
+      if (restartNum & 7) {
+        /* Renumber the restart markers in the entropy-coded data. */
+        for (pos = start; pos + 1 < end; pos++) {
+          if (band->jpegBuf[pos] == 0xFF &&
+              band->jpegBuf[pos + 1] >= JPEG_RST0 &&
+              band->jpegBuf[pos + 1] <= JPEG_RST0 + 7) {
+            band->jpegBuf[pos + 1] = (unsigned char)(JPEG_RST0 +
+              ((band->jpegBuf[pos + 1] - JPEG_RST0 + restartNum) & 7));
+            pos++;
+          }
+        }
+      }
+      rst[0] = 0xFF;
+      rst[1] = (unsigned char)(JPEG_RST0 + ((restartNum - 1) & 7));
+      writeData(cinfo, rst, 2);
+    }
+    if (i == numBands - 1) end += 2;
+    writeData(cinfo, &band->jpegBuf[start], end - start);
+  }
+  (*cinfo->dest->term_destination) (cinfo);
+  goto restore;
+
+badband:
+  snprintf(errStr, JMSG_LENGTH_MAX,
+           "tjCompress2(): Could not parse compressed band");
+  retval = -1;
+
+restore:
+  MEMCOPY(this->jerr.setjmp_buffer, savedJmpBuf, sizeof(jmp_buf));
+
+bailout:
+  for (i = 0; i < numBands; i++) free(bands[i].jpegBuf);
+  free(bands);
+  return retval;
+}
+
+
+/* Scan-parallel progressive compression
+
+   Each scan in a progressive JPEG image is encoded from the whole-image
+   coefficient buffer, and its Huffman tables are optimized using only the
+   statistics gathered from that scan, so the scans can be encoded
+   independently of each other, except that a successive approximation
+   refinement scan must follow the scans that transmitted the upper bits of the
+   same coefficients.  tjCompress2() takes advantage of that by dividing the
+   scans in the scan script into groups of scans that share coefficients and
+   distributing the groups among worker instances.  Each worker compresses the
+   whole image using a scan script containing only its groups (along with the
+   initial DC scans, which the library requires for validation purposes), and
+   the scans are then spliced together in the order of the original scan
+   script.  The JPEG image is identical to the image produced by the
+   single-threaded code path. */
+
+/* Find the end of the frame header and the location and restart interval of
+   each of the first numScans scans in the given JPEG image.  Returns 0 if
+   successful or -1 if the image could not be parsed. */
+
+typedef struct {
+  unsigned long sos, end;
+  unsigned int restartInterval;
+} tjscan;
+
+static int findScans(const unsigned char *buf, unsigned long size,
+                     unsigned long *hdrEnd, tjscan *scans, int numScans)
+{
+  unsigned long pos = 2;
+  unsigned int restartInterval = 0;
+  int scan = 0;
+
+  *hdrEnd = 0;
+  if (size < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return -1;
+
+  while (scan < numScans) {
+    unsigned long start = pos;
+    int marker;
+
+    if (pos + 4 > size || buf[pos] != 0xFF) return -1;
+    marker = buf[pos + 1];
+    pos += 2 + (buf[pos + 2] << 8) + buf[pos + 3];
+    if (pos > size) return -1;
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC)
+      *hdrEnd = pos;
+    else if (marker == 0xDD && pos - start == 6)
+      restartInterval = (buf[start + 4] << 8) + buf[start + 5];
+    else if (marker == 0xDA) {
+      for (;;) {
+        const unsigned char *ptr;
+
+        if (pos >= size ||
+            (ptr = (const unsigned char *)memchr(&buf[pos], 0xFF,
+                                                 size - pos)) == NULL)
+          return -1;
+        pos = (unsigned long)(ptr - buf);
+        if (pos + 1 >= size) return -1;
+        if (buf[pos + 1] != 0 &&
+            (buf[pos + 1] < JPEG_RST0 || buf[pos + 1] > JPEG_RST0 + 7))
+          break;
+        pos += 2;
+      }
+      scans[scan].sos = start;
+      scans[scan].end = pos;
+      scans[scan++].restartInterval = restartInterval;
+    }
+  }
+  return *hdrEnd ? 0 : -1;
+}
+
+
+/* Compress a progressive JPEG image in parallel, if possible.  This must be
+   called after setCompDefaults() and before jpeg_start_compress().  Returns 0
+   if the image was successfully compressed, -1 if an error occurred, or 1 if
+   the image cannot be compressed in parallel. */
+
+static int compressScansParallel(tjinstance *this, JSAMPROW *row_pointer,
+                                 int width, int height, int pixelFormat,
+                                 int jpegSubsamp, int jpegQual, int flags)
+{
+  j_compress_ptr cinfo = &this->cinfo;
+  const jpeg_scan_info *script = cinfo->scan_info;
+  int numScans = cinfo->num_scans;
+  tjcompband *bands = NULL;
+  jpeg_scan_info *scripts = NULL;
+  tjscan *scans = NULL;
+  unsigned long *hdrEnds = NULL;
+  unsigned int restartInterval = 0;
+  long *cost = NULL, *load = NULL;
+  int *group = NULL, *worker = NULL, *index = NULL;
+  int last[MAX_COMPONENTS][DCTSIZE2];
+  int numGroups = 0, numWorkers, s, i, k, retval = 1;
+  jmp_buf savedJmpBuf;
+
+  if (this->numThreads < 2 || script == NULL || numScans < 2 ||
+      (script[0].Ss == 0 && script[0].Se == DCTSIZE2 - 1))
+    return 1;
+
+  if ((group = (int *)malloc(sizeof(int) * numScans * 3)) == NULL ||
+      (cost = (long *)malloc(sizeof(long) * numScans * 2)) == NULL)
+    goto bailout;
+  worker = &group[numScans];
+  index = &group[numScans * 2];
+  load = &cost[numScans];
+
+  /* Divide the scans into groups of scans that share coefficients. */
+  for (i = 0; i < MAX_COMPONENTS; i++)
+    for (k = 0; k < DCTSIZE2; k++) last[i][k] = -1;
+  for (s = 0; s < numScans; s++) {
+    group[s] = s;
+    cost[s] = 0;
+    if (script[s].Ss < 0 || script[s].Se >= DCTSIZE2 ||
+        script[s].Se < script[s].Ss)
+      goto bailout;
+    for (i = 0; i < script[s].comps_in_scan; i++) {
+      int ci = script[s].component_index[i];
+
+      if (ci < 0 || ci >= cinfo->num_components) goto bailout;
+      for (k = script[s].Ss; k <= script[s].Se; k++) {
+        if (last[ci][k] >= 0 && group[last[ci][k]] != group[s]) {
+          int g = group[last[ci][k]], t;
+
+          for (t = 0; t < s; t++)
+            if (group[t] == g) group[t] = group[s];
+        }
+        last[ci][k] = s;
+      }
+    }
+  }
+  for (s = 0; s < numScans; s++) {
+    long blocks = 0;
+
+    for (i = 0; i < script[s].comps_in_scan; i++) {
+      jpeg_component_info *compptr =
+        &cinfo->comp_info[script[s].component_index[i]];
+
+      blocks += compptr->h_samp_factor * compptr->v_samp_factor;
+    }
+    cost[group[s]] += blocks * (script[s].Se - script[s].Ss + 1);
+    if (group[s] == s) numGroups++;
+  }
+  numWorkers = min(this->numThreads, numGroups);
+  if (numWorkers < 2) goto bailout;
+
+  /* Assign the most expensive remaining group to the least loaded worker
+     until all groups have been assigned. */
+  for (i = 0; i < numWorkers; i++) load[i] = 0;
+  for (s = 0; s < numScans; s++) worker[s] = -1;
+  for (k = 0; k < numGroups; k++) {
+    int g = -1, w = 0;
+
+    for (s = 0; s < numScans; s++)
+      if (group[s] == s && worker[s] < 0 && (g < 0 || cost[s] > cost[g]))
+        g = s;
+    for (i = 1; i < numWorkers; i++)
+      if (load[i] < load[w]) w = i;
+    worker[g] = w;
+    load[w] += cost[g];
+  }
+
+  if ((bands = (tjcompband *)malloc(sizeof(tjcompband) * numWorkers)) ==
+      NULL ||
+      (scripts = (jpeg_scan_info *)malloc(sizeof(jpeg_scan_info) * numScans *
+                                          numWorkers)) == NULL ||
+      (scans = (tjscan *)malloc(sizeof(tjscan) * numScans * numWorkers)) ==
+      NULL ||
+      (hdrEnds = (unsigned long *)malloc(sizeof(unsigned long) *
+                                         numWorkers)) == NULL)
+    goto bailout;
+  MEMZERO(bands, sizeof(tjcompband) * numWorkers);
+
+  for (i = 0; i < numWorkers; i++) {
+    tjcompband *band = &bands[i];
+    jpeg_scan_info *bandScript = &scripts[numScans * i];
+
+    band->numScans = 0;
+    for (s = 0; s < numScans; s++) {
+      if (worker[group[s]] == i)
+        index[s] = band->numScans;
+      else if (script[s].Ss != 0 || script[s].Ah != 0)
+        continue;
+      bandScript[band->numScans++] = script[s];
+    }
+    band->scanInfo = bandScript;
+    band->rows = row_pointer;
+    band->width = width;
+    band->height = height;
+    band->pixelFormat = pixelFormat;
+    band->subsamp = jpegSubsamp;
+    band->jpegQual = jpegQual;
+    band->flags = flags;
+    band->jpegSize = tjBufSize(width, height, jpegSubsamp);
+    if (band->jpegSize == (unsigned long)-1 ||
+        (band->jpegBuf = (unsigned char *)malloc(band->jpegSize)) == NULL ||
+        (band->inst = getWorker(this, i, COMPRESS)) == NULL)
+      goto bailout;
+  }
+
+  /* From this point on, the image must either be compressed in parallel or
+     not at all. */
+  tjProcYuv444ScanLine(row_pointer, width, height);
+  if ((retval = compressBands(this, bands, numWorkers)) < 0) goto bailout;
+
+  /* Splice the scans together.  The restart interval may vary from scan to
+     scan (if it is specified in MCU rows), so DRI marker segments are
+     regenerated as needed. */
+  for (i = 0; i < numWorkers; i++) {
+    if (findScans(bands[i].jpegBuf, bands[i].jpegSize, &hdrEnds[i],
+                  &scans[numScans * i], bands[i].numScans) < 0) {
+      snprintf(errStr, JMSG_LENGTH_MAX,
+               "tjCompress2(): Could not parse compressed scans");
+      retval = -1;  goto bailout;
+    }
+  }
+  /* The caller's setjmp() buffer becomes invalid when this function returns,
+     so it must be restored afterward. */
+  MEMCOPY(savedJmpBuf, this->jerr.setjmp_buffer, sizeof(jmp_buf));
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto restore;
+  }
+  (*cinfo->dest->init_destination) (cinfo);
+  writeData(cinfo, bands[0].jpegBuf, hdrEnds[0]);
+  for (s = 0; s < numScans; s++) {
+    int w = worker[group[s]], j = index[s];
+    const unsigned char *buf = bands[w].jpegBuf;
+    tjscan *scan = &scans[numScans * w + j];
+    unsigned long pos = j > 0 ? scan[-1].end : hdrEnds[w];
+
+    while (pos < scan->sos) {
+      unsigned long length = 2 + (buf[pos + 2] << 8) + buf[pos + 3];
+
+      if (buf[pos + 1] != 0xDD) writeData(cinfo, &buf[pos], length);
+      pos += length;
+    }
+    if (scan->restartInterval != restartInterval) {
+      unsigned char dri[6] = { 0xFF, 0xDD, 0, 4, 0, 0 };
+
+      dri[4] = (unsigned char)(scan->restartInterval >> 8);
+      dri[5] = (unsigned char)(scan->restartInterval & 0xFF);
+      writeData(cinfo, dri, 6);
+      restartInterval = scan->restartInterval;
+    }
+    writeData(cinfo, &buf[scan->sos], scan->end - scan->sos);
+  }
+  writeData(cinfo, &bands[0].jpegBuf[bands[0].jpegSize - 2], 2);
+  (*cinfo->dest->term_destination) (cinfo);
+
+restore:
+  MEMCOPY(this->jerr.setjmp_buffer, savedJmpBuf, sizeof(jmp_buf));
+
+bailout:
+  if (bands) {
+    for (i = 0; i < numWorkers; i++) free(bands[i].jpegBuf);
+  }
+  free(bands);
+  free(scripts);
+  free(scans);
+  free(hdrEnds);
+  free(group);
+  free(cost);
+  return retval;
+}
+
+#endif
+
+
 DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
                             unsigned long jpegSize, unsigned char *dstBuf,
                             int width, int pitch, int height, int pixelFormat,
@@ -1246,6 +2920,9 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
 {
   JSAMPROW *row_pointer = NULL;
   int i, retval = 0, jpegwidth, jpegheight, scaledw, scaledh;
+#ifdef WITH_THREADS
+  unsigned long hdrSize;
+#endif
 
   GET_DINSTANCE(handle);
   this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
@@ -1268,7 +2945,11 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
   }
 
   jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  restoreTables(this->tables, dinfo);
   jpeg_read_header(dinfo, TRUE);
+#ifdef WITH_THREADS
+  hdrSize = (unsigned long)(dinfo->src->next_input_byte - jpegBuf);
+#endif
   this->dinfo.out_color_space = pf2cs[pixelFormat];
   if (flags & TJFLAG_FASTDCT) this->dinfo.dct_method = JDCT_FASTEST;
   if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
@@ -1304,6 +2985,12 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
     else
       row_pointer[i] = &dstBuf[i * (size_t)pitch];
   }
+#ifdef WITH_THREADS
+  if ((i = decompressParallel(this, jpegBuf, jpegSize, hdrSize, row_pointer,
+                              pixelFormat, flags)) != 1) {
+    retval = i;  goto bailout;
+  }
+#endif
   while (dinfo->output_scanline < dinfo->output_height)
     jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline],
                         dinfo->output_height - dinfo->output_scanline);
@@ -1317,27 +3004,827 @@ bailout:
   return retval;
 }
 
-DLLEXPORT int tjDecompress(tjhandle handle, unsigned char *jpegBuf,
-                           unsigned long jpegSize, unsigned char *dstBuf,
-                           int width, int pitch, int height, int pixelSize,
-                           int flags)
-{
-  if (flags & TJ_YUV)
-    return tjDecompressToYUV(handle, jpegBuf, jpegSize, dstBuf, flags);
-  else
-    return tjDecompress2(handle, jpegBuf, jpegSize, dstBuf, width, pitch,
-                         height, getPixelFormat(pixelSize, flags), flags);
-}
-
 
-static int setDecodeDefaults(struct jpeg_decompress_struct *dinfo,
-                             int pixelFormat, int subsamp, int flags)
+DLLEXPORT unsigned char *tjDecompressFile(tjhandle handle,
+                                          const char *filename, int *width,
+                                          int align, int *height,
+                                          int pixelFormat, int flags)
 {
-  int i;
-
-  dinfo->scale_num = dinfo->scale_denom = 1;
+  int retval = 0, i, jpegWidth, jpegHeight, jpegSubsamp, jpegColorspace,
+    scaledw = 0, scaledh = 0;
+  size_t pitch;
+  tjinstance *this = (tjinstance *)handle;
+  unsigned char *jpegBuf = NULL, *dstBuf = NULL;
+  unsigned long jpegSize = 0;
+  boolean mapped = FALSE;
+  FILE *file = NULL;
+  long fileSize;
 
-  if (subsamp == TJSAMP_GRAY) {
+  if (!this) {
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle");
+    return NULL;
+  }
+  this->jerr.warning = FALSE;
+  this->isInstanceError = FALSE;
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressFile(): Instance has not been initialized for decompression");
+
+  if (!filename || !width || align < 1 || !height || *width < 0 ||
+      *height < 0 || pixelFormat < 0 || pixelFormat >= TJ_NUMPF)
+    THROW("tjDecompressFile(): Invalid argument");
+  if (!IS_POW2(align))
+    THROW("tjDecompressFile(): Alignment must be a power of 2");
+
+  if ((file = fopen(filename, "rb")) == NULL)
+    THROW_UNIX("tjDecompressFile(): Cannot open input file");
+
+  /* Map the file into memory so that the decompressor (and any worker
+     threads) can read the JPEG image without copying it.  If the file cannot
+     be mapped, then read it into a buffer instead. */
+#ifdef HAVE_MMAP
+  {
+    struct stat st;
+    void *map;
+
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0 &&
+        (unsigned long long)st.st_size <= (unsigned long long)((size_t)-1) &&
+        (unsigned long long)st.st_size <= (unsigned long long)ULONG_MAX &&
+        (map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                    fileno(file), 0)) != MAP_FAILED) {
+      jpegBuf = (unsigned char *)map;
+      jpegSize = (unsigned long)st.st_size;
+      mapped = TRUE;
+    }
+  }
+#endif
+  if (!mapped) {
+    if (fseek(file, 0, SEEK_END) < 0 || (fileSize = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) < 0)
+      THROW_UNIX("tjDecompressFile(): Could not determine input file size");
+    if (fileSize == 0)
+      THROW("tjDecompressFile(): Input file contains no data");
+    jpegSize = (unsigned long)fileSize;
+    if ((jpegBuf = (unsigned char *)malloc(jpegSize)) == NULL)
+      THROW("tjDecompressFile(): Memory allocation failure");
+    if (fread(jpegBuf, jpegSize, 1, file) < 1)
+      THROW_UNIX("tjDecompressFile(): Could not read input file");
+  }
+  fclose(file);  file = NULL;
+
+  if (tjDecompressHeader3(handle, jpegBuf, jpegSize, &jpegWidth, &jpegHeight,
+                          &jpegSubsamp, &jpegColorspace) < 0) {
+    retval = -1;  goto bailout;
+  }
+
+  if (*width == 0) *width = jpegWidth;
+  if (*height == 0) *height = jpegHeight;
+  for (i = 0; i < NUMSF; i++) {
+    scaledw = TJSCALED(jpegWidth, sf[i]);
+    scaledh = TJSCALED(jpegHeight, sf[i]);
+    if (scaledw <= *width && scaledh <= *height)
+      break;
+  }
+  if (i >= NUMSF)
+    THROW("tjDecompressFile(): Could not scale down to desired image dimensions");
+
+  pitch = PAD((size_t)scaledw * tjPixelSize[pixelFormat], (size_t)align);
+  if (pitch > (size_t)INT_MAX ||
+      (unsigned long long)pitch * (unsigned long long)scaledh >
+      (unsigned long long)((size_t)-1) ||
+      (dstBuf = (unsigned char *)malloc(pitch * scaledh)) == NULL)
+    THROW("tjDecompressFile(): Memory allocation failure");
+
+  /* Warnings are not fatal unless TJFLAG_STOPONWARNING is specified, in which
+     case the image was not completely decompressed. */
+  if (tjDecompress2(handle, jpegBuf, jpegSize, dstBuf, scaledw, (int)pitch,
+                    scaledh, pixelFormat, flags) < 0 &&
+      (!this->jerr.warning || (flags & TJFLAG_STOPONWARNING))) {
+    retval = -1;  goto bailout;
+  }
+  *width = scaledw;  *height = scaledh;
+
+bailout:
+  if (file) fclose(file);
+#ifdef HAVE_MMAP
+  if (mapped) munmap(jpegBuf, (size_t)jpegSize);
+  else
+#endif
+    free(jpegBuf);
+  if (retval < 0) { free(dstBuf);  dstBuf = NULL; }
+  return dstBuf;
+}
+
+
+DLLEXPORT int tjDecompressResized(tjhandle handle,
+                                  const unsigned char *jpegBuf,
+                                  unsigned long jpegSize,
+                                  unsigned char *dstBuf, int width, int pitch,
+                                  int height, int pixelFormat, int filter,
+                                  int flags)
+{
+  JSAMPROW *row_pointer = NULL;
+  JSAMPARRAY srcRows;
+  tjresizer resizer;
+  int i, retval = 0, jpegwidth, jpegheight, n;
+
+  GET_DINSTANCE(handle);
+  MEMZERO(&resizer, sizeof(tjresizer));
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressResized(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || dstBuf == NULL || width <= 0 ||
+      pitch < 0 || height <= 0 || pixelFormat < 0 ||
+      pixelFormat >= TJ_NUMPF || filter < 0 || filter >= TJ_NUMFILTER)
+    THROW("tjDecompressResized(): Invalid argument");
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  restoreTables(this->tables, dinfo);
+  jpeg_read_header(dinfo, TRUE);
+  this->dinfo.out_color_space = pf2cs[pixelFormat];
+  if (flags & TJFLAG_FASTDCT) this->dinfo.dct_method = JDCT_FASTEST;
+  if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+
+  /* Let the decompressor do as much of the size reduction as possible by
+     using the smallest scaling factor that produces an image at least as large
+     as the destination image. */
+  jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
+  for (i = NUMSF - 1; i > 0; i--) {
+    if (TJSCALED(jpegwidth, sf[i]) >= width &&
+        TJSCALED(jpegheight, sf[i]) >= height)
+      break;
+  }
+  dinfo->scale_num = sf[i].num;
+  dinfo->scale_denom = sf[i].denom;
+
+  jpeg_start_decompress(dinfo);
+  if (pitch == 0) pitch = width * tjPixelSize[pixelFormat];
+
+  if ((row_pointer = (JSAMPROW *)malloc(sizeof(JSAMPROW) * height)) == NULL)
+    THROW("tjDecompressResized(): Memory allocation failure");
+  for (i = 0; i < height; i++) {
+    if (flags & TJFLAG_BOTTOMUP)
+      row_pointer[i] = &dstBuf[(height - i - 1) * (size_t)pitch];
+    else
+      row_pointer[i] = &dstBuf[i * (size_t)pitch];
+  }
+
+  if ((int)dinfo->output_width == width &&
+      (int)dinfo->output_height == height) {
+    if (setjmp(this->jerr.setjmp_buffer)) {
+      /* If we get here, the JPEG code has signaled an error. */
+      retval = -1;  goto bailout;
+    }
+    while (dinfo->output_scanline < dinfo->output_height)
+      jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline],
+                          dinfo->output_height - dinfo->output_scanline);
+  } else {
+    if (tjResizerInit(&resizer, dinfo->output_width, dinfo->output_height,
+                      width, height, tjPixelSize[pixelFormat], filter) < 0)
+      THROW("tjDecompressResized(): Memory allocation failure");
+    if (setjmp(this->jerr.setjmp_buffer)) {
+      /* If we get here, the JPEG code has signaled an error. */
+      retval = -1;  goto bailout;
+    }
+    srcRows = (*dinfo->mem->alloc_sarray)
+      ((j_common_ptr)dinfo, JPOOL_IMAGE,
+       dinfo->output_width * tjPixelSize[pixelFormat],
+       dinfo->rec_outbuf_height);
+    while (dinfo->output_scanline < dinfo->output_height) {
+      n = jpeg_read_scanlines(dinfo, srcRows, dinfo->rec_outbuf_height);
+      for (i = 0; i < n; i++)
+        tjResizerPushRow(&resizer, srcRows[i], row_pointer);
+    }
+  }
+  jpeg_finish_decompress(dinfo);
+
+bailout:
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  tjResizerFree(&resizer);
+  free(row_pointer);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+DLLEXPORT int tjDecompressRegion(tjhandle handle,
+                                 const unsigned char *jpegBuf,
+                                 unsigned long jpegSize, unsigned char *dstBuf,
+                                 int x, int y, int width, int pitch,
+                                 int height, int pixelFormat, int flags)
+{
+  JSAMPROW *row_pointer = NULL;
+  JSAMPARRAY tmpRows = NULL;
+  JDIMENSION xoffset, cropWidth, right;
+  int i, retval = 0, ps, n, skipCols;
+
+  GET_DINSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressRegion(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || dstBuf == NULL || x < 0 || y < 0 ||
+      width <= 0 || pitch < 0 || height <= 0 || pixelFormat < 0 ||
+      pixelFormat >= TJ_NUMPF)
+    THROW("tjDecompressRegion(): Invalid argument");
+  ps = tjPixelSize[pixelFormat];
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  restoreTables(this->tables, dinfo);
+  jpeg_read_header(dinfo, TRUE);
+  this->dinfo.out_color_space = pf2cs[pixelFormat];
+  if (flags & TJFLAG_FASTDCT) this->dinfo.dct_method = JDCT_FASTEST;
+  if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+
+  if ((JDIMENSION)x >= dinfo->image_width ||
+      (JDIMENSION)width > dinfo->image_width - x ||
+      (JDIMENSION)y >= dinfo->image_height ||
+      (JDIMENSION)height > dinfo->image_height - y)
+    THROW("tjDecompressRegion(): Region is outside of the JPEG image");
+
+  jpeg_start_decompress(dinfo);
+  if (pitch == 0) pitch = width * ps;
+
+  /* The fancy upsampling algorithms use the neighboring samples of each
+     sample, and they replicate the edge samples at the left and right edges
+     of the cropped region.  Thus, we crop one extra column on either side of
+     the region (if possible) so that the pixels in the region are the same as
+     those produced by decompressing the whole image.  jpeg_crop_scanline()
+     may further widen the cropped region to the left so that it is aligned
+     with an iMCU boundary. */
+  xoffset = x > 0 ? x - 1 : 0;
+  right = (JDIMENSION)(x + width) < dinfo->output_width ? x + width + 1 :
+                                                          x + width;
+  cropWidth = right - xoffset;
+  jpeg_crop_scanline(dinfo, &xoffset, &cropWidth);
+  skipCols = x - (int)xoffset;
+
+  if ((row_pointer = (JSAMPROW *)malloc(sizeof(JSAMPROW) * height)) == NULL)
+    THROW("tjDecompressRegion(): Memory allocation failure");
+  for (i = 0; i < height; i++) {
+    if (flags & TJFLAG_BOTTOMUP)
+      row_pointer[i] = &dstBuf[(height - i - 1) * (size_t)pitch];
+    else
+      row_pointer[i] = &dstBuf[i * (size_t)pitch];
+  }
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+  if (y > 0) jpeg_skip_scanlines(dinfo, y);
+
+  if (skipCols == 0 && (int)cropWidth == width) {
+    while ((int)dinfo->output_scanline < y + height)
+      jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline - y],
+                          y + height - dinfo->output_scanline);
+  } else {
+    tmpRows = (*dinfo->mem->alloc_sarray)
+      ((j_common_ptr)dinfo, JPOOL_IMAGE, cropWidth * ps,
+       dinfo->rec_outbuf_height);
+    while ((int)dinfo->output_scanline < y + height) {
+      int row = dinfo->output_scanline - y;
+
+      n = jpeg_read_scanlines(dinfo, tmpRows, dinfo->rec_outbuf_height);
+      for (i = 0; i < n && row + i < height; i++)
+        memcpy(row_pointer[row + i], &tmpRows[i][skipCols * ps],
+               (size_t)width * ps);
+    }
+  }
+
+  /* The remaining rows of the JPEG image are not needed, so the
+     decompression is aborted (in the bailout block) rather than finished. */
+
+bailout:
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  free(row_pointer);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+/* Batch decompression
+
+   tjDecompressBatch() decompresses each image in the batch using
+   tjDecompress2().  Apart from avoiding the per-call overhead, this allows the
+   underlying decompressor to reuse the derived Huffman tables from the
+   previous image.  If multiple threads have been requested, then the batch is
+   split into slices of consecutive images, and each slice is decompressed by
+   a separate worker instance in a separate thread.  (In that case, the
+   worker instances are single-threaded, so the images themselves are not
+   decompressed in parallel.) */
+
+typedef struct {
+  tjinstance *inst;
+  const unsigned char **jpegBufs;
+  const unsigned long *jpegSizes;
+  unsigned char **dstBufs;
+  int numImages, width, pitch, height, pixelFormat, flags;
+  int retval;
+  boolean warning;
+  char errStr[JMSG_LENGTH_MAX];
+} tjdecompslice;
+
+
+static void decompressSlice(void *arg)
+{
+  tjdecompslice *slice = (tjdecompslice *)arg;
+  tjhandle handle = (tjhandle)slice->inst;
+  int n;
+
+  slice->retval = 0;
+  slice->warning = FALSE;
+
+  for (n = 0; n < slice->numImages; n++) {
+    if (tjDecompress2(handle, slice->jpegBufs[n], slice->jpegSizes[n],
+                      slice->dstBufs[n], slice->width, slice->pitch,
+                      slice->height, slice->pixelFormat, slice->flags) < 0) {
+      boolean warning = tjGetErrorCode(handle) == TJERR_WARNING;
+
+      /* Keep the first warning, unless it is followed by an error. */
+      if (!warning || !slice->warning)
+        snprintf(slice->errStr, JMSG_LENGTH_MAX, "%s",
+                 tjGetErrorStr2(handle));
+      if (!warning) {
+        slice->retval = -1;  break;
+      }
+      slice->warning = TRUE;
+      if (slice->flags & TJFLAG_STOPONWARNING) break;
+    }
+  }
+}
+
+
+DLLEXPORT int tjDecompressBatch(tjhandle handle, int numImages,
+                                const unsigned char **jpegBufs,
+                                const unsigned long *jpegSizes,
+                                unsigned char **dstBufs, int width, int pitch,
+                                int height, int pixelFormat, int flags)
+{
+  tjdecompslice *slices = NULL;
+  int i, numSlices = 1, numStarted = 0, retval = 0;
+  boolean warning = FALSE;
+#ifdef WITH_THREADS
+  tjthread *threads = NULL;
+#endif
+
+  GET_TJINSTANCE(handle)
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressBatch(): Instance has not been initialized for decompression");
+
+  if (numImages <= 0 || jpegBufs == NULL || jpegSizes == NULL ||
+      dstBufs == NULL || width < 0 || pitch < 0 || height < 0 ||
+      pixelFormat < 0 || pixelFormat >= TJ_NUMPF)
+    THROW("tjDecompressBatch(): Invalid argument");
+  for (i = 0; i < numImages; i++) {
+    if (jpegBufs[i] == NULL || jpegSizes[i] <= 0 || dstBufs[i] == NULL)
+      THROW("tjDecompressBatch(): Invalid argument");
+  }
+
+#ifdef WITH_THREADS
+  numSlices = max(min(this->numThreads, numImages), 1);
+  if (numSlices > 1 &&
+      (threads = (tjthread *)malloc(sizeof(tjthread) * numSlices)) == NULL)
+    THROW("tjDecompressBatch(): Memory allocation failure");
+#endif
+  if ((slices =
+       (tjdecompslice *)malloc(sizeof(tjdecompslice) * numSlices)) == NULL)
+    THROW("tjDecompressBatch(): Memory allocation failure");
+  MEMZERO(slices, sizeof(tjdecompslice) * numSlices);
+
+  for (i = 0; i < numSlices; i++) {
+    tjdecompslice *slice = &slices[i];
+    int first = (int)((long)numImages * i / numSlices);
+    int next = (int)((long)numImages * (i + 1) / numSlices);
+
+    slice->jpegBufs = &jpegBufs[first];
+    slice->jpegSizes = &jpegSizes[first];
+    slice->dstBufs = &dstBufs[first];
+    slice->numImages = next - first;
+    slice->width = width;
+    slice->pitch = pitch;
+    slice->height = height;
+    slice->pixelFormat = pixelFormat;
+    slice->flags = flags;
+    slice->inst = this;
+#ifdef WITH_THREADS
+    /* The main instance may itself use worker instances to decompress an
+       image in parallel, so it is used only if there is a single slice. */
+    if (numSlices > 1 &&
+        (slice->inst = getWorker(this, i, DECOMPRESS)) == NULL)
+      THROW("tjDecompressBatch(): Memory allocation failure");
+#endif
+  }
+
+#ifdef WITH_THREADS
+  for (i = 1; i < numSlices; i++) {
+    if (tjThreadCreate(&threads[i], decompressSlice, &slices[i]) < 0) {
+      snprintf(errStr, JMSG_LENGTH_MAX,
+               "tjDecompressBatch(): Could not create thread");
+      retval = -1;  break;
+    }
+    numStarted++;
+  }
+#endif
+  if (retval == 0) decompressSlice(&slices[0]);
+
+  /* Report the first error in the batch, or the first warning if no error
+     occurred. */
+  this->isInstanceError = FALSE;
+  for (i = 0; i <= numStarted; i++) {
+#ifdef WITH_THREADS
+    if (i > 0) tjThreadJoin(threads[i]);
+#endif
+    if (slices[i].retval < 0) {
+      if (retval == 0)
+        snprintf(errStr, JMSG_LENGTH_MAX, "%s", slices[i].errStr);
+      retval = -1;
+    } else if (slices[i].warning) {
+      if (retval == 0 && !warning)
+        snprintf(errStr, JMSG_LENGTH_MAX, "%s", slices[i].errStr);
+      warning = TRUE;
+    }
+  }
+  this->jerr.warning = warning && retval == 0;
+  if (warning) retval = -1;
+
+bailout:
+  free(slices);
+#ifdef WITH_THREADS
+  free(threads);
+#endif
+  return retval;
+}
+
+
+DLLEXPORT int tjDecompress(tjhandle handle, unsigned char *jpegBuf,
+                           unsigned long jpegSize, unsigned char *dstBuf,
+                           int width, int pitch, int height, int pixelSize,
+                           int flags)
+{
+  if (flags & TJ_YUV)
+    return tjDecompressToYUV(handle, jpegBuf, jpegSize, dstBuf, flags);
+  else
+    return tjDecompress2(handle, jpegBuf, jpegSize, dstBuf, width, pitch,
+                         height, getPixelFormat(pixelSize, flags), flags);
+}
+
+
+/* Incremental decompression
+
+   The stream source manager suspends the decompressor whenever it runs out of
+   data, until the end of the stream has been signaled.  (Only then does it
+   insert a fake EOI marker.)  When suspending, the decompressor backs up to
+   the last point from which it can resume (typically the start of the current
+   MCU), so tjDecompressStreamPush() moves the unconsumed data to the
+   beginning of the buffer before appending the new data.  Thus, the buffer
+   never holds more than the unconsumed data and the newly-pushed data. */
+
+static void stream_init_source(j_decompress_ptr dinfo)
+{
+}
+
+static boolean stream_fill_input_buffer(j_decompress_ptr dinfo)
+{
+  static const JOCTET eoi[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+  tjdecompstream *stream = (tjdecompstream *)dinfo->src;
+
+  if (!stream->endOfStream) return FALSE;
+
+  WARNMS(dinfo, JWRN_JPEG_EOF);
+  stream->pub.next_input_byte = eoi;
+  stream->pub.bytes_in_buffer = 2;
+  return TRUE;
+}
+
+static void stream_skip_input_data(j_decompress_ptr dinfo, long num_bytes)
+{
+  tjdecompstream *stream = (tjdecompstream *)dinfo->src;
+
+  if (num_bytes <= 0) return;
+  if ((size_t)num_bytes > stream->pub.bytes_in_buffer) {
+    /* The rest of the skipped data will be discarded when it is pushed. */
+    stream->skipBytes += (size_t)num_bytes - stream->pub.bytes_in_buffer;
+    stream->pub.next_input_byte += stream->pub.bytes_in_buffer;
+    stream->pub.bytes_in_buffer = 0;
+  } else {
+    stream->pub.next_input_byte += (size_t)num_bytes;
+    stream->pub.bytes_in_buffer -= (size_t)num_bytes;
+  }
+}
+
+static void stream_term_source(j_decompress_ptr dinfo)
+{
+}
+
+
+DLLEXPORT int tjDecompressStreamStart(tjhandle handle)
+{
+  tjdecompstream *stream;
+  int retval = 0;
+
+  GET_DINSTANCE(handle);
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressStreamStart(): Instance has not been initialized for decompression");
+
+  if (this->dstream == NULL) {
+    if ((this->dstream =
+         (tjdecompstream *)malloc(sizeof(tjdecompstream))) == NULL)
+      THROW("tjDecompressStreamStart(): Memory allocation failure");
+    MEMZERO(this->dstream, sizeof(tjdecompstream));
+  }
+  stream = this->dstream;
+  dinfo = &stream->dinfo;
+  stream->state = STREAM_NONE;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  if (dinfo->global_state == 0) {
+    dinfo->err = &this->jerr.pub;
+    jpeg_create_decompress(dinfo);
+    dinfo->src = &stream->pub;
+    stream->pub.init_source = stream_init_source;
+    stream->pub.fill_input_buffer = stream_fill_input_buffer;
+    stream->pub.skip_input_data = stream_skip_input_data;
+    stream->pub.resync_to_restart = jpeg_resync_to_restart;
+    stream->pub.term_source = stream_term_source;
+  } else
+    jpeg_abort_decompress(dinfo);
+
+  stream->pub.next_input_byte = stream->buf;
+  stream->pub.bytes_in_buffer = 0;
+  stream->skipBytes = 0;
+  stream->endOfStream = FALSE;
+  stream->rows = 0;
+  restoreTables(this->tables, dinfo);
+  stream->state = STREAM_HEADER;
+
+bailout:
+  return retval;
+}
+
+
+DLLEXPORT int tjDecompressStreamPush(tjhandle handle,
+                                     const unsigned char *jpegBuf,
+                                     unsigned long jpegSize, int endOfStream)
+{
+  tjdecompstream *stream;
+  size_t size = (size_t)jpegSize, skip, avail;
+  int retval = 0;
+
+  GET_TJINSTANCE(handle);
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressStreamPush(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL && jpegSize > 0)
+    THROW("tjDecompressStreamPush(): Invalid argument");
+  if ((stream = this->dstream) == NULL || stream->state == STREAM_NONE)
+    THROW("tjDecompressStreamPush(): No stream is in progress");
+  if (stream->endOfStream)
+    THROW("tjDecompressStreamPush(): The end of the stream has already been signaled");
+
+  /* Any data following the end of the image is not needed. */
+  if (stream->state == STREAM_DONE) size = 0;
+
+  skip = min(stream->skipBytes, size);
+  stream->skipBytes -= skip;
+  jpegBuf += skip;  size -= skip;
+
+  if (size > 0) {
+    avail = stream->pub.bytes_in_buffer;
+    if (avail > 0 && stream->pub.next_input_byte != stream->buf)
+      memmove(stream->buf, stream->pub.next_input_byte, avail);
+    stream->pub.next_input_byte = stream->buf;
+
+    if (size > (size_t)-1 - avail)
+      THROW("tjDecompressStreamPush(): Stream buffer is too large");
+    if (avail + size > stream->bufSize) {
+      size_t newSize = max(avail + size, stream->bufSize * 2);
+      unsigned char *newBuf = (unsigned char *)realloc(stream->buf, newSize);
+
+      if (newBuf == NULL)
+        THROW("tjDecompressStreamPush(): Memory allocation failure");
+      stream->buf = newBuf;  stream->bufSize = newSize;
+      stream->pub.next_input_byte = stream->buf;
+    }
+    memcpy(&stream->buf[avail], jpegBuf, size);
+    stream->pub.bytes_in_buffer = avail + size;
+  }
+  if (endOfStream) stream->endOfStream = TRUE;
+
+bailout:
+  return retval;
+}
+
+
+DLLEXPORT int tjDecompressStreamHeader(tjhandle handle, int *width,
+                                       int *height, int *jpegSubsamp,
+                                       int *jpegColorspace)
+{
+  tjdecompstream *stream;
+  int retval = 1;
+
+  GET_DINSTANCE(handle);
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressStreamHeader(): Instance has not been initialized for decompression");
+
+  if (width == NULL || height == NULL || jpegSubsamp == NULL ||
+      jpegColorspace == NULL)
+    THROW("tjDecompressStreamHeader(): Invalid argument");
+  if ((stream = this->dstream) == NULL || stream->state == STREAM_NONE)
+    THROW("tjDecompressStreamHeader(): No stream is in progress");
+  dinfo = &stream->dinfo;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error, and the stream
+       cannot be resumed. */
+    jpeg_abort_decompress(dinfo);
+    stream->state = STREAM_NONE;
+    retval = -1;  goto bailout;
+  }
+
+  if (stream->state == STREAM_HEADER) {
+    if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED) {
+      retval = 0;  goto bailout;
+    }
+    stream->state = STREAM_READY;
+  }
+
+  *width = dinfo->image_width;
+  *height = dinfo->image_height;
+  *jpegSubsamp = getSubsamp(dinfo);
+  switch (dinfo->jpeg_color_space) {
+  case JCS_GRAYSCALE:  *jpegColorspace = TJCS_GRAY;  break;
+  case JCS_RGB:        *jpegColorspace = TJCS_RGB;  break;
+  case JCS_YCbCr:      *jpegColorspace = TJCS_YCbCr;  break;
+  case JCS_CMYK:       *jpegColorspace = TJCS_CMYK;  break;
+  case JCS_YCCK:       *jpegColorspace = TJCS_YCCK;  break;
+  default:             *jpegColorspace = -1;  break;
+  }
+
+  if (*jpegSubsamp < 0)
+    THROW("tjDecompressStreamHeader(): Could not determine subsampling type for JPEG image");
+  if (*jpegColorspace < 0)
+    THROW("tjDecompressStreamHeader(): Could not determine colorspace of JPEG image");
+  if (*width < 1 || *height < 1)
+    THROW("tjDecompressStreamHeader(): Invalid data returned in header");
+
+bailout:
+  if (this->jerr.warning) retval = -1;
+  return retval;
+}
+
+
+DLLEXPORT int tjDecompressStreamRows(tjhandle handle, unsigned char *dstBuf,
+                                     int width, int pitch, int height,
+                                     int pixelFormat, int flags)
+{
+  tjdecompstream *stream;
+  int i, retval = 0, jpegwidth, jpegheight, scaledw, scaledh;
+
+  GET_DINSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressStreamRows(): Instance has not been initialized for decompression");
+
+  if (dstBuf == NULL || width < 0 || pitch < 0 || height < 0 ||
+      pixelFormat < 0 || pixelFormat >= TJ_NUMPF)
+    THROW("tjDecompressStreamRows(): Invalid argument");
+  if ((stream = this->dstream) == NULL || stream->state == STREAM_NONE)
+    THROW("tjDecompressStreamRows(): No stream is in progress");
+  if (stream->state >= STREAM_START &&
+      (pixelFormat != stream->pixelFormat || width != stream->width ||
+       height != stream->height))
+    THROW("tjDecompressStreamRows(): Destination image parameters cannot change while decompressing a stream");
+  dinfo = &stream->dinfo;
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error, and the stream
+       cannot be resumed. */
+    jpeg_abort_decompress(dinfo);
+    stream->state = STREAM_NONE;
+    retval = -1;  goto bailout;
+  }
+
+  if (stream->state == STREAM_HEADER) {
+    if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED) goto bailout;
+    stream->state = STREAM_READY;
+  }
+
+  if (stream->state == STREAM_READY) {
+    JSAMPROW *rowPointers;
+
+    dinfo->out_color_space = pf2cs[pixelFormat];
+    if (flags & TJFLAG_FASTDCT) dinfo->dct_method = JDCT_FASTEST;
+    if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+
+    jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
+    stream->width = width;  stream->height = height;
+    if (width == 0) width = jpegwidth;
+    if (height == 0) height = jpegheight;
+    for (i = 0; i < NUMSF; i++) {
+      scaledw = TJSCALED(jpegwidth, sf[i]);
+      scaledh = TJSCALED(jpegheight, sf[i]);
+      if (scaledw <= width && scaledh <= height)
+        break;
+    }
+    if (i >= NUMSF)
+      THROW("tjDecompressStreamRows(): Could not scale down to desired image dimensions");
+    dinfo->scale_num = sf[i].num;
+    dinfo->scale_denom = sf[i].denom;
+
+    if ((rowPointers = (JSAMPROW *)realloc(stream->rowPointers,
+                                           sizeof(JSAMPROW) * scaledh)) ==
+        NULL)
+      THROW("tjDecompressStreamRows(): Memory allocation failure");
+    stream->rowPointers = rowPointers;
+    stream->pixelFormat = pixelFormat;
+    stream->state = STREAM_START;
+  }
+
+  if (stream->state == STREAM_START) {
+    /* This absorbs all of the scans of a multi-scan JPEG image, so rows are
+       produced only once the final scan has been pushed. */
+    if (!jpeg_start_decompress(dinfo)) goto bailout;
+    stream->state = STREAM_ROWS;
+  }
+
+  if (stream->state == STREAM_ROWS) {
+    if (pitch == 0) pitch = dinfo->output_width * tjPixelSize[pixelFormat];
+    for (i = dinfo->output_scanline; i < (int)dinfo->output_height; i++) {
+      if (flags & TJFLAG_BOTTOMUP)
+        stream->rowPointers[i] =
+          &dstBuf[(dinfo->output_height - i - 1) * (size_t)pitch];
+      else
+        stream->rowPointers[i] = &dstBuf[i * (size_t)pitch];
+    }
+    /* jpeg_read_scanlines() returns 0 if the decompressor has suspended. */
+    while (dinfo->output_scanline < dinfo->output_height) {
+      if (jpeg_read_scanlines(dinfo,
+                              &stream->rowPointers[dinfo->output_scanline],
+                              dinfo->output_height -
+                              dinfo->output_scanline) == 0)
+        break;
+    }
+    stream->rows = dinfo->output_scanline;
+    if (dinfo->output_scanline >= dinfo->output_height) {
+      /* There is no need to wait for the remainder of the datastream once
+         all of the rows have been produced. */
+      jpeg_abort_decompress(dinfo);
+      stream->state = STREAM_DONE;
+    }
+  }
+  retval = stream->rows;
+
+bailout:
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+static int setDecodeDefaults(struct jpeg_decompress_struct *dinfo,
+                             int pixelFormat, int subsamp, int flags)
+{
+  int i;
+
+  dinfo->scale_num = dinfo->scale_denom = 1;
+
+  if (subsamp == TJSAMP_GRAY) {
     dinfo->num_components = dinfo->comps_in_scan = 1;
     dinfo->jpeg_color_space = JCS_GRAYSCALE;
   } else {
@@ -1608,6 +4095,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
 
   if (!this->headerRead) {
     jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+    restoreTables(this->tables, dinfo);
     jpeg_read_header(dinfo, TRUE);
   }
   this->headerRead = 0;
@@ -1707,6 +4195,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
           sf[sfi].num / sf[sfi].denom *
           compptr->v_samp_factor / dinfo->max_v_samp_factor;
         dinfo->idct->inverse_DCT[i] = dinfo->idct->inverse_DCT[0];
+        dinfo->idct->inverse_DCT_pair[i] = dinfo->idct->inverse_DCT_pair[0];
       }
       crow[i] = row * compptr->v_samp_factor / dinfo->max_v_samp_factor;
       if (usetmpbuf) yuvptr[i] = tmpbuf[i];
@@ -1755,19 +4244,169 @@ DLLEXPORT int tjDecompressToYUV2(tjhandle handle, const unsigned char *jpegBuf,
 
   if (setjmp(this->jerr.setjmp_buffer)) {
     /* If we get here, the JPEG code has signaled an error. */
-    return -1;
+    return -1;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  restoreTables(this->tables, dinfo);
+  jpeg_read_header(dinfo, TRUE);
+  jpegSubsamp = getSubsamp(dinfo);
+  if (jpegSubsamp < 0)
+    THROW("tjDecompressToYUV2(): Could not determine subsampling type for JPEG image");
+
+  jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
+  if (width == 0) width = jpegwidth;
+  if (height == 0) height = jpegheight;
+
+  for (i = 0; i < NUMSF; i++) {
+    scaledw = TJSCALED(jpegwidth, sf[i]);
+    scaledh = TJSCALED(jpegheight, sf[i]);
+    if (scaledw <= width && scaledh <= height)
+      break;
+  }
+  if (i >= NUMSF)
+    THROW("tjDecompressToYUV2(): Could not scale down to desired image dimensions");
+
+  pw0 = tjPlaneWidth(0, width, jpegSubsamp);
+  ph0 = tjPlaneHeight(0, height, jpegSubsamp);
+  dstPlanes[0] = dstBuf;
+  strides[0] = PAD(pw0, pad);
+  if (jpegSubsamp == TJSAMP_GRAY) {
+    strides[1] = strides[2] = 0;
+    dstPlanes[1] = dstPlanes[2] = NULL;
+  } else {
+    int pw1 = tjPlaneWidth(1, width, jpegSubsamp);
+    int ph1 = tjPlaneHeight(1, height, jpegSubsamp);
+
+    strides[1] = strides[2] = PAD(pw1, pad);
+    dstPlanes[1] = dstPlanes[0] + strides[0] * ph0;
+    dstPlanes[2] = dstPlanes[1] + strides[1] * ph1;
+  }
+
+  this->headerRead = 1;
+  return tjDecompressToYUVPlanes(handle, jpegBuf, jpegSize, dstPlanes, width,
+                                 strides, height, flags);
+
+bailout:
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+DLLEXPORT int tjDecompressToYUV(tjhandle handle, unsigned char *jpegBuf,
+                                unsigned long jpegSize, unsigned char *dstBuf,
+                                int flags)
+{
+  return tjDecompressToYUV2(handle, jpegBuf, jpegSize, dstBuf, 0, 4, 0, flags);
+}
+
+
+/* Semi-planar YUV decompression
+
+   tjDecompressToNV() uses the raw data interface, as tjDecompressToYUVPlanes()
+   does.  The chrominance components of each iMCU row are decompressed into a
+   small intermediate buffer and immediately interleaved into the chrominance
+   plane of the destination image while they are still in the CPU cache, so
+   no intermediate planar image is generated.  When the JPEG image does not use
+   4:2:0 subsampling, the chrominance components are also downsampled (by
+   averaging) as they are interleaved.  The Y component is decompressed
+   directly into the destination image whenever the iMCU row fits. */
+
+/* Interleave one line of U (Cb) and V (Cr) samples into a line of a
+   semi-planar chrominance plane.  If fx == 2, then each pair of source
+   columns is averaged, and the last source column is replicated if
+   necessary.  If u1 and v1 are non-NULL, then they point to a second source
+   line, which is averaged with the first. */
+
+static void interleaveNV(const JSAMPLE *u0, const JSAMPLE *v0,
+                         const JSAMPLE *u1, const JSAMPLE *v1,
+                         unsigned char *dst, int dstw, int srcw, int fx,
+                         int nvFormat)
+{
+  unsigned char *du = dst, *dv = dst + 1;
+  int i;
+
+  if (nvFormat == TJNV_NV21) {
+    du = dst + 1;  dv = dst;
+  }
+
+  if (fx == 1 && !u1) {
+    for (i = 0; i < dstw; i++) {
+      du[i * 2] = (unsigned char)u0[i];
+      dv[i * 2] = (unsigned char)v0[i];
+    }
+    return;
+  }
+
+  for (i = 0; i < dstw; i++) {
+    int j0 = i * fx, j1 = MIN(j0 + fx - 1, srcw - 1), u, v;
+
+    u = u0[j0] + u0[j1];
+    v = v0[j0] + v0[j1];
+    if (u1) {
+      u += u1[j0] + u1[j1];
+      v += v1[j0] + v1[j1];
+      du[i * 2] = (unsigned char)((u + 2) >> 2);
+      dv[i * 2] = (unsigned char)((v + 2) >> 2);
+    } else {
+      du[i * 2] = (unsigned char)((u + 1) >> 1);
+      dv[i * 2] = (unsigned char)((v + 1) >> 1);
+    }
+  }
+}
+
+DLLEXPORT int tjDecompressToNV(tjhandle handle, const unsigned char *jpegBuf,
+                               unsigned long jpegSize,
+                               unsigned char **dstPlanes, int width,
+                               int *strides, int height, int nvFormat,
+                               int flags)
+{
+  int i, j, sfi, row, retval = 0, dctsize;
+  int jpegwidth, jpegheight, jpegSubsamp, scaledw, scaledh;
+  int iw[MAX_COMPONENTS], th[MAX_COMPONENTS], sw[MAX_COMPONENTS],
+    sh[MAX_COMPONENTS], tmpbufsize = 0;
+  int pw0, ph0, pw1, ph1, ystride, uvstride, fx, fy, pending = 0;
+  JSAMPLE *_tmpbuf = NULL, *pendU = NULL, *pendV = NULL, *ptr;
+  JSAMPROW *tmpbuf[MAX_COMPONENTS], *ybuf = NULL;
+  unsigned char *yplane, *uvplane;
+
+  GET_DINSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+
+  for (i = 0; i < MAX_COMPONENTS; i++) tmpbuf[i] = NULL;
+
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressToNV(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || !dstPlanes || !dstPlanes[0] ||
+      !dstPlanes[1] || width < 0 || height < 0 || nvFormat < 0 ||
+      nvFormat >= TJ_NUMNV)
+    THROW("tjDecompressToNV(): Invalid argument");
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
   }
 
   jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  restoreTables(this->tables, dinfo);
   jpeg_read_header(dinfo, TRUE);
   jpegSubsamp = getSubsamp(dinfo);
   if (jpegSubsamp < 0)
-    THROW("tjDecompressToYUV2(): Could not determine subsampling type for JPEG image");
+    THROW("tjDecompressToNV(): Could not determine subsampling type for JPEG image");
+  if (jpegSubsamp == TJSAMP_411)
+    THROW("tjDecompressToNV(): 4:1:1 subsampling is not supported");
+  if (dinfo->num_components > 3)
+    THROW("tjDecompressToNV(): JPEG image must have 3 or fewer components");
 
   jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
   if (width == 0) width = jpegwidth;
   if (height == 0) height = jpegheight;
-
   for (i = 0; i < NUMSF; i++) {
     scaledw = TJSCALED(jpegwidth, sf[i]);
     scaledh = TJSCALED(jpegheight, sf[i]);
@@ -1775,40 +4414,150 @@ DLLEXPORT int tjDecompressToYUV2(tjhandle handle, const unsigned char *jpegBuf,
       break;
   }
   if (i >= NUMSF)
-    THROW("tjDecompressToYUV2(): Could not scale down to desired image dimensions");
+    THROW("tjDecompressToNV(): Could not scale down to desired image dimensions");
 
-  pw0 = tjPlaneWidth(0, width, jpegSubsamp);
-  ph0 = tjPlaneHeight(0, height, jpegSubsamp);
-  dstPlanes[0] = dstBuf;
-  strides[0] = PAD(pw0, pad);
-  if (jpegSubsamp == TJSAMP_GRAY) {
-    strides[1] = strides[2] = 0;
-    dstPlanes[1] = dstPlanes[2] = NULL;
+  dinfo->scale_num = sf[i].num;
+  dinfo->scale_denom = sf[i].denom;
+  sfi = i;
+  jpeg_calc_output_dimensions(dinfo);
+
+  dctsize = DCTSIZE * sf[sfi].num / sf[sfi].denom;
+
+  /* Dimensions of the destination planes */
+  pw0 = tjPlaneWidth(0, dinfo->output_width, TJSAMP_420);
+  ph0 = tjPlaneHeight(0, dinfo->output_height, TJSAMP_420);
+  pw1 = tjPlaneWidth(1, dinfo->output_width, TJSAMP_420);
+  ph1 = tjPlaneHeight(1, dinfo->output_height, TJSAMP_420);
+  ystride = (strides && strides[0] != 0) ? strides[0] : pw0;
+  uvstride = (strides && strides[1] != 0) ? strides[1] : pw1 * 2;
+  yplane = dstPlanes[0];  uvplane = dstPlanes[1];
+
+  /* Chrominance downsampling factors */
+  fx = 16 / tjMCUWidth[jpegSubsamp];
+  fy = 16 / tjMCUHeight[jpegSubsamp];
+
+  for (i = 0; i < dinfo->num_components; i++) {
+    jpeg_component_info *compptr = &dinfo->comp_info[i];
+
+    iw[i] = compptr->width_in_blocks * dctsize;
+    sw[i] = tjPlaneWidth(i, dinfo->output_width, jpegSubsamp);
+    sh[i] = tjPlaneHeight(i, dinfo->output_height, jpegSubsamp);
+    th[i] = compptr->v_samp_factor * dctsize;
+    tmpbufsize += iw[i] * th[i];
+  }
+  if (dinfo->num_components > 1) tmpbufsize += iw[1] * 2;
+  if ((_tmpbuf = (JSAMPLE *)malloc(sizeof(JSAMPLE) * tmpbufsize)) == NULL ||
+      (ybuf = (JSAMPROW *)malloc(sizeof(JSAMPROW) * th[0])) == NULL)
+    THROW("tjDecompressToNV(): Memory allocation failure");
+  ptr = _tmpbuf;
+  for (i = 0; i < dinfo->num_components; i++) {
+    if ((tmpbuf[i] = (JSAMPROW *)malloc(sizeof(JSAMPROW) * th[i])) == NULL)
+      THROW("tjDecompressToNV(): Memory allocation failure");
+    for (row = 0; row < th[i]; row++) {
+      tmpbuf[i][row] = ptr;
+      ptr += iw[i];
+    }
+  }
+  if (dinfo->num_components > 1) {
+    pendU = ptr;  pendV = ptr + iw[1];
   } else {
-    int pw1 = tjPlaneWidth(1, width, jpegSubsamp);
-    int ph1 = tjPlaneHeight(1, height, jpegSubsamp);
+    for (row = 0; row < ph1; row++)
+      memset(&uvplane[(size_t)row * uvstride], CENTERJSAMPLE, pw1 * 2);
+  }
 
-    strides[1] = strides[2] = PAD(pw1, pad);
-    dstPlanes[1] = dstPlanes[0] + strides[0] * ph0;
-    dstPlanes[2] = dstPlanes[1] + strides[1] * ph1;
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
   }
 
-  this->headerRead = 1;
-  return tjDecompressToYUVPlanes(handle, jpegBuf, jpegSize, dstPlanes, width,
-                                 strides, height, flags);
+  if (flags & TJFLAG_FASTDCT) dinfo->dct_method = JDCT_FASTEST;
+  dinfo->raw_data_out = TRUE;
+
+  jpeg_start_decompress(dinfo);
+  for (row = 0; row < (int)dinfo->output_height;
+       row += dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size) {
+    JSAMPARRAY yuvptr[MAX_COMPONENTS];
+    int direct = (iw[0] == pw0 && row + th[0] <= sh[0]), nrows, crow;
+
+    for (i = 0; i < dinfo->num_components; i++) {
+      jpeg_component_info *compptr = &dinfo->comp_info[i];
+
+      if (jpegSubsamp == TJ_420) {
+        /* See tjDecompressToYUVPlanes() */
+        compptr->_DCT_scaled_size = dctsize;
+        compptr->MCU_sample_width = tjMCUWidth[jpegSubsamp] *
+          sf[sfi].num / sf[sfi].denom *
+          compptr->v_samp_factor / dinfo->max_v_samp_factor;
+        dinfo->idct->inverse_DCT[i] = dinfo->idct->inverse_DCT[0];
+        dinfo->idct->inverse_DCT_pair[i] = dinfo->idct->inverse_DCT_pair[0];
+      }
+      yuvptr[i] = tmpbuf[i];
+    }
+    if (direct) {
+      for (j = 0; j < th[0]; j++)
+        ybuf[j] = &yplane[(size_t)(row + j) * ystride];
+      yuvptr[0] = ybuf;
+    }
+    jpeg_read_raw_data(dinfo, yuvptr,
+                       dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size);
+
+    nrows = MIN(th[0], sh[0] - row);
+    for (j = 0; j < nrows; j++) {
+      unsigned char *dst = &yplane[(size_t)(row + j) * ystride];
+
+      if (!direct) memcpy(dst, tmpbuf[0][j], sw[0]);
+      if (sw[0] < pw0) dst[pw0 - 1] = dst[pw0 - 2];
+    }
+
+    if (dinfo->num_components < 3) continue;
+    crow = row * dinfo->comp_info[1].v_samp_factor / dinfo->max_v_samp_factor;
+    nrows = MIN(th[1], sh[1] - crow);
+    for (j = 0; j < nrows; j++) {
+      int r = crow + j;
+
+      if (fy == 1)
+        interleaveNV(tmpbuf[1][j], tmpbuf[2][j], NULL, NULL,
+                     &uvplane[(size_t)r * uvstride], pw1, sw[1], fx,
+                     nvFormat);
+      else if (pending) {
+        interleaveNV(pendU, pendV, tmpbuf[1][j], tmpbuf[2][j],
+                     &uvplane[(size_t)(r / 2) * uvstride], pw1, sw[1], fx,
+                     nvFormat);
+        pending = 0;
+      } else if (j + 1 < nrows) {
+        interleaveNV(tmpbuf[1][j], tmpbuf[2][j], tmpbuf[1][j + 1],
+                     tmpbuf[2][j + 1], &uvplane[(size_t)(r / 2) * uvstride],
+                     pw1, sw[1], fx, nvFormat);
+        j++;
+      } else {
+        /* The other line of this pair is in the next iMCU row (or does not
+           exist.) */
+        memcpy(pendU, tmpbuf[1][j], sw[1]);
+        memcpy(pendV, tmpbuf[2][j], sw[1]);
+        pending = 1;
+      }
+    }
+  }
+  if (pending)
+    interleaveNV(pendU, pendV, NULL, NULL,
+                 &uvplane[(size_t)(ph1 - 1) * uvstride], pw1, sw[1], fx,
+                 nvFormat);
+  if (sh[0] < ph0)
+    memcpy(&yplane[(size_t)(ph0 - 1) * ystride],
+           &yplane[(size_t)(ph0 - 2) * ystride], pw0);
+  jpeg_finish_decompress(dinfo);
 
 bailout:
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  for (i = 0; i < MAX_COMPONENTS; i++)
+    free(tmpbuf[i]);
+  free(ybuf);
+  free(_tmpbuf);
+  if (this->jerr.warning) retval = -1;
   this->jerr.stopOnWarning = FALSE;
   return retval;
 }
 
-DLLEXPORT int tjDecompressToYUV(tjhandle handle, unsigned char *jpegBuf,
-                                unsigned long jpegSize, unsigned char *dstBuf,
-                                int flags)
-{
-  return tjDecompressToYUV2(handle, jpegBuf, jpegSize, dstBuf, 0, 4, 0, flags);
-}
-
 
 /* Transformer */
 
@@ -1831,14 +4580,135 @@ DLLEXPORT tjhandle tjInitTransform(void)
 }
 
 
+/* Parallel transformation
+
+   If multiple threads have been requested, then tjTransform() splits the
+   transforms into slices of consecutive transforms, and each slice is
+   performed by a separate compressor instance in a separate thread.  All of
+   the threads share the source coefficient arrays (which are read-only unless
+   a custom filter modifies them in place, in which case the transforms are
+   performed by the calling thread), and each transform that requires a
+   workspace has its own.  Each thread also uses its own shallow copy of the
+   decompressor object, so that errors in the thread are reported to the
+   thread's own error handler, and its own copy of the Exif marker (if any),
+   since jtransform_adjust_parameters() modifies that marker in place. */
+
+typedef struct {
+  tjinstance *inst;
+  j_decompress_ptr srcinfo;
+  struct jpeg_decompress_struct srcinfoCopy;
+  jpeg_saved_marker_ptr exifMarker;
+  jvirt_barray_ptr *srccoefs;
+  jpeg_transform_info *xinfo;
+  tjtransform *t;
+  unsigned char **dstBufs;
+  unsigned long *dstSizes;
+  int first, numTransforms, jpegSubsamp, flags;
+  int retval;
+  boolean warning;
+  char errStr[JMSG_LENGTH_MAX];
+} tjxformslice;
+
+
+static void transformSlice(void *arg)
+{
+  tjxformslice *slice = (tjxformslice *)arg;
+  tjinstance *this = slice->inst;
+  j_compress_ptr cinfo = &this->cinfo;
+  j_decompress_ptr dinfo = slice->srcinfo;
+  jpeg_transform_info *xinfo = slice->xinfo;
+  jvirt_barray_ptr *srccoefs = slice->srccoefs, *dstcoefs;
+  tjtransform *t = slice->t;
+  unsigned char **dstBufs = slice->dstBufs;
+  unsigned long *dstSizes = slice->dstSizes;
+  int i, retval = 0, flags = slice->flags;
+
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  for (i = slice->first; i < slice->first + slice->numTransforms; i++) {
+    int w, h, alloc = 1;
+
+    if (!xinfo[i].crop) {
+      w = dinfo->image_width;  h = dinfo->image_height;
+    } else {
+      w = xinfo[i].crop_width;  h = xinfo[i].crop_height;
+    }
+    if (flags & TJFLAG_NOREALLOC) {
+      alloc = 0;  dstSizes[i] = tjBufSize(w, h, slice->jpegSubsamp);
+    }
+    if (!(t[i].options & TJXOPT_NOOUTPUT))
+      jpeg_mem_dest_tj(cinfo, &dstBufs[i], &dstSizes[i], alloc);
+    jpeg_copy_critical_parameters(dinfo, cinfo);
+    dstcoefs = jtransform_adjust_parameters(dinfo, cinfo, srccoefs, &xinfo[i]);
+    if (flags & TJFLAG_PROGRESSIVE || t[i].options & TJXOPT_PROGRESSIVE)
+      jpeg_simple_progression(cinfo);
+    if (!(t[i].options & TJXOPT_NOOUTPUT)) {
+      jpeg_write_coefficients(cinfo, dstcoefs);
+      jcopy_markers_execute(dinfo, cinfo, t[i].options & TJXOPT_COPYNONE ?
+                                          JCOPYOPT_NONE : JCOPYOPT_ALL);
+    } else
+      jinit_c_master_control(cinfo, TRUE);
+    jtransform_execute_transformation(dinfo, cinfo, srccoefs, &xinfo[i]);
+    if (t[i].customFilter) {
+      int ci, y;
+      JDIMENSION by;
+
+      for (ci = 0; ci < cinfo->num_components; ci++) {
+        jpeg_component_info *compptr = &cinfo->comp_info[ci];
+        tjregion arrayRegion = {
+          0, 0, compptr->width_in_blocks * DCTSIZE, DCTSIZE
+        };
+        tjregion planeRegion = {
+          0, 0, compptr->width_in_blocks * DCTSIZE,
+          compptr->height_in_blocks * DCTSIZE
+        };
+
+        for (by = 0; by < compptr->height_in_blocks;
+             by += compptr->v_samp_factor) {
+          JBLOCKARRAY barray = (dinfo->mem->access_virt_barray)
+            ((j_common_ptr)dinfo, dstcoefs[ci], by, compptr->v_samp_factor,
+             TRUE);
+
+          for (y = 0; y < compptr->v_samp_factor; y++) {
+            if (t[i].customFilter(barray[y][0], arrayRegion, planeRegion, ci,
+                                  i, &t[i]) == -1)
+              THROW("tjTransform(): Error in custom filter");
+            arrayRegion.y += DCTSIZE;
+          }
+        }
+      }
+    }
+    if (!(t[i].options & TJXOPT_NOOUTPUT)) jpeg_finish_compress(cinfo);
+  }
+
+bailout:
+  if (cinfo->global_state > CSTATE_START) jpeg_abort_compress(cinfo);
+  slice->warning = this->jerr.warning;
+  if (slice->warning) retval = -1;
+  slice->retval = retval;
+  if (retval < 0) snprintf(slice->errStr, JMSG_LENGTH_MAX, "%s", errStr);
+  this->jerr.stopOnWarning = FALSE;
+}
+
+
 DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
                           unsigned long jpegSize, int n,
                           unsigned char **dstBufs, unsigned long *dstSizes,
                           tjtransform *t, int flags)
 {
   jpeg_transform_info *xinfo = NULL;
-  jvirt_barray_ptr *srccoefs, *dstcoefs;
-  int retval = 0, i, jpegSubsamp, saveMarkers = 0;
+  jvirt_barray_ptr *srccoefs;
+  tjxformslice *slices = NULL;
+  int retval = 0, i, jpegSubsamp, saveMarkers = 0, numSlices = 1;
+  int numStarted = 0;
+#ifdef WITH_THREADS
+  tjthread *threads = NULL;
+#endif
 
   GET_INSTANCE(handle);
   this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
@@ -1875,6 +4745,9 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
     xinfo[i].crop = (t[i].options & TJXOPT_CROP) ? 1 : 0;
     if (n != 1 && t[i].op == TJXOP_HFLIP) xinfo[i].slow_hflip = 1;
     else xinfo[i].slow_hflip = 0;
+    /* Custom filters need the whole destination image. */
+    xinfo[i].streaming = !t[i].customFilter &&
+                         !(t[i].options & TJXOPT_NOOUTPUT);
 
     if (xinfo[i].crop) {
       xinfo[i].crop_xoffset = t[i].r.x;  xinfo[i].crop_xoffset_set = JCROP_POS;
@@ -1892,6 +4765,7 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
   }
 
   jcopy_markers_setup(dinfo, saveMarkers ? JCOPYOPT_ALL : JCOPYOPT_NONE);
+  restoreTables(this->tables, dinfo);
   jpeg_read_header(dinfo, TRUE);
   jpegSubsamp = getSubsamp(dinfo);
   if (jpegSubsamp < 0)
@@ -1916,68 +4790,168 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
 
   srccoefs = jpeg_read_coefficients(dinfo);
 
+#ifdef WITH_THREADS
+  numSlices = max(min(this->numThreads, n), 1);
   for (i = 0; i < n; i++) {
-    int w, h, alloc = 1;
+    if (t[i].customFilter && xinfo[i].workspace_coef_arrays == NULL)
+      numSlices = 1;
+  }
+  if (numSlices > 1 &&
+      (threads = (tjthread *)malloc(sizeof(tjthread) * numSlices)) == NULL)
+    THROW("tjTransform(): Memory allocation failure");
+#endif
+  if ((slices =
+       (tjxformslice *)malloc(sizeof(tjxformslice) * numSlices)) == NULL)
+    THROW("tjTransform(): Memory allocation failure");
+  MEMZERO(slices, sizeof(tjxformslice) * numSlices);
+
+  for (i = 0; i < numSlices; i++) {
+    tjxformslice *slice = &slices[i];
+    int first = (int)((long)n * i / numSlices);
+    int next = (int)((long)n * (i + 1) / numSlices);
+
+    slice->inst = this;
+    slice->srcinfo = dinfo;
+    slice->srccoefs = srccoefs;
+    slice->xinfo = xinfo;
+    slice->t = t;
+    slice->dstBufs = dstBufs;
+    slice->dstSizes = dstSizes;
+    slice->first = first;
+    slice->numTransforms = next - first;
+    slice->jpegSubsamp = jpegSubsamp;
+    slice->flags = flags;
+#ifdef WITH_THREADS
+    if (i > 0) {
+      jpeg_saved_marker_ptr marker = dinfo->marker_list;
+
+      if ((slice->inst = getWorker(this, i - 1, COMPRESS)) == NULL)
+        THROW("tjTransform(): Memory allocation failure");
+      slice->inst->jerr.warning = FALSE;
+      slice->inst->isInstanceError = FALSE;
+      slice->srcinfoCopy = *dinfo;
+      slice->srcinfoCopy.err = &slice->inst->jerr.pub;
+      slice->srcinfo = &slice->srcinfoCopy;
+      if (marker != NULL && marker->marker == JPEG_APP0 + 1) {
+        if ((slice->exifMarker = (jpeg_saved_marker_ptr)
+             malloc(sizeof(struct jpeg_marker_struct) +
+                    marker->data_length)) == NULL)
+          THROW("tjTransform(): Memory allocation failure");
+        *slice->exifMarker = *marker;
+        slice->exifMarker->data = (JOCTET *)&slice->exifMarker[1];
+        MEMCOPY(slice->exifMarker->data, marker->data, marker->data_length);
+        slice->srcinfoCopy.marker_list = slice->exifMarker;
+      }
+    }
+#endif
+  }
 
-    if (!xinfo[i].crop) {
-      w = dinfo->image_width;  h = dinfo->image_height;
-    } else {
-      w = xinfo[i].crop_width;  h = xinfo[i].crop_height;
+#ifdef WITH_THREADS
+  for (i = 1; i < numSlices; i++) {
+    if (tjThreadCreate(&threads[i], transformSlice, &slices[i]) < 0) {
+      snprintf(errStr, JMSG_LENGTH_MAX,
+               "tjTransform(): Could not create thread");
+      retval = -1;  break;
     }
-    if (flags & TJFLAG_NOREALLOC) {
-      alloc = 0;  dstSizes[i] = tjBufSize(w, h, jpegSubsamp);
+    numStarted++;
+  }
+#endif
+  if (retval == 0) transformSlice(&slices[0]);
+
+  for (i = 0; i <= numStarted; i++) {
+#ifdef WITH_THREADS
+    if (i > 0) tjThreadJoin(threads[i]);
+#endif
+    if (retval == 0 && slices[i].retval < 0) {
+      if (i > 0) snprintf(errStr, JMSG_LENGTH_MAX, "%s", slices[i].errStr);
+      retval = -1;
     }
-    if (!(t[i].options & TJXOPT_NOOUTPUT))
-      jpeg_mem_dest_tj(cinfo, &dstBufs[i], &dstSizes[i], alloc);
-    jpeg_copy_critical_parameters(dinfo, cinfo);
-    dstcoefs = jtransform_adjust_parameters(dinfo, cinfo, srccoefs, &xinfo[i]);
-    if (flags & TJFLAG_PROGRESSIVE || t[i].options & TJXOPT_PROGRESSIVE)
-      jpeg_simple_progression(cinfo);
-    if (!(t[i].options & TJXOPT_NOOUTPUT)) {
-      jpeg_write_coefficients(cinfo, dstcoefs);
-      jcopy_markers_execute(dinfo, cinfo, t[i].options & TJXOPT_COPYNONE ?
-                                          JCOPYOPT_NONE : JCOPYOPT_ALL);
-    } else
-      jinit_c_master_control(cinfo, TRUE);
-    jtransform_execute_transformation(dinfo, cinfo, srccoefs, &xinfo[i]);
-    if (t[i].customFilter) {
-      int ci, y;
-      JDIMENSION by;
+    if (slices[i].warning) this->jerr.warning = TRUE;
+  }
 
-      for (ci = 0; ci < cinfo->num_components; ci++) {
-        jpeg_component_info *compptr = &cinfo->comp_info[ci];
-        tjregion arrayRegion = {
-          0, 0, compptr->width_in_blocks * DCTSIZE, DCTSIZE
-        };
-        tjregion planeRegion = {
-          0, 0, compptr->width_in_blocks * DCTSIZE,
-          compptr->height_in_blocks * DCTSIZE
-        };
+  /* transformSlice() used the instance's error handler, so it must be
+     re-armed before the instance is used again (including by the cleanup code
+     below.) */
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+  if (retval < 0) goto bailout;
 
-        for (by = 0; by < compptr->height_in_blocks;
-             by += compptr->v_samp_factor) {
-          JBLOCKARRAY barray = (dinfo->mem->access_virt_barray)
-            ((j_common_ptr)dinfo, dstcoefs[ci], by, compptr->v_samp_factor,
-             TRUE);
+  jpeg_finish_decompress(dinfo);
 
-          for (y = 0; y < compptr->v_samp_factor; y++) {
-            if (t[i].customFilter(barray[y][0], arrayRegion, planeRegion, ci,
-                                  i, &t[i]) == -1)
-              THROW("tjTransform(): Error in custom filter");
-            arrayRegion.y += DCTSIZE;
-          }
-        }
-      }
-    }
-    if (!(t[i].options & TJXOPT_NOOUTPUT)) jpeg_finish_compress(cinfo);
+bailout:
+  if (cinfo->global_state > CSTATE_START) jpeg_abort_compress(cinfo);
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  if (slices) {
+    for (i = 0; i < numSlices; i++) free(slices[i].exifMarker);
+    free(slices);
+  }
+#ifdef WITH_THREADS
+  free(threads);
+#endif
+  free(xinfo);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+DLLEXPORT int tjRequantize(tjhandle handle, const unsigned char *jpegBuf,
+                           unsigned long jpegSize, unsigned char **dstBuf,
+                           unsigned long *dstSize, int jpegQual, int flags)
+{
+  jpeg_transform_info xinfo;
+  jvirt_barray_ptr *srccoefs;
+  int retval = 0, alloc = 1;
+
+  GET_INSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & COMPRESS) == 0 || (this->init & DECOMPRESS) == 0)
+    THROW("tjRequantize(): Instance has not been initialized for transformation");
+
+  if (jpegBuf == NULL || jpegSize <= 0 ||
+      (dstBuf == NULL && !HAS_DESTINATION(this)) || dstSize == NULL ||
+      jpegQual < 1 || jpegQual > 100 || flags < 0)
+    THROW("tjRequantize(): Invalid argument");
+
+  MEMZERO(&xinfo, sizeof(jpeg_transform_info));
+  xinfo.transform = JXFORM_NONE;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
   }
 
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  jcopy_markers_setup(dinfo, JCOPYOPT_ALL);
+  restoreTables(this->tables, dinfo);
+  jpeg_read_header(dinfo, TRUE);
+  if (getSubsamp(dinfo) < 0)
+    THROW("tjRequantize(): Could not determine subsampling type for JPEG image");
+  srccoefs = jpeg_read_coefficients(dinfo);
+
+  if (flags & TJFLAG_NOREALLOC) {
+    alloc = 0;
+    *dstSize = tjBufSize(dinfo->image_width, dinfo->image_height,
+                         getSubsamp(dinfo));
+  }
+  setDestination(this, dstBuf, dstSize, alloc);
+  jpeg_copy_critical_parameters(dinfo, cinfo);
+  jpeg_set_quality(cinfo, jpegQual, TRUE);
+  cinfo->optimize_coding = TRUE;
+  if (flags & TJFLAG_PROGRESSIVE)
+    jpeg_simple_progression(cinfo);
+  jtransform_requantize(dinfo, cinfo, srccoefs, &xinfo);
+  jpeg_write_coefficients(cinfo, srccoefs);
+  jcopy_markers_execute(dinfo, cinfo, JCOPYOPT_ALL);
+  jpeg_finish_compress(cinfo);
   jpeg_finish_decompress(dinfo);
 
 bailout:
   if (cinfo->global_state > CSTATE_START) jpeg_abort_compress(cinfo);
   if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
-  free(xinfo);
   if (this->jerr.warning) retval = -1;
   this->jerr.stopOnWarning = FALSE;
   return retval;
@@ -418,6 +418,16 @@ enum TJCS {
  * reduce compression and decompression performance considerably.
  */
 #define TJFLAG_PROGRESSIVE  16384
+/**
+ * Generate abbreviated JPEG images, which do not contain quantization or
+ * Huffman tables, when compressing.  Such images can only be decompressed by
+ * an instance into which the tables have been loaded using
+ * #tjDecompressTables(), so the tables must be generated separately, using
+ * #tjCompressTables() with the same JPEG quality.  (Huffman tables are still
+ * included in the JPEG image if progressive entropy coding or Huffman table
+ * optimization is used, since those tables are specific to each image.)
+ */
+#define TJFLAG_ABBREVIATED  32768
 
 
 /**
@@ -495,6 +505,65 @@ enum TJXOP {
 };
 
 
+/**
+ * The number of resampling filters
+ */
+#define TJ_NUMFILTER  3
+
+/**
+ * Resampling filters for #tjDecompressResized()
+ */
+enum TJFILTER {
+  /**
+   * Area averaging (box filter.)  Each destination pixel is the average of
+   * the source pixels that it covers, weighted by the fraction of each source
+   * pixel that is covered.  This is the fastest filter, and it produces good
+   * results when reducing the image size.
+   */
+  TJFILTER_AREA = 0,
+  /**
+   * Bilinear interpolation (triangle filter.)  When reducing the image size,
+   * the filter is stretched so that all source pixels contribute to the
+   * destination image.
+   */
+  TJFILTER_BILINEAR,
+  /**
+   * Lanczos filter with a radius of 3.  This is the slowest filter, but it
+   * produces the sharpest results.
+   */
+  TJFILTER_LANCZOS3
+};
+
+
+/**
+ * The number of semi-planar YUV formats
+ */
+#define TJ_NUMNV  2
+
+/**
+ * Semi-planar YUV formats for #tjDecompressToNV()
+ *
+ * A semi-planar YUV image consists of a Y (luminance) plane followed by a
+ * single chrominance plane in which the U (Cb) and V (Cr) samples are
+ * interleaved.  Chrominance is always subsampled by a factor of 2 in both
+ * directions (4:2:0), so the Y plane has the same dimensions as the Y plane of
+ * a #TJSAMP_420 planar YUV image, and each line of the chrominance plane
+ * contains #tjPlaneWidth(1, width, #TJSAMP_420) U/V sample pairs.
+ */
+enum TJNV {
+  /**
+   * NV12 format.  Each U (Cb) sample precedes the corresponding V (Cr) sample
+   * in the chrominance plane.
+   */
+  TJNV_NV12 = 0,
+  /**
+   * NV21 format.  Each V (Cr) sample precedes the corresponding U (Cb) sample
+   * in the chrominance plane.
+   */
+  TJNV_NV21
+};
+
+
 /**
  * This option will cause #tjTransform() to return an error if the transform is
  * not perfect.  Lossless transforms operate on MCU blocks, whose size depends
@@ -651,6 +720,40 @@ typedef struct tjtransform {
 typedef void *tjhandle;
 
 
+/**
+ * Callback function that receives a JPEG image in chunks as it is generated
+ *
+ * @param buf pointer to a buffer containing the next chunk of the JPEG image.
+ * The buffer is valid only until the callback returns.
+ *
+ * @param size size of the chunk (in bytes)
+ *
+ * @param callbackData the arbitrary data that was supplied along with the
+ * callback
+ *
+ * @return 0 if the callback was successful, or -1 if an error occurred (in
+ * which case compression is aborted.)
+ */
+typedef int (*tjwritecallback) (const unsigned char *buf, unsigned long size,
+                                void *callbackData);
+
+
+/**
+ * Memory buffer (used to specify a list of destination buffers for the
+ * compression functions; see #tjSetDestBuffers())
+ */
+typedef struct {
+  /**
+   * Pointer to the buffer
+   */
+  unsigned char *buf;
+  /**
+   * Size of the buffer (in bytes)
+   */
+  unsigned long size;
+} tjbuffer;
+
+
 /**
  * Pad the given width to the nearest 32-bit boundary
  */
@@ -720,7 +823,9 @@ DLLEXPORT tjhandle tjInitCompress(void);
  * If you choose option 1, <tt>*jpegSize</tt> should be set to the size of your
  * pre-allocated buffer.  In any case, unless you have set #TJFLAG_NOREALLOC,
  * you should always check <tt>*jpegBuf</tt> upon return from this function, as
- * it may have changed.
+ * it may have changed.  If a destination has been specified using
+ * #tjSetWriteCallback() or #tjSetDestBuffers(), then this parameter is ignored
+ * and may be NULL.
  *
  * @param jpegSize pointer to an unsigned long variable that holds the size of
  * the JPEG image buffer.  If <tt>*jpegBuf</tt> points to a pre-allocated
@@ -749,6 +854,186 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
                           int jpegSubsamp, int jpegQual, int flags);
 
 
+/**
+ * Compress a batch of RGB, grayscale, or CMYK images, all having the same
+ * dimensions and pixel format, into JPEG images that all use the same
+ * compression parameters.
+ *
+ * This function produces the same JPEG images as calling #tjCompress2() for
+ * each source image in turn, but the compression parameters are set up only
+ * once for the whole batch, so this function is more efficient when
+ * compressing many small images.  If multiple threads have been requested
+ * (see #tjSetNumThreads()), then the batch is split into slices of consecutive
+ * images, and the slices are compressed in parallel.  Each image is still
+ * compressed by a single thread.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param numImages the number of images in the batch
+ *
+ * @param srcBufs an array of <tt>numImages</tt> pointers to image buffers,
+ * each containing RGB, grayscale, or CMYK pixels to be compressed
+ *
+ * @param width width (in pixels) of each source image
+ *
+ * @param pitch bytes per line in each source image (see #tjCompress2().)
+ * Setting this parameter to 0 is the equivalent of setting it to
+ * <tt>width * #tjPixelSize[pixelFormat]</tt>.
+ *
+ * @param height height (in pixels) of each source image
+ *
+ * @param pixelFormat pixel format of the source images (see @ref TJPF
+ * "Pixel formats".)
+ *
+ * @param jpegBufs an array of <tt>numImages</tt> pointers to image buffers
+ * that will receive the JPEG images.  Each element of this array is treated in
+ * the same way as the <tt>*jpegBuf</tt> argument to #tjCompress2().
+ *
+ * @param jpegSizes an array of <tt>numImages</tt> unsigned long variables,
+ * each of which is treated in the same way as the <tt>*jpegSize</tt> argument
+ * to #tjCompress2().
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the JPEG images (see @ref TJSAMP
+ * "Chrominance subsampling options".)
+ *
+ * @param jpegQual the image quality of the generated JPEG images (1 = worst,
+ * 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)  If an error occurs, then some of the images in the
+ * batch may not have been compressed.
+*/
+DLLEXPORT int tjCompressBatch(tjhandle handle, int numImages,
+                              const unsigned char **srcBufs, int width,
+                              int pitch, int height, int pixelFormat,
+                              unsigned char **jpegBufs,
+                              unsigned long *jpegSizes, int jpegSubsamp,
+                              int jpegQual, int flags);
+
+
+/**
+ * Generate a tables-only JPEG datastream containing the quantization and
+ * Huffman tables that the JPEG compression functions use for the given JPEG
+ * quality.  The tables-only datastream can be stored or transmitted once for
+ * many abbreviated JPEG images (see #TJFLAG_ABBREVIATED) and loaded into a
+ * decompressor using #tjDecompressTables().
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param tablesBuf address of a pointer to a buffer that will receive the
+ * tables-only datastream.  This buffer is treated in the same way as the
+ * <tt>*jpegBuf</tt> argument to #tjCompress2(), except that if
+ * #TJFLAG_NOREALLOC is set, then <tt>*tablesSize</tt> must be set to the size
+ * of the pre-allocated buffer.
+ *
+ * @param tablesSize pointer to an unsigned long variable that holds the size
+ * of the tables-only datastream buffer.  Upon return, <tt>*tablesSize</tt>
+ * will contain the size of the tables-only datastream (in bytes.)
+ *
+ * @param jpegQual the image quality of the JPEG images that will be generated
+ * with #TJFLAG_ABBREVIATED (1 = worst, 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjCompressTables(tjhandle handle, unsigned char **tablesBuf,
+                               unsigned long *tablesSize, int jpegQual,
+                               int flags);
+
+
+/**
+ * Begin compressing an image that will be supplied incrementally, using
+ * #tjCompressStreamRows(), into a JPEG image that is passed to a callback
+ * function as it is generated.  This allows images that are too large to fit
+ * in memory to be compressed, since the memory required by the compressor
+ * does not depend on the height of the image (unless progressive entropy
+ * coding or Huffman table optimization is used, in which case the DCT
+ * coefficients for the entire image are buffered.)  Any stream that is already
+ * in progress is discarded.  A stream in progress does not affect the other
+ * compression functions, which can be used with the same instance at any
+ * time.  Streams are always compressed using a single thread.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param width width (in pixels) of the source image
+ *
+ * @param height height (in pixels) of the source image
+ *
+ * @param pixelFormat pixel format of the source image (see @ref TJPF
+ * "Pixel formats".)
+ *
+ * @param callback a function that will receive the JPEG image in chunks, in
+ * order, as it is generated.  The callback may be called from this function,
+ * #tjCompressStreamRows(), and #tjCompressStreamFinish().
+ *
+ * @param callbackData arbitrary data that will be passed to the callback
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the JPEG image (see @ref TJSAMP
+ * "Chrominance subsampling options".)
+ *
+ * @param jpegQual the image quality of the generated JPEG image (1 = worst,
+ * 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags".  The flags apply to the whole stream.  If #TJFLAG_BOTTOMUP is set,
+ * then the rows in each buffer passed to #tjCompressStreamRows() are stored in
+ * bottom-up order, but the buffers must still be passed in top-down order.
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjCompressStreamStart(tjhandle handle, int width, int height,
+                                    int pixelFormat, tjwritecallback callback,
+                                    void *callbackData, int jpegSubsamp,
+                                    int jpegQual, int flags);
+
+
+/**
+ * Compress the next rows of the image that is being compressed incrementally
+ * (see #tjCompressStreamStart().)  The rows are compressed immediately, so the
+ * buffer can be reused as soon as this function returns.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param srcBuf pointer to an image buffer containing the next
+ * <tt>numRows</tt> rows of the source image, in the pixel format that was
+ * passed to #tjCompressStreamStart()
+ *
+ * @param pitch bytes per line in the source image buffer, or 0 to use the
+ * image width times the pixel size
+ *
+ * @param numRows number of rows in the source image buffer.  The total number
+ * of rows passed to this function cannot exceed the image height.
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)  A fatal error ends the stream.
+ */
+DLLEXPORT int tjCompressStreamRows(tjhandle handle,
+                                   const unsigned char *srcBuf, int pitch,
+                                   int numRows);
+
+
+/**
+ * Finish compressing the image that is being compressed incrementally (see
+ * #tjCompressStreamStart()), and pass the remainder of the JPEG image to the
+ * callback.  All of the rows of the image must have been supplied.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjCompressStreamFinish(tjhandle handle);
+
+
 /**
  * Compress a YUV planar image into a JPEG image.
  *
@@ -790,7 +1075,9 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
  * If you choose option 1, <tt>*jpegSize</tt> should be set to the size of your
  * pre-allocated buffer.  In any case, unless you have set #TJFLAG_NOREALLOC,
  * you should always check <tt>*jpegBuf</tt> upon return from this function, as
- * it may have changed.
+ * it may have changed.  If a destination has been specified using
+ * #tjSetWriteCallback() or #tjSetDestBuffers(), then this parameter is ignored
+ * and may be NULL.
  *
  * @param jpegSize pointer to an unsigned long variable that holds the size of
  * the JPEG image buffer.  If <tt>*jpegBuf</tt> points to a pre-allocated
@@ -863,7 +1150,9 @@ DLLEXPORT int tjCompressFromYUV(tjhandle handle, const unsigned char *srcBuf,
  * If you choose option 1, <tt>*jpegSize</tt> should be set to the size of your
  * pre-allocated buffer.  In any case, unless you have set #TJFLAG_NOREALLOC,
  * you should always check <tt>*jpegBuf</tt> upon return from this function, as
- * it may have changed.
+ * it may have changed.  If a destination has been specified using
+ * #tjSetWriteCallback() or #tjSetDestBuffers(), then this parameter is ignored
+ * and may be NULL.
  *
  * @param jpegSize pointer to an unsigned long variable that holds the size of
  * the JPEG image buffer.  If <tt>*jpegBuf</tt> points to a pre-allocated
@@ -1153,6 +1442,29 @@ DLLEXPORT int tjDecompressHeader3(tjhandle handle,
                                   int *jpegColorspace);
 
 
+/**
+ * Load the quantization and Huffman tables from a tables-only JPEG datastream
+ * (such as one generated by #tjCompressTables()) into a TurboJPEG
+ * decompressor or transformer instance.  The decompression and transform
+ * functions can then read abbreviated JPEG images (see #TJFLAG_ABBREVIATED)
+ * that use those tables.  Tables that are contained in a JPEG image take
+ * precedence over the loaded tables, but only for that image.  Loading another
+ * tables-only datastream replaces the previously-loaded tables.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param tablesBuf pointer to a buffer containing the tables-only datastream
+ *
+ * @param tablesSize size of the tables-only datastream (in bytes)
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressTables(tjhandle handle,
+                                 const unsigned char *tablesBuf,
+                                 unsigned long tablesSize);
+
+
 /**
  * Returns a list of fractional scaling factors that the JPEG decompressor in
  * this implementation of TurboJPEG supports.
@@ -1222,6 +1534,347 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
                             int flags);
 
 
+/**
+ * Decompress a JPEG file to an RGB, grayscale, or CMYK image.  This is
+ * equivalent to reading the JPEG file into memory and calling
+ * #tjDecompressHeader3() and #tjDecompress2(), except that the file is
+ * memory-mapped (if the platform supports it) rather than read, so the JPEG
+ * data is never copied.  The file must not be truncated or modified while this
+ * function is running.  On most Unix systems, reading a part of the mapping
+ * that no longer exists in the file raises SIGBUS rather than causing this
+ * function to return an error.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param filename name of a file containing a JPEG image
+ *
+ * @param width pointer to an integer variable that specifies the desired width
+ * (in pixels) of the destination image (see #tjDecompress2()) and that will
+ * receive the scaled width of the decompressed image.  If <tt>*width</tt> is
+ * set to 0, then only the height will be considered when determining the
+ * scaled image size.
+ *
+ * @param align row alignment of the image buffer to be returned (must be a
+ * power of 2.)  For instance, setting this parameter to 4 will cause all rows
+ * in the image buffer to be padded to the nearest 32-bit boundary, and setting
+ * this parameter to 1 will cause all rows in the image buffer to be unpadded.
+ *
+ * @param height pointer to an integer variable that specifies the desired
+ * height (in pixels) of the destination image (see #tjDecompress2()) and that
+ * will receive the scaled height of the decompressed image.  If
+ * <tt>*height</tt> is set to 0, then only the width will be considered when
+ * determining the scaled image size.
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return a pointer to a newly-allocated buffer containing the decompressed
+ * image, or NULL if an error occurred (see #tjGetErrorStr2().)  This buffer
+ * should be freed using #tjFree().  If the JPEG image was decompressed but the
+ * decompressor issued a warning, then the buffer is returned, and
+ * #tjGetErrorCode() will return #TJERR_WARNING until the next TurboJPEG
+ * function is called with the same handle.  (If #TJFLAG_STOPONWARNING is
+ * specified, then warnings are treated as errors.)
+ */
+DLLEXPORT unsigned char *tjDecompressFile(tjhandle handle,
+                                          const char *filename, int *width,
+                                          int align, int *height,
+                                          int pixelFormat, int flags);
+
+
+/**
+ * Decompress a JPEG image to an RGB, grayscale, or CMYK image with arbitrary
+ * dimensions.  The JPEG image is first decompressed using the smallest scaling
+ * factor (see #tjGetScalingFactors()) that produces an image at least as large
+ * as the desired image in both dimensions, and the decompressed rows are then
+ * resampled to the desired size as they are produced.  Thus, the unresized
+ * image is never stored in memory, and scaling in the JPEG decompressor
+ * performs most of the size reduction.  If the desired size is the same as one
+ * of the scaled sizes that the decompressor supports, then this function is
+ * equivalent to #tjDecompress2().
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param dstBuf pointer to an image buffer that will receive the decompressed
+ * image.  This buffer should normally be <tt>pitch * height</tt> bytes in
+ * size.
+ *
+ * @param width width (in pixels) of the destination image (must be greater
+ * than 0)
+ *
+ * @param pitch bytes per line in the destination image.  Normally, this is
+ * <tt>width * #tjPixelSize[pixelFormat]</tt> if the destination image is
+ * unpadded, else <tt>#TJPAD(width * #tjPixelSize[pixelFormat])</tt> if each
+ * line of the destination image is padded to the nearest 32-bit boundary.
+ * Setting this parameter to 0 is the equivalent of setting it to
+ * <tt>width * #tjPixelSize[pixelFormat]</tt>.
+ *
+ * @param height height (in pixels) of the destination image (must be greater
+ * than 0)
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param filter resampling filter to use (see @ref TJFILTER
+ * "Resampling filters".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressResized(tjhandle handle,
+                                  const unsigned char *jpegBuf,
+                                  unsigned long jpegSize,
+                                  unsigned char *dstBuf, int width, int pitch,
+                                  int height, int pixelFormat, int filter,
+                                  int flags);
+
+
+/**
+ * Decompress a rectangular region of a JPEG image to an RGB, grayscale, or
+ * CMYK image.  Only the iMCU rows that intersect the region are decompressed,
+ * and within those rows, only the iMCU columns that intersect the region are
+ * transformed and color-converted.  The remaining iMCUs in those rows are
+ * entropy-decoded (which is necessary in order to locate the iMCUs in the
+ * region), but their coefficients are discarded.  The iMCU rows above the
+ * region are skipped as quickly as possible, and decompression stops as soon
+ * as the last row of the region has been produced.  Thus, extracting a small
+ * region from a large JPEG image is much faster than decompressing the whole
+ * image.  The decompressed pixels are identical to the corresponding pixels
+ * that #tjDecompress2() would produce when decompressing the whole image
+ * without scaling.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param dstBuf pointer to an image buffer that will receive the decompressed
+ * region.  This buffer should normally be <tt>pitch * height</tt> bytes in
+ * size.
+ *
+ * @param x left boundary (in pixels) of the region to decompress, relative to
+ * the left edge of the JPEG image
+ *
+ * @param y upper boundary (in pixels) of the region to decompress, relative to
+ * the top of the JPEG image
+ *
+ * @param width width (in pixels) of the region to decompress (must be greater
+ * than 0.)  <tt>x + width</tt> must not exceed the width of the JPEG image.
+ *
+ * @param pitch bytes per line in the destination image.  Normally, this is
+ * <tt>width * #tjPixelSize[pixelFormat]</tt> if the destination image is
+ * unpadded, else <tt>#TJPAD(width * #tjPixelSize[pixelFormat])</tt> if each
+ * line of the destination image is padded to the nearest 32-bit boundary.
+ * Setting this parameter to 0 is the equivalent of setting it to
+ * <tt>width * #tjPixelSize[pixelFormat]</tt>.
+ *
+ * @param height height (in pixels) of the region to decompress (must be
+ * greater than 0.)  <tt>y + height</tt> must not exceed the height of the JPEG
+ * image.
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressRegion(tjhandle handle,
+                                 const unsigned char *jpegBuf,
+                                 unsigned long jpegSize, unsigned char *dstBuf,
+                                 int x, int y, int width, int pitch,
+                                 int height, int pixelFormat, int flags);
+
+
+/**
+ * Decompress a batch of JPEG images to RGB, grayscale, or CMYK images.
+ *
+ * This function produces the same images as calling #tjDecompress2() for each
+ * JPEG image in turn, with the same destination dimensions, pixel format, and
+ * flags.  The JPEG images need not have the same dimensions or level of
+ * chrominance subsampling, but a batch of images that share the same Huffman
+ * tables (which is typically the case for images generated by the same
+ * encoder) is decompressed more efficiently, since the decompressor reuses the
+ * derived Huffman tables from the previous image.  If multiple threads have
+ * been requested (see #tjSetNumThreads()), then the batch is split into slices
+ * of consecutive images, and the slices are decompressed in parallel.  Each
+ * image is then decompressed by a single thread.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param numImages the number of images in the batch
+ *
+ * @param jpegBufs an array of <tt>numImages</tt> pointers to buffers, each
+ * containing a JPEG image to decompress
+ *
+ * @param jpegSizes an array of <tt>numImages</tt> values, each specifying the
+ * size of the corresponding JPEG image (in bytes)
+ *
+ * @param dstBufs an array of <tt>numImages</tt> pointers to image buffers that
+ * will receive the decompressed images.  Each buffer must be large enough to
+ * hold the corresponding decompressed image (see #tjDecompress2().)
+ *
+ * @param width desired width (in pixels) of each destination image, or 0 to
+ * use the width of the JPEG image (see #tjDecompress2().)
+ *
+ * @param pitch bytes per line in each destination image, or 0 to use the
+ * scaled width of the corresponding JPEG image times the pixel size (see
+ * #tjDecompress2().)
+ *
+ * @param height desired height (in pixels) of each destination image, or 0 to
+ * use the height of the JPEG image (see #tjDecompress2().)
+ *
+ * @param pixelFormat pixel format of the destination images (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)  If a non-fatal error (warning) occurs while
+ * decompressing an image, then the rest of the batch is still decompressed
+ * unless #TJFLAG_STOPONWARNING is set.  If a fatal error occurs, then some of
+ * the images in the batch may not have been decompressed.
+ */
+DLLEXPORT int tjDecompressBatch(tjhandle handle, int numImages,
+                                const unsigned char **jpegBufs,
+                                const unsigned long *jpegSizes,
+                                unsigned char **dstBufs, int width, int pitch,
+                                int height, int pixelFormat, int flags);
+
+
+/**
+ * Begin decompressing a JPEG image that will be supplied incrementally, using
+ * #tjDecompressStreamPush(), as it becomes available.  This is useful when
+ * receiving a JPEG image over a slow connection, since rows of the
+ * decompressed image can be retrieved (using #tjDecompressStreamRows()) as
+ * soon as the data for them has arrived, and the JPEG image does not have to
+ * be buffered in its entirety.  Any stream that is already in progress is
+ * discarded.  A stream in progress does not affect the other decompression
+ * functions, which can be used with the same instance at any time.
+ *
+ * Tables that were loaded using #tjDecompressTables() before this function is
+ * called are used when decompressing an abbreviated JPEG image.  Streams are
+ * always decompressed using a single thread.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressStreamStart(tjhandle handle);
+
+
+/**
+ * Supply the next part of the JPEG image that is being decompressed
+ * incrementally (see #tjDecompressStreamStart().)  The data is copied, so the
+ * buffer can be reused as soon as this function returns.  No decompression is
+ * performed until #tjDecompressStreamHeader() or #tjDecompressStreamRows() is
+ * called.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the next part of the JPEG
+ * image (can be NULL if <tt>jpegSize</tt> is 0)
+ *
+ * @param jpegSize size of the data in <tt>jpegBuf</tt> (in bytes)
+ *
+ * @param endOfStream nonzero if no more data will be supplied for this JPEG
+ * image.  If the stream ends before the JPEG image is complete, then the
+ * remainder of the image is treated in the same manner as a truncated JPEG
+ * image passed to #tjDecompress2().
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressStreamPush(tjhandle handle,
+                                     const unsigned char *jpegBuf,
+                                     unsigned long jpegSize, int endOfStream);
+
+
+/**
+ * Retrieve information about the JPEG image that is being decompressed
+ * incrementally (see #tjDecompressStreamStart()), if enough of the image has
+ * been supplied to read its header.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param width pointer to an integer variable that will receive the width (in
+ * pixels) of the JPEG image
+ *
+ * @param height pointer to an integer variable that will receive the height
+ * (in pixels) of the JPEG image
+ *
+ * @param jpegSubsamp pointer to an integer variable that will receive the
+ * level of chrominance subsampling used when the JPEG image was compressed
+ * (see @ref TJSAMP "Chrominance subsampling options".)
+ *
+ * @param jpegColorspace pointer to an integer variable that will receive one
+ * of the JPEG colorspace constants, indicating the colorspace of the JPEG
+ * image (see @ref TJCS "JPEG colorspaces".)
+ *
+ * @return 1 if the header has been read and the other arguments have been
+ * filled in, 0 if more data must be supplied before the header can be read,
+ * or -1 if an error occurred (see #tjGetErrorStr2() and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressStreamHeader(tjhandle handle, int *width,
+                                       int *height, int *jpegSubsamp,
+                                       int *jpegColorspace);
+
+
+/**
+ * Decompress as many rows of the JPEG image that is being decompressed
+ * incrementally (see #tjDecompressStreamStart()) as the data supplied so far
+ * allows.  This function should be called with the same arguments each time
+ * more data is supplied, until it returns the scaled height of the image.
+ * Rows of a progressive or multi-scan JPEG image are not produced until all of
+ * the scans have been supplied.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param dstBuf pointer to an image buffer that will receive the decompressed
+ * image (see #tjDecompress2().)  The rows are stored in this buffer as they
+ * are decompressed.
+ *
+ * @param width desired width (in pixels) of the destination image, or 0 to use
+ * the width of the JPEG image (see #tjDecompress2().)
+ *
+ * @param pitch bytes per line in the destination image, or 0 to use the scaled
+ * width of the JPEG image times the pixel size (see #tjDecompress2().)
+ *
+ * @param height desired height (in pixels) of the destination image, or 0 to
+ * use the height of the JPEG image (see #tjDecompress2().)
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return the number of rows of the destination image that have been
+ * decompressed so far, or -1 if an error occurred (see #tjGetErrorStr2() and
+ * #tjGetErrorCode().)  If a non-fatal error (warning) occurs, then this
+ * function returns -1, but the stream can still be resumed unless
+ * #TJFLAG_STOPONWARNING is set.  A fatal error ends the stream.
+ */
+DLLEXPORT int tjDecompressStreamRows(tjhandle handle, unsigned char *dstBuf,
+                                     int width, int pitch, int height,
+                                     int pixelFormat, int flags);
+
+
 /**
  * Decompress a JPEG image to a YUV planar image.  This function performs JPEG
  * decompression but leaves out the color conversion step, so a planar YUV
@@ -1332,6 +1985,74 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
                                       int *strides, int height, int flags);
 
 
+/**
+ * Decompress a JPEG image into a semi-planar (NV12 or NV21) YUV image, such as
+ * those used by many video encoders.  The chrominance samples are interleaved
+ * as each row of MCUs is decompressed, so no intermediate planar YUV image is
+ * generated.
+ *
+ * JPEG images with 4:2:0 subsampling are decompressed without resampling, so
+ * the Y and chrominance samples are identical to those produced by
+ * #tjDecompressToYUVPlanes().  For JPEG images with 4:4:4, 4:2:2, or 4:4:0
+ * subsampling, each chrominance sample in the semi-planar image is the rounded
+ * average of the corresponding 2 or 4 samples in the JPEG image.  For
+ * grayscale JPEG images, the chrominance plane is set to the neutral value
+ * (128.)  JPEG images with 4:1:1 subsampling are not supported.  If the scaled
+ * image width or height is odd and the JPEG image does not use 4:2:0
+ * subsampling, then the last column or line of the Y plane is replicated.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param dstPlanes an array of two pointers: the Y plane and the interleaved
+ * chrominance plane that will receive the semi-planar YUV image.  These planes
+ * can be contiguous or non-contiguous in memory.  The Y plane should be at
+ * least <tt>strides[0] * #tjPlaneHeight(0, scaledHeight, #TJSAMP_420)</tt>
+ * bytes in size, and the chrominance plane should be at least
+ * <tt>strides[1] * #tjPlaneHeight(1, scaledHeight, #TJSAMP_420)</tt> bytes in
+ * size.
+ *
+ * @param width desired width (in pixels) of the YUV image.  If this is
+ * different than the width of the JPEG image being decompressed, then
+ * TurboJPEG will use scaling in the JPEG decompressor to generate the largest
+ * possible image that will fit within the desired width.  If <tt>width</tt> is
+ * set to 0, then only the height will be considered when determining the
+ * scaled image size.
+ *
+ * @param strides an array of two integers specifying the number of bytes per
+ * line in the Y plane and the chrominance plane, respectively.  Setting the
+ * stride for either plane to 0 is the same as setting it to
+ * #tjPlaneWidth(0, scaledWidth, #TJSAMP_420) for the Y plane or
+ * <tt>2 * #tjPlaneWidth(1, scaledWidth, #TJSAMP_420)</tt> for the chrominance
+ * plane.  If <tt>strides</tt> is NULL, then both strides will be set to those
+ * defaults.
+ *
+ * @param height desired height (in pixels) of the YUV image.  If this is
+ * different than the height of the JPEG image being decompressed, then
+ * TurboJPEG will use scaling in the JPEG decompressor to generate the largest
+ * possible image that will fit within the desired height.  If <tt>height</tt>
+ * is set to 0, then only the width will be considered when determining the
+ * scaled image size.
+ *
+ * @param nvFormat the semi-planar YUV format to generate (see @ref TJNV
+ * "Semi-planar YUV formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressToNV(tjhandle handle, const unsigned char *jpegBuf,
+                               unsigned long jpegSize,
+                               unsigned char **dstPlanes, int width,
+                               int *strides, int height, int nvFormat,
+                               int flags);
+
+
 /**
  * Decode a YUV planar image into an RGB or grayscale image.  This function
  * uses the accelerated color conversion routines in the underlying
@@ -1521,6 +2242,48 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
                           tjtransform *transforms, int flags);
 
 
+/**
+ * Reduce the quality of a JPEG image without fully decompressing it.  This
+ * function reads the DCT coefficients of the source image, requantizes them
+ * using the quantization tables that #tjCompress2() would use for the given
+ * quality, and writes them with optimized Huffman tables.  This is typically
+ * several times faster than decompressing and re-compressing the image, and
+ * it avoids the generation loss caused by the second lossy compression.  Any
+ * quantization table entry that would be finer than the corresponding entry
+ * in the source image retains its source value, so this function never
+ * increases the size of the image merely in order to store precision that the
+ * source image does not have.
+ *
+ * @param handle a handle to a TurboJPEG transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG source image
+ *
+ * @param jpegSize size of the JPEG source image (in bytes)
+ *
+ * @param dstBuf address of a pointer to an image buffer that will receive the
+ * requantized JPEG image.  This buffer is handled in the same way as the
+ * <tt>jpegBuf</tt> parameter of #tjCompress2(), except that the worst-case
+ * size is based on the dimensions and subsampling of the source image.
+ *
+ * @param dstSize pointer to an unsigned long variable that holds the size of
+ * the JPEG image buffer.  Upon return, <tt>*dstSize</tt> will contain the
+ * size of the requantized JPEG image (in bytes.)
+ *
+ * @param jpegQual the image quality of the requantized JPEG image (1 = worst,
+ * 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags".  Of these, #TJFLAG_NOREALLOC, #TJFLAG_PROGRESSIVE, and
+ * #TJFLAG_STOPONWARNING are meaningful.
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjRequantize(tjhandle handle, const unsigned char *jpegBuf,
+                           unsigned long jpegSize, unsigned char **dstBuf,
+                           unsigned long *dstSize, int jpegQual, int flags);
+
+
 /**
  * Destroy a TurboJPEG compressor, decompressor, or transformer instance.
  *
@@ -1532,6 +2295,118 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
 DLLEXPORT int tjDestroy(tjhandle handle);
 
 
+/**
+ * Set the maximum number of threads that a TurboJPEG instance may use.
+ *
+ * The default is 1 (single-threaded.)  Increasing the number of threads has no
+ * effect unless TurboJPEG was built with multithreading support.  The
+ * following operations can currently take advantage of multiple threads:
+ *
+ * - #tjDecompress2() can decompress a baseline (single-scan) JPEG image that
+ * contains restart markers in parallel, by splitting the image into
+ * horizontal bands that begin at restart boundaries.  The decompressed image
+ * is identical to the image produced by the single-threaded code path.
+ * - #tjCompress2() can compress a baseline JPEG image in parallel, by splitting
+ * the source image into horizontal bands that begin at restart boundaries and
+ * stitching the compressed bands together.  The JPEG image is identical to the
+ * image produced by the single-threaded code path with the same restart
+ * interval.  If no restart interval was specified (using the
+ * <tt>TJ_RESTART</tt> environment variable), then one restart interval per MCU
+ * row is used.  Baseline JPEG images with optimized Huffman tables are always
+ * compressed by the calling thread.
+ * - #tjCompress2() can also generate a progressive JPEG image in parallel, by
+ * distributing groups of independent scans among multiple threads and
+ * splicing the scans together in the order specified by the scan script.  The
+ * JPEG image is identical to the image produced by the single-threaded code
+ * path.  The number of threads that can be used is limited by the number of
+ * independent scan groups (one per component plus one for the DC scans, with
+ * the default scan script), and each thread requires its own whole-image
+ * coefficient buffer.
+ * - #tjCompressBatch() and #tjDecompressBatch() can compress or decompress a
+ * batch of images in parallel, by distributing slices of consecutive images
+ * among multiple threads.
+ * - #tjTransform() can perform multiple transforms in parallel, by
+ * distributing slices of consecutive transforms among multiple threads.  The
+ * threads share the source image's DCT coefficients, so the JPEG images are
+ * identical to the images produced by the single-threaded code path.  If a
+ * custom filter is specified for a transform that modifies the source image's
+ * DCT coefficients in place (#TJXOP_NONE, with or without a cropping region
+ * that begins at the upper left corner of the image), then all of the
+ * transforms are performed by the calling thread.  Otherwise, custom filters
+ * may be called concurrently from multiple threads.
+ *
+ * @param handle a handle to a TurboJPEG compressor, decompressor, or
+ * transformer instance
+ *
+ * @param numThreads the maximum number of threads (including the calling
+ * thread) that the instance may use, or 0 to use one thread per logical CPU
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2().)
+ */
+DLLEXPORT int tjSetNumThreads(tjhandle handle, int numThreads);
+
+
+/**
+ * Write the JPEG images generated by subsequent calls to #tjCompress2(),
+ * #tjCompressFromYUV(), and #tjCompressFromYUVPlanes() with the given
+ * compressor instance to a callback function rather than to a JPEG image
+ * buffer.  The JPEG image is accumulated in a buffer of <tt>chunkSize</tt>
+ * bytes that is owned by the instance, and the buffer is passed to the
+ * callback function whenever it fills up and once more (if it contains any
+ * data) when compression finishes.  Thus, all but the last chunk of each JPEG
+ * image are exactly <tt>chunkSize</tt> bytes in size, and the JPEG image is
+ * never stored in memory in its entirety.  The compression functions ignore
+ * their <tt>jpegBuf</tt> argument, and they return the total size of the JPEG
+ * image in <tt>*jpegSize</tt>.  This function cancels the effect of any
+ * previous call to #tjSetDestBuffers().
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param callback the callback function that will receive the JPEG image, or
+ * NULL to restore the default behavior (writing the JPEG image to
+ * <tt>*jpegBuf</tt>)
+ *
+ * @param callbackData arbitrary data that will be passed to
+ * <tt>callback</tt>
+ *
+ * @param chunkSize size (in bytes) of the chunks that will be passed to
+ * <tt>callback</tt>, or 0 to use the default chunk size (64 KB)
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2().)
+ */
+DLLEXPORT int tjSetWriteCallback(tjhandle handle, tjwritecallback callback,
+                                 void *callbackData, unsigned long chunkSize);
+
+
+/**
+ * Write the JPEG images generated by subsequent calls to #tjCompress2(),
+ * #tjCompressFromYUV(), and #tjCompressFromYUVPlanes() with the given
+ * compressor instance to a list of caller-supplied buffers (scatter-gather
+ * output) rather than to a single JPEG image buffer.  The buffers are filled
+ * in order, and the JPEG image is split across them as necessary.  The
+ * buffers are never reallocated, so compression fails if the JPEG image does
+ * not fit in them.  The compression functions ignore their <tt>jpegBuf</tt>
+ * argument, and they return the total size of the JPEG image in
+ * <tt>*jpegSize</tt>.  Each JPEG image is written starting at the beginning of
+ * the first buffer.  This function cancels the effect of any previous call to
+ * #tjSetWriteCallback().
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param buffers an array of #tjbuffer structures, each specifying a buffer
+ * that will receive a portion of the JPEG image.  The array is copied, but
+ * the buffers themselves must remain valid for as long as they are in use.
+ * Setting this to NULL (and <tt>numBuffers</tt> to 0) restores the default
+ * behavior (writing the JPEG image to <tt>*jpegBuf</tt>.)
+ *
+ * @param numBuffers number of elements in <tt>buffers</tt>
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2().)
+ */
+DLLEXPORT int tjSetDestBuffers(tjhandle handle, const tjbuffer *buffers,
+                               int numBuffers);
+
+
 /**
  * Allocate an image buffer for use with TurboJPEG.  You should always use
  * this function to allocate the JPEG destination buffer(s) for the compression
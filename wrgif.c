@@ -13,7 +13,8 @@
  *
  * These routines may need modification for non-Unix environments or
  * specialized applications.  As they stand, they assume output to
- * an ordinary stdio stream.
+ * an ordinary stdio stream or (if jinit_write_gif_mem() is used) to a
+ * memory buffer.
  */
 
 /*
@@ -41,30 +42,39 @@ typedef INT16 code_int;         /* must hold -1 .. 2**MAX_LZW_BITS */
 
 #define LZW_TABLE_SIZE   ((code_int)1 << MAX_LZW_BITS)
 
-#define HSIZE            5003   /* hash table size for 80% occupancy */
+#define HSIZE_BITS       13     /* hash table size (log2) for 50% occupancy */
+#define HSIZE            ((hash_int)1 << HSIZE_BITS)
 
-typedef int hash_int;           /* must hold -2*HSIZE..2*HSIZE */
+typedef int hash_int;           /* must hold 0..HSIZE-1 */
 
 #define MAXCODE(n_bits)  (((code_int)1 << (n_bits)) - 1)
 
 
 /*
- * The LZW hash table consists of two parallel arrays:
- *   hash_code[i]       code of symbol in slot i, or 0 if empty slot
- *   hash_value[i]      symbol's value; undefined if empty slot
- * where slot values (i) range from 0 to HSIZE-1.  The symbol value is
- * its prefix symbol's code concatenated with its suffix character.
+ * The LZW hash table is an array of HSIZE entries, each of which holds a
+ * symbol's value in the upper bits and its code in the lower MAX_LZW_BITS
+ * bits, or 0 if the slot is empty.  (Code 0 is never assigned to a symbol,
+ * since assigned codes start at ClearCode + 2.)  The symbol value is its
+ * prefix symbol's code concatenated with its suffix character.  Keeping the
+ * value and the code together means that each probe touches only one entry.
  *
- * Algorithm:  use open addressing double hashing (no chaining) on the
- * prefix code / suffix character combination.  We do a variant of Knuth's
- * algorithm D (vol. 3, sec. 6.4) along with G. Knott's relatively-prime
- * secondary probe.
+ * Algorithm:  use open addressing with linear probing (no chaining) on the
+ * prefix code / suffix character combination.  The table is never more than
+ * half full, so probe sequences are short, and most pixels extend an
+ * existing symbol with a single probe.  Since each probe depends on the
+ * result of the previous one, the hash function is kept as cheap as possible.
  */
 
-typedef int hash_entry;         /* must hold (code_int << 8) | byte */
+typedef unsigned int hash_entry; /* must hold 32 bits */
 
 #define HASH_ENTRY(prefix, suffix)  ((((hash_entry)(prefix)) << 8) | (suffix))
 
+#define HASH(prefix, suffix) \
+  ((((hash_int)(suffix) << (HSIZE_BITS - 8)) ^ (hash_int)(prefix)) & \
+   (HSIZE - 1))
+
+#define OUTPUT_BUF_SIZE  4096   /* bytes to accumulate before writing */
+
 
 /* Private version of data destination object */
 
@@ -91,18 +101,77 @@ typedef struct {
   code_int code_counter;        /* not LZW: counts output symbols */
 
   /* LZW hash table */
-  code_int *hash_code;          /* => hash table of symbol codes */
-  hash_entry *hash_value;       /* => hash table of symbol values */
+  hash_entry *hash_table;       /* => hash table of symbol values and codes */
 
   /* GIF data packet construction buffer */
   int bytesinpkt;               /* # of bytes in current packet */
-  char packetbuf[256];          /* workspace for accumulating packet */
+  JOCTET packetbuf[256];        /* workspace for accumulating packet */
+
+  /* Output buffer */
+  size_t outbytes;              /* # of bytes in outbuf */
+  JOCTET outbuf[OUTPUT_BUF_SIZE];
+
+  /* Memory destination (used instead of pub.output_file if outbuffer is not
+     NULL) */
+  unsigned char **outbuffer;    /* target buffer */
+  unsigned long *outsize;
+  unsigned char *newbuffer;     /* buffer allocated by this module */
+  size_t memsize;               /* size of newbuffer */
+  size_t memused;               /* # of bytes written to newbuffer */
 
 } gif_dest_struct;
 
 typedef gif_dest_struct *gif_dest_ptr;
 
 
+/*
+ * Routines to accumulate output bytes and write them in large blocks, either
+ * to the output file or to a growable memory buffer.
+ */
+
+LOCAL(void)
+flush_output(gif_dest_ptr dinfo)
+/* write any accumulated bytes */
+{
+  if (dinfo->outbytes == 0)
+    return;
+  if (dinfo->outbuffer != NULL) {
+    if (dinfo->memused + dinfo->outbytes > dinfo->memsize) {
+      /* Grow the memory buffer by (at least) doubling its size */
+      size_t nextsize = dinfo->memsize * 2;
+      unsigned char *nextbuffer;
+
+      if (nextsize < dinfo->memused + dinfo->outbytes)
+        nextsize = dinfo->memused + dinfo->outbytes;
+      nextbuffer = (unsigned char *)malloc(nextsize);
+      if (nextbuffer == NULL)
+        ERREXIT1(dinfo->cinfo, JERR_OUT_OF_MEMORY, 10);
+      if (dinfo->memused > 0)
+        MEMCOPY(nextbuffer, dinfo->newbuffer, dinfo->memused);
+      free(dinfo->newbuffer);
+      dinfo->newbuffer = nextbuffer;
+      dinfo->memsize = nextsize;
+    }
+    MEMCOPY(dinfo->newbuffer + dinfo->memused, dinfo->outbuf,
+            dinfo->outbytes);
+    dinfo->memused += dinfo->outbytes;
+  } else {
+    if (JFWRITE(dinfo->pub.output_file, dinfo->outbuf, dinfo->outbytes) !=
+        dinfo->outbytes)
+      ERREXIT(dinfo->cinfo, JERR_FILE_WRITE);
+  }
+  dinfo->outbytes = 0;
+}
+
+
+/* Add a byte to the output buffer; write it out if necessary */
+#define BYTE_OUT(dinfo, c) { \
+  if ((dinfo)->outbytes >= OUTPUT_BUF_SIZE) \
+    flush_output(dinfo); \
+  (dinfo)->outbuf[(dinfo)->outbytes++] = (JOCTET)(c); \
+}
+
+
 /*
  * Routines to package finished data bytes into GIF data blocks.
  * A data block consists of a count byte (1..255) and that many data bytes.
@@ -113,18 +182,20 @@ flush_packet(gif_dest_ptr dinfo)
 /* flush any accumulated data */
 {
   if (dinfo->bytesinpkt > 0) {  /* never write zero-length packet */
-    dinfo->packetbuf[0] = (char)dinfo->bytesinpkt++;
-    if (JFWRITE(dinfo->pub.output_file, dinfo->packetbuf, dinfo->bytesinpkt) !=
-        (size_t)dinfo->bytesinpkt)
-      ERREXIT(dinfo->cinfo, JERR_FILE_WRITE);
+    dinfo->packetbuf[0] = (JOCTET)dinfo->bytesinpkt++;
+    if (dinfo->outbytes + dinfo->bytesinpkt > OUTPUT_BUF_SIZE)
+      flush_output(dinfo);
+    MEMCOPY(dinfo->outbuf + dinfo->outbytes, dinfo->packetbuf,
+            dinfo->bytesinpkt);
+    dinfo->outbytes += dinfo->bytesinpkt;
     dinfo->bytesinpkt = 0;
   }
 }
 
 
-/* Add a character to current packet; flush to disk if necessary */
+/* Add a character to current packet; flush to output buffer if necessary */
 #define CHAR_OUT(dinfo, c) { \
-  (dinfo)->packetbuf[++(dinfo)->bytesinpkt] = (char)(c); \
+  (dinfo)->packetbuf[++(dinfo)->bytesinpkt] = (JOCTET)(c); \
   if ((dinfo)->bytesinpkt >= 255) \
     flush_packet(dinfo); \
 }
@@ -168,8 +239,7 @@ LOCAL(void)
 clear_hash(gif_dest_ptr dinfo)
 /* Fill the hash table with empty entries */
 {
-  /* It's sufficient to zero hash_code[] */
-  MEMZERO(dinfo->hash_code, HSIZE * sizeof(code_int));
+  MEMZERO(dinfo->hash_table, HSIZE * sizeof(hash_entry));
 }
 
 
@@ -201,7 +271,7 @@ compress_init(gif_dest_ptr dinfo, int i_bits)
   dinfo->cur_accum = 0;
   dinfo->cur_bits = 0;
   /* clear hash table */
-  if (dinfo->hash_code != NULL)
+  if (dinfo->hash_table != NULL)
     clear_hash(dinfo);
   /* GIF specifies an initial Clear code */
   output(dinfo, dinfo->ClearCode);
@@ -233,8 +303,8 @@ LOCAL(void)
 put_word(gif_dest_ptr dinfo, unsigned int w)
 /* Emit a 16-bit word, LSB first */
 {
-  putc(w & 0xFF, dinfo->pub.output_file);
-  putc((w >> 8) & 0xFF, dinfo->pub.output_file);
+  BYTE_OUT(dinfo, w & 0xFF);
+  BYTE_OUT(dinfo, (w >> 8) & 0xFF);
 }
 
 
@@ -242,9 +312,9 @@ LOCAL(void)
 put_3bytes(gif_dest_ptr dinfo, int val)
 /* Emit 3 copies of same byte value --- handy subr for colormap construction */
 {
-  putc(val, dinfo->pub.output_file);
-  putc(val, dinfo->pub.output_file);
-  putc(val, dinfo->pub.output_file);
+  BYTE_OUT(dinfo, val);
+  BYTE_OUT(dinfo, val);
+  BYTE_OUT(dinfo, val);
 }
 
 
@@ -272,21 +342,21 @@ emit_header(gif_dest_ptr dinfo, int num_colors, JSAMPARRAY colormap)
    * Write the GIF header.
    * Note that we generate a plain GIF87 header for maximum compatibility.
    */
-  putc('G', dinfo->pub.output_file);
-  putc('I', dinfo->pub.output_file);
-  putc('F', dinfo->pub.output_file);
-  putc('8', dinfo->pub.output_file);
-  putc('7', dinfo->pub.output_file);
-  putc('a', dinfo->pub.output_file);
+  BYTE_OUT(dinfo, 'G');
+  BYTE_OUT(dinfo, 'I');
+  BYTE_OUT(dinfo, 'F');
+  BYTE_OUT(dinfo, '8');
+  BYTE_OUT(dinfo, '7');
+  BYTE_OUT(dinfo, 'a');
   /* Write the Logical Screen Descriptor */
   put_word(dinfo, (unsigned int)dinfo->cinfo->output_width);
   put_word(dinfo, (unsigned int)dinfo->cinfo->output_height);
   FlagByte = 0x80;              /* Yes, there is a global color table */
   FlagByte |= (BitsPerPixel - 1) << 4; /* color resolution */
   FlagByte |= (BitsPerPixel - 1); /* size of global color table */
-  putc(FlagByte, dinfo->pub.output_file);
-  putc(0, dinfo->pub.output_file); /* Background color index */
-  putc(0, dinfo->pub.output_file); /* Reserved (aspect ratio in GIF89) */
+  BYTE_OUT(dinfo, FlagByte);
+  BYTE_OUT(dinfo, 0);           /* Background color index */
+  BYTE_OUT(dinfo, 0);           /* Reserved (aspect ratio in GIF89) */
   /* Write the Global Color Map */
   /* If the color map is more than 8 bits precision, */
   /* we reduce it to 8 bits by shifting */
@@ -295,9 +365,9 @@ emit_header(gif_dest_ptr dinfo, int num_colors, JSAMPARRAY colormap)
       if (colormap != NULL) {
         if (dinfo->cinfo->out_color_space == JCS_RGB) {
           /* Normal case: RGB color map */
-          putc(colormap[0][i] >> cshift, dinfo->pub.output_file);
-          putc(colormap[1][i] >> cshift, dinfo->pub.output_file);
-          putc(colormap[2][i] >> cshift, dinfo->pub.output_file);
+          BYTE_OUT(dinfo, colormap[0][i] >> cshift);
+          BYTE_OUT(dinfo, colormap[1][i] >> cshift);
+          BYTE_OUT(dinfo, colormap[2][i] >> cshift);
         } else {
           /* Grayscale "color map": possible if quantizing grayscale image */
           put_3bytes(dinfo, colormap[0][i] >> cshift);
@@ -312,15 +382,15 @@ emit_header(gif_dest_ptr dinfo, int num_colors, JSAMPARRAY colormap)
     }
   }
   /* Write image separator and Image Descriptor */
-  putc(',', dinfo->pub.output_file); /* separator */
+  BYTE_OUT(dinfo, ',');         /* separator */
   put_word(dinfo, 0);           /* left/top offset */
   put_word(dinfo, 0);
   put_word(dinfo, (unsigned int)dinfo->cinfo->output_width); /* image size */
   put_word(dinfo, (unsigned int)dinfo->cinfo->output_height);
   /* flag byte: not interlaced, no local color map */
-  putc(0x00, dinfo->pub.output_file);
+  BYTE_OUT(dinfo, 0x00);
   /* Write Initial Code Size byte */
-  putc(InitCodeSize, dinfo->pub.output_file);
+  BYTE_OUT(dinfo, InitCodeSize);
 
   /* Initialize for compression of image data */
   compress_init(dinfo, InitCodeSize + 1);
@@ -361,73 +431,53 @@ put_LZW_pixel_rows(j_decompress_ptr cinfo, djpeg_dest_ptr dinfo,
   register JSAMPROW ptr;
   register JDIMENSION col;
   code_int c;
+  register code_int waiting_code;
   register hash_int i;
-  register hash_int disp;
-  register hash_entry probe_value;
+  register hash_entry probe_value, entry;
+  hash_entry *hash_table = dest->hash_table;
 
   ptr = dest->pub.buffer[0];
-  for (col = cinfo->output_width; col > 0; col--) {
+  col = cinfo->output_width;
+  if (dest->first_byte) {       /* need to initialize waiting_code */
+    dest->waiting_code = (code_int)(*ptr++);
+    dest->first_byte = FALSE;
+    col--;
+  }
+  waiting_code = dest->waiting_code;
+
+  for (; col > 0; col--) {
     /* Accept and compress one 8-bit byte */
     c = (code_int)(*ptr++);
 
-    if (dest->first_byte) {     /* need to initialize waiting_code */
-      dest->waiting_code = c;
-      dest->first_byte = FALSE;
-      continue;
-    }
-
     /* Probe hash table to see if a symbol exists for
      * waiting_code followed by c.
      * If so, replace waiting_code by that symbol and continue.
      */
-    i = ((hash_int)c << (MAX_LZW_BITS - 8)) + dest->waiting_code;
-    /* i is less than twice 2**MAX_LZW_BITS, therefore less than twice HSIZE */
-    if (i >= HSIZE)
-      i -= HSIZE;
-
-    probe_value = HASH_ENTRY(dest->waiting_code, c);
-
-    if (dest->hash_code[i] == 0) {
-      /* hit empty slot; desired symbol not in table */
-      output(dest, dest->waiting_code);
-      if (dest->free_code < LZW_TABLE_SIZE) {
-        dest->hash_code[i] = dest->free_code++; /* add symbol to hashtable */
-        dest->hash_value[i] = probe_value;
-      } else
-        clear_block(dest);
-      dest->waiting_code = c;
-      continue;
-    }
-    if (dest->hash_value[i] == probe_value) {
-      dest->waiting_code = dest->hash_code[i];
-      continue;
-    }
+    probe_value = HASH_ENTRY(waiting_code, c);
+    i = HASH(waiting_code, c);
 
-    if (i == 0)                 /* secondary hash (after G. Knott) */
-      disp = 1;
-    else
-      disp = HSIZE - i;
     for (;;) {
-      i -= disp;
-      if (i < 0)
-        i += HSIZE;
-      if (dest->hash_code[i] == 0) {
+      entry = hash_table[i];
+      if (entry == 0) {
         /* hit empty slot; desired symbol not in table */
-        output(dest, dest->waiting_code);
+        output(dest, waiting_code);
         if (dest->free_code < LZW_TABLE_SIZE) {
-          dest->hash_code[i] = dest->free_code++; /* add symbol to hashtable */
-          dest->hash_value[i] = probe_value;
+          /* add symbol to hashtable */
+          hash_table[i] = (probe_value << MAX_LZW_BITS) | dest->free_code++;
         } else
           clear_block(dest);
-        dest->waiting_code = c;
+        waiting_code = c;
         break;
       }
-      if (dest->hash_value[i] == probe_value) {
-        dest->waiting_code = dest->hash_code[i];
+      if ((entry >> MAX_LZW_BITS) == probe_value) {
+        waiting_code = (code_int)(entry & (LZW_TABLE_SIZE - 1));
         break;
       }
+      i = (i + 1) & (HSIZE - 1);
     }
   }
+
+  dest->waiting_code = waiting_code;
 }
 
 
@@ -497,13 +547,21 @@ finish_output_gif(j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
   /* Flush compression mechanism */
   compress_term(dest);
   /* Write a zero-length data block to end the series */
-  putc(0, dest->pub.output_file);
+  BYTE_OUT(dest, 0);
   /* Write the GIF terminator mark */
-  putc(';', dest->pub.output_file);
-  /* Make sure we wrote the output file OK */
-  fflush(dest->pub.output_file);
-  if (ferror(dest->pub.output_file))
-    ERREXIT(cinfo, JERR_FILE_WRITE);
+  BYTE_OUT(dest, ';');
+  flush_output(dest);
+  if (dest->outbuffer != NULL) {
+    /* Hand the memory buffer over to the caller */
+    *dest->outbuffer = dest->newbuffer;
+    *dest->outsize = (unsigned long)dest->memused;
+    dest->newbuffer = NULL;
+  } else {
+    /* Make sure we wrote the output file OK */
+    fflush(dest->pub.output_file);
+    if (ferror(dest->pub.output_file))
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+  }
 }
 
 
@@ -531,6 +589,11 @@ jinit_write_gif(j_decompress_ptr cinfo, boolean is_lzw)
     (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
                                 sizeof(gif_dest_struct));
   dest->cinfo = cinfo;          /* make back link for subroutines */
+  dest->outbytes = 0;
+  dest->outbuffer = NULL;       /* write to pub.output_file */
+  dest->outsize = NULL;
+  dest->newbuffer = NULL;
+  dest->memsize = dest->memused = 0;
   dest->pub.start_output = start_output_gif;
   dest->pub.finish_output = finish_output_gif;
   dest->pub.calc_buffer_dimensions = calc_buffer_dimensions_gif;
@@ -561,20 +624,42 @@ jinit_write_gif(j_decompress_ptr cinfo, boolean is_lzw)
   if (is_lzw) {
     dest->pub.put_pixel_rows = put_LZW_pixel_rows;
     /* Allocate space for hash table */
-    dest->hash_code = (code_int *)
-      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                  HSIZE * sizeof(code_int));
-    dest->hash_value = (hash_entry *)
+    dest->hash_table = (hash_entry *)
       (*cinfo->mem->alloc_large) ((j_common_ptr)cinfo, JPOOL_IMAGE,
                                   HSIZE * sizeof(hash_entry));
   } else {
     dest->pub.put_pixel_rows = put_raw_pixel_rows;
-    /* Mark tables unused */
-    dest->hash_code = NULL;
-    dest->hash_value = NULL;
+    /* Mark table unused */
+    dest->hash_table = NULL;
   }
 
   return (djpeg_dest_ptr)dest;
 }
 
+
+/*
+ * The module selection routine for GIF format output to memory.
+ * The GIF file is written to a buffer allocated with malloc(), and when
+ * finish_output() is called, the address and size of that buffer are stored
+ * in *outbuffer and *outsize.  The caller is responsible for freeing the
+ * buffer.  (If an error occurs before finish_output() is called, the buffer
+ * is leaked, just as with jpeg_mem_dest().)  pub.output_file is ignored.
+ */
+
+GLOBAL(djpeg_dest_ptr)
+jinit_write_gif_mem(j_decompress_ptr cinfo, boolean is_lzw,
+                    unsigned char **outbuffer, unsigned long *outsize)
+{
+  gif_dest_ptr dest;
+
+  if (outbuffer == NULL || outsize == NULL)  /* sanity check */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  dest = (gif_dest_ptr)jinit_write_gif(cinfo, is_lzw);
+  dest->outbuffer = outbuffer;
+  dest->outsize = outsize;
+
+  return (djpeg_dest_ptr)dest;
+}
+
 #endif /* GIF_SUPPORTED */